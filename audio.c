@@ -52,6 +52,12 @@
 #include <math.h>
 #include <sys/prctl.h>
 #include <sched.h>
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <libintl.h>
 #define _(str) gettext(str)             ///< gettext shortcut
@@ -99,6 +105,7 @@
 #include "ringbuffer.h"
 #include "misc.h"
 #include "audio.h"
+#include "softhddev.h"
 
 
 //----------------------------------------------------------------------------
@@ -418,212 +425,461 @@ static void AudioSoftAmplifier(int16_t * samples, int count)
 
 #ifdef USE_AUDIO_MIXER
 
+#define AUDIO_MIX_SHIFT 14              ///< fixed point of mix coefficients
+#define AUDIO_MIX_ONE (1 << AUDIO_MIX_SHIFT)    ///< coefficient 1.0
+
+/**
+**	Channel mix matrix.
+**
+**	out[o] = sum(in[i] * Column[i][o]) >> AUDIO_MIX_SHIFT, rounded and
+**	saturated.  Unused rows and columns are zero, so a kernel can always
+**	work on 8 channels.  The sum of the coefficients of an output must
+**	not exceed 4.0.
+*/
+typedef struct _audio_mix_
+{
+    int InChannels;                     ///< nr. of input channels
+    int OutChannels;                    ///< nr. of output channels
+    /// mix kernel, NULL for a plain copy
+    void (*Mix)(const struct _audio_mix_ *, const int16_t *, int, int16_t *);
+    int16_t Column[8][8] __attribute__ ((aligned(16)));    ///< [in][out]
+#ifdef __SSE2__
+    /// input pairs interleaved per output: [in pair][out half][8]
+    int16_t Pair[4][2][8] __attribute__ ((aligned(16)));
+#endif
+} AudioMix;
+
+/**
+**	Downmix surround to stereo, coefficients in 1/1000.
+**
+**	ffmpeg L  R  C	Ls Rs		-> alsa L R  Ls Rs C
+**	ffmpeg L  R  C	LFE Ls Rs	-> alsa L R  Ls Rs C  LFE
+**	ffmpeg L  R  C	LFE Ls Rs Rl Rr	-> alsa L R  Ls Rs C  LFE Rl Rr
+*/
+static const int16_t AudioSurroundDownmix[9][8][2] = {
+    [3] = {{600, 0}, {0, 600}, {400, 400}},     // stereo or surround? =>stereo
+    [4] = {{600, 0}, {0, 600}, {400, 0}, {0, 400}}, // quad or surround? =>quad
+    [5] = {{500, 0}, {0, 500}, {200, 0}, {0, 200}, {300, 300}}, // 5.0
+    [6] = {{400, 0}, {0, 400}, {200, 0}, {0, 200}, {300, 300}, {100, 100}}, // 5.1
+    [7] = {{400, 0}, {0, 400}, {200, 0}, {0, 200}, {300, 300}, {100, 0}, {0, 100}}, // 7.0
+    [8] = {{400, 0}, {0, 400}, {150, 0}, {0, 150}, {250, 250}, {100, 100}, {100, 0}, {0, 100}},    // 7.1
+};
+
 /**
-**	Upmix mono to stereo.
+**	Mix kernel, scalar reference.
 **
+**	@param mix	channel mix matrix
 **	@param in	input sample buffer
 **	@param frames	number of frames in sample buffer
 **	@param out	output sample buffer
 */
-static void AudioMono2Stereo(const int16_t * in, int frames, int16_t * out)
+static void AudioMixScalar(const AudioMix * mix, const int16_t * in, int frames, int16_t * out)
 {
-    int i;
+    while (frames--) {
+        int o;
 
-    for (i = 0; i < frames; ++i) {
-        int t;
+        for (o = 0; o < mix->OutChannels; ++o) {
+            int32_t t;
+            int i;
 
-        t = in[i];
-        out[i * 2 + 0] = t;
-        out[i * 2 + 1] = t;
+            t = 1 << (AUDIO_MIX_SHIFT - 1);
+            for (i = 0; i < mix->InChannels; ++i) {
+                t += in[i] * mix->Column[i][o];
+            }
+            t >>= AUDIO_MIX_SHIFT;
+            if (t < INT16_MIN) {
+                t = INT16_MIN;
+            } else if (t > INT16_MAX) {
+                t = INT16_MAX;
+            }
+            *out++ = t;
+        }
+        in += mix->InChannels;
     }
 }
 
+#if defined(__ARM_NEON) || defined(__SSE2__)
+
 /**
-**	Downmix stereo to mono.
+**	Mix kernel, NEON or SSE2.
+**
+**	One frame is mixed into all 8 output lanes at once.  Loads and stores
+**	are 8 samples wide, the last frames which would touch memory outside
+**	the buffers are left to the scalar kernel.
 **
+**	@param mix	channel mix matrix
 **	@param in	input sample buffer
 **	@param frames	number of frames in sample buffer
 **	@param out	output sample buffer
 */
-static void AudioStereo2Mono(const int16_t * in, int frames, int16_t * out)
+static void AudioMixSimd(const AudioMix * mix, const int16_t * in, int frames, int16_t * out)
 {
-    int i;
+    int in_chan;
+    int out_chan;
+    int tail;
+
+    in_chan = mix->InChannels;
+    out_chan = mix->OutChannels;
+    // frames at the end, which can't use 8 sample loads and stores
+    tail = (8 + in_chan - 1) / in_chan;
+    if ((8 + out_chan - 1) / out_chan > tail) {
+        tail = (8 + out_chan - 1) / out_chan;
+    }
+    if (tail > frames) {
+        tail = frames;
+    }
+    frames -= tail;
 
-    for (i = 0; i < frames; i += 2) {
-        out[i / 2] = (in[i + 0] + in[i + 1]) / 2;
+#if defined(__ARM_NEON)
+    while (frames--) {
+        int32x4_t lo;
+        int32x4_t hi;
+        int i;
+
+        lo = vdupq_n_s32(0);
+        hi = vdupq_n_s32(0);
+        for (i = 0; i < in_chan; ++i) {
+            lo = vmlal_n_s16(lo, vld1_s16(mix->Column[i] + 0), in[i]);
+            hi = vmlal_n_s16(hi, vld1_s16(mix->Column[i] + 4), in[i]);
+        }
+        // rounding shift with saturation, same as the scalar kernel
+        vst1q_s16(out, vcombine_s16(vqrshrn_n_s32(lo, AUDIO_MIX_SHIFT), vqrshrn_n_s32(hi,
+                    AUDIO_MIX_SHIFT)));
+        in += in_chan;
+        out += out_chan;
+    }
+#else
+    while (frames--) {
+        __m128i x;
+        __m128i lo;
+        __m128i hi;
+        __m128i v;
+        int p;
+
+        // lanes behind in_chan belong to the next frame, their
+        // coefficients are zero
+        x = _mm_loadu_si128((const __m128i *)in);
+        lo = _mm_set1_epi32(1 << (AUDIO_MIX_SHIFT - 1));
+        hi = lo;
+        for (p = 0; p < (in_chan + 1) / 2; ++p) {
+            switch (p) {               // shuffle needs an immediate
+                case 0:
+                    v = _mm_shuffle_epi32(x, 0x00);
+                    break;
+                case 1:
+                    v = _mm_shuffle_epi32(x, 0x55);
+                    break;
+                case 2:
+                    v = _mm_shuffle_epi32(x, 0xAA);
+                    break;
+                default:
+                    v = _mm_shuffle_epi32(x, 0xFF);
+                    break;
+            }
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(v, _mm_load_si128((const __m128i *)mix->Pair[p][0])));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(v, _mm_load_si128((const __m128i *)mix->Pair[p][1])));
+        }
+        lo = _mm_srai_epi32(lo, AUDIO_MIX_SHIFT);
+        hi = _mm_srai_epi32(hi, AUDIO_MIX_SHIFT);
+        // lanes behind out_chan are overwritten by the next frame
+        _mm_storeu_si128((__m128i *) out, _mm_packs_epi32(lo, hi));
+        in += in_chan;
+        out += out_chan;
     }
+#endif
+    AudioMixScalar(mix, in, tail, out);
 }
 
+#endif
+
 /**
-**	Downmix surround to stereo.
+**	Prepare channel mix from ffmpeg to hardware channels.
 **
-**	ffmpeg L  R  C	Ls Rs		-> alsa L R  Ls Rs C
-**	ffmpeg L  R  C	LFE Ls Rs	-> alsa L R  Ls Rs C  LFE
-**	ffmpeg L  R  C	LFE Ls Rs Rl Rr	-> alsa L R  Ls Rs C  LFE Rl Rr
+**	FIXME: ffmpeg to alsa conversion is already done in codec.c.
 **
-**	@param in	input sample buffer
+**	@param mix	channel mix matrix to fill
 **	@param in_chan	nr. of input channels
-**	@param frames	number of frames in sample buffer
-**	@param out	output sample buffer
+**	@param out_chan	nr. of output channels
+**
+**	@retval -1	unsupported channel combination, the mix is cleared
+**	@retval 0	okay
 */
-static void AudioSurround2Stereo(const int16_t * in, int in_chan, int frames, int16_t * out)
+static int AudioMixSetup(AudioMix * mix, int in_chan, int out_chan)
 {
-    while (frames--) {
-        int l;
-        int r;
-
-        switch (in_chan) {
-            case 3:                    // stereo or surround? =>stereo
-                l = in[0] * 600;        // L
-                r = in[1] * 600;        // R
-                l += in[2] * 400;       // C
-                r += in[2] * 400;
-                break;
-            case 4:                    // quad or surround? =>quad
-                l = in[0] * 600;        // L
-                r = in[1] * 600;        // R
-                l += in[2] * 400;       // Ls
-                r += in[3] * 400;       // Rs
-                break;
-            case 5:                    // 5.0
-                l = in[0] * 500;        // L
-                r = in[1] * 500;        // R
-                l += in[2] * 200;       // Ls
-                r += in[3] * 200;       // Rs
-                l += in[4] * 300;       // C
-                r += in[4] * 300;
-                break;
-            case 6:                    // 5.1
-                l = in[0] * 400;        // L
-                r = in[1] * 400;        // R
-                l += in[2] * 200;       // Ls
-                r += in[3] * 200;       // Rs
-                l += in[4] * 300;       // C
-                r += in[4] * 300;
-                l += in[5] * 100;       // LFE
-                r += in[5] * 100;
-                break;
-            case 7:                    // 7.0
-                l = in[0] * 400;        // L
-                r = in[1] * 400;        // R
-                l += in[2] * 200;       // Ls
-                r += in[3] * 200;       // Rs
-                l += in[4] * 300;       // C
-                r += in[4] * 300;
-                l += in[5] * 100;       // RL
-                r += in[6] * 100;       // RR
-                break;
-            case 8:                    // 7.1
-                l = in[0] * 400;        // L
-                r = in[1] * 400;        // R
-                l += in[2] * 150;       // Ls
-                r += in[3] * 150;       // Rs
-                l += in[4] * 250;       // C
-                r += in[4] * 250;
-                l += in[5] * 100;       // LFE
-                r += in[5] * 100;
-                l += in[6] * 100;       // RL
-                r += in[7] * 100;       // RR
-                break;
-            default:
-                abort();
+    int i;
+    int o;
+
+    memset(mix, 0, sizeof(*mix));
+    if (in_chan < 1 || in_chan > 8 || out_chan < 1 || out_chan > 8) {
+        return -1;
+    }
+    if (in_chan == out_chan) {          // input = output channels
+        mix->InChannels = in_chan;
+        mix->OutChannels = out_chan;
+        return 0;
+    }
+    if (in_chan == 2 && out_chan == 1) {    // downmix stereo to mono
+        mix->Column[0][0] = AUDIO_MIX_ONE / 2;
+        mix->Column[1][0] = AUDIO_MIX_ONE / 2;
+    } else if (in_chan == 1 && out_chan == 2) { // upmix mono to stereo
+        mix->Column[0][0] = AUDIO_MIX_ONE;
+        mix->Column[0][1] = AUDIO_MIX_ONE;
+    } else if (in_chan >= 3 && out_chan == 2) { // downmix surround to stereo
+        for (i = 0; i < in_chan; ++i) {
+            for (o = 0; o < 2; ++o) {
+                mix->Column[i][o] = (AudioSurroundDownmix[in_chan][i][o] * AUDIO_MIX_ONE + 500) / 1000;
+            }
         }
-        in += in_chan;
+    } else if ((in_chan == 5 && out_chan == 6) || (in_chan == 3 && out_chan == 8) || (in_chan == 5
+            && out_chan == 8) || (in_chan == 6 && out_chan == 8)) {
+        // copy existing channels, silents missing channels
+        for (i = 0; i < in_chan; ++i) {
+            mix->Column[i][i] = AUDIO_MIX_ONE;
+        }
+    } else {
+        return -1;
+    }
 
-        out[0] = l / 1000;
-        out[1] = r / 1000;
-        out += 2;
+#if defined(__SSE2__)
+    for (i = 0; i < 8; ++i) {
+        for (o = 0; o < 8; ++o) {
+            mix->Pair[i / 2][o / 4][(o % 4) * 2 + i % 2] = mix->Column[i][o];
+        }
     }
+#endif
+#if defined(__ARM_NEON) || defined(__SSE2__)
+    mix->Mix = AudioMixSimd;
+#else
+    mix->Mix = AudioMixScalar;
+#endif
+    mix->InChannels = in_chan;
+    mix->OutChannels = out_chan;
+    return 0;
 }
 
 /**
-**	Upmix @a in_chan channels to @a out_chan.
+**	Resample ffmpeg sample format to hardware format.
+**
+**	FIXME: use libswresample for this and move it to codec.
 **
+**	@param mix	channel mix matrix
 **	@param in	input sample buffer
-**	@param in_chan	nr. of input channels
 **	@param frames	number of frames in sample buffer
 **	@param out	output sample buffer
-**	@param out_chan	nr. of output channels
 */
-static void AudioUpmix(const int16_t * in, int in_chan, int frames, int16_t * out, int out_chan)
+static void AudioResample(const AudioMix * mix, const int16_t * in, int frames, int16_t * out)
 {
-    while (frames--) {
-        int i;
+    if (!mix->InChannels) {
+        // unsupported, play silence
+        memset(out, 0, frames * mix->OutChannels * AudioBytesProSample);
+    } else if (!mix->Mix) {
+        memcpy(out, in, frames * mix->InChannels * AudioBytesProSample);
+    } else {
+        mix->Mix(mix, in, frames, out);
+    }
+}
 
-        for (i = 0; i < in_chan; ++i) { // copy existing channels
-            *out++ = *in++;
-        }
-        for (; i < out_chan; ++i) {     // silents missing channels
-            *out++ = 0;
-        }
+#endif
+
+//----------------------------------------------------------------------------
+//  drift correction
+//----------------------------------------------------------------------------
+
+#define AUDIO_DRIFT_PHASES 256          ///< phases of the interpolation filter
+#define AUDIO_DRIFT_MAX_PPM 1000        ///< max. ratio correction in ppm
+#define AUDIO_DRIFT_SLEW_PPM 5          ///< max. ratio change per update
+#define AUDIO_DRIFT_SETTLE 2000         ///< ms running, before target is taken
+#define AUDIO_DRIFT_RESET (200 * 90)    ///< delay error, which restarts loop
+
+static char AudioDriftCorrection;       ///< flag: resample clock drift
+
+/// 4 tap cubic (Catmull-Rom) polyphase filter [phase][tap] in Q14
+static int16_t AudioDriftFilter[AUDIO_DRIFT_PHASES][4];
+
+/**
+**	Drift correction of the written ring.
+*/
+static struct
+{
+    int Ppm;                            ///< current ratio correction
+    uint64_t Pos;                       ///< input position 32.32 fixed point
+    int Channels;                       ///< channels of history, 0 = restart
+    int16_t History[3 * 8];             ///< last 3 input frames
+    uint32_t Start;                     ///< ms tick of loop start, 0 = off
+    int64_t Target;                     ///< wanted hw + sw delay
+    int64_t Average;                    ///< filtered hw + sw delay * 64
+    int64_t Integral;                   ///< integrated delay error
+    int Updates;                        ///< number of updates
+} AudioDrift;
+
+/**
+**	Fill polyphase filter table.
+*/
+static void AudioDriftInit(void)
+{
+    int p;
+
+    for (p = 0; p < AUDIO_DRIFT_PHASES; ++p) {
+        double t;
+        double t2;
+        double t3;
+
+        t = (double)p / AUDIO_DRIFT_PHASES;
+        t2 = t * t;
+        t3 = t2 * t;
+        AudioDriftFilter[p][0] = lrint((-t3 + 2 * t2 - t) / 2 * (1 << 14));
+        AudioDriftFilter[p][2] = lrint((-3 * t3 + 4 * t2 + t) / 2 * (1 << 14));
+        AudioDriftFilter[p][3] = lrint((t3 - t2) / 2 * (1 << 14));
+        // taps sum up to 1.0
+        AudioDriftFilter[p][1] = (1 << 14) - AudioDriftFilter[p][0] - AudioDriftFilter[p][2]
+            - AudioDriftFilter[p][3];
     }
 }
 
 /**
-**	Resample ffmpeg sample format to hardware format.
+**	Update drift correction ratio.
 **
-**	FIXME: use libswresample for this and move it to codec.
-**	FIXME: ffmpeg to alsa conversion is already done in codec.c.
+**	Keeps the hw + sw delay at the level, which was reached after the
+**	start.  A too low delay means the output clock runs faster than the
+**	stream, more samples are produced, and vice versa.  The delay is low
+**	pass filtered and drives a slow PI controller, its output is limited
+**	to AUDIO_DRIFT_MAX_PPM and changes slowly, this is inaudible.
+*/
+static void AudioDriftUpdate(void)
+{
+    int64_t delay;
+    int64_t error;
+    int64_t ppm;
+    uint32_t tick;
+
+    delay = AudioGetDelay();
+    if (!delay || AudioPaused) {        // not running or ring switch
+        AudioDrift.Start = 0;
+        return;
+    }
+    tick = GetMsTicks();
+    if (!AudioDrift.Start) {
+        AudioDrift.Start = tick ? tick : 1;
+        AudioDrift.Average = delay * 64;
+        AudioDrift.Target = 0;
+        return;
+    }
+    // first order low pass, time constant 64 updates
+    AudioDrift.Average += delay - AudioDrift.Average / 64;
+    if (tick - AudioDrift.Start < AUDIO_DRIFT_SETTLE) {
+        return;
+    }
+    if (!AudioDrift.Target) {
+        AudioDrift.Target = AudioDrift.Average / 64;
+        Debug(3, "audio: drift target %" PRId64 "ms %dppm\n", AudioDrift.Target / 90, AudioDrift.Ppm);
+        return;
+    }
+    error = AudioDrift.Average / 64 - AudioDrift.Target;
+    if (error > AUDIO_DRIFT_RESET || error < -AUDIO_DRIFT_RESET) {
+        // skipped or underrun, the ratio is kept
+        Debug(3, "audio: drift %" PRId64 "ms restart\n", error / 90);
+        AudioDrift.Start = 0;
+        return;
+    }
+    // 10ms error give 100ppm, the integral removes the remaining error
+    AudioDrift.Integral += error;
+    if (AudioDrift.Integral > (int64_t) AUDIO_DRIFT_MAX_PPM * 65536) {
+        AudioDrift.Integral = (int64_t) AUDIO_DRIFT_MAX_PPM * 65536;
+    } else if (AudioDrift.Integral < (int64_t) - AUDIO_DRIFT_MAX_PPM * 65536) {
+        AudioDrift.Integral = (int64_t) - AUDIO_DRIFT_MAX_PPM * 65536;
+    }
+    ppm = -(error * 100 / 900 + AudioDrift.Integral / 65536);
+
+    if (ppm > AudioDrift.Ppm + AUDIO_DRIFT_SLEW_PPM) {
+        ppm = AudioDrift.Ppm + AUDIO_DRIFT_SLEW_PPM;
+    } else if (ppm < AudioDrift.Ppm - AUDIO_DRIFT_SLEW_PPM) {
+        ppm = AudioDrift.Ppm - AUDIO_DRIFT_SLEW_PPM;
+    }
+    if (ppm > AUDIO_DRIFT_MAX_PPM) {
+        ppm = AUDIO_DRIFT_MAX_PPM;
+    } else if (ppm < -AUDIO_DRIFT_MAX_PPM) {
+        ppm = -AUDIO_DRIFT_MAX_PPM;
+    }
+    AudioDrift.Ppm = ppm;
+
+    if (!(++AudioDrift.Updates % 512)) {
+        Debug(3, "audio: drift %dppm delay %" PRId64 "ms error %" PRId64 "ms\n", AudioDrift.Ppm,
+            AudioDrift.Average / 64 / 90, error / 90);
+    }
+}
+
+/**
+**	Resample by the drift correction ratio.
 **
-**	ffmpeg L  R  C	Ls Rs		-> alsa L R  Ls Rs C
-**	ffmpeg L  R  C	LFE Ls Rs	-> alsa L R  Ls Rs C  LFE
-**	ffmpeg L  R  C	LFE Ls Rs Rl Rr	-> alsa L R  Ls Rs C  LFE Rl Rr
+**	The filter runs continuously, also at 0ppm, to avoid switching
+**	clicks.  It delays the output by 2 frames.
 **
 **	@param in	input sample buffer
-**	@param in_chan	nr. of input channels
 **	@param frames	number of frames in sample buffer
-**	@param out	output sample buffer
-**	@param out_chan	nr. of output channels
+**	@param out	output sample buffer, frames + frames / 512 + 2
+**	@param channels	number of channels
+**
+**	@returns number of frames in output buffer
 */
-static void AudioResample(const int16_t * in, int in_chan, int frames, int16_t * out, int out_chan)
-{
-    switch (in_chan * 8 + out_chan) {
-        case 1 * 8 + 1:
-        case 2 * 8 + 2:
-        case 3 * 8 + 3:
-        case 4 * 8 + 4:
-        case 5 * 8 + 5:
-        case 6 * 8 + 6:
-        case 7 * 8 + 7:
-        case 8 * 8 + 8:                // input = output channels
-            memcpy(out, in, frames * in_chan * AudioBytesProSample);
-            break;
-        case 2 * 8 + 1:
-            AudioStereo2Mono(in, frames, out);
-            break;
-        case 1 * 8 + 2:
-            AudioMono2Stereo(in, frames, out);
-            break;
-        case 3 * 8 + 2:
-        case 4 * 8 + 2:
-        case 5 * 8 + 2:
-        case 6 * 8 + 2:
-        case 7 * 8 + 2:
-        case 8 * 8 + 2:
-            AudioSurround2Stereo(in, in_chan, frames, out);
-            break;
-        case 5 * 8 + 6:
-        case 3 * 8 + 8:
-        case 5 * 8 + 8:
-        case 6 * 8 + 8:
-            AudioUpmix(in, in_chan, frames, out, out_chan);
-            break;
+static int AudioDriftResample(const int16_t * in, int frames, int16_t * out, int channels)
+{
+    int16_t *buf;
+    uint64_t step;
+    uint64_t pos;
+    uint64_t end;
+    int n;
 
-        default:
-            Error("audio: unsupported %d -> %d channels resample\n", in_chan, out_chan);
-            // play silence
-            memset(out, 0, frames * out_chan * AudioBytesProSample);
-            break;
+    if (AudioDrift.Channels != channels) {
+        memset(AudioDrift.History, 0, sizeof(AudioDrift.History));
+        AudioDrift.Channels = channels;
+        AudioDrift.Pos = 1ULL << 32;
+    }
+    // history frames in front of the new frames
+    buf = alloca((frames + 3) * channels * AudioBytesProSample);
+    memcpy(buf, AudioDrift.History, 3 * channels * AudioBytesProSample);
+    memcpy(buf + 3 * channels, in, frames * channels * AudioBytesProSample);
+
+    // input frames per output frame
+    step = ((uint64_t) 1000000 << 32) / (1000000 + AudioDrift.Ppm);
+    pos = AudioDrift.Pos;
+    end = (uint64_t) (frames + 1) << 32;
+    n = 0;
+    while (pos < end) {
+        const int16_t *x;
+        const int16_t *f;
+        int c;
+
+        x = buf + ((pos >> 32) - 1) * channels;
+        f = AudioDriftFilter[(pos >> 24) & (AUDIO_DRIFT_PHASES - 1)];
+        for (c = 0; c < channels; ++c) {
+            int t;
+
+            t = (x[c] * f[0] + x[c + channels] * f[1] + x[c + 2 * channels] * f[2]
+                + x[c + 3 * channels] * f[3] + (1 << 13)) >> 14;
+            if (t < INT16_MIN) {
+                t = INT16_MIN;
+            } else if (t > INT16_MAX) {
+                t = INT16_MAX;
+            }
+            *out++ = t;
+        }
+        pos += step;
+        n++;
     }
-}
+    AudioDrift.Pos = pos - ((uint64_t) frames << 32);
+    memcpy(AudioDrift.History, buf + frames * channels, 3 * channels * AudioBytesProSample);
 
-#endif
+    return n;
+}
 
 //----------------------------------------------------------------------------
 //  ring buffer
 //----------------------------------------------------------------------------
 
 #define AUDIO_RING_MAX 4                ///< number of audio ring buffers
+#define AUDIO_PTS_INDEX_MAX 256         ///< number of pts index entries per ring
+#define AUDIO_PTS_INDEX_STEP (100 * 90) ///< pts span of a pts index entry
+#define AUDIO_ALIGN_MAX_PAD (1000 * 90) ///< max. silence inserted at start
 
 /**
 **	Audio ring buffer.
@@ -639,6 +895,18 @@ typedef struct _audio_ring_ring_
     unsigned InChannels;                ///< input number of channels
     int64_t PTS;                        ///< pts clock
     RingBuffer *RingBuffer;             ///< sample ring buffer
+#ifdef USE_AUDIO_MIXER
+    AudioMix Mix;                       ///< input to hardware channel mix
+#endif
+    size_t Written;                     ///< total bytes written into ring buffer
+    size_t PtsIndexStart;               ///< older index entries are stale
+    struct
+    {
+        int64_t Slot;                   ///< pts / AUDIO_PTS_INDEX_STEP of entry
+        int64_t PTS;                    ///< pts of first byte of packet
+        size_t Offset;                  ///< write offset of first byte of packet
+        size_t Size;                    ///< bytes written for the packet
+    } PtsIndex[AUDIO_PTS_INDEX_MAX];    ///< first packet of each time slot
 } AudioRingRing;
 
     /// ring of audio ring buffers
@@ -647,8 +915,207 @@ static int AudioRingWrite;              ///< audio ring write pointer
 static int AudioRingRead;               ///< audio ring read pointer
 static atomic_t AudioRingFilled;        ///< how many of the ring is used
 static unsigned AudioStartThreshold;    ///< start play, if filled
+static char AudioPreRoll;               ///< flag ring trimmed to first video pts
+static uint32_t AudioPreRollTick;       ///< ms tick of pre-roll trim
+
+    /// audio start after a channel switch
+static struct
+{
+    unsigned Starts;                    ///< number of starts
+    unsigned Aligned;                   ///< starts aligned to first video pts
+    int Dropped;                        ///< ms dropped since last flush
+    int Padded;                         ///< ms silence inserted since last flush
+    int Delay;                          ///< ms from last alignment to start
+} AudioStartStats;
 char AudioTemp[200 * 1024];               /// Temp Buffer for playout
 
+/**
+**	Get pts index slot of a time stamp.
+**
+**	@param pts	presentation time stamp
+*/
+static inline int64_t AudioPtsIndexSlot(int64_t pts)
+{
+    return (pts & PTS_MASK) / AUDIO_PTS_INDEX_STEP;
+}
+
+/**
+**	Add packet to pts index of ring.
+**
+**	The index is direct mapped, each entry holds the first packet of an
+**	AUDIO_PTS_INDEX_STEP time slot.  256 slots are 25.6s, more than a
+**	ring buffer can hold.
+**
+**	@param ring	audio ring buffer
+**	@param count	number of bytes written for the packet
+*/
+static void AudioPtsIndexAdd(AudioRingRing * ring, size_t count)
+{
+    if (ring->PTS != (int64_t) AV_NOPTS_VALUE && count) {
+        int64_t slot;
+        int i;
+
+        slot = AudioPtsIndexSlot(ring->PTS);
+        i = slot % AUDIO_PTS_INDEX_MAX;
+        if (ring->PtsIndex[i].Slot != slot || ring->PtsIndex[i].Offset < ring->PtsIndexStart) {
+            ring->PtsIndex[i].Slot = slot;
+            ring->PtsIndex[i].PTS = ring->PTS;
+            ring->PtsIndex[i].Offset = ring->Written;
+            ring->PtsIndex[i].Size = count;
+        }
+    }
+    ring->Written += count;
+}
+
+/**
+**	Drop the pts index of ring.
+**
+**	@param ring	audio ring buffer
+*/
+static void AudioPtsIndexReset(AudioRingRing * ring)
+{
+    ring->PtsIndexStart = ring->Written;
+}
+
+/**
+**	Get number of buffered bytes before a time stamp.
+**
+**	Looks up the first packet of the time slot of pts, or of the slot
+**	before, and interpolates from it.  Without an entry it interpolates
+**	from the end of the buffered samples.
+**
+**	@param ring	audio ring buffer
+**	@param pts	presentation time stamp to trim to
+**
+**	@returns number of bytes to skip, to start playing at pts.
+*/
+static size_t AudioPtsIndexSkip(const AudioRingRing * ring, int64_t pts)
+{
+    size_t used;
+    size_t start;
+    int64_t offset;
+    int64_t slot;
+    unsigned bytes_per_second;
+    unsigned frame;
+    int i;
+
+    used = RingBufferUsedBytes(ring->RingBuffer);
+    start = ring->Written - used;
+    frame = ring->HwChannels * AudioBytesProSample;
+    bytes_per_second = ring->HwSampleRate * frame;
+    if (!used || !bytes_per_second) {
+        return 0;
+    }
+
+    slot = AudioPtsIndexSlot(pts);
+    i = slot % AUDIO_PTS_INDEX_MAX;
+    if (ring->PtsIndex[i].Slot != slot || ring->PtsIndex[i].Offset < ring->PtsIndexStart
+        || PtsDiff(ring->PtsIndex[i].PTS, pts) < 0) {
+        // previous slot, slot 0 follows the last slot before the wrap
+        slot = slot ? slot - 1 : AudioPtsIndexSlot(PTS_WRAP - 1);
+        i = slot % AUDIO_PTS_INDEX_MAX;
+        if (ring->PtsIndex[i].Slot != slot || ring->PtsIndex[i].Offset < ring->PtsIndexStart) {
+            i = -1;
+        }
+    }
+
+    if (i < 0) {
+        int64_t back;
+        unsigned unit;
+
+        if (ring->PTS == (int64_t) AV_NOPTS_VALUE) {
+            return 0;
+        }
+        // the ring pts is behind the last buffered sample
+        back = PtsDiff(pts, ring->PTS) * bytes_per_second / (90 * 1000);
+        if (back <= 0) {
+            return used;
+        }
+        unit = ring->Passthrough ? (unsigned)ring->PacketSize : frame;
+        if (!unit) {
+            return 0;
+        }
+        offset = ring->Written - (back + unit - 1) / unit * unit;
+    } else if (ring->Passthrough) {
+        // can't cut inside a pass-through burst, the bursts have one size
+        offset = ring->PtsIndex[i].Offset
+            + (PtsDiff(ring->PtsIndex[i].PTS, pts) * bytes_per_second / (90 * 1000))
+            / ring->PtsIndex[i].Size * ring->PtsIndex[i].Size;
+    } else {
+        offset = ring->PtsIndex[i].Offset
+            + (PtsDiff(ring->PtsIndex[i].PTS, pts) * bytes_per_second / (90 * 1000)) / frame * frame;
+    }
+    if (offset <= (int64_t) start) {
+        return 0;
+    }
+    if (offset >= (int64_t) ring->Written) {
+        return used;
+    }
+    return offset - start;
+}
+
+/**
+**	Compute the a/v start alignment of a ring, before it is played.
+**
+**	The first played sample should have the pts vpts - VideoAudioDelay.
+**	Buffered audio in front of it is dropped.  If audio starts behind
+**	it, silence must be inserted in front (not for pass-through).
+**
+**	@param ring	audio ring buffer
+**	@param vpts	pts of the first video frame
+**	@param[out] pad	number of silence bytes to insert
+**
+**	@returns number of bytes to drop.
+*/
+static size_t AudioStartAlign(const AudioRingRing * ring, int64_t vpts, size_t * pad)
+{
+    size_t used;
+    int64_t target;
+    int64_t first;
+    unsigned frame;
+    unsigned bytes_per_second;
+
+    *pad = 0;
+    used = RingBufferUsedBytes(ring->RingBuffer);
+    frame = ring->HwChannels * AudioBytesProSample;
+    bytes_per_second = ring->HwSampleRate * frame;
+    if (!used || !bytes_per_second || ring->PTS == (int64_t) AV_NOPTS_VALUE) {
+        return 0;
+    }
+    target = PtsAdd(vpts, -VideoAudioDelay);
+    // pts of the first buffered sample, the ring pts is behind the last
+    first = PtsAdd(ring->PTS, -(int64_t) used * 90 * 1000 / bytes_per_second);
+    if (PtsDiff(first, target) >= 0) {
+        return AudioPtsIndexSkip(ring, target);
+    }
+    if (!ring->Passthrough && PtsDiff(target, first) < AUDIO_ALIGN_MAX_PAD) {
+        *pad = (PtsDiff(target, first) * bytes_per_second / (90 * 1000)) / frame * frame;
+    }
+    return 0;
+}
+
+/**
+**	Insert silence in front of a ring, before it is played.
+**
+**	@param ring	audio ring buffer
+**	@param pad	number of silence bytes
+**
+**	@returns number of bytes inserted.
+*/
+static size_t AudioStartPad(AudioRingRing * ring, size_t pad)
+{
+    int i;
+
+    pad = RingBufferReadPad(ring->RingBuffer, pad);
+    // buffered packets are played later
+    for (i = 0; i < AUDIO_PTS_INDEX_MAX; ++i) {
+        ring->PtsIndex[i].Offset += pad;
+    }
+    ring->PtsIndexStart += pad;
+    ring->Written += pad;
+    return pad;
+}
+
 /**
 **	Add sample-rate, number of channels change to ring.
 **
@@ -697,8 +1164,17 @@ static int AudioRingAdd(unsigned sample_rate, int channels, int passthrough)
     AudioRing[AudioRingWrite].InChannels = channels;
     AudioRing[AudioRingWrite].HwSampleRate = sample_rate;
     AudioRing[AudioRingWrite].HwChannels = AudioChannelMatrix[u][channels];
+#ifdef USE_AUDIO_MIXER
+    if (!passthrough && AudioMixSetup(&AudioRing[AudioRingWrite].Mix, channels, AudioChannelMatrix[u][channels])) {
+        Error("audio: unsupported %d -> %d channels resample\n", channels, AudioChannelMatrix[u][channels]);
+        AudioRing[AudioRingWrite].Mix.OutChannels = AudioChannelMatrix[u][channels];
+    }
+#endif
     AudioRing[AudioRingWrite].PTS = AV_NOPTS_VALUE;
     RingBufferReset(AudioRing[AudioRingWrite].RingBuffer);
+    AudioPtsIndexReset(&AudioRing[AudioRingWrite]);
+    AudioDrift.Channels = 0;
+    AudioDrift.Start = 0;
 
     Debug(3, "audio: %d ring buffer prepared\n", atomic_read(&AudioRingFilled) + 1);
 
@@ -722,10 +1198,17 @@ static int AudioRingAdd(unsigned sample_rate, int channels, int passthrough)
 static void AudioRingInit(void)
 {
     int i;
+    int j;
 
     for (i = 0; i < AUDIO_RING_MAX; ++i) {
         // ~2s 8ch 16bit
         AudioRing[i].RingBuffer = RingBufferNew(AudioRingBufferSize);
+        if (AudioRing[i].RingBuffer) {
+            MemReserve(MEM_AUDIO, AudioRingBufferSize, AudioRingBufferSize);
+        }
+        for (j = 0; j < AUDIO_PTS_INDEX_MAX; ++j) {
+            AudioRing[i].PtsIndex[j].Slot = -1;
+        }
     }
     atomic_set(&AudioRingFilled, 0);
 }
@@ -740,6 +1223,7 @@ static void AudioRingExit(void)
     for (i = 0; i < AUDIO_RING_MAX; ++i) {
         if (AudioRing[i].RingBuffer) {
             RingBufferDel(AudioRing[i].RingBuffer);
+            MemRelease(MEM_AUDIO, AudioRingBufferSize);
             AudioRing[i].RingBuffer = NULL;
         }
         AudioRing[i].HwSampleRate = 0;  // checked for valid setup
@@ -763,6 +1247,39 @@ static snd_pcm_t *AlsaPCMHandle;        ///< alsa pcm handle
 static char AlsaCanPause;               ///< hw supports pause
 static int AlsaUseMmap;                 ///< use mmap
 
+/// locks AlsaPCMHandle for threads other than the audio thread, setup
+/// only touches the handles while it is NULL
+static pthread_mutex_t AlsaMutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define ALSA_PARAMS_CACHE 8             ///< entries of negotiated params cache
+
+/**
+**	Alsa pcm handle kept open with its configuration.
+*/
+typedef struct _alsa_pcm_
+{
+    snd_pcm_t *Handle;                  ///< open pcm handle
+    unsigned Rate;                      ///< configured sample rate, 0 none
+    unsigned Channels;                  ///< configured channels
+    char Passthrough;                   ///< configured for pass-through
+} AlsaPcm;
+
+/**
+**	Negotiated alsa params.
+*/
+typedef struct _alsa_params_
+{
+    unsigned Rate;                      ///< sample rate, 0 unused
+    unsigned Channels;                  ///< channels
+    char Passthrough;                   ///< pass-through handle
+    snd_pcm_hw_params_t *HwParams;      ///< negotiated hw params
+    snd_pcm_sw_params_t *SwParams;      ///< sw params set with them
+} AlsaParams;
+
+static AlsaPcm AlsaPcms[2];             ///< pcm and pass-through handle
+static AlsaParams AlsaParamsCache[ALSA_PARAMS_CACHE];   ///< negotiated params
+static int AlsaParamsNext;              ///< next params cache entry to use
+
 static snd_mixer_t *AlsaMixer;          ///< alsa mixer handle
 static snd_mixer_elem_t *AlsaMixerElem; ///< alsa pcm mixer element
 static int AlsaRatio;                   ///< internal -> mixer ratio * 1000
@@ -1009,15 +1526,13 @@ static int AlsaThread(void)
 //----------------------------------------------------------------------------
 
 /**
-**	Open alsa pcm device.
+**	Get alsa pcm device name.
 **
 **	@param passthrough	use pass-through (AC-3, ...) device
 */
-static snd_pcm_t *AlsaOpenPCM(int passthrough)
+static const char *AlsaDeviceName(int passthrough)
 {
     const char *device;
-    snd_pcm_t *handle;
-    int err;
 
     // &&|| hell
     if (!(passthrough && ((device = AudioPassthroughDevice)
@@ -1025,6 +1540,21 @@ static snd_pcm_t *AlsaOpenPCM(int passthrough)
         && !(device = AudioPCMDevice) && !(device = getenv("ALSA_DEVICE"))) {
         device = "default";
     }
+    return device;
+}
+
+/**
+**	Open alsa pcm device.
+**
+**	@param passthrough	use pass-through (AC-3, ...) device
+*/
+static snd_pcm_t *AlsaOpenPCM(int passthrough)
+{
+    const char *device;
+    snd_pcm_t *handle;
+    int err;
+
+    device = AlsaDeviceName(passthrough);
     if (!AudioDoingInit) {              // reduce blabla during init
         Info(_("audio: using %sdevice '%s'\n"), passthrough ? "pass-through " : "", device);
     }
@@ -1060,6 +1590,18 @@ static snd_pcm_t *AlsaOpenPCM(int passthrough)
     return handle;
 }
 
+/**
+**	Publish the current pcm handle to the other threads.
+**
+**	@param handle	pcm handle, NULL while setup changes the handles
+*/
+static void AlsaSetHandle(snd_pcm_t * handle)
+{
+    pthread_mutex_lock(&AlsaMutex);
+    AlsaPCMHandle = handle;
+    pthread_mutex_unlock(&AlsaMutex);
+}
+
 /**
 **	Initialize alsa pcm device.
 **
@@ -1083,7 +1625,9 @@ static void AlsaInitPCM(void)
     AlsaCanPause = snd_pcm_hw_params_can_pause(hw_params);
     Info(_("audio: supports pause: %s\n"), AlsaCanPause ? "yes" : "no");
 
-    AlsaPCMHandle = handle;
+    AlsaPcms[0].Handle = handle;
+    AlsaPcms[0].Rate = 0;
+    AlsaSetHandle(handle);
 }
 
 //----------------------------------------------------------------------------
@@ -1105,7 +1649,9 @@ static void AlsaSetVolume(int volume)
 
 
 
-    if (use_cec) {
+    // steps are queued to the cec worker, fall back to the mixer
+    // when libcec could not be loaded
+    if (use_cec && cec_active()) {
         if (vol == -1 && volume) {
             vol = volume;
         }
@@ -1209,8 +1755,10 @@ static int64_t AlsaGetDelay(void)
     snd_pcm_sframes_t delay;
     int64_t pts;
 
+    pthread_mutex_lock(&AlsaMutex);
     // setup error
     if (!AlsaPCMHandle || !AudioRing[AudioRingRead].HwSampleRate) {
+        pthread_mutex_unlock(&AlsaMutex);
         return 0L;
     }
     // delay in frames in alsa + kernel buffers
@@ -1222,6 +1770,7 @@ static int64_t AlsaGetDelay(void)
         //Debug(3, "audio: %ld frames delay ok, but not running\n", delay);
 #endif
     }
+    pthread_mutex_unlock(&AlsaMutex);
     Debug(4, "audio: %ld frames hw delay\n", delay);
 
     // delay can be negative, when underrun occur
@@ -1234,9 +1783,109 @@ static int64_t AlsaGetDelay(void)
     return pts;
 }
 
+/**
+**	Get the handle slot for pcm or pass-through output.
+**
+**	Pass-through shares the pcm handle, if both use the same device.
+*/
+static AlsaPcm *AlsaPcmSlot(int passthrough)
+{
+    if (passthrough && strcmp(AlsaDeviceName(1), AlsaDeviceName(0))) {
+        return &AlsaPcms[1];
+    }
+    return &AlsaPcms[0];
+}
+
+/**
+**	Lookup the negotiated params of a configuration.
+**
+**	@returns cache entry, NULL if not negotiated yet
+*/
+static AlsaParams *AlsaParamsLookup(unsigned rate, unsigned channels, int passthrough)
+{
+    int i;
+
+    for (i = 0; i < ALSA_PARAMS_CACHE; ++i) {
+        AlsaParams *params = &AlsaParamsCache[i];
+
+        if (params->Rate == rate && params->Channels == channels && params->Passthrough == !!passthrough) {
+            return params;
+        }
+    }
+    return NULL;
+}
+
+/**
+**	Remember the params negotiated for a configuration.
+**
+**	@param handle	pcm handle with the negotiated params
+*/
+static void AlsaParamsStore(snd_pcm_t * handle, unsigned rate, unsigned channels, int passthrough)
+{
+    AlsaParams *params;
+
+    if (!(params = AlsaParamsLookup(rate, channels, passthrough))) {
+        params = &AlsaParamsCache[AlsaParamsNext];
+        AlsaParamsNext = (AlsaParamsNext + 1) % ALSA_PARAMS_CACHE;
+    }
+    params->Rate = 0;
+    if ((!params->HwParams && snd_pcm_hw_params_malloc(&params->HwParams) < 0)
+        || (!params->SwParams && snd_pcm_sw_params_malloc(&params->SwParams) < 0)) {
+        return;
+    }
+    if (snd_pcm_hw_params_current(handle, params->HwParams) < 0
+        || snd_pcm_sw_params_current(handle, params->SwParams) < 0) {
+        return;
+    }
+    params->Rate = rate;
+    params->Channels = channels;
+    params->Passthrough = !!passthrough;
+}
+
+/**
+**	Make the pcm or pass-through handle current.
+**
+**	The handles stay open, an idle handle is only stopped. If the
+**	device is busy, the idle handle is closed to free it.  Must be
+**	called with AlsaPCMHandle NULL.
+**
+**	@param passthrough	use pass-through (AC-3, ...) device
+**
+**	@returns handle slot or NULL if the device can't be opened
+*/
+static AlsaPcm *AlsaPcmSelect(int passthrough)
+{
+    AlsaPcm *pcm;
+    AlsaPcm *idle;
+
+    pcm = AlsaPcmSlot(passthrough);
+    idle = &AlsaPcms[pcm == &AlsaPcms[0]];
+    if (!pcm->Handle) {
+        if (!(pcm->Handle = AlsaOpenPCM(passthrough)) && idle->Handle) {
+            snd_pcm_close(idle->Handle);
+            idle->Handle = NULL;
+            idle->Rate = 0;
+            pcm->Handle = AlsaOpenPCM(passthrough);
+        }
+        if (!pcm->Handle) {
+            return NULL;
+        }
+        pcm->Rate = 0;
+    }
+    if (idle->Handle && idle->Handle != pcm->Handle) {
+        snd_pcm_drop(idle->Handle);
+    }
+    return pcm;
+}
+
 /**
 **	Setup alsa audio for requested format.
 **
+**	With alsa-no-close-open the pcm handles stay open.  A handle
+**	running the requested rate, channels and pass-through is only
+**	stopped and prepared, otherwise the hw and sw params negotiated
+**	before for the configuration are applied again.
+**
 **	@param freq		sample frequency
 **	@param channels		number of channels
 **	@param passthrough	use pass-through (AC-3, ...) device
@@ -1251,6 +1900,9 @@ static int AlsaSetup(int *freq, int *channels, int passthrough)
 {
     snd_pcm_uframes_t buffer_size;
     snd_pcm_uframes_t period_size;
+    snd_pcm_t *handle;
+    AlsaPcm *pcm;
+    AlsaParams *params;
     int err;
     int delay;
 
@@ -1258,13 +1910,11 @@ static int AlsaSetup(int *freq, int *channels, int passthrough)
         // FIXME: if open fails for fe. pass-through, we never recover
         return -1;
     }
+    handle = AlsaPCMHandle;
+    AlsaSetHandle(NULL);                // other threads should check handle
     if (!AudioAlsaNoCloseOpen) {        // close+open to fix HDMI no sound bug
-        snd_pcm_t *handle;
-
-        handle = AlsaPCMHandle;
-        // no lock needed, thread exit in main loop only
         //Debug(3, "audio: %s [\n", __FUNCTION__);
-        AlsaPCMHandle = NULL;           // other threads should check handle
+        AlsaPcms[0].Handle = NULL;
         snd_pcm_close(handle);
         if (AudioAlsaCloseOpenDelay) {
             usleep(50 * 1000);          // 50ms delay for alsa recovery
@@ -1273,39 +1923,59 @@ static int AlsaSetup(int *freq, int *channels, int passthrough)
         if (!(handle = AlsaOpenPCM(passthrough))) {
             return -1;
         }
-        AlsaPCMHandle = handle;
+        AlsaPcms[0].Handle = handle;
+        AlsaPcms[0].Rate = 0;
+        pcm = &AlsaPcms[0];
         //Debug(3, "audio: %s ]\n", __FUNCTION__);
+    } else {
+        if (!(pcm = AlsaPcmSelect(passthrough))) {
+            return -1;
+        }
+        handle = pcm->Handle;
+        snd_pcm_drop(handle);
+        if (pcm->Rate == (unsigned)*freq && pcm->Channels == (unsigned)*channels
+            && pcm->Passthrough == !!passthrough) {
+            if ((err = snd_pcm_prepare(handle)) < 0) {
+                Error(_("audio: snd_pcm_prepare(): %s\n"), snd_strerror(err));
+            }
+            Debug(3, "audio: reuse %s handle %dHz %d channels\n", passthrough ? "pass-through" : "pcm", *freq,
+                *channels);
+            goto configured;
+        }
+        pcm->Rate = 0;
     }
 
-    for (;;) {
+    // params negotiated before for this configuration
+    if ((params = AlsaParamsLookup(*freq, *channels, passthrough))) {
+        if (snd_pcm_hw_params(handle, params->HwParams) >= 0 && snd_pcm_sw_params(handle, params->SwParams) >= 0) {
+            Debug(3, "audio: cached params %dHz %d channels\n", *freq, *channels);
+            goto negotiated;
+        }
+        params->Rate = 0;
+    }
+    if ((err =
+            snd_pcm_set_params(handle, SND_PCM_FORMAT_S16,
+                AlsaUseMmap ? SND_PCM_ACCESS_MMAP_INTERLEAVED : SND_PCM_ACCESS_RW_INTERLEAVED, *channels, *freq, 1,
+                96 * 1000))) {
+        // try reduced buffer size (needed for sunxi)
+        // FIXME: alternativ make this configurable
         if ((err =
-                snd_pcm_set_params(AlsaPCMHandle, SND_PCM_FORMAT_S16,
-                    AlsaUseMmap ? SND_PCM_ACCESS_MMAP_INTERLEAVED : SND_PCM_ACCESS_RW_INTERLEAVED, *channels, *freq, 1,
-                    96 * 1000))) {
-            // try reduced buffer size (needed for sunxi)
-            // FIXME: alternativ make this configurable
-            if ((err =
-                    snd_pcm_set_params(AlsaPCMHandle, SND_PCM_FORMAT_S16,
-                        AlsaUseMmap ? SND_PCM_ACCESS_MMAP_INTERLEAVED : SND_PCM_ACCESS_RW_INTERLEAVED, *channels,
-                        *freq, 1, 72 * 1000))) {
-
-                /*
-                   if ( err == -EBADFD ) {
-                   snd_pcm_close(AlsaPCMHandle);
-                   AlsaPCMHandle = NULL;
-                   continue;
-                   }
-                 */
-
-                if (!AudioDoingInit) {
-                    Error(_("audio: set params error: %s\n"), snd_strerror(err));
-                }
-                // FIXME: must stop sound, AudioChannels ... invalid
-                return -1;
+                snd_pcm_set_params(handle, SND_PCM_FORMAT_S16,
+                    AlsaUseMmap ? SND_PCM_ACCESS_MMAP_INTERLEAVED : SND_PCM_ACCESS_RW_INTERLEAVED, *channels, *freq,
+                    1, 72 * 1000))) {
+            if (!AudioDoingInit) {
+                Error(_("audio: set params error: %s\n"), snd_strerror(err));
             }
+            // FIXME: must stop sound, AudioChannels ... invalid
+            AlsaSetHandle(handle);
+            return -1;
         }
-        break;
     }
+    AlsaParamsStore(handle, *freq, *channels, passthrough);
+  negotiated:
+    pcm->Rate = *freq;
+    pcm->Channels = *channels;
+    pcm->Passthrough = !!passthrough;
 
     // this is disabled, no advantages!
     if (0) {                            // no underruns allowed, play silence
@@ -1313,7 +1983,7 @@ static int AlsaSetup(int *freq, int *channels, int passthrough)
         snd_pcm_uframes_t boundary;
 
         snd_pcm_sw_params_alloca(&sw_params);
-        err = snd_pcm_sw_params_current(AlsaPCMHandle, sw_params);
+        err = snd_pcm_sw_params_current(handle, sw_params);
         if (err < 0) {
             Error(_("audio: snd_pcm_sw_params_current failed: %s\n"), snd_strerror(err));
         }
@@ -1321,26 +1991,26 @@ static int AlsaSetup(int *freq, int *channels, int passthrough)
             Error(_("audio: snd_pcm_sw_params_get_boundary failed: %s\n"), snd_strerror(err));
         }
         Debug(4, "audio: boundary %lu frames\n", boundary);
-        if ((err = snd_pcm_sw_params_set_stop_threshold(AlsaPCMHandle, sw_params, boundary)) < 0) {
+        if ((err = snd_pcm_sw_params_set_stop_threshold(handle, sw_params, boundary)) < 0) {
             Error(_("audio: snd_pcm_sw_params_set_silence_size failed: %s\n"), snd_strerror(err));
         }
-        if ((err = snd_pcm_sw_params_set_silence_size(AlsaPCMHandle, sw_params, boundary)) < 0) {
+        if ((err = snd_pcm_sw_params_set_silence_size(handle, sw_params, boundary)) < 0) {
             Error(_("audio: snd_pcm_sw_params_set_silence_size failed: %s\n"), snd_strerror(err));
         }
-        if ((err = snd_pcm_sw_params(AlsaPCMHandle, sw_params)) < 0) {
+        if ((err = snd_pcm_sw_params(handle, sw_params)) < 0) {
             Error(_("audio: snd_pcm_sw_params failed: %s\n"), snd_strerror(err));
         }
     }
     // update buffer
-
-    snd_pcm_get_params(AlsaPCMHandle, &buffer_size, &period_size);
+  configured:
+    snd_pcm_get_params(handle, &buffer_size, &period_size);
     Debug(3, "audio: buffer size %lu %zdms, period size %lu %zdms\n", buffer_size,
-        snd_pcm_frames_to_bytes(AlsaPCMHandle, buffer_size) * 1000 / (*freq * *channels * AudioBytesProSample),
-        period_size, snd_pcm_frames_to_bytes(AlsaPCMHandle,
+        snd_pcm_frames_to_bytes(handle, buffer_size) * 1000 / (*freq * *channels * AudioBytesProSample),
+        period_size, snd_pcm_frames_to_bytes(handle,
             period_size) * 1000 / (*freq * *channels * AudioBytesProSample));
-    Debug(3, "audio: state %s\n", snd_pcm_state_name(snd_pcm_state(AlsaPCMHandle)));
+    Debug(3, "audio: state %s\n", snd_pcm_state_name(snd_pcm_state(handle)));
 
-    AudioStartThreshold = snd_pcm_frames_to_bytes(AlsaPCMHandle, period_size);
+    AudioStartThreshold = snd_pcm_frames_to_bytes(handle, period_size);
     // buffer time/delay in ms
     delay = AudioBufferTime;
     if (VideoAudioDelay > 0) {
@@ -1357,6 +2027,7 @@ static int AlsaSetup(int *freq, int *channels, int passthrough)
         Info(_("audio: start delay %ums\n"), (AudioStartThreshold * 1000)
             / (*freq * *channels * AudioBytesProSample));
     }
+    AlsaSetHandle(handle);
     return 0;
 }
 
@@ -1367,6 +2038,11 @@ static void AlsaPlay(void)
 {
     int err;
 
+    pthread_mutex_lock(&AlsaMutex);
+    if (!AlsaPCMHandle) {
+        pthread_mutex_unlock(&AlsaMutex);
+        return;
+    }
     if (AlsaCanPause) {
         if ((err = snd_pcm_pause(AlsaPCMHandle, 0))) {
             Error(_("audio: snd_pcm_pause(): %s\n"), snd_strerror(err));
@@ -1381,6 +2057,7 @@ static void AlsaPlay(void)
         Error(_("audio: still paused\n"));
     }
 #endif
+    pthread_mutex_unlock(&AlsaMutex);
 }
 
 /**
@@ -1390,6 +2067,11 @@ static void AlsaPause(void)
 {
     int err;
 
+    pthread_mutex_lock(&AlsaMutex);
+    if (!AlsaPCMHandle) {
+        pthread_mutex_unlock(&AlsaMutex);
+        return;
+    }
     if (AlsaCanPause) {
         if ((err = snd_pcm_pause(AlsaPCMHandle, 1))) {
             Error(_("snd_pcm_pause(): %s\n"), snd_strerror(err));
@@ -1399,6 +2081,7 @@ static void AlsaPause(void)
             Error(_("snd_pcm_drop(): %s\n"), snd_strerror(err));
         }
     }
+    pthread_mutex_unlock(&AlsaMutex);
 }
 
 /**
@@ -1434,9 +2117,26 @@ static void AlsaInit(void)
 */
 static void AlsaExit(void)
 {
-    if (AlsaPCMHandle) {
-        snd_pcm_close(AlsaPCMHandle);
-        AlsaPCMHandle = NULL;
+    int i;
+
+    AlsaSetHandle(NULL);
+    for (i = 0; i < 2; ++i) {
+        if (AlsaPcms[i].Handle) {
+            snd_pcm_close(AlsaPcms[i].Handle);
+            AlsaPcms[i].Handle = NULL;
+            AlsaPcms[i].Rate = 0;
+        }
+    }
+    for (i = 0; i < ALSA_PARAMS_CACHE; ++i) {
+        if (AlsaParamsCache[i].HwParams) {
+            snd_pcm_hw_params_free(AlsaParamsCache[i].HwParams);
+            AlsaParamsCache[i].HwParams = NULL;
+        }
+        if (AlsaParamsCache[i].SwParams) {
+            snd_pcm_sw_params_free(AlsaParamsCache[i].SwParams);
+            AlsaParamsCache[i].SwParams = NULL;
+        }
+        AlsaParamsCache[i].Rate = 0;
     }
     if (AlsaMixer) {
         snd_mixer_close(AlsaMixer);
@@ -1582,6 +2282,7 @@ static void *AudioPlayHandlerThread(void *dummy)
 {
     Debug(3, "audio: play thread started\n");
     prctl(PR_SET_NAME, "cuvid audio", 0, 0, 0);
+    ThreadApplyProfile(THREAD_AUDIO);
 
     for (;;) {
         // check if we should stop the thread
@@ -1779,81 +2480,22 @@ extern int hasVideo;
 extern uint64_t last_time;
 
 /**
-**	Place samples in audio output queue.
+**	Samples are placed in the ring buffer, start play-back if enough.
 **
-**	@param samples	sample buffer
-**	@param count	number of bytes in sample buffer
+**	@param n	number of bytes placed in the ring buffer
+**	@param count	number of bytes which should be placed
 */
-void AudioEnqueue(const void *samples, int count)
+static void AudioEnqueued(size_t n, int count)
 {
-    size_t n;
-    int16_t *buffer;
-    
     uint64_t vpts;
-   
-    
-#ifdef PERFTEST1
-    static uint64_t mytime;
-    if (((GetusTicks()-mytime) / 1000) > 120 || count < 4608) {
-        printf("Count %d Enqueue diff %ldms\n",count,(GetusTicks()-mytime) / 1000);
-    }
-    mytime = GetusTicks();
-#endif
-
-#ifdef noDEBUG
-    static uint32_t last_tick;
-    uint32_t tick;
-
-    tick = GetMsTicks();
-    if (tick - last_tick > 101) {
-        Debug(3, "audio: enqueue %4d %dms\n", count, tick - last_tick);
-    }
-    last_tick = tick;
-#endif
-
-    if (!AudioRing[AudioRingWrite].HwSampleRate) {
-        Debug(3, "audio: enqueue not ready\n");
-        return;                         // no setup yet
-    }
-    // save packet size
-    if (!AudioRing[AudioRingWrite].PacketSize) {
-        AudioRing[AudioRingWrite].PacketSize = count;
-        Debug(3, "audio: a/v packet size %d bytes\n", count);
-    }
-    // audio sample modification allowed and needed?
-    buffer = (void *)samples;
-    if (!AudioRing[AudioRingWrite].Passthrough && (AudioCompression || AudioNormalize
-            || AudioRing[AudioRingWrite].InChannels != AudioRing[AudioRingWrite].HwChannels)) {
-        int frames;
-
-        // resample into ring-buffer is too complex in the case of a roundabout
-        // just use a temporary buffer
-        frames = count / (AudioRing[AudioRingWrite].InChannels * AudioBytesProSample);
-        buffer = alloca(frames * AudioRing[AudioRingWrite].HwChannels * AudioBytesProSample);
-#ifdef USE_AUDIO_MIXER
-        // Convert / resample input to hardware format
-        AudioResample(samples, AudioRing[AudioRingWrite].InChannels, frames, buffer,
-            AudioRing[AudioRingWrite].HwChannels);
-#else
-#ifdef DEBUG
-        if (AudioRing[AudioRingWrite].InChannels != AudioRing[AudioRingWrite].HwChannels) {
-            Debug(3, "audio: internal failure channels mismatch\n");
-            return;
-        }
-#endif
-        memcpy(buffer, samples, count);
-#endif
-        count = frames * AudioRing[AudioRingWrite].HwChannels * AudioBytesProSample;
 
-        if (AudioCompression) {         // in place operation
-            AudioCompressor(buffer, count);
-        }
-        if (AudioNormalize) {           // in place operation
-            AudioNormalizer(buffer, count);
-        }
+    AudioPtsIndexAdd(&AudioRing[AudioRingWrite], n);
+    // Update audio clock (stupid gcc developers thinks INT64_C is unsigned)
+    // before the start, it is the pts of the end of the buffered samples
+    if (AudioRing[AudioRingWrite].PTS != (int64_t) AV_NOPTS_VALUE) {
+        AudioRing[AudioRingWrite].PTS = PtsAdd(AudioRing[AudioRingWrite].PTS, ((int64_t) count * 90 * 1000)
+            / (AudioRing[AudioRingWrite].HwSampleRate * AudioRing[AudioRingWrite].HwChannels * AudioBytesProSample));
     }
-
-    n = RingBufferWrite(AudioRing[AudioRingWrite].RingBuffer, buffer, count);
     if (n != (size_t)count) {
         Error(_("audio: can't place %d samples in ring buffer\n"), count);
         // too many bytes are lost
@@ -1867,26 +2509,50 @@ void AudioEnqueue(const void *samples, int count)
 
         n = RingBufferUsedBytes(AudioRing[AudioRingWrite].RingBuffer);
 
-        if (!ConfigVideoFastSwitch && hasVideo) {
+        // with fast switch the video doesn't wait for the audio, but the
+        // pre-roll in front of the first video frame is never in sync
+        if (hasVideo) {
             vpts = FirstVPTS;
 
             if (vpts == AV_NOPTS_VALUE || AudioRing[AudioRingWrite].PTS == AV_NOPTS_VALUE || !vpts) {
-                //usleep(1000);
-                skip = n;   // Clear all audio until video is avail
+                // keep the pre-roll, until first video pts is known
+                if (n > AudioRingBufferSize / 2) {
+                    skip = n - AudioRingBufferSize / 2;
+                }
+                AudioPreRoll = 0;
                 //printf("%d No PTS in %ld ms \n",n,(GetusTicks() - last_time) / 1000);
             }
-            else if ((uint64_t)AudioRing[AudioRingWrite].PTS  < vpts) {
-                skip = n;    // Clear Audio until Video PTS
-          
+            else if (!AudioPreRoll) {
+                size_t pad;
+                unsigned bytes_per_ms;
+
+                // align start to first video pts, drop or pad
+                skip = AudioStartAlign(&AudioRing[AudioRingWrite], vpts, &pad);
+                if (pad) {
+                    pad = AudioStartPad(&AudioRing[AudioRingWrite], pad);
+                    n = RingBufferUsedBytes(AudioRing[AudioRingWrite].RingBuffer);
+                }
+                AudioPreRoll = skip < n;
+                AudioPreRollTick = GetMsTicks();
+                bytes_per_ms = AudioRing[AudioRingWrite].HwSampleRate * AudioRing[AudioRingWrite].HwChannels
+                    * AudioBytesProSample / 1000;
+                if (bytes_per_ms) {
+                    AudioStartStats.Dropped += skip / bytes_per_ms;
+                    AudioStartStats.Padded += pad / bytes_per_ms;
+                }
+                Debug(3, "audio: a/v start align drop %d pad %zd of %zd bytes to vpts %s\n", skip, pad, n,
+                    Timestamp2String(vpts));
+            }
 #ifdef PERFTEST
+            if (PtsBefore(AudioRing[AudioRingWrite].PTS, vpts)) {
                 static int sw=0;
                 if (!sw) {
                    //printf("%ld too small PTS apts  %#012" PRIx64 " vpts  %#012" PRIx64 " in %ld ms \n",n,AudioRing[AudioRingWrite].PTS,vpts ,(GetusTicks() - last_time) / 1000);
-                   printf("Audio vorlauf ist %ldms \n",(vpts - AudioRing[AudioRingWrite].PTS) / 90);
+                   printf("Audio vorlauf ist %ldms \n",PtsDiff(AudioRing[AudioRingWrite].PTS, vpts) / 90);
                    sw = 1;
                 }
-#endif
             }
+#endif
             //else {
                 //printf("store %ld of %d Audio in %ld ms \n",n,AudioStartThreshold,(GetusTicks() - last_time) / 1000);
             //}
@@ -1906,7 +2572,7 @@ void AudioEnqueue(const void *samples, int count)
 #endif
         }
         
-        if (ConfigVideoFastSwitch) {
+        if (ConfigVideoFastSwitch && AudioSkip > skip) {
             skip = AudioSkip;
         }
         
@@ -1914,7 +2580,7 @@ void AudioEnqueue(const void *samples, int count)
             if (n < (unsigned)skip) {
                 skip = n;
             }
-            AudioSkip -= skip;
+            AudioSkip = AudioSkip > skip ? AudioSkip - skip : 0;
             RingBufferReadAdvance(AudioRing[AudioRingWrite].RingBuffer, skip);
             n = RingBufferUsedBytes(AudioRing[AudioRingWrite].RingBuffer);
         }
@@ -1922,34 +2588,371 @@ void AudioEnqueue(const void *samples, int count)
         // for some exotic channels * 4 too small
 
         if (AudioStartThreshold * (ConfigVideoFastSwitch ? 1.8 : 4)  < n
-            ||  (AudioVideoIsReady && AudioStartThreshold < n)) {
+            ||  ((AudioVideoIsReady || AudioPreRoll) && AudioStartThreshold < n)) {
             // restart play-back
             // no lock needed, can wakeup next time
             AudioRunning = 1;
             FirstVPTS = 0;
             if (!ConfigVideoFastSwitch) {
-                //printf("AudioEnque: SetCurrentPCR %#012" PRIx64 "\n", AudioRing[AudioRingWrite].PTS - AudioBufferTime * 90 + VideoAudioDelay);
+                int64_t pcr;
                 int i = 10;
-                while (SetCurrentPCR(0, (uint64_t)(AudioRing[AudioRingWrite].PTS - AudioBufferTime * 90 + VideoAudioDelay )) == 2 && i--) {
+
+                pcr = PtsAdd(AudioRing[AudioRingWrite].PTS, -AudioBufferTime * 90 + VideoAudioDelay);
+                if (AudioPreRoll) {
+                    // aligned, the first played sample belongs to the first video frame
+                    pcr = PtsAdd(AudioRing[AudioRingWrite].PTS, -(int64_t) n * 90 * 1000
+                        / (AudioRing[AudioRingWrite].HwSampleRate * AudioRing[AudioRingWrite].HwChannels *
+                        AudioBytesProSample) + VideoAudioDelay);
+                }
+                while (SetCurrentPCR(0, (uint64_t) pcr) == 2 && i--) {
                     usleep(3000);
                 }
             }
 #ifdef PERFTEST
-                firstapts =  (uint64_t)(AudioRing[AudioRingWrite].PTS - AudioBufferTime * 90 + VideoAudioDelay );
+                firstapts = PtsAdd(AudioRing[AudioRingWrite].PTS, -AudioBufferTime * 90 + VideoAudioDelay);
                 //printf("AVR %d new firstapts  %#012" PRIx64 " \n",AudioVideoIsReady,firstapts);
                 printf("Set PCR PTS in %ld ms \n",(GetusTicks() - last_time) / 1000);
                 sw = 0;
 #endif
             pthread_cond_signal(&AudioStartCond);
             Debug(3, "audio: Start on AudioEnque Threshold %d n %ld IsReady %d\n", AudioStartThreshold, n, AudioVideoIsReady);
+            AudioStartStats.Starts++;
+            if (AudioPreRoll) {
+                AudioStartStats.Aligned++;
+                AudioStartStats.Delay = GetMsTicks() - AudioPreRollTick;
+                Debug(3, "audio: start delay after pre-roll trim %dms\n", AudioStartStats.Delay);
+                AudioPreRoll = 0;
+            }
         }
 
     }
-    // Update audio clock (stupid gcc developers thinks INT64_C is unsigned)
-    if (AudioRing[AudioRingWrite].PTS != (int64_t) AV_NOPTS_VALUE) {
-        AudioRing[AudioRingWrite].PTS += ((int64_t) count * 90 * 1000)
-            / (AudioRing[AudioRingWrite].HwSampleRate * AudioRing[AudioRingWrite].HwChannels * AudioBytesProSample);
+}
+
+/**
+**	Place samples in audio output queue.
+**
+**	@param samples	sample buffer
+**	@param count	number of bytes in sample buffer
+*/
+void AudioEnqueue(const void *samples, int count)
+{
+    size_t n;
+    int16_t *buffer;
+
+#ifdef PERFTEST1
+    static uint64_t mytime;
+    if (((GetusTicks()-mytime) / 1000) > 120 || count < 4608) {
+        printf("Count %d Enqueue diff %ldms\n",count,(GetusTicks()-mytime) / 1000);
+    }
+    mytime = GetusTicks();
+#endif
+
+#ifdef noDEBUG
+    static uint32_t last_tick;
+    uint32_t tick;
+
+    tick = GetMsTicks();
+    if (tick - last_tick > 101) {
+        Debug(3, "audio: enqueue %4d %dms\n", count, tick - last_tick);
+    }
+    last_tick = tick;
+#endif
+
+    if (!AudioRing[AudioRingWrite].HwSampleRate) {
+        Debug(3, "audio: enqueue not ready\n");
+        return;                         // no setup yet
+    }
+    // save packet size
+    if (!AudioRing[AudioRingWrite].PacketSize) {
+        AudioRing[AudioRingWrite].PacketSize = count;
+        Debug(3, "audio: a/v packet size %d bytes\n", count);
+    }
+    // audio sample modification allowed and needed?
+    buffer = (void *)samples;
+    if (!AudioRing[AudioRingWrite].Passthrough && (AudioCompression || AudioNormalize
+            || AudioRing[AudioRingWrite].InChannels != AudioRing[AudioRingWrite].HwChannels)) {
+        int frames;
+
+        // resample into ring-buffer is too complex in the case of a roundabout
+        // just use a temporary buffer
+        frames = count / (AudioRing[AudioRingWrite].InChannels * AudioBytesProSample);
+        buffer = alloca(frames * AudioRing[AudioRingWrite].HwChannels * AudioBytesProSample);
+#ifdef USE_AUDIO_MIXER
+        // Convert / resample input to hardware format
+        AudioResample(&AudioRing[AudioRingWrite].Mix, samples, frames, buffer);
+#else
+#ifdef DEBUG
+        if (AudioRing[AudioRingWrite].InChannels != AudioRing[AudioRingWrite].HwChannels) {
+            Debug(3, "audio: internal failure channels mismatch\n");
+            return;
+        }
+#endif
+        memcpy(buffer, samples, count);
+#endif
+        count = frames * AudioRing[AudioRingWrite].HwChannels * AudioBytesProSample;
+
+        if (AudioCompression) {         // in place operation
+            AudioCompressor(buffer, count);
+        }
+        if (AudioNormalize) {           // in place operation
+            AudioNormalizer(buffer, count);
+        }
+    }
+    if (AudioDriftCorrection && !AudioRing[AudioRingWrite].Passthrough && count) {
+        int frames;
+        int channels;
+        int16_t *out;
+
+        AudioDriftUpdate();
+        channels = AudioRing[AudioRingWrite].HwChannels;
+        frames = count / (channels * AudioBytesProSample);
+        out = alloca((frames + frames / 512 + 2) * channels * AudioBytesProSample);
+        count = AudioDriftResample(buffer, frames, out, channels) * channels * AudioBytesProSample;
+        buffer = out;
+    }
+
+    n = RingBufferWrite(AudioRing[AudioRingWrite].RingBuffer, buffer, count);
+    AudioEnqueued(n, count);
+}
+
+/**
+**	Channel order of DVD LPCM in the ring, same as decoded audio.
+**
+**	dvd L  R  C	Ls Rs		-> L R  Ls Rs C
+**	dvd L  R  C	LFE Ls Rs	-> L R  LFE C  Ls Rs
+**	dvd L  R  C	LFE Ls Rs Rl Rr	-> L R  LFE C  Ls Rs Rl Rr
+*/
+static const uint8_t AudioLpcmOrder[9][8] = {
+    [1] = {0},
+    [2] = {0, 1},
+    [3] = {0, 1, 2},
+    [4] = {0, 1, 2, 3},
+    [5] = {0, 1, 3, 4, 2},
+    [6] = {0, 1, 3, 2, 4, 5},
+    [7] = {0, 1, 2, 3, 4, 5, 6},
+    [8] = {0, 1, 3, 2, 4, 5, 6, 7},
+};
+
+/**
+**	Convert big-endian DVD LPCM frames to native 16-bit samples.
+**
+**	20 and 24-bit samples are stored in units of 4 samples (2 for
+**	mono), first the upper 16 bits of the samples, then the lower bits.
+**	Only the upper 16 bits are used.
+**
+**	@param out	output sample buffer
+**	@param in	DVD LPCM data, starts at a unit
+**	@param frames	number of frames to convert
+**	@param bits	bits per sample 16, 20 or 24
+**	@param channels	number of channels
+*/
+static void AudioLpcmConvert(int16_t * out, const uint8_t * in, int frames, int bits, int channels)
+{
+    const uint8_t *order;
+    int samples;
+    int i;
+
+    samples = frames * channels;
+    order = AudioLpcmOrder[channels];
+    if (bits == 16 && channels != 5 && channels != 6 && channels != 8) {
+        uint8_t *o;
+
+        o = (uint8_t *) out;
+        i = 0;
+#if defined(__ARM_NEON)
+        for (; i + 8 <= samples; i += 8) {
+            vst1q_u8(o + i * 2, vrev16q_u8(vld1q_u8(in + i * 2)));
+        }
+#elif defined(__SSE2__)
+        for (; i + 8 <= samples; i += 8) {
+            __m128i v;
+
+            v = _mm_loadu_si128((const __m128i *)(in + i * 2));
+            v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+            _mm_storeu_si128((__m128i *) (o + i * 2), v);
+        }
+#endif
+        for (; i < samples; ++i) {
+            out[i] = (int16_t) (in[i * 2] << 8 | in[i * 2 + 1]);
+        }
+        return;
+    }
+    if (bits == 16) {
+        for (i = 0; i < frames; ++i) {
+            int c;
+
+            for (c = 0; c < channels; ++c) {
+                out[c] = (int16_t) (in[order[c] * 2] << 8 | in[order[c] * 2 + 1]);
+            }
+            in += channels * 2;
+            out += channels;
+        }
+        return;
+    }
+    {
+        int16_t frame[8];
+        int unit;
+        int bytes;
+        int f;
+        int u;
+
+        unit = channels == 1 ? 2 : 4;
+        bytes = unit * bits / 8;        // 20 bit: 4 samples in 10 bytes
+        f = 0;
+        for (i = 0; i < samples; i += unit) {
+            for (u = 0; u < unit; ++u) {
+                frame[f++] = (int16_t) (in[u * 2] << 8 | in[u * 2 + 1]);
+                if (f == channels) {
+                    int c;
+
+                    for (c = 0; c < channels; ++c) {
+                        *out++ = frame[order[c]];
+                    }
+                    f = 0;
+                }
+            }
+            in += bytes;
+        }
+    }
+}
+
+/**
+**	Check if a DVD LPCM layout can be played.
+**
+**	20 and 24-bit samples are stored in units of 2 frames, which only
+**	fit mono and an even number of channels.  Quantization 3 (28 bit)
+**	is reserved.
+**
+**	@param bits	bits per sample
+**	@param channels	number of channels
+*/
+static int AudioLpcmSupported(int bits, int channels)
+{
+    if (channels < 1 || channels > 8) {
+        return 0;
+    }
+    switch (bits) {
+        case 16:
+            return 1;
+        case 20:
+        case 24:
+            return channels == 1 || !(channels & 1);
+    }
+    return 0;
+}
+
+/**
+**	Decode the header of DVD LPCM samples.
+**
+**	The format byte holds the quantization in bits 7-6 (16, 20, 24
+**	bit), the sample rate in bits 5-4 (48, 96, 44.1, 32 kHz) and the
+**	number of channels - 1 in bits 2-0.
+**
+**	@param header	LPCM header, LPCM_HEADER_SIZE bytes
+**	@param[out] samplerate	sample rate in Hz
+**	@param[out] bits	bits per sample
+**	@param[out] channels	number of channels
+**
+**	@returns 0 for a layout AudioEnqueueLpcm plays, -1 otherwise
+*/
+int AudioLpcmHeader(const uint8_t * header, int *samplerate, int *bits, int *channels)
+{
+    static const int samplerates[] = { 48000, 96000, 44100, 32000 };
+    int format;
+
+    format = header[LPCM_FORMAT];
+    *bits = 16 + ((format >> 6) & 0x3) * 4;
+    *samplerate = samplerates[(format >> 4) & 0x3];
+    *channels = (format & 0x7) + 1;
+
+    return AudioLpcmSupported(*bits, *channels) ? 0 : -1;
+}
+
+/**
+**	Place DVD LPCM samples in audio output queue.
+**
+**	Without mixer, compression, normalizer and drift correction the samples are converted
+**	directly into the ring buffer, otherwise through AudioEnqueue.
+**
+**	@param data	DVD LPCM data, without LPCM header
+**	@param size	number of bytes in data
+**	@param bits	bits per sample 16, 20 or 24
+**	@param channels	number of channels
+*/
+void AudioEnqueueLpcm(const uint8_t * data, int size, int bits, int channels)
+{
+    RingBuffer *rb;
+    size_t n;
+    int frame_size;
+    int frames;
+    int count;
+    int group;
+
+    if (!AudioLpcmSupported(bits, channels)) {
+        return;
+    }
+    // 20/24 bit: 2 frames are whole units
+    group = bits == 16 ? 1 : 2;
+    frames = size * 8 / bits / channels;
+    frames -= frames % group;
+    if (frames <= 0) {
+        return;
+    }
+    frame_size = channels * AudioBytesProSample;
+    count = frames * frame_size;
+
+    if (!AudioRing[AudioRingWrite].HwSampleRate || AudioRing[AudioRingWrite].Passthrough
+        || AudioCompression || AudioNormalize || AudioDriftCorrection || AudioRing[AudioRingWrite].InChannels != (unsigned)channels
+        || AudioRing[AudioRingWrite].HwChannels != (unsigned)channels) {
+        int16_t *buffer;
+
+        buffer = alloca(count);
+        AudioLpcmConvert(buffer, data, frames, bits, channels);
+        AudioEnqueue(buffer, count);
+        return;
+    }
+    if (!AudioRing[AudioRingWrite].PacketSize) {
+        AudioRing[AudioRingWrite].PacketSize = count;
+        Debug(3, "audio: a/v packet size %d bytes\n", count);
+    }
+
+    rb = AudioRing[AudioRingWrite].RingBuffer;
+    n = 0;
+    while (frames) {
+        void *p;
+        size_t avail;
+        int f;
+
+        avail = RingBufferGetWritePointer(rb, &p);
+        f = avail / frame_size;
+        if (f > frames) {
+            f = frames;
+        }
+        f -= f % group;
+        if (f) {
+            AudioLpcmConvert(p, data, f, bits, channels);
+            RingBufferWriteAdvance(rb, f * frame_size);
+        } else {
+            int16_t tmp[2 * 8];
+            int w;
+
+            // frames across the buffer end
+            f = group;
+            if (RingBufferFreeBytes(rb) < (size_t)(f * frame_size)) {
+                break;
+            }
+            AudioLpcmConvert(tmp, data, f, bits, channels);
+            w = RingBufferWrite(rb, tmp, f * frame_size);
+            if (w != f * frame_size) {
+                n += w;
+                break;
+            }
+        }
+        data += f * channels * bits / 8;
+        frames -= f;
+        n += f * frame_size;
     }
+    AudioEnqueued(n, count);
 }
 
 /**
@@ -1959,9 +2962,6 @@ void AudioEnqueue(const void *samples, int count)
 */
 void AudioVideoReady(uint64_t pts)
 {
-    //int64_t audio_pts;
-    //size_t used;
-
     if (AudioVideoIsReady) {
         return;
     }
@@ -1977,66 +2977,30 @@ void AudioVideoReady(uint64_t pts)
         //AudioVideoIsReady = 1;
         return;
     }
-    // Audio.PTS = next written sample time stamp
-#if 0
-    used = RingBufferUsedBytes(AudioRing[AudioRingWrite].RingBuffer);
-    audio_pts =
-        AudioRing[AudioRingWrite].PTS -
-        (used * 90 * 1000) / (AudioRing[AudioRingWrite].HwSampleRate * AudioRing[AudioRingWrite].HwChannels *
-        AudioBytesProSample);
-
-    Debug(3, "audio: a/v sync buf(%d,%4zdms) %s | %s = %dms %s\n", atomic_read(&AudioRingFilled),
-        (used * 1000) / (AudioRing[AudioRingWrite].HwSampleRate * AudioRing[AudioRingWrite].HwChannels *
-            AudioBytesProSample), Timestamp2String(pts), Timestamp2String(audio_pts), (int)(pts - audio_pts) / 90,
-        AudioRunning ? "running" : "ready");
-
-    if (!AudioRunning) {
-        int skip;
-
-        // buffer ~15 video frames
-        // FIXME: HDTV can use smaller video buffer
-        skip = pts - 0 * 20 * 90 - AudioBufferTime * 90 - audio_pts + VideoAudioDelay;
-        printf("AVR skip %d used %ld\n",skip,used);
-#ifdef DEBUG
-        //      fprintf(stderr, "a/v-diff %dms a/v-delay %dms skip %dms  Audiobuffer %d\n", (int)(pts - audio_pts) / 90, VideoAudioDelay / 90, skip / 90,AudioBufferTime);
-#endif
-        // guard against old PTS
-        if (skip > 0 && skip < 4000 * 90) {
-            skip = (((int64_t) skip * AudioRing[AudioRingWrite].HwSampleRate) / (1000 * 90))
-                * AudioRing[AudioRingWrite].HwChannels * AudioBytesProSample;
-            // FIXME: round to packet size
-            printf("AVR1 skip %d uses %ld\n",skip,used);
-            if ((unsigned)skip > used) {
-                AudioSkip = skip - used;
-                skip = used;
-            }
-            Debug(3, "audio: sync advance %dms %d/%zd  Rest %d\n",
-                (skip * 1000) / (AudioRing[AudioRingWrite].HwSampleRate * AudioRing[AudioRingWrite].HwChannels *
-                    AudioBytesProSample), skip, used, AudioSkip);
-            RingBufferReadAdvance(AudioRing[AudioRingWrite].RingBuffer, skip);
-
-            used = RingBufferUsedBytes(AudioRing[AudioRingWrite].RingBuffer);
-        } else {
-            Debug(3, "No audio skip -> should skip %d\n", skip / 90);
-        }
-#if 0
-        // FIXME: skip<0 we need bigger audio buffer
-        // enough video + audio buffered
-        if (AudioStartThreshold < used) {
-            AudioRunning = 1;
-            pthread_cond_signal(&AudioStartCond);
-            Debug(3, "Start on AudioVideoReady\n");
-        }
-#endif
-    } else {
-#endif
-        AudioRunning = 0;
-    //}
+    // the ring is aligned by AudioEnqueue, which owns it before play-back
+    if (!AudioRunning && !AudioPreRoll && (!FirstVPTS || FirstVPTS == AV_NOPTS_VALUE)) {
+        FirstVPTS = pts;
+    }
+    AudioRunning = 0;
     Debug(3,"audio: AudioVideoIsReady");
     AudioVideoIsReady = 1;
 
 }
 
+/**
+**	Get audio start statistics of the channel switches.
+**
+**	@param buf	output buffer
+**	@param size	size of output buffer
+*/
+void AudioGetStartStats(char *buf, size_t size)
+{
+    snprintf(buf, size,
+        "audio starts %u, aligned %u\nlast switch: dropped %d ms, padded %d ms, start %d ms after alignment",
+        AudioStartStats.Starts, AudioStartStats.Aligned, AudioStartStats.Dropped, AudioStartStats.Padded,
+        AudioStartStats.Delay);
+}
+
 /**
 **	Flush audio buffers.
 */
@@ -2069,12 +3033,21 @@ void AudioFlushBuffers(void)
     AudioRing[AudioRingWrite].HwChannels = AudioRing[old].HwChannels;
     AudioRing[AudioRingWrite].InSampleRate = AudioRing[old].InSampleRate;
     AudioRing[AudioRingWrite].InChannels = AudioRing[old].InChannels;
+#ifdef USE_AUDIO_MIXER
+    AudioRing[AudioRingWrite].Mix = AudioRing[old].Mix;
+#endif
     AudioRing[AudioRingWrite].PTS = AV_NOPTS_VALUE;
     RingBufferReadAdvance(AudioRing[AudioRingWrite].RingBuffer,
         RingBufferUsedBytes(AudioRing[AudioRingWrite].RingBuffer));
+    AudioPtsIndexReset(&AudioRing[AudioRingWrite]);
     Debug(3, "audio: reset video ready\n");
     AudioVideoIsReady = 0;
     AudioSkip = 0;
+    AudioPreRoll = 0;
+    AudioStartStats.Dropped = 0;
+    AudioStartStats.Padded = 0;
+    AudioDrift.Channels = 0;
+    AudioDrift.Start = 0;
 
     atomic_inc(&AudioRingFilled);
 
@@ -2168,7 +3141,8 @@ void AudioSetClock(int64_t pts)
             Timestamp2String(pts));
     }
   //printf("Audiosetclock                  pts %#012" PRIx64 " %ld\n",pts,RingBufferUsedBytes(AudioRing[AudioRingWrite].RingBuffer));
-    AudioRing[AudioRingWrite].PTS = pts;
+    // the ring clock is a 33 bit time stamp, compare it with PtsDiff
+    AudioRing[AudioRingWrite].PTS = pts == (int64_t) AV_NOPTS_VALUE ? pts : pts & PTS_MASK;
     //printf("apts  %#012" PRIx64 " \n",pts);
 }
 
@@ -2188,10 +3162,7 @@ uint64_t AudioGetClock(void)
             if (delay > AudioRing[AudioRingRead].PTS) {
                 //delay = 0;
             }
-            if (AudioRing[AudioRingRead].Passthrough) {
-                return AudioRing[AudioRingRead].PTS + 0 * 90 - delay;
-            }
-            return AudioRing[AudioRingRead].PTS + 0 * 90 - delay;
+            return PtsAdd(AudioRing[AudioRingRead].PTS, -delay);
         }
     }
     return 0;
@@ -2204,10 +3175,7 @@ uint64_t AudioGetwClock(void)
 
         // delay zero, if no valid time stamp
         if ((delay = AudioGetDelay())) {
-            if (AudioRing[AudioRingRead].Passthrough) {
-                return AudioRing[AudioRingWrite].PTS + 0 * 90 - delay;
-            }
-            return AudioRing[AudioRingWrite].PTS + 0 * 90 - delay;
+            return PtsAdd(AudioRing[AudioRingWrite].PTS, -delay);
         }
     }
     return AV_NOPTS_VALUE;
@@ -2307,6 +3275,22 @@ void AudioSetBufferTime(int delay)
     AudioBufferTime = delay;
 }
 
+/**
+**	Enable/disable audio clock drift correction.
+**
+**	@param onoff	-1 toggle, true turn on, false turn off
+*/
+void AudioSetDriftCorrection(int onoff)
+{
+    if (onoff < 0) {
+        AudioDriftCorrection ^= 1;
+    } else {
+        AudioDriftCorrection = onoff;
+    }
+    AudioDrift.Channels = 0;
+    AudioDrift.Start = 0;
+}
+
 /**
 **	Enable/disable software volume.
 **
@@ -2486,6 +3470,7 @@ void AudioInit(void)
 
     AudioDoingInit = 1;
     AudioRingInit();
+    AudioDriftInit();
     AudioUsedModule->Init();
 
 
@@ -2518,6 +3503,7 @@ void AudioInit(void)
 
 #ifdef USE_CEC
     if (!AudioSoftVolume) {
+        // only starts the worker, the adapter is opened in background
         use_cec = cec_init();
     }
     else {
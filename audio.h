@@ -23,11 +23,25 @@
 /// @addtogroup Audio
 /// @{
 
+//----------------------------------------------------------------------------
+//  Defines
+//----------------------------------------------------------------------------
+
+    /// DVD LPCM header in front of the samples: sub stream id, number
+    /// of frame headers, first access unit (2), emphasis/mute/frame
+    /// number, format and dynamic range
+#define LPCM_HEADER_SIZE 7
+#define LPCM_FORMAT 5                   ///< offset of the format byte
+
 //----------------------------------------------------------------------------
 //  Prototypes
 //----------------------------------------------------------------------------
 
 extern void AudioEnqueue(const void *, int);    ///< buffer audio samples
+    /// buffer DVD LPCM samples
+extern void AudioEnqueueLpcm(const uint8_t *, int, int, int);
+    /// decode a DVD LPCM header
+extern int AudioLpcmHeader(const uint8_t *, int *, int *, int *);
 extern void AudioFlushBuffers(void);    ///< flush audio buffers
 extern void AudioPoller(void);          ///< poll audio events/handling
 extern int AudioFreeBytes(void);        ///< free bytes in audio output
@@ -43,6 +57,7 @@ extern void AudioPause(void);           ///< pause audio
 
 extern void AudioSetBufferTime(int);    ///< set audio buffer time
 extern void AudioSetSoftvol(int);       ///< enable/disable softvol
+extern void AudioSetDriftCorrection(int);   ///< enable/disable drift correction
 extern void AudioSetCECDevice(int);       ///< set Audio CEC Device
 extern void AudioSetNormalize(int, int);    ///< set normalize parameters
 extern void AudioSetCompression(int, int);  ///< set compression parameters
@@ -50,6 +65,7 @@ extern void AudioSetStereoDescent(int); ///< set stereo loudness descent
 
 extern void AudioSetDevice(const char *);   ///< set PCM audio device
 extern void AudioVideoReady(uint64_t);
+extern void AudioGetStartStats(char *, size_t);    ///< audio start statistics
 
     /// set pass-through device
 extern void AudioSetPassthroughDevice(const char *);
@@ -66,6 +82,8 @@ int cec_send_command(int ,char *);
 extern int cec_init();
 extern int cec_send_command(int ,char *);
 extern int cec_exit();
+extern int cec_active();                ///< cec adapter usable
+extern void cec_get_stats(char *, size_t);  ///< cec latency counters
 
 //----------------------------------------------------------------------------
 //  Variables
@@ -42,6 +42,14 @@
 #include <sstream>
 #include <signal.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "softhddev.h"
 //#include "p8-platform/os.h"
 //#include "p8-platform/util/StringUtils.h"
 //#include "p8-platform/threads/threads.h"
@@ -50,8 +58,10 @@
 extern "C" {
     int cec_init();
     int cec_exit();
+    int cec_active();
     int ProcessCommandTX(char *);
     int cec_send_command(int, char*);
+    void cec_get_stats(char *, size_t);
 }
 
 using namespace CEC;
@@ -65,6 +75,47 @@ using namespace CEC;
 #define LIBCEC_OSD_NAME_SIZE (13)
 #endif
 
+#define CEC_QUEUE_MAX       16          ///< pending commands
+#define CEC_RAW_MAX         64          ///< max. length of a raw command string
+#define CEC_OPEN_TIMEOUT    5000        ///< adapter open timeout in ms
+#define CEC_RETRY_MIN       1000        ///< first discovery retry in ms
+#define CEC_RETRY_MAX       30000       ///< max. discovery retry in ms
+#define CEC_STALE_MS        3000        ///< drop commands queued longer
+#define CEC_FAKE_TX_US      30000       ///< transmit time of the fake adapter
+
+enum {
+    CEC_STATE_SEARCH,                   ///< adapter discovery running
+    CEC_STATE_READY,                    ///< adapter open
+    CEC_STATE_FAILED,                   ///< libcec not usable
+};
+
+enum {
+    CEC_CMD_VOLUME,                     ///< net volume steps
+    CEC_CMD_RAW,                        ///< command string "1f:82:10:00"
+};
+
+///
+/// Queued CEC command.
+///
+struct CecCmd {
+    int Type;                           ///< CEC_CMD_VOLUME or CEC_CMD_RAW
+    int Dev;                            ///< destination logical address
+    int Steps;                          ///< volume steps, > 0 up, < 0 down
+    uint64_t Queued;                    ///< enqueue time in us
+    char Raw[CEC_RAW_MAX];              ///< raw command string
+};
+
+///
+/// CEC adapter backend.
+///
+struct CecBackend {
+    const char *Name;
+    int (*Open)(const char *);          ///< open adapter, 0 retry, -1 give up
+    int (*Parse)(const char *, cec_command *);
+    int (*Transmit)(const cec_command *);
+    void (*Close)(void);
+};
+
 ICECCallbacks         g_callbacks;
 libcec_configuration  g_config;
 int                   g_cecLogLevel(-1);
@@ -72,91 +123,433 @@ int                   g_cecDefaultLogLevel(0);
 std::string           g_strPort;
 ICECAdapter*          g_parser;
 
-int ProcessCommandTX(char *arguments)
+static const CecBackend *CecUsed;       ///< selected backend
+static pthread_t CecThread;             ///< command worker
+static pthread_mutex_t CecMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t CecCond;          ///< queue / state changed
+static volatile int CecRunning;         ///< worker running
+static volatile int CecState;           ///< CEC_STATE_...
+
+static CecCmd CecQueue[CEC_QUEUE_MAX];  ///< command ring
+static int CecHead;                     ///< first pending command
+static int CecCount;                    ///< pending commands
+
+static unsigned CecQueued;              ///< commands accepted
+static unsigned CecCoalesced;           ///< volume steps merged
+static unsigned CecDropped;             ///< queue full or stale
+static unsigned CecSent;                ///< frames transmitted
+static unsigned CecFailed;              ///< frames not acked
+static uint64_t CecWaitSum;             ///< queue wait in us
+static uint64_t CecWaitMax;
+static uint64_t CecTxSum;               ///< transmit time in us
+static uint64_t CecTxMax;
+static uint64_t CecOpenUs;              ///< time to open the adapter
+
+static uint64_t CecTicks(void)
 {
-  
-    std::string strvalue;
-    cec_command bytes = g_parser->CommandFromString(arguments);
+    struct timespec ts;
 
-    bytes.ack = 0;
-    bytes.eom = 0;
-    bytes.transmit_timeout = 1000;
-    
-    g_parser->Transmit(bytes);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-    return 0;
+// ----------------------------------------------------------------------------
+//  libcec backend
+// ----------------------------------------------------------------------------
+
+static int LibCecOpen(const char *port)
+{
+    if (!g_parser) {
+        g_config.Clear();
+        g_callbacks.Clear();
+        snprintf(g_config.strDeviceName, LIBCEC_OSD_NAME_SIZE, "VDR CEC");
+        g_config.clientVersion      = LIBCEC_VERSION_CURRENT;
+        g_config.bActivateSource    = 0;
+        g_callbacks.logMessage      = NULL;
+        g_callbacks.keyPress        = NULL;
+        g_callbacks.commandReceived = NULL;
+        g_callbacks.alert           = NULL;
+        g_config.callbacks          = &g_callbacks;
+
+        g_config.deviceTypes.Add(CEC_DEVICE_TYPE_RECORDING_DEVICE);
+
+        if (g_cecLogLevel == -1)
+            g_cecLogLevel = g_cecDefaultLogLevel;
+
+        g_parser = CECInitialise(&g_config);
+        if (!g_parser) {
+            std::cout << "Cannot load libcec.so" << std::endl;
+            return -1;
+        }
+    }
+
+    g_strPort = port;
+    if (!g_parser->Open(g_strPort.c_str(), CEC_OPEN_TIMEOUT)) {
+        return 0;
+    }
+    return 1;
 }
 
-int cec_send_command(int dev,char *buffer) {
-    
-    cec_command tx;
-
-    tx.initiator = (cec_logical_address)1;
-    tx.destination = (cec_logical_address)dev;
-    tx.ack = 0; 
-    tx.eom = 0;
-    tx.opcode = CEC_OPCODE_USER_CONTROL_PRESSED;
-    tx.parameters.size = 1;
-    tx.opcode_set = 1;
-    tx.transmit_timeout = 1000;
-
-    if (strcmp("up",buffer) == 0) {
-        tx.parameters.data[0]= CEC_USER_CONTROL_CODE_VOLUME_UP;
-    } else {
-        tx.parameters.data[0]= CEC_USER_CONTROL_CODE_VOLUME_DOWN;
+static int LibCecParse(const char *raw, cec_command *cmd)
+{
+    *cmd = g_parser->CommandFromString(raw);
+    return 1;
+}
+
+static int LibCecTransmit(const cec_command *cmd)
+{
+    return g_parser->Transmit(*cmd);
+}
+
+static void LibCecClose(void)
+{
+    if (g_parser) {
+        CECDestroy(g_parser);
+        g_parser = NULL;
+    }
+}
+
+static const CecBackend LibCecBackend = {
+    "libcec", LibCecOpen, LibCecParse, LibCecTransmit, LibCecClose
+};
+
+// ----------------------------------------------------------------------------
+//  fake backend, CEC_ADAPTER=fake
+// ----------------------------------------------------------------------------
+
+static int FakeOpen(const char *)
+{
+    return 1;
+}
+
+static int FakeParse(const char *, cec_command *cmd)
+{
+    memset(cmd, 0, sizeof(*cmd));
+    return 1;
+}
+
+static int FakeTransmit(const cec_command *)
+{
+    usleep(CEC_FAKE_TX_US);
+    return 1;
+}
+
+static void FakeClose(void)
+{
+}
+
+static const CecBackend FakeBackend = {
+    "fake", FakeOpen, FakeParse, FakeTransmit, FakeClose
+};
+
+// ----------------------------------------------------------------------------
+//  command queue
+// ----------------------------------------------------------------------------
+
+///
+/// Add a command to the queue, caller holds CecMutex.
+///
+/// Volume steps are merged into a pending volume command for the same
+/// device, so a burst of key presses becomes one net change.
+///
+static int CecEnqueue(const CecCmd *cmd)
+{
+    CecCmd *tail;
+
+    if (CecState == CEC_STATE_FAILED) {
+        return -1;
     }
-    g_parser->Transmit(tx);
+    ++CecQueued;
+    if (cmd->Type == CEC_CMD_VOLUME && CecCount) {
+        tail = &CecQueue[(CecHead + CecCount - 1) % CEC_QUEUE_MAX];
+        if (tail->Type == CEC_CMD_VOLUME && tail->Dev == cmd->Dev) {
+            tail->Steps += cmd->Steps;
+            tail->Queued = cmd->Queued;
+            ++CecCoalesced;
+            if (!tail->Steps) {         // up and down cancel out
+                --CecCount;
+            }
+            return 0;
+        }
+    }
+    if (CecCount >= CEC_QUEUE_MAX) {
+        ++CecDropped;
+        return -1;
+    }
+    CecQueue[(CecHead + CecCount) % CEC_QUEUE_MAX] = *cmd;
+    ++CecCount;
+    pthread_cond_signal(&CecCond);
+    return 0;
+}
+
+///
+/// Take the next frame to send from the queue, caller holds CecMutex.
+///
+/// A volume command is consumed one step at a time, steps queued while
+/// the previous one is on the bus are still merged.
+///
+static int CecDequeue(cec_command *tx, uint64_t *queued)
+{
+    CecCmd *cmd;
+    uint64_t now;
+
+    now = CecTicks();
+    while (CecCount) {
+        cmd = &CecQueue[CecHead];
+        *queued = cmd->Queued;
+        if (now - cmd->Queued > CEC_STALE_MS * 1000ULL) {
+            ++CecDropped;
+            CecHead = (CecHead + 1) % CEC_QUEUE_MAX;
+            --CecCount;
+            continue;
+        }
+        if (cmd->Type == CEC_CMD_RAW) {
+            CecUsed->Parse(cmd->Raw, tx);
+            tx->ack = 0;
+            tx->eom = 0;
+            tx->transmit_timeout = 1000;
+            CecHead = (CecHead + 1) % CEC_QUEUE_MAX;
+            --CecCount;
+            return 1;
+        }
 
+        memset(tx, 0, sizeof(*tx));
+        tx->initiator = (cec_logical_address)1;
+        tx->destination = (cec_logical_address)cmd->Dev;
+        tx->opcode = CEC_OPCODE_USER_CONTROL_PRESSED;
+        tx->parameters.size = 1;
+        tx->opcode_set = 1;
+        tx->transmit_timeout = 1000;
+        if (cmd->Steps > 0) {
+            tx->parameters.data[0] = CEC_USER_CONTROL_CODE_VOLUME_UP;
+            --cmd->Steps;
+        } else {
+            tx->parameters.data[0] = CEC_USER_CONTROL_CODE_VOLUME_DOWN;
+            ++cmd->Steps;
+        }
+        if (!cmd->Steps) {
+            CecHead = (CecHead + 1) % CEC_QUEUE_MAX;
+            --CecCount;
+        }
+        return 1;
+    }
     return 0;
+}
 
+///
+/// Wait on the condition for up to ms milli seconds, caller holds CecMutex.
+///
+static void CecWait(int ms)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&CecCond, &CecMutex, &ts);
 }
 
-int cec_init() {
+///
+/// CEC worker thread.
+///
+/// Discovers the adapter in the background, retrying with back off,
+/// and then sends the queued commands.  All libcec calls are made here,
+/// so a slow bus never blocks startup or the audio control path.
+///
+static void *CecWorker(void *)
+{
+    const char *port;
+    int retry;
+    uint64_t start;
 
-    g_config.Clear();
-    g_callbacks.Clear();
-    snprintf(g_config.strDeviceName, LIBCEC_OSD_NAME_SIZE, "VDR CEC");
-    g_config.clientVersion      = LIBCEC_VERSION_CURRENT;
-    g_config.bActivateSource    = 0;
-    g_callbacks.logMessage      = NULL;
-    g_callbacks.keyPress        = NULL;
-    g_callbacks.commandReceived = NULL;
-    g_callbacks.alert           = NULL;
-    g_config.callbacks          = &g_callbacks;
+    if (!(port = getenv("CEC_ADAPTER"))) {
+        port = "AOCEC";
+    }
+    ThreadApplyProfile(THREAD_CEC);
+    retry = CEC_RETRY_MIN;
+    start = CecTicks();
 
-    g_config.deviceTypes.Add(CEC_DEVICE_TYPE_RECORDING_DEVICE);
+    pthread_mutex_lock(&CecMutex);
+    while (CecRunning) {
+        cec_command tx;
+        uint64_t queued;
+        uint64_t t;
+        uint64_t wait;
+        int ok;
 
-    if (g_cecLogLevel == -1)
-        g_cecLogLevel = g_cecDefaultLogLevel;
+        if (CecState == CEC_STATE_SEARCH) {
+            pthread_mutex_unlock(&CecMutex);
+            ok = CecUsed->Open(port);
+            pthread_mutex_lock(&CecMutex);
+            if (ok > 0) {
+                CecOpenUs = CecTicks() - start;
+                CecState = CEC_STATE_READY;
+                continue;
+            }
+            if (ok < 0) {
+                CecState = CEC_STATE_FAILED;
+                CecCount = 0;
+                break;
+            }
+            if (CecRunning) {
+                CecWait(retry);
+            }
+            retry = retry * 2 > CEC_RETRY_MAX ? CEC_RETRY_MAX : retry * 2;
+            continue;
+        }
 
+        if (!CecDequeue(&tx, &queued)) {
+            pthread_cond_wait(&CecCond, &CecMutex);
+            continue;
+        }
+        pthread_mutex_unlock(&CecMutex);
 
-    g_parser = CECInitialise(&g_config);
-    if (!g_parser)
-    {
-    
-        std::cout << "Cannot load libcec.so" << std::endl;
+        t = CecTicks();
+        wait = t - queued;
+        ok = CecUsed->Transmit(&tx);
+        t = CecTicks() - t;
 
-        if (g_parser)
-            CECDestroy(g_parser);
+        pthread_mutex_lock(&CecMutex);
+        CecWaitSum += wait;
+        if (wait > CecWaitMax) {
+            CecWaitMax = wait;
+        }
+        CecTxSum += t;
+        if (t > CecTxMax) {
+            CecTxMax = t;
+        }
+        if (ok) {
+            ++CecSent;
+        } else {
+            ++CecFailed;
+        }
+    }
+    pthread_mutex_unlock(&CecMutex);
 
-        return 0;
+    return NULL;
+}
+
+// ----------------------------------------------------------------------------
+//  C interface
+// ----------------------------------------------------------------------------
+
+int ProcessCommandTX(char *arguments)
+{
+    CecCmd cmd;
+    int ret;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.Type = CEC_CMD_RAW;
+    cmd.Queued = CecTicks();
+    snprintf(cmd.Raw, sizeof(cmd.Raw), "%s", arguments);
+
+    pthread_mutex_lock(&CecMutex);
+    ret = CecEnqueue(&cmd);
+    pthread_mutex_unlock(&CecMutex);
+
+    return ret;
+}
+
+///
+/// Queue a volume step, returns -1 when CEC is not usable.
+///
+int cec_send_command(int dev,char *buffer) {
+
+    CecCmd cmd;
+    int ret;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.Type = CEC_CMD_VOLUME;
+    cmd.Dev = dev;
+    cmd.Steps = strcmp("up", buffer) ? -1 : 1;
+    cmd.Queued = CecTicks();
+
+    pthread_mutex_lock(&CecMutex);
+    ret = CecEnqueue(&cmd);
+    pthread_mutex_unlock(&CecMutex);
+
+    return ret;
+}
+
+///
+/// CEC can be used, adapter open or discovery still running.
+///
+int cec_active() {
+    return CecRunning && CecState != CEC_STATE_FAILED;
+}
+
+///
+/// Start the CEC worker, adapter discovery continues in the background.
+///
+int cec_init() {
+
+    pthread_condattr_t attr;
+    const char *port;
+
+    if (CecRunning) {
+        return 1;
     }
+    port = getenv("CEC_ADAPTER");
+    CecUsed = port && !strcmp(port, "fake") ? &FakeBackend : &LibCecBackend;
+    CecState = CEC_STATE_SEARCH;
+    CecHead = 0;
+    CecCount = 0;
 
-    g_strPort = "AOCEC";
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&CecCond, &attr);
+    pthread_condattr_destroy(&attr);
 
-    if (!g_parser->Open(g_strPort.c_str()))
-    {
-        CECDestroy(g_parser);
+    CecRunning = 1;
+    if (pthread_create(&CecThread, NULL, CecWorker, NULL)) {
+        CecRunning = 0;
+        pthread_cond_destroy(&CecCond);
         return 0;
     }
-    
+    pthread_setname_np(CecThread, "softhddev cec");
+
     return 1;
 }
 
 int cec_exit() {
-    if (g_parser) {
-        CECDestroy(g_parser);
-        g_parser = NULL;
+    if (!CecRunning) {
+        return 0;
     }
+    pthread_mutex_lock(&CecMutex);
+    CecRunning = 0;
+    pthread_cond_signal(&CecCond);
+    pthread_mutex_unlock(&CecMutex);
+    pthread_join(CecThread, NULL);
+    pthread_cond_destroy(&CecCond);
+
+    CecUsed->Close();
+    CecState = CEC_STATE_SEARCH;
     return 0;
 }
+
+///
+/// Get CEC state and latency counters.
+///
+void cec_get_stats(char *buf, size_t size)
+{
+    static const char *const state[] = { "searching", "ready", "failed" };
+    unsigned done;
+
+    pthread_mutex_lock(&CecMutex);
+    done = CecSent + CecFailed;
+    snprintf(buf, size,
+        "adapter %s (%s), open %llu ms\n"
+        "queued %u coalesced %u dropped %u pending %d\n"
+        "sent %u failed %u\n"
+        "wait avg %llu max %llu us, transmit avg %llu max %llu us",
+        CecUsed ? CecUsed->Name : "none", CecRunning ? state[CecState] : "stopped",
+        (unsigned long long)CecOpenUs / 1000,
+        CecQueued, CecCoalesced, CecDropped, CecCount, CecSent, CecFailed,
+        (unsigned long long)(done ? CecWaitSum / done : 0), (unsigned long long)CecWaitMax,
+        (unsigned long long)(done ? CecTxSum / done : 0), (unsigned long long)CecTxMax);
+    pthread_mutex_unlock(&CecMutex);
+}
@@ -30,7 +30,7 @@
 /// many bugs and incompatiblity in it.  Don't use this shit.
 ///
 
-/// compile with pass-through support (stable, AC-3, E-AC-3 only)
+/// compile with pass-through support (stable, AC-3, E-AC-3, DTS, DTS-HD)
 #define USE_PASSTHROUGH
 /// compile audio drift correction support (very experimental)
 #define USE_AUDIO_DRIFT_CORRECTION
@@ -54,6 +54,12 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <libintl.h>
 #define _(str) gettext(str)             ///< gettext shortcut
 #define _N(str) str                     ///< gettext_noop shortcut
@@ -178,9 +184,11 @@ struct _audio_decoder_
     AVAudioResampleContext *Resample;   ///< libav software resample context
 #endif
 
-    uint16_t Spdif[24576 / 2];          ///< SPDIF output buffer
+    uint16_t Spdif[65536 / 2];          ///< SPDIF output buffer
     int SpdifIndex;                     ///< index into SPDIF output buffer
     int SpdifCount;                     ///< SPDIF repeat counter
+    int SpdifDirty;                     ///< SPDIF payload bytes not cleared
+    char DtsHd;                         ///< flag DTS-HD pass-through active
 
     int64_t LastDelay;                  ///< last delay
     struct timespec LastTime;           ///< last time
@@ -200,10 +208,18 @@ int AHandle;
 enum IEC61937
 {
     IEC61937_AC3 = 0x01,                ///< AC-3 data
-    // FIXME: more data types
+    IEC61937_DTS1 = 0x0B,               ///< DTS type I (512 samples)
+    IEC61937_DTS2 = 0x0C,               ///< DTS type II (1024 samples)
+    IEC61937_DTS3 = 0x0D,               ///< DTS type III (2048 samples)
+    IEC61937_DTSHD = 0x11,              ///< DTS-HD data
     IEC61937_EAC3 = 0x15,               ///< E-AC-3 data
 };
 
+#ifndef FF_PROFILE_DTS_HD_HRA
+#define FF_PROFILE_DTS_HD_HRA AV_PROFILE_DTS_HD_HRA
+#define FF_PROFILE_DTS_EXPRESS AV_PROFILE_DTS_EXPRESS
+#endif
+
 #ifdef USE_AUDIO_DRIFT_CORRECTION
 #define CORRECT_PCM 1                   ///< do PCM audio-drift correction
 #define CORRECT_AC3 2                   ///< do AC-3 audio-drift correction
@@ -268,6 +284,9 @@ void CodecAudioOpen(AudioDecoder * audio_decoder, int codec_id)
             case AV_CODEC_ID_EAC3:
                     amlSetInt("/sys/class/audiodsp/digital_codec", 4);
                 break;
+            case AV_CODEC_ID_DTS:
+                    amlSetInt("/sys/class/audiodsp/digital_codec", 3);
+                break;
             case AV_CODEC_ID_AAC_LATM:
                     amlSetInt("/sys/class/audiodsp/digital_codec", 0);
                 break;
@@ -408,6 +427,7 @@ void CodecSetAudioDrift(int mask)
 {
 #ifdef USE_AUDIO_DRIFT_CORRECTION
     CodecAudioDrift = mask & (CORRECT_PCM | CORRECT_AC3);
+    AudioSetDriftCorrection(mask & CORRECT_PCM);
 #endif
     (void)mask;
 }
@@ -420,7 +440,7 @@ void CodecSetAudioDrift(int mask)
 void CodecSetAudioPassthrough(int mask)
 {
 #ifdef USE_PASSTHROUGH
-    CodecPassthrough = mask & (CodecPCM | CodecAC3 | CodecEAC3);
+    CodecPassthrough = mask & (CodecPCM | CodecAC3 | CodecEAC3 | CodecDTS | CodecDTSHD);
 #endif
     (void)mask;
 }
@@ -621,7 +641,7 @@ static int CodecAudioUpdateHelper(AudioDecoder * audio_decoder, int *passthrough
 
     audio_ctx = audio_decoder->AudioCtx;
 
-    Debug(3, "codec/audio: format change %s %dHz *%d channels%s%s%s%s%s%s\n",
+    Debug(3, "codec/audio: format change %s %dHz *%d channels%s%s%s%s%s%s%s\n",
 	    av_get_sample_fmt_name(audio_ctx->sample_fmt), audio_ctx->sample_rate,
 #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(59,24,100)
 	    audio_ctx->channels, CodecPassthrough & CodecPCM ? " PCM" : "",
@@ -632,6 +652,7 @@ static int CodecAudioUpdateHelper(AudioDecoder * audio_decoder, int *passthrough
 	    CodecPassthrough & CodecAC3 ? " AC-3" : "",
 	    CodecPassthrough & CodecEAC3 ? " E-AC-3" : "",
 	    CodecPassthrough & CodecDTS ? " DTS" : "",
+	    CodecPassthrough & CodecDTSHD ? " DTS-HD" : "",
 	    CodecPassthrough ? " pass-through" : "");
 
     *passthrough = 0;
@@ -646,15 +667,24 @@ static int CodecAudioUpdateHelper(AudioDecoder * audio_decoder, int *passthrough
 #endif
    
     audio_decoder->Passthrough = CodecPassthrough;
+    audio_decoder->DtsHd = 0;
 
     // SPDIF/HDMI pass-through
     if ((CodecPassthrough & CodecAC3 && audio_ctx->codec_id == AV_CODEC_ID_AC3)
-        || (CodecPassthrough & CodecEAC3 && audio_ctx->codec_id == AV_CODEC_ID_EAC3)) {
+        || (CodecPassthrough & CodecEAC3 && audio_ctx->codec_id == AV_CODEC_ID_EAC3)
+        || (CodecPassthrough & CodecDTS && audio_ctx->codec_id == AV_CODEC_ID_DTS)) {
         if (audio_ctx->codec_id == AV_CODEC_ID_EAC3) {
             // E-AC-3 over HDMI some receivers need HBR
             audio_decoder->HwSampleRate *= 4;
         }
         audio_decoder->HwChannels = 2;
+        if (audio_ctx->codec_id == AV_CODEC_ID_DTS && CodecPassthrough & CodecDTSHD
+            && audio_ctx->profile >= FF_PROFILE_DTS_HD_HRA && audio_ctx->profile != FF_PROFILE_DTS_EXPRESS) {
+            // DTS-HD needs HBR with 8 channels at 192kHz
+            audio_decoder->DtsHd = 1;
+            audio_decoder->HwSampleRate = 192000;
+            audio_decoder->HwChannels = 8;
+        }
         audio_decoder->SpdifIndex = 0;  // reset buffer
         audio_decoder->SpdifCount = 0;
         *passthrough = 1;
@@ -668,10 +698,20 @@ static int CodecAudioUpdateHelper(AudioDecoder * audio_decoder, int *passthrough
     
     // channels/sample-rate not support?
     if ((err = AudioSetup(&audio_decoder->HwSampleRate, &audio_decoder->HwChannels, *passthrough))) {
+        int retry;
+
         // try E-AC-3 none HBR
         audio_decoder->HwSampleRate /= 4;
-        if (audio_ctx->codec_id != AV_CODEC_ID_EAC3
-            || (err = AudioSetup(&audio_decoder->HwSampleRate, &audio_decoder->HwChannels, *passthrough))) {
+        retry = audio_ctx->codec_id == AV_CODEC_ID_EAC3;
+        if (audio_decoder->DtsHd) {
+            // try DTS core only
+            Debug(3, "codec/audio: DTS-HD not supported, using DTS core\n");
+            audio_decoder->DtsHd = 0;
+            audio_decoder->HwSampleRate = audio_ctx->sample_rate;
+            audio_decoder->HwChannels = 2;
+            retry = 1;
+        }
+        if (!retry || (err = AudioSetup(&audio_decoder->HwSampleRate, &audio_decoder->HwChannels, *passthrough))) {
 
             Debug(3, "codec/audio: audio setup error\n");
             // FIXME: handle errors
@@ -693,6 +733,184 @@ static int CodecAudioUpdateHelper(AudioDecoder * audio_decoder, int *passthrough
     return 0;
 }
 
+#ifdef USE_PASSTHROUGH
+
+//----------------------------------------------------------------------------
+//  IEC 61937
+//----------------------------------------------------------------------------
+
+/**
+**  Copy big-endian audio data byte swapped into the SPDIF buffer.
+**
+**  An odd last byte is padded with zero, like the ffmpeg spdif muxer.
+**
+**  @param src  big-endian encoded audio data
+**  @param dst  SPDIF buffer (16-bit words)
+**  @param size number of bytes in src
+*/
+static void CodecSpdifSwab(const uint8_t * src, uint16_t * dst, int size)
+{
+    uint8_t *out;
+    int i;
+
+    out = (uint8_t *) dst;
+    i = 0;
+#if defined(__ARM_NEON)
+    for (; i + 16 <= size; i += 16) {
+        vst1q_u8(out + i, vrev16q_u8(vld1q_u8(src + i)));
+    }
+#elif defined(__SSE2__)
+    for (; i + 16 <= size; i += 16) {
+        __m128i v;
+
+        v = _mm_loadu_si128((const __m128i *)(src + i));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *) (out + i), v);
+    }
+#endif
+    for (; i + 2 <= size; i += 2) {
+        out[i] = src[i + 1];
+        out[i + 1] = src[i];
+    }
+    if (i < size) {                     // odd size
+        out[i] = 0;
+        out[i + 1] = src[i];
+    }
+}
+
+/**
+**  Finish and enqueue an IEC 61937 burst.
+**
+**  The payload is already placed behind the 8 byte preamble.  Only the
+**  bytes which the previous burst has left behind are cleared, the rest
+**  of the buffer is still zero.
+**
+**  @param audio_decoder    audio decoder data
+**  @param data_type        burst-info (Pc)
+**  @param length_code      length code (Pd)
+**  @param payload          number of payload bytes written
+**  @param spdif_sz         size of the burst in bytes
+*/
+static void CodecSpdifBurst(AudioDecoder * audio_decoder, int data_type, int length_code, int payload,
+    int spdif_sz)
+{
+    uint16_t *spdif;
+
+    spdif = audio_decoder->Spdif;
+    spdif[0] = htole16(0xF872);         // iec 61937 sync word
+    spdif[1] = htole16(0x4E1F);
+    spdif[2] = htole16(data_type);
+    spdif[3] = htole16(length_code);
+
+    payload = (payload + 1) & ~1;
+    if (payload < audio_decoder->SpdifDirty) {
+        memset((uint8_t *) (spdif + 4) + payload, 0, audio_decoder->SpdifDirty - payload);
+    }
+    audio_decoder->SpdifDirty = payload;
+
+    AudioEnqueue(spdif, spdif_sz);
+}
+
+/**
+**  DTS pass-through helper.
+**
+**  Packs the DTS core as IEC 61937 type I-III burst, or the complete
+**  frame (core + extension substream) as DTS-HD burst, if enabled.
+**
+**  @param audio_decoder    audio decoder data
+**  @param avpkt            undecoded audio packet
+*/
+static int CodecAudioPassthroughDts(AudioDecoder * audio_decoder, const AVPacket * avpkt)
+{
+    static const int dts_rates[16] = { 0, 8000, 16000, 32000, 0, 0, 11025, 22050, 44100, 0, 0, 12000,
+        24000, 48000, 96000, 192000
+    };
+    const uint8_t *p;
+    uint16_t *spdif;
+    int blocks;
+    int core_size;
+    int sample_rate;
+    int spdif_sz;
+
+    p = avpkt->data;
+    spdif = audio_decoder->Spdif;
+
+    // only 16-bit big-endian core sync is used in broadcast and on disc
+    if (avpkt->size < 10 || p[0] != 0x7F || p[1] != 0xFE || p[2] != 0x80 || p[3] != 0x01) {
+        Error(_("codec/audio: unsupported DTS frame\n"));
+        return -1;
+    }
+    blocks = (((p[4] & 0x01) << 6) | (p[5] >> 2)) + 1;
+    core_size = (((p[5] & 0x03) << 12) | (p[6] << 4) | (p[7] >> 4)) + 1;
+    sample_rate = dts_rates[(p[8] >> 2) & 0x0F];
+    if (!sample_rate || core_size > avpkt->size) {
+        Error(_("codec/audio: invalid DTS header\n"));
+        return -1;
+    }
+
+    if (audio_decoder->DtsHd) {
+        // DTS-HD header: start code + payload size, stored byte swapped
+        static const uint8_t dtshd_start_code[10] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFE, 0xFE };
+        uint8_t *hd;
+        int period;
+        int subtype;
+        int length;
+
+        period = 768000 * (blocks << 5) / sample_rate;
+        for (subtype = 0; subtype < 6 && (512 << subtype) != period; ++subtype) ;
+        if (subtype == 6) {
+            Error(_("codec/audio: unsupported DTS-HD period %d\n"), period);
+            return -1;
+        }
+        spdif_sz = period * 4;
+        length = ((12 + avpkt->size + 8 + 15) & ~15) - 8;
+        if (spdif_sz < length + 8) {
+            Error(_("codec/audio: decoded data smaller than encoded\n"));
+            return -1;
+        }
+        hd = (uint8_t *) (spdif + 4);
+        memcpy(hd, dtshd_start_code, sizeof(dtshd_start_code));
+        hd[10] = avpkt->size & 0xFF;
+        hd[11] = avpkt->size >> 8;
+        CodecSpdifSwab(p, spdif + 4 + 6, avpkt->size);
+        CodecSpdifBurst(audio_decoder, IEC61937_DTSHD | subtype << 8, length, 12 + avpkt->size, spdif_sz);
+        return 1;
+    }
+
+    switch (blocks << 5) {
+        case 512:
+            spdif_sz = IEC61937_DTS1;
+            break;
+        case 1024:
+            spdif_sz = IEC61937_DTS2;
+            break;
+        case 2048:
+            spdif_sz = IEC61937_DTS3;
+            break;
+        default:
+            Error(_("codec/audio: unsupported DTS with %d samples\n"), blocks << 5);
+            return -1;
+    }
+    if (core_size == blocks << 7) {
+        // core fills the complete burst, send it without preamble
+        CodecSpdifSwab(p, spdif, core_size);
+        if (core_size - 8 > audio_decoder->SpdifDirty) {
+            audio_decoder->SpdifDirty = core_size - 8;
+        }
+        AudioEnqueue(spdif, core_size);
+        return 1;
+    }
+    if (core_size + 8 > blocks << 7) {
+        Error(_("codec/audio: decoded data smaller than encoded\n"));
+        return -1;
+    }
+    CodecSpdifSwab(p, spdif + 4, core_size);
+    CodecSpdifBurst(audio_decoder, spdif_sz, core_size * 8, core_size, blocks << 7);
+    return 1;
+}
+
+#endif
+
 /**
 **  Audio pass-through decoder helper.
 **
@@ -707,10 +925,8 @@ int CodecAudioPassthroughHelper(AudioDecoder * audio_decoder, const AVPacket * a
     audio_ctx = audio_decoder->AudioCtx;
     // SPDIF/HDMI passthrough
     if (CodecPassthrough & CodecAC3 && audio_ctx->codec_id == AV_CODEC_ID_AC3) {
-        uint16_t *spdif;
         int spdif_sz;
 
-        spdif = audio_decoder->Spdif;
         spdif_sz = 6144;
 
 #ifdef USE_AC3_DRIFT_CORRECTION
@@ -741,27 +957,19 @@ int CodecAudioPassthroughHelper(AudioDecoder * audio_decoder, const AVPacket * a
             Error(_("codec/audio: decoded data smaller than encoded\n"));
             return -1;
         }
-        spdif[0] = htole16(0xF872);     // iec 61937 sync word
-        spdif[1] = htole16(0x4E1F);
-        spdif[2] = htole16(IEC61937_AC3 | (avpkt->data[5] & 0x07) << 8);
-        spdif[3] = htole16(avpkt->size * 8);
         // copy original data for output
-        // FIXME: not 100% sure, if endian is correct on not intel hardware
-        swab(avpkt->data, spdif + 4, avpkt->size);
-        // FIXME: don't need to clear always
-        memset(spdif + 4 + avpkt->size / 2, 0, spdif_sz - 8 - avpkt->size);
+        CodecSpdifSwab(avpkt->data, audio_decoder->Spdif + 4, avpkt->size);
         // don't play with the ac-3 samples
-        AudioEnqueue(spdif, spdif_sz);
+        CodecSpdifBurst(audio_decoder, IEC61937_AC3 | (avpkt->data[5] & 0x07) << 8, avpkt->size * 8,
+            avpkt->size, spdif_sz);
         return 1;
     }
     if (CodecPassthrough & CodecEAC3 && audio_ctx->codec_id == AV_CODEC_ID_EAC3) {
-        uint16_t *spdif;
         int spdif_sz;
         int repeat;
 
         // build SPDIF header and append A52 audio to it
         // avpkt is the original data
-        spdif = audio_decoder->Spdif;
         spdif_sz = 24576;               // 4 * 6144
         if (audio_decoder->HwSampleRate == 48000) {
             spdif_sz = 6144;
@@ -772,7 +980,7 @@ int CodecAudioPassthroughHelper(AudioDecoder * audio_decoder, const AVPacket * a
         }
         // check if we must pack multiple packets
         repeat = 1;
-        if ((avpkt->data[4] & 0xc0) != 0xc0) {  // fscod
+        if ((avpkt->data[5] >> 3) > 10 && (avpkt->data[4] & 0xc0) != 0xc0) {  // bsid, fscod
             static const uint8_t eac3_repeat[4] = { 6, 3, 2, 1 };
 
             // fscod2
@@ -782,26 +990,23 @@ int CodecAudioPassthroughHelper(AudioDecoder * audio_decoder, const AVPacket * a
 
         // copy original data for output
         // pack upto repeat EAC-3 pakets into one IEC 61937 burst
-        // FIXME: not 100% sure, if endian is correct on not intel hardware
-        swab(avpkt->data, spdif + 4 + audio_decoder->SpdifIndex, avpkt->size);
+        CodecSpdifSwab(avpkt->data, audio_decoder->Spdif + 4 + audio_decoder->SpdifIndex / 2, avpkt->size);
         audio_decoder->SpdifIndex += avpkt->size;
         if (++audio_decoder->SpdifCount < repeat) {
             return 1;
         }
 
-        spdif[0] = htole16(0xF872);     // iec 61937 sync word
-        spdif[1] = htole16(0x4E1F);
-        spdif[2] = htole16(IEC61937_EAC3);
-        spdif[3] = htole16(audio_decoder->SpdifIndex * 8);
-        memset(spdif + 4 + audio_decoder->SpdifIndex / 2, 0, spdif_sz - 8 - audio_decoder->SpdifIndex);
-
-        // don't play with the eac-3 samples
-        AudioEnqueue(spdif, spdif_sz);
+        // don't play with the eac-3 samples, the length code is in bytes
+        CodecSpdifBurst(audio_decoder, IEC61937_EAC3, audio_decoder->SpdifIndex, audio_decoder->SpdifIndex,
+            spdif_sz);
 
         audio_decoder->SpdifIndex = 0;
         audio_decoder->SpdifCount = 0;
         return 1;
     }
+    if (CodecPassthrough & CodecDTS && audio_ctx->codec_id == AV_CODEC_ID_DTS) {
+        return CodecAudioPassthroughDts(audio_decoder, avpkt);
+    }
 #endif
     return 0;
 }
@@ -841,7 +1046,7 @@ static void CodecAudioSetClock(AudioDecoder * audio_decoder, int64_t pts)
         return;
     }
     // collect over some time
-    pts_diff = pts - audio_decoder->LastPTS;
+    pts_diff = PtsDiff(audio_decoder->LastPTS, pts);
     if (pts_diff < 10 * 1000 * 90) {
         return;
     }
@@ -31,7 +31,8 @@
 #define CodecMPA 0x02                   ///< MPA bit mask (planned)
 #define CodecAC3 0x04                   ///< AC-3 bit mask
 #define CodecEAC3 0x08                  ///< E-AC-3 bit mask
-#define CodecDTS 0x10                   ///< DTS bit mask (planned)
+#define CodecDTS 0x10                   ///< DTS bit mask
+#define CodecDTSHD 0x20                 ///< DTS-HD bit mask
 
 #define AVCODEC_MAX_AUDIO_FRAME_SIZE 192000
 
@@ -65,6 +66,9 @@ extern void CodecVideoDecode(VideoDecoder * , const AVPacket * ) ;
 /// Close video codec.
 extern void CodecVideoClose(VideoHwDecoder *);
 
+/// Park video codec on channel switch.
+extern void CodecVideoPark(VideoHwDecoder *);
+
 /// Flush video buffers.
 extern void CodecVideoFlushBuffers(VideoDecoder *);
 
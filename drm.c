@@ -25,6 +25,18 @@ VideoRender *render;
 
 int DRMRefresh = 50; 
 
+#define DRM_MODES_MAX 64				///< max. cached connector modes
+
+static drmModeModeInfo DrmModes[DRM_MODES_MAX];	///< cached connector modes
+static int DrmModeCount;				///< number of cached modes
+static int DrmModeRequest = -1;			///< mode index to commit or -1
+static int DrmRefreshStop;				///< stop the refresh worker
+static pthread_t DrmRefreshThread;		///< refresh worker thread
+static int DrmRefreshRunning;			///< refresh worker started
+/// locks the request and render->mode, once the refresh worker runs
+static pthread_mutex_t DrmRefreshMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t DrmRefreshCond = PTHREAD_COND_INITIALIZER;
+
 //----------------------------------------------------------------------------
 //  Helper functions
 //----------------------------------------------------------------------------
@@ -164,27 +176,200 @@ static int SetPropertyRequest(drmModeAtomicReqPtr ModeReq, int fd_drm, uint32_t
     return drmModeAtomicAddProperty(ModeReq, objectID, id, value);
 }
 
-void set_video_mode(int width, int height) {
-    drmModeConnector *connector;
-    drmModeModeInfo *mode;
-    int ii;
-    printf("Set video mode %d &%d\n",width,height);
-    if (height != 1080 && height != 2160)
-        return;
-    connector = drmModeGetConnector(render->fd_drm, render->connector_id);
-    for (ii = 0; ii < connector->count_modes; ii++) {
-        mode = &connector->modes[ii];
-        printf("Mode %d %dx%d Rate %d\n", ii, mode->hdisplay, mode->vdisplay, mode->vrefresh);
-        if (width == mode->hdisplay && height == mode->vdisplay && mode->vrefresh == DRMRefresh &&
-            render->mode.hdisplay != width && render->mode.vdisplay != height &&
-            !(mode->flags & DRM_MODE_FLAG_INTERLACE)) {
-            memcpy(&render->mode, mode, sizeof(drmModeModeInfo));
-            VideoWindowWidth = mode->hdisplay;
-            VideoWindowHeight = mode->vdisplay;
-            Debug(3, "Set new mode %d:%d\n", mode->hdisplay, mode->vdisplay);
+///
+/// Refresh rate of a mode in mHz, computed from the timings.
+///
+static int DrmModeRefresh(const drmModeModeInfo *mode) {
+    int64_t refresh;
+
+    if (!mode->htotal || !mode->vtotal) {
+        return mode->vrefresh * 1000;
+    }
+    refresh = (int64_t)mode->clock * 1000000 / ((int64_t)mode->htotal * mode->vtotal);
+    if (mode->flags & DRM_MODE_FLAG_INTERLACE)
+        refresh *= 2;
+    if (mode->flags & DRM_MODE_FLAG_DBLSCAN)
+        refresh /= 2;
+    if (mode->vscan > 1)
+        refresh /= mode->vscan;
+    return refresh;
+}
+
+///
+/// Find the mode for a frame rate in a mode table.
+///
+/// Searches progressive modes of the given size for a refresh that is
+/// an integer multiple of the frame rate (0.05% tolerance, to tell
+/// 59.94 from 60 Hz). Film rates prefer the lowest multiple, all other
+/// rates the lowest multiple of at least 48 Hz.
+///
+/// @param modes    mode table
+/// @param count    number of modes in table
+/// @param width    display width
+/// @param height   display height
+/// @param rate     frame rate in mHz
+///
+/// @returns index of the mode or -1 if none matches
+///
+static int DrmFindRefreshMode(const drmModeModeInfo *modes, int count, int width, int height, int rate) {
+    int best = -1;
+    int best_refresh = 0;
+    int i;
+
+    if (rate <= 0) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        const drmModeModeInfo *mode = &modes[i];
+        int refresh;
+        int k;
+
+        if (mode->hdisplay != width || mode->vdisplay != height || (mode->flags & DRM_MODE_FLAG_INTERLACE)) {
+            continue;
+        }
+        refresh = DrmModeRefresh(mode);
+        k = (refresh + rate / 2) / rate;
+        if (k < 1 || llabs((int64_t)refresh - (int64_t)k * rate) * 2000 > (int64_t)refresh) {
+            continue;
+        }
+        if (rate > 24500 && refresh < 48000) {  // no 25/30 Hz modes for video
+            continue;
+        }
+        if (best < 0 || refresh < best_refresh) {
+            best = i;
+            best_refresh = refresh;
+        }
+    }
+    return best;
+}
+
+///
+/// Commit a mode, called from the refresh worker.
+///
+static int DrmCommitMode(const drmModeModeInfo *mode) {
+    drmModeAtomicReqPtr ModeReq;
+    uint32_t modeID = 0;
+    int ret;
+
+    if (drmModeCreatePropertyBlob(render->fd_drm, mode, sizeof(*mode), &modeID) != 0) {
+        fprintf(stderr, "Failed to create mode property.\n");
+        return -1;
+    }
+    if (!(ModeReq = drmModeAtomicAlloc())) {
+        drmModeDestroyPropertyBlob(render->fd_drm, modeID);
+        return -1;
+    }
+    SetPropertyRequest(ModeReq, render->fd_drm, render->crtc_id, DRM_MODE_OBJECT_CRTC, "MODE_ID", modeID);
+    SetPropertyRequest(ModeReq, render->fd_drm, render->connector_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID",
+                       render->crtc_id);
+    SetPropertyRequest(ModeReq, render->fd_drm, render->crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE", 1);
+
+    // the previous commit may still be pending
+    for (int i = 0; i < 25; i++) {
+        ret = drmModeAtomicCommit(render->fd_drm, ModeReq,
+                                  DRM_MODE_ATOMIC_ALLOW_MODESET | DRM_MODE_ATOMIC_NONBLOCK, NULL);
+        if (!ret || errno != EBUSY)
+            break;
+        usleep(20 * 1000);
+    }
+    if (ret)
+        fprintf(stderr, "cannot set atomic mode (%d): %m\n", errno);
+
+    drmModeDestroyPropertyBlob(render->fd_drm, modeID);
+    drmModeAtomicFree(ModeReq);
+    return ret;
+}
+
+///
+/// Refresh worker, commits requested modes off the decoder thread.
+///
+static void *DrmRefreshWorker(void *dummy) {
+    (void)dummy;
+    ThreadApplyProfile(THREAD_DRM);
+
+    pthread_mutex_lock(&DrmRefreshMutex);
+    for (;;) {
+        int index;
+        int ok;
+
+        while (DrmModeRequest < 0 && !DrmRefreshStop) {
+            pthread_cond_wait(&DrmRefreshCond, &DrmRefreshMutex);
+        }
+        if (DrmRefreshStop) {
             break;
         }
+        index = DrmModeRequest;
+        DrmModeRequest = -1;
+        pthread_mutex_unlock(&DrmRefreshMutex);
+
+        uint32_t tick = GetMsTicks();
+        if (drmSetMaster(render->fd_drm) < 0) {
+            Debug(3, "drm: refresh switch without master: %s\n", strerror(errno));
+        }
+        ok = !DrmCommitMode(&DrmModes[index]);
+        drmDropMaster(render->fd_drm);
+
+        pthread_mutex_lock(&DrmRefreshMutex);
+        if (ok) {
+            memcpy(&render->mode, &DrmModes[index], sizeof(drmModeModeInfo));
+            Debug(3, "drm: switched to %dx%d@%.3f in %dms\n", render->mode.hdisplay, render->mode.vdisplay,
+                  DrmModeRefresh(&render->mode) / 1000.0, GetMsTicks() - tick);
+        }
+    }
+    pthread_mutex_unlock(&DrmRefreshMutex);
+    return NULL;
+}
+
+///
+/// Switch the display refresh to match a frame rate.
+///
+/// Only looks up the cached mode table and queues the mode, the commit
+/// is done by the refresh worker.  A rate of the running mode drops a
+/// queued request.
+///
+/// @param rate     frame rate in mHz
+///
+void VideoSetContentRate(int rate) {
+    int index;
+
+    if (!ConfigVideoAutoRefresh || !DrmRefreshRunning || !DrmModeCount) {
+        return;
+    }
+    pthread_mutex_lock(&DrmRefreshMutex);
+    index = DrmFindRefreshMode(DrmModes, DrmModeCount, render->mode.hdisplay, render->mode.vdisplay, rate);
+    if (index >= 0) {
+        if (memcmp(&DrmModes[index], &render->mode, sizeof(drmModeModeInfo))) {
+            DrmModeRequest = index;
+            pthread_cond_signal(&DrmRefreshCond);
+        } else {
+            DrmModeRequest = -1;
+        }
+    }
+    pthread_mutex_unlock(&DrmRefreshMutex);
+    if (index < 0) {
+        Debug(3, "drm: no mode for %.3f fps\n", rate / 1000.0);
+    }
+}
+
+///
+/// Select a display mode of the given size at the refresh of the stream.
+///
+void set_video_mode(int width, int height) {
+    int index;
+
+    if (!render)
+        return;
+    index = DrmFindRefreshMode(DrmModes, DrmModeCount, width, height, FrameRate * 1000);
+    if (index < 0)
+        index = DrmFindRefreshMode(DrmModes, DrmModeCount, width, height, DRMRefresh * 1000);
+    pthread_mutex_lock(&DrmRefreshMutex);
+    if (index >= 0 && memcmp(&render->mode, &DrmModes[index], sizeof(drmModeModeInfo))) {
+        memcpy(&render->mode, &DrmModes[index], sizeof(drmModeModeInfo));
+        VideoWindowWidth = render->mode.hdisplay;
+        VideoWindowHeight = render->mode.vdisplay;
+        Debug(3, "Set new mode %d:%d\n", render->mode.hdisplay, render->mode.vdisplay);
     }
+    pthread_mutex_unlock(&DrmRefreshMutex);
 }
 
 static int FindDevice(VideoRender *render) {
@@ -292,6 +477,9 @@ static int FindDevice(VideoRender *render) {
             render->crtc_id = encoder->crtc_id;
 
             memcpy(&render->mode, &connector->modes[0], sizeof(drmModeModeInfo)); // set fallback
+            // cache modes, a connector query probes the EDID
+            DrmModeCount = connector->count_modes < DRM_MODES_MAX ? connector->count_modes : DRM_MODES_MAX;
+            memcpy(DrmModes, connector->modes, DrmModeCount * sizeof(drmModeModeInfo));
             // search Modes for Connector
             for (ii = 0; ii < connector->count_modes; ii++) {
                 mode = &connector->modes[ii];
@@ -397,7 +585,10 @@ static int FindDevice(VideoRender *render) {
 ///
 /// Initialize video output module.
 ///
-void VideoInitDrm() {
+/// @param modeset  set the mode from command line, else keep the
+///                 running mode and only prepare refresh switches
+///
+void VideoInitDrm(int modeset) {
 
     if (!(render = calloc(1, sizeof(*render)))) {
        Debug(3,"video/DRM: out of memory\n");
@@ -409,44 +600,64 @@ void VideoInitDrm() {
         return;
     }
 
-    drmModeAtomicReqPtr ModeReq;
-    const uint32_t flags = DRM_MODE_ATOMIC_ALLOW_MODESET;
-    uint32_t modeID = 0;
-
-    if (drmModeCreatePropertyBlob(render->fd_drm, &render->mode, sizeof(render->mode), &modeID) != 0) {
-        fprintf(stderr, "Failed to create mode property.\n");
-        return;
-    }
-    if (!(ModeReq = drmModeAtomicAlloc())) {
-        fprintf(stderr, "cannot allocate atomic request (%d): %m\n", errno);
-        return;
-    }
-    //printf("set CRTC %d of Connector %d aktiv\n", render->crtc_id, render->connector_id);
-    SetPropertyRequest(ModeReq, render->fd_drm, render->crtc_id, DRM_MODE_OBJECT_CRTC, "MODE_ID", modeID);
-    SetPropertyRequest(ModeReq, render->fd_drm, render->connector_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID",
-                       render->crtc_id);
-    SetPropertyRequest(ModeReq, render->fd_drm, render->crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE", 1);
+    if (!modeset && render->saved_crtc && render->saved_crtc->mode_valid) {
+        memcpy(&render->mode, &render->saved_crtc->mode, sizeof(drmModeModeInfo));
+        VideoWindowWidth = render->mode.hdisplay;
+        VideoWindowHeight = render->mode.vdisplay;
+    } else {
+        drmModeAtomicReqPtr ModeReq;
+        const uint32_t flags = DRM_MODE_ATOMIC_ALLOW_MODESET;
+        uint32_t modeID = 0;
+
+        if (drmModeCreatePropertyBlob(render->fd_drm, &render->mode, sizeof(render->mode), &modeID) != 0) {
+            fprintf(stderr, "Failed to create mode property.\n");
+            return;
+        }
+        if (!(ModeReq = drmModeAtomicAlloc())) {
+            fprintf(stderr, "cannot allocate atomic request (%d): %m\n", errno);
+            return;
+        }
+        //printf("set CRTC %d of Connector %d aktiv\n", render->crtc_id, render->connector_id);
+        SetPropertyRequest(ModeReq, render->fd_drm, render->crtc_id, DRM_MODE_OBJECT_CRTC, "MODE_ID", modeID);
+        SetPropertyRequest(ModeReq, render->fd_drm, render->connector_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID",
+                           render->crtc_id);
+        SetPropertyRequest(ModeReq, render->fd_drm, render->crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE", 1);
 
-    if (drmModeAtomicCommit(render->fd_drm, ModeReq, flags, NULL) != 0)
-        fprintf(stderr, "cannot set atomic mode (%d): %m\n", errno);
+        if (drmModeAtomicCommit(render->fd_drm, ModeReq, flags, NULL) != 0)
+            fprintf(stderr, "cannot set atomic mode (%d): %m\n", errno);
 
-    if (drmModeDestroyPropertyBlob(render->fd_drm, modeID) != 0)
-        fprintf(stderr, "cannot destroy property blob (%d): %m\n", errno);
+        if (drmModeDestroyPropertyBlob(render->fd_drm, modeID) != 0)
+            fprintf(stderr, "cannot destroy property blob (%d): %m\n", errno);
 
-    drmModeAtomicFree(ModeReq);
+        drmModeAtomicFree(ModeReq);
+    }
     drmDropMaster(render->fd_drm);
-    close(render->fd_drm);
-    free(render);
-}
 
+    // keep the device for refresh switches
+    DrmRefreshStop = 0;
+    DrmRefreshRunning = !pthread_create(&DrmRefreshThread, NULL, DrmRefreshWorker, NULL);
+}
 
-#if 0
-static void drm_clean_up() {
+///
+/// Cleanup video output module.
+///
+void VideoExitDrm() {
    
     if (!render)
         return;
-    drmDropMaster(render->fd_drm);
+    if (DrmRefreshRunning) {
+        pthread_mutex_lock(&DrmRefreshMutex);
+        DrmRefreshStop = 1;
+        pthread_cond_signal(&DrmRefreshCond);
+        pthread_mutex_unlock(&DrmRefreshMutex);
+        pthread_join(DrmRefreshThread, NULL);
+        DrmRefreshRunning = 0;
+    }
+
+    if (render->saved_crtc)
+        drmModeFreeCrtc(render->saved_crtc);
     close(render->fd_drm);
     free(render);
-}
-#endif
\ No newline at end of file
+    render = NULL;
+    DrmModeCount = 0;
+}
\ No newline at end of file
@@ -0,0 +1,575 @@
+///
+/// @file log.c	@brief Log module
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// @defgroup Log The log module.
+///
+/// Asynchronous syslog backend.
+///
+/// Every thread logs into its own lock free ring with one writer and
+/// one reader.  The caller only stores the format pointer and the raw
+/// arguments, the formatting and the syslog call are done by a
+/// background thread.  Format strings must be literals or otherwise
+/// live as long as the plugin, string arguments are copied.
+///
+/// A token bucket per thread limits the message rate, lost messages are
+/// counted and reported by the writer.
+///
+/// Fatal errors are written by the caller, after the queued messages of
+/// its thread, so they reach syslog before the abort.
+///
+
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "iatomic.h"
+#include "misc.h"
+
+#ifndef HAVE_PTHREAD_NAME
+    /// only available with newer glibc
+#define pthread_setname_np(thread, name)
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//  Defines
+//////////////////////////////////////////////////////////////////////////////
+
+#define LOG_SLOTS 256                   ///< records per thread, power of 2
+#define LOG_RECORD_SIZE 256             ///< bytes per record
+#define LOG_LINE_MAX 1024               ///< max. length of a formatted line
+#define LOG_INTERVAL 20                 ///< writer poll interval in ms
+#define LOG_RATE 1000                   ///< messages per second and thread
+#define LOG_BURST 200                   ///< max. messages in a burst
+
+//////////////////////////////////////////////////////////////////////////////
+//  Declares
+//////////////////////////////////////////////////////////////////////////////
+
+/// log record
+typedef struct _log_record_
+{
+    const char *Format;                 ///< format, NULL = text in Args
+    int Errno;                          ///< errno of the caller for %m
+    int Length;                         ///< used bytes of Args
+    char Args[LOG_RECORD_SIZE - sizeof(const char *) - 2 * sizeof(int)];
+} LogRecord;
+
+/// per thread log ring
+typedef struct _log_ring_
+{
+    struct _log_ring_ *Next;            ///< next ring of all rings
+    atomic_t Used;                      ///< ring is owned by a thread
+    atomic_t Head;                      ///< records written, by the owner
+    atomic_t Tail;                      ///< records read, by the writer
+    atomic_t Tokens;                    ///< messages left in this burst
+    atomic_t Dropped;                   ///< messages lost
+    LogRecord Record[LOG_SLOTS];        ///< records
+} LogRing;
+
+//////////////////////////////////////////////////////////////////////////////
+//  Variables
+//////////////////////////////////////////////////////////////////////////////
+
+static pthread_once_t LogOnce = PTHREAD_ONCE_INIT;  ///< start the writer once
+static pthread_key_t LogKey;            ///< releases the ring of a thread
+static pthread_t LogThread;             ///< background writer thread
+static atomic_t LogRunning;             ///< writer thread running
+    /// only one reader of the rings, the writer or a fatal error
+static pthread_mutex_t LogMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static LogRing *volatile LogRings;      ///< all rings, never freed
+
+static __thread LogRing *LogThreadRing; ///< ring of the current thread
+
+//////////////////////////////////////////////////////////////////////////////
+//  Functions
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+**	Parse a printf conversion specification.
+**
+**	@param spec	points after the '%'
+**	@param[out] length	length modifier, 'H' for hh and 'q' for ll
+**
+**	@returns pointer to the conversion character, NULL for a
+**	specification the log can't defer.
+*/
+static const char *LogParseSpec(const char *spec, int *length)
+{
+    while (*spec && strchr("-+ #0'", *spec)) {
+        spec++;
+    }
+    while (*spec >= '0' && *spec <= '9') {
+        spec++;
+    }
+    if (*spec == '.') {
+        spec++;
+        while (*spec >= '0' && *spec <= '9') {
+            spec++;
+        }
+    }
+    *length = 0;
+    switch (*spec) {
+        case 'h':
+            *length = spec[1] == 'h' ? (spec++, 'H') : 'h';
+            spec++;
+            break;
+        case 'l':
+            *length = spec[1] == 'l' ? (spec++, 'q') : 'l';
+            spec++;
+            break;
+        case 'z':
+        case 'j':
+        case 't':
+            *length = *spec++;
+            break;
+    }
+    return *spec && strchr("diouxXcsfFeEgGaApm%", *spec) ? spec : NULL;
+}
+
+/**
+**	Store the arguments of a format in a record.
+**
+**	@param record	log record
+**	@param format	printf format
+**	@param ap	arguments
+**
+**	@returns true if all arguments are stored.
+*/
+static int LogPack(LogRecord * record, const char *format, va_list ap)
+{
+    char *args;
+    char *end;
+    const char *s;
+
+    args = record->Args;
+    end = record->Args + sizeof(record->Args);
+    for (s = format; (s = strchr(s, '%'));) {
+        int length;
+        int64_t i;
+        double d;
+        void *p;
+        const char *str;
+        size_t n;
+
+        if (!(s = LogParseSpec(s + 1, &length))) {
+            return 0;
+        }
+        switch (*s++) {
+            case 'd':
+            case 'i':
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'c':
+                switch (length) {
+                    case 'l':
+                        i = va_arg(ap, long);
+                        break;
+                    case 'q':
+                        i = va_arg(ap, long long);
+                        break;
+                    case 'z':
+                        i = va_arg(ap, size_t);
+                        break;
+                    case 'j':
+                        i = va_arg(ap, intmax_t);
+                        break;
+                    case 't':
+                        i = va_arg(ap, ptrdiff_t);
+                        break;
+                    default:
+                        i = va_arg(ap, int);
+                        break;
+                }
+                if (args + sizeof(i) > end) {
+                    return 0;
+                }
+                memcpy(args, &i, sizeof(i));
+                args += sizeof(i);
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                d = va_arg(ap, double);
+                if (args + sizeof(d) > end) {
+                    return 0;
+                }
+                memcpy(args, &d, sizeof(d));
+                args += sizeof(d);
+                break;
+            case 'p':
+                p = va_arg(ap, void *);
+                if (args + sizeof(p) > end) {
+                    return 0;
+                }
+                memcpy(args, &p, sizeof(p));
+                args += sizeof(p);
+                break;
+            case 's':
+                if (!(str = va_arg(ap, const char *))) {
+                    str = "(null)";
+                }
+                n = strnlen(str, end - args);
+                if (args + n >= end) {
+                    return 0;
+                }
+                memcpy(args, str, n);
+                args[n] = '\0';
+                args += n + 1;
+                break;
+            default:                   // %m and %%
+                break;
+        }
+    }
+    record->Length = args - record->Args;
+    return 1;
+}
+
+/**
+**	Format a record.
+**
+**	@param record	log record
+**	@param[out] line	output buffer with LOG_LINE_MAX bytes
+*/
+static void LogFormat(const LogRecord * record, char *line)
+{
+    const char *args;
+    const char *s;
+    char *out;
+    char *end;
+
+    if (!record->Format) {
+        snprintf(line, LOG_LINE_MAX, "%s", record->Args);
+        return;
+    }
+    args = record->Args;
+    out = line;
+    end = line + LOG_LINE_MAX - 1;
+    for (s = record->Format; *s && out < end;) {
+        const char *e;
+        char spec[32];
+        int length;
+        int64_t i;
+        double d;
+        void *p;
+        int n;
+
+        if (*s != '%') {
+            *out++ = *s++;
+            continue;
+        }
+        e = LogParseSpec(s + 1, &length) + 1;
+        if (e - s >= (int)sizeof(spec)) {  // packed, so parsed fine before
+            break;
+        }
+        memcpy(spec, s, e - s);
+        spec[e - s] = '\0';
+        n = 0;
+        switch (e[-1]) {
+            case 'd':
+            case 'i':
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'c':
+                memcpy(&i, args, sizeof(i));
+                args += sizeof(i);
+                switch (length) {
+                    case 'l':
+                        n = snprintf(out, end - out + 1, spec, (long)i);
+                        break;
+                    case 'q':
+                        n = snprintf(out, end - out + 1, spec, (long long)i);
+                        break;
+                    case 'z':
+                        n = snprintf(out, end - out + 1, spec, (size_t) i);
+                        break;
+                    case 'j':
+                        n = snprintf(out, end - out + 1, spec, (intmax_t) i);
+                        break;
+                    case 't':
+                        n = snprintf(out, end - out + 1, spec, (ptrdiff_t) i);
+                        break;
+                    default:
+                        n = snprintf(out, end - out + 1, spec, (int)i);
+                        break;
+                }
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                memcpy(&d, args, sizeof(d));
+                args += sizeof(d);
+                n = snprintf(out, end - out + 1, spec, d);
+                break;
+            case 'p':
+                memcpy(&p, args, sizeof(p));
+                args += sizeof(p);
+                n = snprintf(out, end - out + 1, spec, p);
+                break;
+            case 's':
+                n = snprintf(out, end - out + 1, spec, args);
+                args += strlen(args) + 1;
+                break;
+            case 'm':
+                n = snprintf(out, end - out + 1, "%s", strerror(record->Errno));
+                break;
+            case '%':
+                *out = '%';
+                n = 1;
+                break;
+        }
+        out += n < end - out ? n : end - out;
+        s = e;
+    }
+    *out = '\0';
+}
+
+/**
+**	Write the queued records of a ring.
+**
+**	Called with #LogMutex locked.
+**
+**	@param ring	log ring
+*/
+static void LogFlushRing(LogRing * ring)
+{
+    char line[LOG_LINE_MAX];
+    unsigned head;
+    unsigned tail;
+    int dropped;
+
+    head = atomic_read(&ring->Head);
+    for (tail = atomic_read(&ring->Tail); tail != head; tail++) {
+        LogFormat(&ring->Record[tail & (LOG_SLOTS - 1)], line);
+        syslog(LOG_ERR, "%s", line);
+        atomic_set(&ring->Tail, tail + 1);
+    }
+    // counted down after the report, the drops are pending until written
+    if ((dropped = atomic_read(&ring->Dropped))) {
+        syslog(LOG_ERR, "log: %d messages dropped\n", dropped);
+        atomic_sub(dropped, &ring->Dropped);
+    }
+}
+
+/**
+**	Write all queued records of all rings.
+*/
+static void LogFlush(void)
+{
+    LogRing *ring;
+
+    pthread_mutex_lock(&LogMutex);
+    for (ring = __atomic_load_n(&LogRings, __ATOMIC_ACQUIRE); ring; ring = ring->Next) {
+        int tokens;
+
+        LogFlushRing(ring);
+        // refill the token bucket
+        tokens = atomic_read(&ring->Tokens);
+        if (tokens < LOG_BURST) {
+            tokens = LOG_BURST - tokens;
+            atomic_add(tokens < LOG_RATE * LOG_INTERVAL / 1000 ? tokens : LOG_RATE * LOG_INTERVAL / 1000,
+                &ring->Tokens);
+        }
+    }
+    pthread_mutex_unlock(&LogMutex);
+}
+
+/**
+**	Log writer thread.
+**
+**	@param dummy	unused thread argument
+*/
+static void *LogWriterThread(void *dummy)
+{
+    (void)dummy;
+    while (atomic_read(&LogRunning)) {
+        LogFlush();
+        usleep(LOG_INTERVAL * 1000);
+    }
+    LogFlush();
+
+    return dummy;
+}
+
+/**
+**	Release the ring of an exiting thread.
+**
+**	@param ring	ring of the thread
+*/
+static void LogRelease(void *ring)
+{
+    atomic_set(&((LogRing *) ring)->Used, 0);
+}
+
+/**
+**	Start the log writer, called once.
+*/
+static void LogStart(void)
+{
+    pthread_key_create(&LogKey, LogRelease);
+    atomic_set(&LogRunning, 1);
+    if (pthread_create(&LogThread, NULL, LogWriterThread, NULL)) {
+        atomic_set(&LogRunning, 0);
+        return;
+    }
+    pthread_setname_np(LogThread, "softhddev log");
+}
+
+/**
+**	Get the ring of the current thread.
+**
+**	Reuses a ring of an exited thread or allocates a new one.
+**
+**	@returns ring, NULL for out of memory.
+*/
+static LogRing *LogGetRing(void)
+{
+    LogRing *ring;
+
+    if ((ring = LogThreadRing)) {
+        return ring;
+    }
+    for (ring = __atomic_load_n(&LogRings, __ATOMIC_ACQUIRE); ring; ring = ring->Next) {
+        if (__sync_bool_compare_and_swap(&ring->Used, 0, 1)) {
+            break;
+        }
+    }
+    if (!ring) {
+        if (!(ring = calloc(1, sizeof(*ring)))) {
+            return NULL;
+        }
+        ring->Used = 1;
+        ring->Tokens = LOG_BURST;
+        do {
+            ring->Next = LogRings;
+        } while (!__sync_bool_compare_and_swap(&LogRings, ring->Next, ring));
+    }
+    pthread_setspecific(LogKey, ring);
+    return LogThreadRing = ring;
+}
+
+/**
+**	Queue a log message.
+**
+**	Falls back to a direct syslog call, if there is no writer thread.
+**
+**	@param format	printf format, must stay valid until written
+**	@param ap	arguments
+*/
+void LogPrintf(const char *format, va_list ap)
+{
+    LogRing *ring;
+    LogRecord *record;
+    unsigned head;
+    int saved;
+    va_list aq;
+
+    saved = errno;
+    pthread_once(&LogOnce, LogStart);
+    if (!atomic_read(&LogRunning) || !(ring = LogGetRing())) {
+        errno = saved;
+        vsyslog(LOG_ERR, format, ap);
+        return;
+    }
+    head = atomic_read(&ring->Head);
+    if (head - (unsigned)atomic_read(&ring->Tail) >= LOG_SLOTS || atomic_read(&ring->Tokens) <= 0) {
+        atomic_inc(&ring->Dropped);
+        return;
+    }
+    atomic_dec(&ring->Tokens);
+
+    record = &ring->Record[head & (LOG_SLOTS - 1)];
+    record->Format = format;
+    record->Errno = saved;
+    va_copy(aq, ap);
+    if (!LogPack(record, format, aq)) {
+        // can't defer, format now
+        errno = saved;
+        record->Format = NULL;
+        vsnprintf(record->Args, sizeof(record->Args), format, ap);
+    }
+    va_end(aq);
+    atomic_set(&ring->Head, head + 1);
+    errno = saved;
+}
+
+/**
+**	Write a fatal error and abort.
+**
+**	The queued messages of the calling thread are written first, then
+**	the error itself, both without the writer thread and the rate
+**	limit.
+**
+**	@param format	printf format
+*/
+void LogFatal(const char *format, ...)
+{
+    va_list ap;
+    int saved;
+
+    saved = errno;
+    pthread_mutex_lock(&LogMutex);
+    if (LogThreadRing) {
+        LogFlushRing(LogThreadRing);
+    }
+    errno = saved;
+    va_start(ap, format);
+    vsyslog(LOG_ERR, format, ap);
+    va_end(ap);
+    pthread_mutex_unlock(&LogMutex);
+    abort();
+}
+
+/**
+**	Stop the log writer and write all queued messages.
+**
+**	Later messages are written directly.
+*/
+void LogExit(void)
+{
+    if (atomic_read(&LogRunning)) {
+        atomic_set(&LogRunning, 0);
+        pthread_join(LogThread, NULL);
+    }
+}
+
+/// @}
@@ -32,6 +32,12 @@
 //  Defines
 //////////////////////////////////////////////////////////////////////////////
 
+    /// highest syslog level compiled in.  VDR's SysLogLevel is at most
+    /// 3 and DebugLevel 4, no higher level than LOG_ERR passes Syslog().
+#ifndef LOG_LEVEL_MAX
+#define LOG_LEVEL_MAX LOG_ERR
+#endif
+
 //////////////////////////////////////////////////////////////////////////////
 //  Declares
 //////////////////////////////////////////////////////////////////////////////
@@ -46,6 +52,16 @@ extern int SysLogLevel;                 ///< how much information wanted
 //  Prototypes
 //////////////////////////////////////////////////////////////////////////////
 
+    /// queue a log message for the writer thread
+extern void LogPrintf(const char *, va_list);
+
+    /// stop the log writer thread
+extern void LogExit(void);
+
+    /// write the queued messages and a fatal error, then abort
+extern void LogFatal(const char *, ...)
+    __attribute__((format(printf, 1, 2), noreturn));
+
 static inline void Syslog(const int, const char *format, ...)
     __attribute__((format(printf, 2, 3)));
 
@@ -66,14 +82,17 @@ static inline void Syslog(const int, const char *format, ...)
 **	- 1	warnings
 **	- 2	info
 **	- 3	important debug and fixme's
+**
+**	Levels above #LOG_LEVEL_MAX are removed at compile time.  The
+**	message is formatted and written by the log writer thread.
 */
 static inline void Syslog(const int level, const char *format, ...)
 {
-    if (SysLogLevel > level || DebugLevel > level) {
+    if (level <= LOG_LEVEL_MAX && (SysLogLevel > level || DebugLevel > level)) {
         va_list ap;
 
         va_start(ap, format);
-        vsyslog(LOG_ERR, format, ap);
+        LogPrintf(format, ap);
         va_end(ap);
     }
 }
@@ -84,9 +103,9 @@ static inline void Syslog(const int level, const char *format, ...)
 #define Error(fmt...)	Syslog(LOG_ERR, fmt)
 
 /**
-**	Show fatal error.
+**	Show fatal error and abort, written at once and at every log level.
 */
-#define Fatal(fmt...)	do { Error(fmt); abort(); } while (0)
+#define Fatal(fmt...)	LogFatal(fmt)
 
 /**
 **	Show warning.
@@ -111,6 +130,43 @@ static inline void Syslog(const int level, const char *format, ...)
 #define AV_NOPTS_VALUE INT64_C(0x8000000000000000)
 #endif
 
+#define PTS_MASK INT64_C(0x1FFFFFFFF)   ///< 33 bit time stamp mask
+#define PTS_WRAP INT64_C(0x200000000)   ///< time stamp wrap around
+
+/**
+**	Wrap-aware distance of two 33 bit time stamps.
+**
+**	@param a	dvb time stamp
+**	@param b	dvb time stamp
+**
+**	@returns b - a in the range -2^32 .. 2^32 - 1.
+*/
+static inline int64_t PtsDiff(int64_t a, int64_t b)
+{
+    int64_t d;
+
+    d = (b - a) & PTS_MASK;
+    return d >= PTS_WRAP / 2 ? d - PTS_WRAP : d;
+}
+
+/**
+**	Wrap-aware compare of two 33 bit time stamps.
+**
+**	@returns true if time stamp @a a is before @a b.
+*/
+static inline int PtsBefore(int64_t a, int64_t b)
+{
+    return PtsDiff(a, b) > 0;
+}
+
+/**
+**	Add ticks to a time stamp, the result wraps at 33 bit.
+*/
+static inline int64_t PtsAdd(int64_t pts, int64_t ticks)
+{
+    return (pts + ticks) & PTS_MASK;
+}
+
 /**
 **	Nice time-stamp string.
 **
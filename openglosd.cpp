@@ -193,6 +193,27 @@ void main() \
 } \
 ";
 
+/// same as the image shader, the color comes from the palette texture
+const char *indexedFragmentShader = "%s\n \
+precision mediump float; \
+in vec2 TexCoords; \
+in vec4 alphaValue; \
+out vec4 color; \
+\
+uniform sampler2D indexTexture; \
+uniform sampler2D paletteTexture; \
+\
+void main() \
+{ \
+    int index = int(texture(indexTexture, TexCoords).r * 255.0 + 0.5); \
+    vec4 temp = texelFetch(paletteTexture, ivec2(index, 0), 0) * alphaValue; \
+    color.r = temp.b; \
+    color.g = temp.g; \
+    color.b = temp.r; \
+    color.a = temp.a; \
+} \
+";
+
 const char *textVertexShader = "%s\n \
 \
 layout (location = 0) in vec2 position; \
@@ -271,6 +292,10 @@ bool cShader::Load(eShaderType type)
             vertexCode = imageVertexShader;
             fragmentCode = imageFragmentShader;
             break;
+        case stIndexed:
+            vertexCode = imageVertexShader;
+            fragmentCode = indexedFragmentShader;
+            break;
         default:
             esyslog("[softhddev]unknown shader type\n");
             break;
@@ -837,6 +862,13 @@ bool cOglVb::Init(void)
         numVertices = 6;
         drawMode = GL_TRIANGLES;
         shader = stImage;
+    } else if (type == vbIndexed) {
+        // Palette indexed bitmap VBO definition
+        sizeVertex1 = 2;
+        sizeVertex2 = 2;
+        numVertices = 6;
+        drawMode = GL_TRIANGLES;
+        shader = stIndexed;
     }
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
@@ -904,6 +936,11 @@ void cOglVb::SetShaderProjectionMatrix(GLint width, GLint height)
     Shaders[shader]->SetMatrix4("projection", projection);
 }
 
+void cOglVb::SetShaderTexture(const GLchar * name, GLint unit)
+{
+    Shaders[shader]->SetInteger(name, unit);
+}
+
 void cOglVb::SetVertexData(GLfloat * vertices, int count)
 {
     if (count == 0)
@@ -1034,6 +1071,111 @@ bool cOglCmdRenderFbToBufferFb::Execute(void)
     return true;
 }
 
+//------------------ cOglCmdBlitFb --------------------
+cOglFb *cOglCmdBlitFb::scratch = NULL;
+
+cOglCmdBlitFb::cOglCmdBlitFb(cOglFb * fb, cOglFb * dest, const cRect & source, const cPoint & dest_point,
+    GLint transparency, bool blend):cOglCmd(fb)
+{
+    this->dest = dest;
+    srcX = source.X();
+    srcY = source.Y();
+    width = source.Width();
+    height = source.Height();
+    destX = dest_point.X();
+    destY = dest_point.Y();
+    this->transparency = transparency;
+    this->blend = blend;
+}
+
+/**
+**  Draw a rectangle of the src fb texture into dst as one textured quad.
+**
+**  Rows are stored bottom up in the fb textures, see
+**  cOglCmdRenderFbToBufferFb.
+*/
+void cOglCmdBlitFb::DrawQuad(cOglFb * src, cOglFb * dst, GLint srcX, GLint srcY, GLint width, GLint height,
+    GLint destX, GLint destY)
+{
+    GLfloat x1 = destX;
+    GLfloat y1 = destY;
+    GLfloat x2 = destX + width;
+    GLfloat y2 = destY + height;
+
+    GLfloat texX1 = srcX / (GLfloat) src->Width();
+    GLfloat texX2 = (srcX + width) / (GLfloat) src->Width();
+    GLfloat texY1 = 1.0f - srcY / (GLfloat) src->Height();
+    GLfloat texY2 = 1.0f - (srcY + height) / (GLfloat) src->Height();
+
+    GLfloat quadVertices[] = {
+        // Pos    // TexCoords
+        x1, y1, texX1, texY1,           //left top
+        x1, y2, texX1, texY2,           //left bottom
+        x2, y2, texX2, texY2,           //right bottom
+
+        x1, y1, texX1, texY1,           //left top
+        x2, y2, texX2, texY2,           //right bottom
+        x2, y1, texX2, texY1            //right top
+    };
+
+    VertexBuffers[vbTexture]->SetShaderProjectionMatrix(dst->Width(), dst->Height());
+    dst->Bind();
+    src->BindTexture();
+    VertexBuffers[vbTexture]->Bind();
+    VertexBuffers[vbTexture]->SetVertexData(quadVertices);
+    VertexBuffers[vbTexture]->DrawArrays();
+    VertexBuffers[vbTexture]->Unbind();
+    dst->Unbind();
+}
+
+bool cOglCmdBlitFb::Execute(void)
+{
+    if (width <= 0 || height <= 0 || !fb->Initiated())
+        return false;
+    if (!dest->Initiated() && !dest->Init())
+        return false;
+
+    VertexBuffers[vbTexture]->ActivateShader();
+    VertexBuffers[vbTexture]->SetShaderAlpha(blend ? transparency : ALPHA_OPAQUE);
+    if (!blend)
+        VertexBuffers[vbTexture]->DisableBlending();
+
+    if (fb == dest) {
+        // a texture can't be sampled while it is the render target
+        if (!scratch || scratch->Width() < width || scratch->Height() < height) {
+            int w = scratch && scratch->Width() > width ? scratch->Width() : width;
+            int h = scratch && scratch->Height() > height ? scratch->Height() : height;
+
+            delete scratch;
+            scratch = new cOglFb(w, h, w, h);
+            scratch->Init();
+        }
+        if (blend)
+            VertexBuffers[vbTexture]->DisableBlending();
+        DrawQuad(fb, scratch, srcX, srcY, width, height, 0, 0);
+        if (blend)
+            VertexBuffers[vbTexture]->EnableBlending();
+        DrawQuad(scratch, dest, 0, 0, width, height, destX, destY);
+    } else {
+        DrawQuad(fb, dest, srcX, srcY, width, height, destX, destY);
+    }
+
+    if (!blend)
+        VertexBuffers[vbTexture]->EnableBlending();
+
+    return true;
+}
+
+/**
+**  Free the bounce buffer, called with the gl context still current.
+*/
+void cOglCmdBlitFb::Cleanup(void)
+{
+    delete scratch;
+
+    scratch = NULL;
+}
+
 //------------------ cOglCmdCopyBufferToOutputFb --------------------
 cOglCmdCopyBufferToOutputFb::cOglCmdCopyBufferToOutputFb(cOglFb * fb, cOglOutputFb * oFb, GLint x, GLint y):cOglCmd(fb)
 {
@@ -1706,7 +1848,106 @@ bool cOglCmdDrawText::Execute(void)
     return true;
 }
 
+/****************************************************************************************
+* cOglTexturePool
+****************************************************************************************/
+cOglTexturePool::cOglTexturePool(void)
+{
+    count = 0;
+    tick = 0;
+    bytes = 0;
+}
+
+cOglTexturePool::~cOglTexturePool(void)
+{
+    while (count)
+        Remove(count - 1);
+}
+
+void cOglTexturePool::Remove(int i)
+{
+    glDeleteTextures(1, &entries[i].texture);
+    bytes -= entries[i].width * entries[i].height * sizeof(tColor);
+    entries[i] = entries[--count];
+}
+
+/**
+**  Upload an image into a pooled texture.
+**
+**  Textures are allocated rounded up to OGL_TEXPOOL_GRAIN pixels and
+**  refilled with glTexSubImage2D.  Up to OGL_TEXPOOL_RING textures of
+**  one size are used in turn, so an upload rarely has to wait for a
+**  draw still reading the texture.
+**
+**  @param argb         image data
+**  @param width        image width
+**  @param height       image height
+**  @param[out] poolWidth   width of the returned texture
+**  @param[out] poolHeight  height of the returned texture
+**
+**  @returns texture or GL_NONE for an image too large for the pool
+*/
+GLuint cOglTexturePool::Upload(const tColor * argb, GLint width, GLint height, GLint * poolWidth, GLint * poolHeight)
+{
+    GLint w = (width + OGL_TEXPOOL_GRAIN - 1) & ~(OGL_TEXPOOL_GRAIN - 1);
+    GLint h = (height + OGL_TEXPOOL_GRAIN - 1) & ~(OGL_TEXPOOL_GRAIN - 1);
+    long size = w * h * sizeof(tColor);
+    int same = 0;
+    int oldest = -1;
+    int i;
+
+    if (size > OGL_TEXPOOL_MAX_IMAGE)
+        return GL_NONE;
+
+    for (i = 0; i < count; i++) {
+        if (entries[i].width == w && entries[i].height == h) {
+            same++;
+            if (oldest < 0 || entries[i].lastUse < entries[oldest].lastUse)
+                oldest = i;
+        }
+    }
+
+    if (oldest < 0 || (same < OGL_TEXPOOL_RING && size <= OGL_TEXPOOL_BYTES / OGL_TEXPOOL_SIZE)) {
+        // make room, least recently used first
+        while (count && (count == OGL_TEXPOOL_SIZE || bytes + size > OGL_TEXPOOL_BYTES)) {
+            int lru = 0;
+
+            for (i = 1; i < count; i++) {
+                if (entries[i].lastUse < entries[lru].lastUse)
+                    lru = i;
+            }
+            Remove(lru);
+        }
+        i = count++;
+        glGenTextures(1, &entries[i].texture);
+        glBindTexture(GL_TEXTURE_2D, entries[i].texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        GlxCheck();
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        entries[i].width = w;
+        entries[i].height = h;
+        bytes += size;
+    } else {
+        i = oldest;
+        glBindTexture(GL_TEXTURE_2D, entries[i].texture);
+    }
+    entries[i].lastUse = ++tick;
+
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, argb);
+    GlxCheck();
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    *poolWidth = w;
+    *poolHeight = h;
+    return entries[i].texture;
+}
+
 //------------------ cOglCmdDrawImage --------------------
+cOglTexturePool *cOglCmdDrawImage::texturePool = NULL;
+
 cOglCmdDrawImage::cOglCmdDrawImage(cOglFb * fb, tColor * argb, GLint width, GLint height, GLint x, GLint y,
     bool overlay, double scaleX, double scaleY):cOglCmd(fb)
 {
@@ -1731,23 +1972,25 @@ bool cOglCmdDrawImage::Execute(void)
     if (width <= 0 || height <= 0)
         return false;
     GLuint texture;
-
-
-//  pthread_mutex_lock(&OSDMutex);
-
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, argb);
-    GlxCheck();
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glFlush();
-
-    GlxCheck();
-//  pthread_mutex_unlock(&OSDMutex);
+    GLint poolWidth;
+    GLint poolHeight;
+
+    if (!texturePool)
+        texturePool = new cOglTexturePool();
+    texture = texturePool->Upload(argb, width, height, &poolWidth, &poolHeight);
+    if (texture == GL_NONE) {
+        // too large for the pool, use a texture for this draw only
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, argb);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        poolWidth = 0;
+        poolHeight = 0;
+    }
     if (x + width * scaleX > VideoWindowWidth) {
 	 printf("Scaling over the Width edge %f\n",x + width * scaleX);
          scaleX = 1.0;
@@ -1762,14 +2005,20 @@ bool cOglCmdDrawImage::Execute(void)
     GLfloat x2 = x + width * scaleX;    //right
     GLfloat y2 = y + height * scaleY;   //bottom
 
+    // the image is the top left part of the pooled texture, a scaled
+    // image must not sample the unused border
+    GLfloat inset = scaleX != 1.0f || scaleY != 1.0f ? 0.5f : 0.0f;
+    GLfloat texX2 = poolWidth ? (width - inset) / (GLfloat) poolWidth : 1.0f;
+    GLfloat texY2 = poolHeight ? (height - inset) / (GLfloat) poolHeight : 1.0f;
+
     GLfloat quadVertices[] = {
-        x1, y2, 0.0, 1.0,               // left bottom
+        x1, y2, 0.0, texY2,             // left bottom
         x1, y1, 0.0, 0.0,               // left top
-        x2, y1, 1.0, 0.0,               // right top
+        x2, y1, texX2, 0.0,             // right top
 
-        x1, y2, 0.0, 1.0,               // left bottom
-        x2, y1, 1.0, 0.0,               // right top
-        x2, y2, 1.0, 1.0                // right bottom
+        x1, y2, 0.0, texY2,             // left bottom
+        x2, y1, texX2, 0.0,             // right top
+        x2, y2, texX2, texY2            // right bottom
     };
 
     VertexBuffers[vbImage]->ActivateShader();
@@ -1788,11 +2037,142 @@ bool cOglCmdDrawImage::Execute(void)
         VertexBuffers[vbImage]->EnableBlending();
     fb->Unbind();
     glBindTexture(GL_TEXTURE_2D, 0);
-    glDeleteTextures(1, &texture);
+    if (!poolWidth)
+        glDeleteTextures(1, &texture);
 
     return true;
 }
 
+/**
+**  Delete the pooled textures, called with the gl context still current.
+*/
+void cOglCmdDrawImage::Cleanup(void)
+{
+    delete texturePool;
+
+    texturePool = NULL;
+}
+
+//------------------ cOglCmdDrawBitmap --------------------
+GLuint cOglCmdDrawBitmap::indexTexture = GL_NONE;
+GLint cOglCmdDrawBitmap::indexWidth = 0;
+GLint cOglCmdDrawBitmap::indexHeight = 0;
+GLuint cOglCmdDrawBitmap::paletteTexture = GL_NONE;
+
+cOglCmdDrawBitmap::cOglCmdDrawBitmap(cOglFb * fb, uint8_t * index, const tColor * palette, GLint width, GLint height,
+    GLint x, GLint y, bool overlay):cOglCmd(fb)
+{
+    this->index = index;
+    memcpy(this->palette, palette, sizeof(this->palette));
+    this->x = x;
+    this->y = y;
+    this->width = width;
+    this->height = height;
+    this->overlay = overlay;
+}
+
+cOglCmdDrawBitmap::~cOglCmdDrawBitmap(void)
+{
+    free(index);
+}
+
+/**
+**  Draw an 8 bit index plane, the colors are looked up by the shader.
+**
+**  Uploads a quarter of the bytes of the ARGB image path.  The index
+**  texture is only reallocated when a larger bitmap comes along.
+*/
+bool cOglCmdDrawBitmap::Execute(void)
+{
+    if (width <= 0 || height <= 0)
+        return false;
+
+    if (paletteTexture == GL_NONE) {
+        glGenTextures(1, &paletteTexture);
+        glBindTexture(GL_TEXTURE_2D, paletteTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 256, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    glBindTexture(GL_TEXTURE_2D, paletteTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 1, GL_RGBA, GL_UNSIGNED_BYTE, palette);
+
+    if (width > indexWidth || height > indexHeight) {
+        if (indexTexture != GL_NONE)
+            glDeleteTextures(1, &indexTexture);
+        indexWidth = width > indexWidth ? width : indexWidth;
+        indexHeight = height > indexHeight ? height : indexHeight;
+        glGenTextures(1, &indexTexture);
+        glBindTexture(GL_TEXTURE_2D, indexTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, indexWidth, indexHeight, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    glBindTexture(GL_TEXTURE_2D, indexTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, index);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    GlxCheck();
+
+    GLfloat x1 = x;                     //left
+    GLfloat y1 = y;                     //top
+    GLfloat x2 = x + width;             //right
+    GLfloat y2 = y + height;            //bottom
+    GLfloat texX2 = width / (GLfloat) indexWidth;
+    GLfloat texY2 = height / (GLfloat) indexHeight;
+
+    GLfloat quadVertices[] = {
+        x1, y2, 0.0, texY2,             // left bottom
+        x1, y1, 0.0, 0.0,               // left top
+        x2, y1, texX2, 0.0,             // right top
+
+        x1, y2, 0.0, texY2,             // left bottom
+        x2, y1, texX2, 0.0,             // right top
+        x2, y2, texX2, texY2            // right bottom
+    };
+
+    VertexBuffers[vbIndexed]->ActivateShader();
+    VertexBuffers[vbIndexed]->SetShaderAlpha(255);
+    VertexBuffers[vbIndexed]->SetShaderProjectionMatrix(fb->Width(), fb->Height());
+    VertexBuffers[vbIndexed]->SetShaderTexture("indexTexture", 0);
+    VertexBuffers[vbIndexed]->SetShaderTexture("paletteTexture", 1);
+
+    fb->Bind();
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, paletteTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, indexTexture);
+    if (overlay)
+        VertexBuffers[vbIndexed]->DisableBlending();
+    VertexBuffers[vbIndexed]->Bind();
+    VertexBuffers[vbIndexed]->SetVertexData(quadVertices);
+    VertexBuffers[vbIndexed]->DrawArrays();
+    VertexBuffers[vbIndexed]->Unbind();
+    if (overlay)
+        VertexBuffers[vbIndexed]->EnableBlending();
+    fb->Unbind();
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    return true;
+}
+
+/**
+**  Delete the index and palette textures, gl context still current.
+*/
+void cOglCmdDrawBitmap::Cleanup(void)
+{
+    if (indexTexture != GL_NONE)
+        glDeleteTextures(1, &indexTexture);
+    if (paletteTexture != GL_NONE)
+        glDeleteTextures(1, &paletteTexture);
+    indexTexture = paletteTexture = GL_NONE;
+    indexWidth = indexHeight = 0;
+}
+
 //------------------ cOglCmdDrawTexture --------------------
 cOglCmdDrawTexture::cOglCmdDrawTexture(cOglFb * fb, sOglImage * imageRef, GLint x, GLint y, double scaleX, double scaleY):cOglCmd(fb)
 {
@@ -1870,17 +2250,22 @@ bool cOglCmdStoreImage::Execute(void)
 }
 
 //------------------ cOglCmdDropImage --------------------
-cOglCmdDropImage::cOglCmdDropImage(sOglImage * imageRef, cCondWait * wait):cOglCmd(NULL)
+cOglCmdDropImage::cOglCmdDropImage(cOglThread * oglThread, int slot, cCondWait * wait):cOglCmd(NULL)
 {
-    this->imageRef = imageRef;
+    this->oglThread = oglThread;
+    this->slot = slot;
     this->wait = wait;
 }
 
 bool cOglCmdDropImage::Execute(void)
 {
-    if (imageRef->texture != GL_NONE)
+    sOglImage *imageRef = oglThread->GetImageRef(slot);
+
+    if (imageRef && imageRef->texture != GL_NONE)
         glDeleteTextures(1, &imageRef->texture);
-    wait->Signal();
+    oglThread->ReleaseSlot(-slot - 1);
+    if (wait)
+        wait->Signal();
     return true;
 }
 
@@ -1892,16 +2277,28 @@ cOglThread::cOglThread(cCondWait * startWait, int maxCacheSize):cThread("oglThre
     stalled = false;
     memCached = 0;
 
-    this->maxCacheSize = 0;
+    this->maxCacheSize = (int64_t)maxCacheSize * 1024 * 1024;
+    if (MemBudget(MEM_IMAGE) && (int64_t)MemBudget(MEM_IMAGE) < this->maxCacheSize)
+        this->maxCacheSize = MemBudget(MEM_IMAGE);
+    // readback buffer is static, account it while the thread exists
+    MemReserve(MEM_OSD, sizeof(posd), sizeof(posd));
     this->startWait = startWait;
     wait = new cCondWait();
     maxTextureSize = 0;
-    for (int i = 0; i < OGL_MAX_OSDIMAGES; i++) {
+    freeCount = 0;
+    for (int i = OGL_MAX_OSDIMAGES - 1; i >= 0; i--) {
         imageCache[i].used = false;
+        imageCache[i].dropping = false;
         imageCache[i].texture = GL_NONE;
         imageCache[i].width = 0;
         imageCache[i].height = 0;
+        imageCache[i].refs = 0;
+        freeSlots[freeCount++] = i;
     }
+    for (int i = 0; i < OGL_IMAGE_BUCKETS; i++)
+        imageBuckets[i] = -1;
+    lruHead = lruTail = -1;
+    imageHits = imageMisses = imageEvictions = imageRejects = 0;
 
     Start();
 
@@ -1913,6 +2310,7 @@ cOglThread::~cOglThread()
 
     wait = NULL;
     ClearCursor(0);
+    MemRelease(MEM_OSD, sizeof(posd));
     //close(fd);
     //close(ge2d_fd);
     close(ion_fd);
@@ -1920,11 +2318,24 @@ cOglThread::~cOglThread()
 
 void cOglThread::Stop(void)
 {
+    int drop[OGL_MAX_OSDIMAGES];
+    int n = 0;
+
+    Lock();
     for (int i = 0; i < OGL_MAX_OSDIMAGES; i++) {
-        if (imageCache[i].used) {
-            DropImageData(i);
+        if (imageCache[i].used && !imageCache[i].dropping) {
+            UnlinkImage(i);
+            drop[n++] = i;
         }
     }
+    Unlock();
+    if (n && Active()) {
+        cCondWait dropWait;
+
+        for (int j = 0; j < n; j++)
+            DoCmd(new cOglCmdDropImage(this, -drop[j] - 1, j == n - 1 ? &dropWait : NULL));
+        dropWait.Wait(1000);
+    }
     Cancel(2);
     stalled = false;
 }
@@ -1950,8 +2361,123 @@ void cOglThread::DoCmd(cOglCmd * cmd)
         wait->Signal();
 }
 
+/**
+**  Hash image content and size.
+**
+**  FNV-1a over 64 bit words with an extra shift, fast enough to run on
+**  every StoreImage call.
+*/
+static uint64_t OglImageHash(const tColor * data, int width, int height)
+{
+    uint64_t h = 0xcbf29ce484222325ULL ^ ((uint64_t) width << 32 | (uint32_t) height);
+    long n = (long)width * height;
+    const tColor *p = data;
+
+    for (; n >= 2; n -= 2, p += 2) {
+        uint64_t v;
+
+        memcpy(&v, p, sizeof(v));
+        h = (h ^ v) * 0x100000001b3ULL;
+        h ^= h >> 29;
+    }
+    if (n)
+        h = (h ^ *p) * 0x100000001b3ULL;
+    return h ^ (h >> 32);
+}
+
+int cOglThread::FindImage(uint64_t hash, int width, int height)
+{
+    for (int i = imageBuckets[hash & (OGL_IMAGE_BUCKETS - 1)]; i >= 0; i = imageCache[i].hashNext) {
+        if (imageCache[i].hash == hash && imageCache[i].width == width && imageCache[i].height == height)
+            return i;
+    }
+    return -1;
+}
+
+void cOglThread::LruUnlink(int i)
+{
+    sOglImage *img = &imageCache[i];
+
+    if (img->lruPrev >= 0)
+        imageCache[img->lruPrev].lruNext = img->lruNext;
+    else
+        lruHead = img->lruNext;
+    if (img->lruNext >= 0)
+        imageCache[img->lruNext].lruPrev = img->lruPrev;
+    else
+        lruTail = img->lruPrev;
+    img->lruPrev = img->lruNext = -1;
+}
+
+void cOglThread::LruAppend(int i)
+{
+    sOglImage *img = &imageCache[i];
+
+    img->lruPrev = lruTail;
+    img->lruNext = -1;
+    if (lruTail >= 0)
+        imageCache[lruTail].lruNext = i;
+    else
+        lruHead = i;
+    lruTail = i;
+}
+
+/**
+**  Remove an image from the cache, the slot is freed by the drop command.
+**
+**  Caller holds the thread lock.
+*/
+void cOglThread::UnlinkImage(int i)
+{
+    sOglImage *img = &imageCache[i];
+    int *link = &imageBuckets[img->hash & (OGL_IMAGE_BUCKETS - 1)];
+
+    while (*link >= 0 && *link != i)
+        link = &imageCache[*link].hashNext;
+    if (*link == i)
+        *link = img->hashNext;
+    if (!img->refs)
+        LruUnlink(i);
+    img->refs = 0;
+    img->dropping = true;
+    memCached -= img->width * img->height * sizeof(tColor);
+    MemRelease(MEM_IMAGE, img->width * img->height * sizeof(tColor));
+}
+
+/**
+**  Evict unreferenced images, oldest first, until need bytes fit.
+**
+**  Caller holds the thread lock.  The evicted slots are returned in drop,
+**  their drop commands must be queued after unlocking.  An evicted slot
+**  is freed later by the gl thread, so with no free slot one image is
+**  evicted ahead for the next store.
+**
+**  @returns number of evicted slots
+*/
+int cOglThread::Evict(int64_t need, int *drop)
+{
+    int n = 0;
+
+    while ((memCached + need > maxCacheSize || (!freeCount && !n)) && lruHead >= 0) {
+        drop[n++] = lruHead;
+        UnlinkImage(lruHead);
+        imageEvictions++;
+    }
+    return n;
+}
+
+/**
+**  Store an image as texture.
+**
+**  Images with the same content share one texture.  The upload is only
+**  queued, the texture is valid for all commands queued after it.
+*/
 int cOglThread::StoreImage(const cImage & image)
 {
+    int drop[OGL_MAX_OSDIMAGES];
+    uint64_t hash;
+    int i;
+    int n;
 
     if (!maxCacheSize) {
         return 0;
@@ -1964,81 +2490,84 @@ int cOglThread::StoreImage(const cImage & image)
     }
 
     long int imgSize = image.Width() * image.Height();
-    int newMemUsed = imgSize * sizeof(tColor) + memCached;
 
-    if (newMemUsed > maxCacheSize) {
-        float cachedMB = memCached / 1024.0f / 1024.0f;
-        float maxMB = maxCacheSize / 1024.0f / 1024.0f;
+    hash = OglImageHash(image.Data(), image.Width(), image.Height());
+
+    Lock();
+    if ((i = FindImage(hash, image.Width(), image.Height())) >= 0) {
+        if (!imageCache[i].refs++)
+            LruUnlink(i);
+        imageHits++;
+        Unlock();
+        return -i - 1;
+    }
+    imageMisses++;
 
-        esyslog("[softhddev]Maximum size for GPU cache reached. Used: %.2fMB Max: %.2fMB", cachedMB, maxMB);
+    n = Evict(imgSize * sizeof(tColor), drop);
+    if (memCached + (int64_t)(imgSize * sizeof(tColor)) > maxCacheSize || !freeCount) {
+        imageRejects++;
+        Unlock();
+        dsyslog("[softhddev]GPU image cache full. Used: %.2fMB Max: %.2fMB",
+            memCached / 1024.0f / 1024.0f, maxCacheSize / 1024.0f / 1024.0f);
+        for (int j = 0; j < n; j++)
+            DoCmd(new cOglCmdDropImage(this, -drop[j] - 1));
         return 0;
     }
+    i = freeSlots[--freeCount];
 
-    int slot = GetFreeSlot();
+    sOglImage *imageRef = &imageCache[i];
 
-    if (!slot)
-        return 0;
+    imageRef->used = true;
+    imageRef->dropping = false;
+    imageRef->texture = GL_NONE;
+    imageRef->width = image.Width();
+    imageRef->height = image.Height();
+    imageRef->hash = hash;
+    imageRef->refs = 1;
+    imageRef->lruPrev = imageRef->lruNext = -1;
+    imageRef->hashNext = imageBuckets[hash & (OGL_IMAGE_BUCKETS - 1)];
+    imageBuckets[hash & (OGL_IMAGE_BUCKETS - 1)] = i;
+    memCached += imgSize * sizeof(tColor);
+    MemReserve(MEM_IMAGE, imgSize * sizeof(tColor), imgSize * sizeof(tColor));
+    Unlock();
+
+    for (int j = 0; j < n; j++)
+        DoCmd(new cOglCmdDropImage(this, -drop[j] - 1));
 
     tColor *argb = MALLOC(tColor, imgSize);
 
     if (!argb) {
         esyslog("[softhddev]memory allocation of %ld kb for OSD image failed", (imgSize * sizeof(tColor)) / 1024);
-        ClearSlot(slot);
-        slot = 0;
+        Lock();
+        UnlinkImage(i);
+        Unlock();
+        DoCmd(new cOglCmdDropImage(this, -i - 1));
         return 0;
     }
 
     memcpy(argb, image.Data(), sizeof(tColor) * imgSize);
-
-    sOglImage *imageRef = GetImageRef(slot);
-
-    imageRef->width = image.Width();
-    imageRef->height = image.Height();
     DoCmd(new cOglCmdStoreImage(imageRef, argb));
 
-    cTimeMs timer(5000);
-
-    while (imageRef->used && imageRef->texture == 0 && !timer.TimedOut())
-        cCondWait::SleepMs(2);
-
-    if (imageRef->texture == GL_NONE) {
-        esyslog("[softhddev]failed to store OSD image texture! (%s)",
-            timer.TimedOut()? "timed out" : "allocation failed");
-        DropImageData(slot);
-        slot = 0;
-    }
-
-    memCached += imgSize * sizeof(tColor);
-    return slot;
+    return -i - 1;
 }
 
-int cOglThread::GetFreeSlot(void)
+/**
+**  Return a slot to the free list, called by the gl thread.
+*/
+void cOglThread::ReleaseSlot(int i)
 {
+    if (i < 0 || i >= OGL_MAX_OSDIMAGES)
+        return;
     Lock();
-    int slot = 0;
-
-    for (int i = 0; i < OGL_MAX_OSDIMAGES && !slot; i++) {
-        if (!imageCache[i].used) {
-            imageCache[i].used = true;
-            slot = -i - 1;
-        }
-    }
-    Unlock();
-    return slot;
-}
-
-void cOglThread::ClearSlot(int slot)
-{
-    int i = -slot - 1;
-
-    if (i >= 0 && i < OGL_MAX_OSDIMAGES) {
-        Lock();
+    if (imageCache[i].dropping) {
         imageCache[i].used = false;
+        imageCache[i].dropping = false;
         imageCache[i].texture = GL_NONE;
         imageCache[i].width = 0;
         imageCache[i].height = 0;
-        Unlock();
+        freeSlots[freeCount++] = i;
     }
+    Unlock();
 }
 
 sOglImage *cOglThread::GetImageRef(int slot)
@@ -2050,24 +2579,41 @@ sOglImage *cOglThread::GetImageRef(int slot)
     return 0;
 }
 
+/**
+**  Release an image handle.
+**
+**  The texture stays cached until its memory or slot is needed.
+*/
 void cOglThread::DropImageData(int imageHandle)
 {
-    sOglImage *imageRef = GetImageRef(imageHandle);
+    int i = -imageHandle - 1;
 
-    if (!imageRef)
+    if (i < 0 || i >= OGL_MAX_OSDIMAGES)
         return;
-    int imgSize = imageRef->width * imageRef->height * sizeof(tColor);
-
-    memCached -= imgSize;
-    cCondWait dropWait;
+    Lock();
+    if (imageCache[i].used && !imageCache[i].dropping && imageCache[i].refs > 0) {
+        if (!--imageCache[i].refs)
+            LruAppend(i);
+    }
+    Unlock();
+}
 
-    DoCmd(new cOglCmdDropImage(imageRef, &dropWait));
-    dropWait.Wait();
-    ClearSlot(imageHandle);
+/**
+**  Get image cache counters.
+*/
+void cOglThread::GetImageStats(char *buf, size_t size)
+{
+    Lock();
+    snprintf(buf, size,
+        "images %d, %.2f of %.2f MB\n" "hits %u misses %u evictions %u rejects %u",
+        OGL_MAX_OSDIMAGES - freeCount, memCached / 1024.0f / 1024.0f, maxCacheSize / 1024.0f / 1024.0f,
+        imageHits, imageMisses, imageEvictions, imageRejects);
+    Unlock();
 }
 
 void cOglThread::Action(void)
 {
+    ThreadApplyProfile(THREAD_OSD);
     if (!InitOpenGL()) {
         esyslog("[softhddev]Could not initiate OpenGL Context");
         Cleanup();
@@ -2313,6 +2859,9 @@ void cOglThread::Cleanup(void)
 
     OsdClose();
 
+    cOglCmdBlitFb::Cleanup();
+    cOglCmdDrawImage::Cleanup();
+    cOglCmdDrawBitmap::Cleanup();
     DeleteVertexBuffers();
     delete cOglOsd::oFb;
 
@@ -2455,23 +3004,26 @@ void cOglPixmap::DrawBitmap(const cPoint & Point, const cBitmap & Bitmap, tColor
         return;
     LOCK_PIXMAPS;
     bool specialColors = ColorFg || ColorBg;
-    tColor *argb = MALLOC(tColor, Bitmap.Width() * Bitmap.Height());
+    int size = Bitmap.Width() * Bitmap.Height();
+    uint8_t *index = MALLOC(uint8_t, size);
+    tColor palette[256];
 
-    if (!argb)
+    if (!index)
         return;
 
-    tColor *p = argb;
-
-    for (int py = 0; py < Bitmap.Height(); py++)
-        for (int px = 0; px < Bitmap.Width(); px++) {
-            tIndex index = *Bitmap.Data(px, py);
-
-            *p++ = (!index
-                && Overlay) ? clrTransparent : (specialColors ? (index == 0 ? ColorBg : index ==
-                    1 ? ColorFg : Bitmap.Color(index)) : Bitmap.Color(index));
-        }
+    // the bitmap keeps its index plane in one piece, colors are expanded
+    // by the shader
+    memcpy(index, Bitmap.Data(0, 0), size);
+    for (int i = 0; i < 256; i++)
+        palette[i] = Bitmap.Color(i);
+    if (specialColors) {
+        palette[0] = ColorBg;
+        palette[1] = ColorFg;
+    }
+    if (Overlay)
+        palette[0] = clrTransparent;
 
-    oglThread->DoCmd(new cOglCmdDrawImage(fb, argb, Bitmap.Width(), Bitmap.Height(), Point.X(), Point.Y(), true, 1.0, 1.0));
+    oglThread->DoCmd(new cOglCmdDrawBitmap(fb, index, palette, Bitmap.Width(), Bitmap.Height(), Point.X(), Point.Y(), true));
     SetDirty();
     MarkDrawPortDirty(cRect(Point, cSize(Bitmap.Width(), Bitmap.Height())).Intersected(DrawPort().Size()));
 }
@@ -2570,22 +3122,100 @@ void cOglPixmap::DrawSlope(const cRect & Rect, tColor Color, int Type)
 
 void cOglPixmap::Render(const cPixmap * Pixmap, const cRect & Source, const cPoint & Dest)
 {
-    esyslog("[softhddev] Render %d %d %d not implemented in OpenGl OSD", Pixmap->ViewPort().X(), Source.X(), Dest.X());
+    if (!oglThread->Active())
+        return;
+    LOCK_PIXMAPS;
+    if (Pixmap->Alpha() == ALPHA_TRANSPARENT)
+        return;
+    const cOglPixmap *pm = dynamic_cast < const cOglPixmap * >(Pixmap);
+
+    if (!pm) {
+        esyslog("[softhddev] Render from a non OpenGl pixmap not supported");
+        return;
+    }
+    cRect s = Source.Intersected(Pixmap->DrawPort().Size());
+
+    if (s.IsEmpty())
+        return;
+    cPoint v = Dest - Source.Point();
+    cRect d = s.Shifted(v).Intersected(DrawPort().Size());
+
+    if (d.IsEmpty())
+        return;
+    s = d.Shifted(-v);
+    oglThread->DoCmd(new cOglCmdBlitFb(const_cast < cOglPixmap * >(pm)->Fb(), fb, s, d.Point(), Pixmap->Alpha(), true));
+    SetDirty();
+    MarkDrawPortDirty(d);
 }
 
 void cOglPixmap::Copy(const cPixmap * Pixmap, const cRect & Source, const cPoint & Dest)
 {
-    esyslog("[softhddev] Copy %d %d %d not implemented in OpenGl OSD", Pixmap->ViewPort().X(), Source.X(), Dest.X());
+    if (!oglThread->Active())
+        return;
+    LOCK_PIXMAPS;
+    const cOglPixmap *pm = dynamic_cast < const cOglPixmap * >(Pixmap);
+
+    if (!pm) {
+        esyslog("[softhddev] Copy from a non OpenGl pixmap not supported");
+        return;
+    }
+    cRect s = Source.Intersected(Pixmap->DrawPort().Size());
+
+    if (s.IsEmpty())
+        return;
+    cPoint v = Dest - Source.Point();
+    cRect d = s.Shifted(v).Intersected(DrawPort().Size());
+
+    if (d.IsEmpty())
+        return;
+    s = d.Shifted(-v);
+    oglThread->DoCmd(new cOglCmdBlitFb(const_cast < cOglPixmap * >(pm)->Fb(), fb, s, d.Point(), ALPHA_OPAQUE, false));
+    SetDirty();
+    MarkDrawPortDirty(d);
 }
 
 void cOglPixmap::Scroll(const cPoint & Dest, const cRect & Source)
 {
-    esyslog("[softhddev] Scroll %d %d not implemented in OpenGl OSD", Source.X(), Dest.X());
+    if (!oglThread->Active())
+        return;
+    LOCK_PIXMAPS;
+    cRect s;
+
+    if (&Source == &cRect::Null)
+        s = DrawPort().Shifted(-DrawPort().Point());
+    else
+        s = Source.Intersected(DrawPort().Size());
+    if (s.IsEmpty())
+        return;
+    cPoint v = Dest - s.Point();
+    cRect d = s.Shifted(v).Intersected(DrawPort().Size());
+
+    if (d.IsEmpty())
+        return;
+    s = d.Shifted(-v);
+    oglThread->DoCmd(new cOglCmdBlitFb(fb, fb, s, d.Point(), ALPHA_OPAQUE, false));
+    SetDirty();
+    MarkDrawPortDirty(d);
 }
 
 void cOglPixmap::Pan(const cPoint & Dest, const cRect & Source)
 {
-    esyslog("[softhddev] Pan %d %d not implemented in OpenGl OSD", Source.X(), Dest.X());
+    if (!oglThread->Active())
+        return;
+    LOCK_PIXMAPS;
+    cRect s;
+
+    if (&Source == &cRect::Null)
+        s = DrawPort().Shifted(-DrawPort().Point());
+    else
+        s = Source.Intersected(DrawPort().Size());
+    if (s.IsEmpty())
+        return;
+    cPoint v = Dest - s.Point();
+
+    // move the content and the draw port, the view port stays the same
+    Scroll(Dest, s);
+    SetDrawPortPoint(DrawPort().Point() - v, false);
 }
 
 /******************************************************************************
@@ -78,6 +78,12 @@ struct sOglImage
     GLint width;
     GLint height;
     bool used;
+    bool dropping;                      // drop queued, slot freed by the gl thread
+    uint64_t hash;                      // content hash
+    int refs;                           // handles given out
+    int hashNext;                       // next slot in hash bucket
+    int lruPrev;                        // unreferenced images, oldest first
+    int lruNext;
 };
 
 /****************************************************************************************
@@ -95,6 +101,7 @@ enum eShaderType
     stTexture,
     stText,
     stImage,
+    stIndexed,
     stCount
 };
 
@@ -304,6 +311,7 @@ enum eVertexBufferType
     vbTexture,
     vbText,
     vbImage,
+    vbIndexed,
     vbCount
 };
 
@@ -330,6 +338,7 @@ class cOglVb
     void SetShaderColor(GLint color);
     void SetShaderAlpha(GLint alpha);
     void SetShaderProjectionMatrix(GLint width, GLint height);
+    void SetShaderTexture(const GLchar * name, GLint unit);
     void SetVertexData(GLfloat * vertices, int count = 0);
     void DrawArrays(int count = 0);
 };
@@ -420,6 +429,32 @@ class cOglCmdRenderFbToBufferFb:public cOglCmd
     virtual bool Execute(void);
 };
 
+class cOglCmdBlitFb:public cOglCmd
+{
+  private:
+    static cOglFb *scratch;             // bounce buffer for blits within one fb
+    cOglFb *dest;
+    GLint srcX, srcY;
+    GLint width, height;
+    GLint destX, destY;
+    GLint transparency;
+    bool blend;
+    static void DrawQuad(cOglFb * src, cOglFb * dst, GLint srcX, GLint srcY, GLint width, GLint height, GLint destX,
+        GLint destY);
+  public:
+     cOglCmdBlitFb(cOglFb * fb, cOglFb * dest, const cRect & source, const cPoint & dest_point, GLint transparency,
+        bool blend);
+     virtual ~ cOglCmdBlitFb(void)
+    {
+    };
+    virtual const char *Description(void)
+    {
+        return "Blit Framebuffer";
+    }
+    virtual bool Execute(void);
+    static void Cleanup(void);
+};
+
 class cOglCmdCopyBufferToOutputFb:public cOglCmd
 {
   private:
@@ -532,9 +567,40 @@ class cOglCmdDrawText:public cOglCmd
     virtual bool Execute(void);
 };
 
+/****************************************************************************************
+* cOglTexturePool
+****************************************************************************************/
+#define OGL_TEXPOOL_SIZE 64             // max. pooled textures
+#define OGL_TEXPOOL_RING 3              // textures per size before reusing
+#define OGL_TEXPOOL_GRAIN 16            // size granularity in pixels
+#define OGL_TEXPOOL_BYTES (32 * 1024 * 1024)    // max. pooled texture memory
+#define OGL_TEXPOOL_MAX_IMAGE (OGL_TEXPOOL_BYTES / 2)   // larger images aren't pooled
+
+class cOglTexturePool
+{
+  private:
+    struct sEntry
+    {
+        GLuint texture;
+        GLint width;
+        GLint height;
+        unsigned lastUse;
+    };
+    sEntry entries[OGL_TEXPOOL_SIZE];
+    int count;
+    unsigned tick;
+    long bytes;
+    void Remove(int i);
+  public:
+     cOglTexturePool(void);
+     virtual ~ cOglTexturePool(void);
+    GLuint Upload(const tColor * argb, GLint width, GLint height, GLint * poolWidth, GLint * poolHeight);
+};
+
 class cOglCmdDrawImage:public cOglCmd
 {
   private:
+    static cOglTexturePool *texturePool;
     tColor * argb;
     GLint x, y, width, height;
     bool overlay;
@@ -548,6 +614,29 @@ class cOglCmdDrawImage:public cOglCmd
         return "Draw Image";
     }
     virtual bool Execute(void);
+    static void Cleanup(void);
+};
+
+class cOglCmdDrawBitmap:public cOglCmd
+{
+  private:
+    static GLuint indexTexture;         // reused index plane
+    static GLint indexWidth, indexHeight;
+    static GLuint paletteTexture;       // 256 x 1 palette
+    uint8_t *index;
+    tColor palette[256];
+    GLint x, y, width, height;
+    bool overlay;
+  public:
+     cOglCmdDrawBitmap(cOglFb * fb, uint8_t * index, const tColor * palette, GLint width, GLint height, GLint x,
+        GLint y, bool overlay = true);
+     virtual ~ cOglCmdDrawBitmap(void);
+    virtual const char *Description(void)
+    {
+        return "Draw Bitmap";
+    }
+    virtual bool Execute(void);
+    static void Cleanup(void);
 };
 
 class cOglCmdDrawTexture:public cOglCmd
@@ -583,13 +672,16 @@ class cOglCmdStoreImage:public cOglCmd
     virtual bool Execute(void);
 };
 
+class cOglThread;
+
 class cOglCmdDropImage:public cOglCmd
 {
   private:
-    sOglImage * imageRef;
+    cOglThread * oglThread;
+    int slot;
     cCondWait *wait;
   public:
-     cOglCmdDropImage(sOglImage * imageRef, cCondWait * wait);
+     cOglCmdDropImage(cOglThread * oglThread, int slot, cCondWait * wait = NULL);
      virtual ~ cOglCmdDropImage(void)
     {
     };
@@ -604,6 +696,7 @@ class cOglCmdDropImage:public cOglCmd
 * cOglThread
 ******************************************************************************/
 #define OGL_MAX_OSDIMAGES 256
+#define OGL_IMAGE_BUCKETS 512           // power of two
 #define OGL_CMDQUEUE_SIZE 100
 
 class cOglThread:public cThread
@@ -615,8 +708,17 @@ class cOglThread:public cThread
      std::queue < cOglCmd * >commands;
     GLint maxTextureSize;
     sOglImage imageCache[OGL_MAX_OSDIMAGES];
-    long memCached;
-    long maxCacheSize;
+    int freeSlots[OGL_MAX_OSDIMAGES];
+    int freeCount;
+    int imageBuckets[OGL_IMAGE_BUCKETS];
+    int lruHead;
+    int lruTail;
+    int64_t memCached;
+    int64_t maxCacheSize;
+    unsigned imageHits;
+    unsigned imageMisses;
+    unsigned imageEvictions;
+    unsigned imageRejects;
     bool InitOpenGL(void);
     bool InitShaders(void);
     void DeleteShaders(void);
@@ -624,8 +726,11 @@ class cOglThread:public cThread
     bool InitVertexBuffers(void);
     void DeleteVertexBuffers(void);
     void Cleanup(void);
-    int GetFreeSlot(void);
-    void ClearSlot(int slot);
+    int FindImage(uint64_t hash, int width, int height);
+    void UnlinkImage(int i);
+    void LruUnlink(int i);
+    void LruAppend(int i);
+    int Evict(int64_t need, int *drop);
   protected:
      virtual void Action(void);
   public:
@@ -636,6 +741,8 @@ class cOglThread:public cThread
     int StoreImage(const cImage & image);
     void DropImageData(int imageHandle);
     sOglImage *GetImageRef(int slot);
+    void ReleaseSlot(int i);
+    void GetImageStats(char *buf, size_t size);
     int MaxTextureSize(void)
     {
         return maxTextureSize;
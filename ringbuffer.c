@@ -241,6 +241,44 @@ size_t RingBufferReadAdvance(RingBuffer * rb, size_t cnt)
     return cnt;
 }
 
+/**
+**	Insert zero bytes in front of the unread data.
+**
+**	Moves the read pointer back, this is a reader operation.
+**
+**	@param rb	Ring buffer to pad.
+**	@param cnt	Number of zero bytes to be inserted.
+**
+**	@returns	Number of bytes that could be inserted in ring buffer.
+*/
+size_t RingBufferReadPad(RingBuffer * rb, size_t cnt)
+{
+    size_t n;
+
+    n = rb->Size - atomic_read(&rb->Filled);
+    if (cnt > n) {                      // not enough space
+        cnt = n;
+    }
+    //
+    //  Hitting start of buffer?
+    //
+    n = rb->ReadPointer - rb->Buffer;
+    if (n >= cnt) {                     // don't cross the start
+        rb->ReadPointer -= cnt;
+        memset((char *)rb->ReadPointer, 0, cnt);
+    } else {                            // cross the start
+        memset(rb->Buffer, 0, n);
+        rb->ReadPointer = rb->BufferEnd - (cnt - n);
+        memset((char *)rb->ReadPointer, 0, cnt - n);
+    }
+
+    //
+    //  Only atomic modification!
+    //
+    atomic_add(cnt, &rb->Filled);
+    return cnt;
+}
+
 /**
 **	Read from a ring buffer.
 **
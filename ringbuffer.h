@@ -53,6 +53,9 @@ extern size_t RingBufferGetReadPointer(RingBuffer *, const void **);
 /// advance read pointer of ring buffer
 extern size_t RingBufferReadAdvance(RingBuffer *, size_t);
 
+/// insert zeros in front of ring buffer
+extern size_t RingBufferReadPad(RingBuffer *, size_t);
+
 /// free bytes ring buffer
 extern size_t RingBufferFreeBytes(RingBuffer *);
 
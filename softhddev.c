@@ -26,6 +26,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #ifdef __FreeBSD__
 #include <signal.h>
 #endif
@@ -49,6 +50,9 @@
 #define __USE_GNU
 #endif
 #include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 #include "iatomic.h"                    // portable atomic_t
 #include "misc.h"
@@ -69,6 +73,9 @@ static void DumpMpeg(const uint8_t * data, int size);
 
 extern int ConfigAudioBufferTime;       ///< config size ms of audio buffer
 extern int ConfigVideoBlackPicture;	    ///< config enable black picture mode
+extern int ConfigVideoBufferSD;         ///< config SD video buffer budget in MB
+extern int ConfigVideoBufferHD;         ///< config HD video buffer budget in MB
+extern int ConfigVideoBufferUHD;        ///< config UHD video buffer budget in MB
 char ConfigStartX11Server;              ///< flag start the x11 server
 static signed char ConfigStartSuspended;    ///< flag to start in suspend mode
 
@@ -86,6 +93,8 @@ static volatile char NewAudioStream;    ///< new audio stream
 static volatile char SkipAudio;         ///< skip audio stream
 AudioDecoder *MyAudioDecoder;    ///< audio decoder
 static enum AVCodecID AudioCodecID;     ///< current codec id
+static int AudioLpcmFormat;             ///< current LPCM format byte
+static int AudioLpcmRejected = -1;      ///< last unsupported LPCM format byte
 static int AudioChannelID;              ///< current audio channel id
 static VideoStream *AudioSyncStream;    ///< video stream for audio/video sync
 
@@ -364,8 +373,8 @@ static int Ac3Check(const uint8_t * data, int size)
 {
     int frame_size;
 
-    if (size < 5) {                     // need 5 bytes to see if AC-3/E-AC-3
-        return -5;
+    if (size < 6) {                     // need 6 bytes to see if AC-3/E-AC-3
+        return -6;
     }
 
     if (data[5] > (10 << 3)) {          // E-AC-3
@@ -403,6 +412,91 @@ static int Ac3Check(const uint8_t * data, int size)
     return 0;
 }
 
+///
+/// Fast check for DTS audio.
+///
+/// 4 bytes 0x7FFE8001 DTS audio (16-bit big-endian core)
+///
+static inline int FastDtsCheck(const uint8_t * p)
+{
+    if (p[0] != 0x7F || p[1] != 0xFE) { // 32bit sync
+        return 0;
+    }
+    if (p[2] != 0x80 || p[3] != 0x01) {
+        return 0;
+    }
+    return 1;
+}
+
+///
+/// Check for DTS audio.
+///
+/// 0x7FFE8001 already checked.
+///
+/// @param data incomplete PES packet
+/// @param size number of bytes
+///
+/// @retval <0  possible DTS audio, but need more data
+/// @retval 0   no valid DTS audio
+/// @retval >0  valid DTS audio
+///
+/// o DTS core header
+/// AAAAAAAA AAAAAAAA AAAAAAAA AAAAAAAA BCCCCCDE EEEEEEFF FFFFFFFF FFFFGGGG
+///
+/// o A*32  sync word 0x7FFE8001
+/// o B*1   frame type
+/// o C*5   deficit sample count
+/// o D*1   CRC present
+/// o E*7   number of PCM sample blocks - 1
+/// o F*14  frame size - 1
+/// o G*6   ..
+///
+/// o DTS-HD extension substream (follows the core)
+/// AAAAAAAA AAAAAAAA AAAAAAAA AAAAAAAA BBBBBBBB CCDEEEEE ...
+///
+/// o A*32  sync word 0x64582025
+/// o B*8   user defined bits
+/// o C*2   extension substream index
+/// o D*1   header size type, selects 8/16 or 12/20 bits header/frame size
+///
+static int DtsCheck(const uint8_t * data, int size)
+{
+    int frame_size;
+
+    if (size < 10) {
+        return -10;
+    }
+
+    frame_size = (((data[5] & 0x03) << 12) | (data[6] << 4) | (data[7] >> 4)) + 1;
+    if (frame_size < 96) {              // invalid frame size
+        return 0;
+    }
+    if (frame_size + 12 > size) {
+        return -frame_size - 12;
+    }
+    if (data[frame_size] == 0x64 && data[frame_size + 1] == 0x58 && data[frame_size + 2] == 0x20
+        && data[frame_size + 3] == 0x25) {
+        const uint8_t *x;
+
+        x = data + frame_size;
+        if (x[5] & 0x20) {
+            frame_size += (((x[6] & 0x01) << 19) | (x[7] << 11) | (x[8] << 3) | (x[9] >> 5)) + 1;
+        } else {
+            frame_size += (((x[6] & 0x1F) << 11) | (x[7] << 3) | (x[8] >> 5)) + 1;
+        }
+    }
+
+    if (frame_size + 4 > size) {
+        return -frame_size - 4;
+    }
+    // check if after this frame a new DTS frame starts
+    if (FastDtsCheck(data + frame_size)) {
+        return frame_size;
+    }
+
+    return 0;
+}
+
 ///
 /// Fast check for ADTS Audio Data Transport Stream.
 ///
@@ -567,6 +661,8 @@ static void PesInit(PesDemux * pesdx)
     if (!pesdx->Buffer) {
         Fatal(_("pesdemux: out of memory\n"));
     }
+    MemReserve(MEM_PES, PES_MAX_PAYLOAD + AV_INPUT_BUFFER_PADDING_SIZE,
+        PES_MAX_PAYLOAD + AV_INPUT_BUFFER_PADDING_SIZE);
     PesReset(pesdx);
 }
 
@@ -653,6 +749,7 @@ static void PesParse(PesDemux * pesdx, const uint8_t * data, int size, int is_st
                     // 6 bytes 0x0B77xxxxxxxx E-AC-3 audio
                     // 3 bytes 0x56Exxx AAC LATM audio
                     // 7/9 bytes 0xFFFxxxxxxxxxxx ADTS audio
+                    // 4 bytes 0x7FFE8001 DTS audio
                     // PCM audio can't be found
                     // FIXME: simple+faster detection, if codec already known
                     if (FastMpegCheck(q)) {
@@ -674,6 +771,10 @@ static void PesParse(PesDemux * pesdx, const uint8_t * data, int size, int is_st
                         r = AdtsCheck(q, n);
                         codec_id = AV_CODEC_ID_AAC;
                     }
+                    if (!r && FastDtsCheck(q)) {
+                        r = DtsCheck(q, n);
+                        codec_id = AV_CODEC_ID_DTS;
+                    }
                     if (r < 0) {        // need more bytes
                         break;
                     }
@@ -780,25 +881,26 @@ static void PesParse(PesDemux * pesdx, const uint8_t * data, int size, int is_st
                     pesdx->HeaderSize += pesdx->Header[8];
                     // have complete header
                 } else if (pesdx->HeaderIndex == pesdx->HeaderSize) {
+                    const uint8_t *h;
                     int64_t pts;
                     int64_t dts;
 
-                    if ((pesdx->Header[7] & 0xC0) == 0x80) {
+                    // the header can be split over ts packets, use the copy
+                    h = pesdx->Header;
+                    if ((h[7] & 0xC0) == 0x80 && pesdx->HeaderSize >= 14) {
                         pts =
-                            (int64_t) (data[9] & 0x0E) << 29 | data[10] << 22 | (data[11] & 0xFE) << 14 | data[12] << 7
-                            | (data[13]
-                            & 0xFE) >> 1;
+                            (int64_t) (h[9] & 0x0E) << 29 | h[10] << 22 | (h[11] & 0xFE) << 14 | h[12] << 7 | (h[13] &
+                            0xFE) >> 1;
                         pesdx->PTS = pts;
                         pesdx->DTS = AV_NOPTS_VALUE;
-                    } else if ((pesdx->Header[7] & 0xC0) == 0xC0) {
+                    } else if ((h[7] & 0xC0) == 0xC0 && pesdx->HeaderSize >= 19) {
                         pts =
-                            (int64_t) (data[9] & 0x0E) << 29 | data[10] << 22 | (data[11] & 0xFE) << 14 | data[12] << 7
-                            | (data[13]
-                            & 0xFE) >> 1;
+                            (int64_t) (h[9] & 0x0E) << 29 | h[10] << 22 | (h[11] & 0xFE) << 14 | h[12] << 7 | (h[13] &
+                            0xFE) >> 1;
                         pesdx->PTS = pts;
                         dts =
-                            (int64_t) (data[14] & 0x0E) << 29 | data[15] << 22 | (data[16] & 0xFE) << 14 | data[17] <<
-                            7 | (data[18] & 0xFE) >> 1;
+                            (int64_t) (h[14] & 0x0E) << 29 | h[15] << 22 | (h[16] & 0xFE) << 14 | h[17] << 7 | (h[18] &
+                            0xFE) >> 1;
                         pesdx->DTS = dts;
                         Debug(4, "pesdemux: pts %#012" PRIx64 " %#012" PRIx64 "\n", pts, dts);
                     }
@@ -1092,49 +1194,55 @@ int PlayAudio(const uint8_t * data, int size, uint8_t id)
     }
     // Private stream + LPCM ID
     if ((id & 0xF0) == 0xA0) {
-        if (n < 7) {
+        int samplerate;
+        int channels;
+        int bits_per_sample;
+
+        if (n < LPCM_HEADER_SIZE) {
             Error(_("[softhddev] invalid LPCM audio packet %d bytes\n"), size);
             return size;
         }
-        if (AudioCodecID != AV_CODEC_ID_PCM_DVD) {
-            static int samplerates[] = { 48000, 96000, 44100, 32000 };
-            int samplerate;
-            int channels;
-            int bits_per_sample;
+        if (AudioLpcmHeader(p, &samplerate, &bits_per_sample, &channels)) {
+            // drop the packets, report a format only once
+            if (AudioLpcmRejected != p[LPCM_FORMAT]) {
+                Error(_("[softhddev] LPCM %d bit %d channels aren't supported\n"), bits_per_sample, channels);
+                AudioLpcmRejected = p[LPCM_FORMAT];
+            }
+            AudioCodecID = AV_CODEC_ID_NONE;
+            return size;
+        }
+        if (AudioCodecID != AV_CODEC_ID_PCM_DVD || AudioLpcmFormat != p[LPCM_FORMAT]) {
+            int rate;
+            int ch;
 
-            Debug(3, "[softhddev]%s: LPCM %d sr:%d bits:%d chan:%d\n", __FUNCTION__, id, p[5] >> 4,
-                (((p[5] >> 6) & 0x3) + 4) * 4, (p[5] & 0x7) + 1);
+            Debug(3, "[softhddev]%s: LPCM %d sr:%d bits:%d chan:%d\n", __FUNCTION__, id, samplerate,
+                bits_per_sample, channels);
             CodecAudioClose(MyAudioDecoder);
 
-            bits_per_sample = (((p[5] >> 6) & 0x3) + 4) * 4;
-            if (bits_per_sample != 16) {
-                Error(_("[softhddev] LPCM %d bits per sample aren't supported\n"), bits_per_sample);
-                // FIXME: handle unsupported formats.
-            }
-            samplerate = samplerates[p[5] >> 4];
-            channels = (p[5] & 0x7) + 1;
-
             // FIXME: ConfigAudioBufferTime + x
             AudioSetBufferTime(400);
-            AudioSetup(&samplerate, &channels, 0);
-            if (samplerate != samplerates[p[5] >> 4]) {
-                Error(_("[softhddev] LPCM %d sample-rate is unsupported\n"), samplerates[p[5] >> 4]);
+            rate = samplerate;
+            ch = channels;
+            AudioSetup(&rate, &ch, 0);
+            if (rate != samplerate) {
+                Error(_("[softhddev] LPCM %d sample-rate is unsupported\n"), samplerate);
                 // FIXME: support resample
             }
-            if (channels != (p[5] & 0x7) + 1) {
-                Error(_("[softhddev] LPCM %d channels are unsupported\n"), (p[5] & 0x7) + 1);
+            if (ch != channels) {
+                Error(_("[softhddev] LPCM %d channels are unsupported\n"), channels);
                 // FIXME: support resample
             }
             //CodecAudioOpen(MyAudioDecoder, AV_CODEC_ID_PCM_DVD);
             AudioCodecID = AV_CODEC_ID_PCM_DVD;
+            AudioLpcmFormat = p[LPCM_FORMAT];
         }
 
         if (AudioAvPkt->pts != (int64_t) AV_NOPTS_VALUE) {
             AudioSetClock(AudioAvPkt->pts);
             AudioAvPkt->pts = AV_NOPTS_VALUE;
         }
-        swab(p + 7, AudioAvPkt->data, n - 7);
-        AudioEnqueue(AudioAvPkt->data, n - 7);
+        // byte swap, unpack and reorder straight into the audio ring
+        AudioEnqueueLpcm(p + LPCM_HEADER_SIZE, n - LPCM_HEADER_SIZE, bits_per_sample, channels);
 
         return size;
     }
@@ -1162,6 +1270,7 @@ int PlayAudio(const uint8_t * data, int size, uint8_t id)
         // 5 bytes 0x0B77xxxxxx AC-3 audio
         // 6 bytes 0x0B77xxxxxxxx E-AC-3 audio
         // 7/9 bytes 0xFFFxxxxxxxxxxx ADTS audio
+        // 4 bytes 0x7FFE8001 DTS audio
         // PCM audio can't be found
         r = 0;
         codec_id = AV_CODEC_ID_NONE;    // keep compiler happy
@@ -1189,6 +1298,10 @@ int PlayAudio(const uint8_t * data, int size, uint8_t id)
             r = AdtsCheck(p, n);
             codec_id = AV_CODEC_ID_AAC;
         }
+        if ((id == 0xbd || (id & 0xF0) == 0x80) && !r && FastDtsCheck(p)) {
+            r = DtsCheck(p, n);
+            codec_id = AV_CODEC_ID_DTS;
+        }
         if (r < 0) {                    // need more bytes
             break;
         }
@@ -1316,7 +1429,13 @@ void ResetChannelId(void)
     Debug(3, "audio/demux: reset channel id\n");
 }
 
-#define VIDEO_BUFFER_SIZE (1024 * 1024) ///< video PES buffer default size  512 * 1024
+#define VIDEO_ARENA_MIN_MB 4            ///< min. packet arena budget in MB
+#define VIDEO_ARENA_ALIGN 64            ///< alignment of packets in the arena
+#define VIDEO_MAX_DURATION 8000         ///< max. queued video in ms
+
+/// arena bytes for a packet of len bytes including decoder padding
+#define VideoArenaNeed(len) \
+    (((len) + AV_INPUT_BUFFER_PADDING_SIZE + VIDEO_ARENA_ALIGN - 1) & ~(VIDEO_ARENA_ALIGN - 1))
 
 #if 0
 //////////////////////////////////////////////////////////////////////////////
@@ -1382,27 +1501,90 @@ static volatile char Usr1Signal;        ///< true got usr1 signal
 
 //////////////////////////////////////////////////////////////////////////////
 
+/**
+**  Get arena byte budget for a video codec.
+**
+**  The codec is the resolution hint: MPEG-2 is SD, H.264 HD and
+**  H.265 UHD.
+**
+**  @param codec_id codec id of the stream
+*/
+static int VideoArenaBudget(int codec_id)
+{
+    int mb;
+
+    switch (codec_id) {
+        case AV_CODEC_ID_MPEG2VIDEO:
+            mb = ConfigVideoBufferSD;
+            break;
+        case AV_CODEC_ID_HEVC:
+            mb = ConfigVideoBufferUHD;
+            break;
+        default:
+            mb = ConfigVideoBufferHD;
+            break;
+    }
+    if (mb < VIDEO_ARENA_MIN_MB) {
+        mb = VIDEO_ARENA_MIN_MB;
+    }
+    return mb * 1024 * 1024;
+}
+
 /**
 **  Initialize video packet ringbuffer.
 **
+**  The packets don't own memory, their data points into one arena
+**  which is only mapped, pages become resident when the ring reaches
+**  them. Each packet takes the space it needs, the ring wraps at the
+**  byte budget of the current stream.
+**
 **  @param stream   video stream
 */
 static void VideoPacketInit(VideoStream * stream)
 {
     int i;
+    int tag;
+
+    stream->ArenaSize = VideoArenaBudget(AV_CODEC_ID_MPEG2VIDEO);
+    if (stream->ArenaSize < VideoArenaBudget(AV_CODEC_ID_H264)) {
+        stream->ArenaSize = VideoArenaBudget(AV_CODEC_ID_H264);
+    }
+    if (stream->ArenaSize < VideoArenaBudget(AV_CODEC_ID_HEVC)) {
+        stream->ArenaSize = VideoArenaBudget(AV_CODEC_ID_HEVC);
+    }
+    tag = stream == PipVideoStream ? MEM_PIP : MEM_VIDEO;
+    stream->ArenaSize = MemReserve(tag, stream->ArenaSize, VIDEO_ARENA_MIN_MB * 1024 * 1024);
+    stream->Arena = mmap(NULL, stream->ArenaSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (stream->Arena == MAP_FAILED) {
+        stream->Arena = NULL;
+        MemRelease(tag, stream->ArenaSize);
+        Fatal(_("[softhddev] out of memory\n"));
+    }
+    stream->ArenaBudget = VideoArenaBudget(AV_CODEC_ID_H264);
+    if (stream->ArenaBudget > stream->ArenaSize) {
+        stream->ArenaBudget = stream->ArenaSize;
+    }
+    stream->ArenaEnd = stream->ArenaBudget;
+    stream->ArenaPrevEnd = stream->ArenaBudget;
+    stream->ArenaHigh = stream->ArenaBudget;
+    stream->ArenaWrite = 0;
+    stream->ArenaWaste = 0;
+    atomic_set(&stream->ArenaFilled, 0);
 
     for (i = 0; i < VIDEO_PACKET_MAX; ++i) {
         AVPacket *avpkt;
 
         avpkt = &stream->PacketRb[i];
-        // build a clean ffmpeg av packet
-        if (av_new_packet(avpkt, VIDEO_BUFFER_SIZE)) {
-            Fatal(_("[softhddev] out of memory\n"));
-        }
+        memset(avpkt, 0, sizeof(*avpkt));
+        avpkt->data = stream->Arena;
+        stream->ReservedRb[i] = 0;
     }
 
     atomic_set(&stream->PacketsFilled, 0);
     stream->PacketRead = stream->PacketWrite = 0;
+    stream->WritePts = AV_NOPTS_VALUE;
+    stream->ReadPts = AV_NOPTS_VALUE;
+    Debug(3, "video: packet arena %d MB\n", stream->ArenaSize / (1024 * 1024));
 }
 
 /**
@@ -1415,10 +1597,157 @@ static void VideoPacketExit(VideoStream * stream)
     int i;
 
     atomic_set(&stream->PacketsFilled, 0);
+    atomic_set(&stream->ArenaFilled, 0);
 
     for (i = 0; i < VIDEO_PACKET_MAX; ++i) {
-        av_packet_unref(&stream->PacketRb[i]);
+        stream->PacketRb[i].data = NULL;
+        stream->PacketRb[i].size = 0;
+    }
+    if (stream->Arena) {
+        munmap(stream->Arena, stream->ArenaSize);
+        MemRelease(stream == PipVideoStream ? MEM_PIP : MEM_VIDEO, stream->ArenaSize);
+        stream->Arena = NULL;
+    }
+}
+
+/**
+**  Release the packet ringbuffer, called from the reader.
+**
+**  @param stream   video stream
+*/
+static void VideoPacketClear(VideoStream * stream)
+{
+    atomic_set(&stream->PacketsFilled, 0);
+    atomic_set(&stream->ArenaFilled, 0);
+    stream->PacketRead = stream->PacketWrite;
+    stream->ReadPts = AV_NOPTS_VALUE;
+}
+
+/**
+**  Check where the packet in progress fits into the arena.
+**
+**  @param stream   video stream
+**  @param need     bytes needed for the packet including padding
+**
+**  @retval 1   packet fits in place
+**  @retval 2   packet fits at the start of the arena
+**  @retval 0   arena full
+*/
+static int VideoArenaFits(const VideoStream * stream, int need)
+{
+    int filled;
+    int pos;
+
+    filled = atomic_read(&stream->ArenaFilled) + stream->ArenaWaste;
+    pos = stream->ArenaWrite;
+
+    // fits in place: behind all queued data of this lap and before the
+    // queued data of the previous lap
+    if (pos + need <= stream->ArenaEnd && (filled <= pos || filled + need <= stream->ArenaPrevEnd)) {
+        return 1;
+    }
+    // wrap: all queued data must be in this lap, behind the new packet
+    if (!pos || need > stream->ArenaBudget || (filled && filled + need > pos)) {
+        return 0;
+    }
+    return 2;
+}
+
+/**
+**  Make room in the arena for the packet in progress.
+**
+**  The packet must stay contiguous for the decoder. If it doesn't fit
+**  before the wrap offset it is moved to the start of the arena, the
+**  skipped tail is accounted to the packet until it is decoded.
+**
+**  @param stream   video stream
+**  @param need     bytes needed for the packet including padding
+**
+**  @retval 0   packet has room
+**  @retval -1  arena full
+*/
+static int VideoArenaReserve(VideoStream * stream, int need)
+{
+    AVPacket *avpkt;
+    int pos;
+    int end;
+
+    switch (VideoArenaFits(stream, need)) {
+        case 0:
+            return -1;
+        case 1:
+            return 0;
     }
+    avpkt = &stream->PacketRb[stream->PacketWrite];
+    pos = stream->ArenaWrite;
+    end = stream->ArenaBudget;
+    memmove(stream->Arena, stream->Arena + pos, avpkt->stream_index);
+    avpkt->data = stream->Arena;
+
+    // pages behind both laps are no longer used, return them
+    if (stream->ArenaHigh > end && stream->ArenaHigh > stream->ArenaEnd) {
+        int keep;
+
+        keep = end > stream->ArenaEnd ? end : stream->ArenaEnd;
+        keep = (keep + getpagesize() - 1) & ~(getpagesize() - 1);
+        if (keep < stream->ArenaHigh) {
+            madvise(stream->Arena + keep, stream->ArenaHigh - keep, MADV_DONTNEED);
+            Debug(3, "video: packet arena trimmed to %d KB\n", keep / 1024);
+            stream->ArenaHigh = keep;
+        }
+    }
+    if (end > stream->ArenaHigh) {
+        stream->ArenaHigh = end;
+    }
+
+    stream->ArenaWaste += stream->ArenaEnd - pos;
+    stream->ArenaPrevEnd = stream->ArenaEnd;
+    stream->ArenaEnd = end;
+    stream->ArenaWrite = 0;
+    return 0;
+}
+
+/**
+**  Check if the video packet ringbuffer is full.
+**
+**  Limits are the byte budget of the stream and the queued duration,
+**  the slot count is only a hard limit. 1/8 of the budget is kept free,
+**  so a packet can still wrap to the arena start.  The packet in
+**  progress counts with the added bytes and must stay contiguous, a
+**  packet without room would be dropped.  With nothing queued the
+**  reader can't make room, then only the slot count limits.
+**
+**  @param stream   video stream
+**  @param size     bytes which should be added
+*/
+static int VideoPacketsFull(const VideoStream * stream, int size)
+{
+    int64_t duration;
+    int filled;
+    int need;
+
+    filled = atomic_read(&stream->PacketsFilled);
+    if (filled >= VIDEO_PACKET_MAX - 10) {
+        return 1;
+    }
+    if (filled) {
+        need = VideoArenaNeed(stream->PacketRb[stream->PacketWrite].stream_index + size);
+        if (atomic_read(&stream->ArenaFilled) + stream->ArenaWaste + need >
+            stream->ArenaBudget - stream->ArenaBudget / 8) {
+            return 1;
+        }
+        if (!VideoArenaFits(stream, need)) {
+            return 1;
+        }
+    }
+    if (!stream->TrickSpeed && stream->WritePts != (int64_t) AV_NOPTS_VALUE
+        && stream->ReadPts != (int64_t) AV_NOPTS_VALUE) {
+        duration = PtsDiff(stream->ReadPts, stream->WritePts);
+        if (duration > VIDEO_MAX_DURATION * 90) {
+            return 1;
+        }
+    }
+    return 0;
 }
 
 /**
@@ -1441,22 +1770,11 @@ static void VideoEnqueue(VideoStream * stream, int64_t pts, int64_t dts, const v
         avpkt->dts = dts;
     }
 
-    if (avpkt->stream_index + size >= avpkt->size) {
-
-        // Warning(_("video: packet buffer too small for %d\n"),
-        // avpkt->stream_index + size);
-
-        // new + grow reserves FF_INPUT_BUFFER_PADDING_SIZE
-        av_grow_packet(avpkt, ((size + VIDEO_BUFFER_SIZE / 2)
-                / (VIDEO_BUFFER_SIZE / 2)) * (VIDEO_BUFFER_SIZE / 2));
-        // FIXME: out of memory!
-#ifdef DEBUG
-        if (avpkt->size <= avpkt->stream_index + size) {
-            fprintf(stderr, "%d %d %d\n", avpkt->size, avpkt->stream_index, size);
-            fflush(stderr);
-            abort();
-        }
-#endif
+    if (VideoArenaReserve(stream, VideoArenaNeed(avpkt->stream_index + size))) {
+        // no room in arena drop the packet
+        Error(_("video: no room for %d bytes in packet arena\n"), avpkt->stream_index + size);
+        avpkt->stream_index = 0;
+        return;
     }
 
     memcpy(avpkt->data + avpkt->stream_index, data, size);
@@ -1482,6 +1800,8 @@ static void VideoResetPacket(VideoStream * stream)
 
     stream->CodecIDRb[stream->PacketWrite] = AV_CODEC_ID_NONE;
     avpkt = &stream->PacketRb[stream->PacketWrite];
+    avpkt->data = stream->Arena + stream->ArenaWrite;
+    avpkt->size = 0;
     avpkt->stream_index = 0;
     avpkt->pts = AV_NOPTS_VALUE;
     avpkt->dts = AV_NOPTS_VALUE;
@@ -1496,6 +1816,7 @@ static void VideoResetPacket(VideoStream * stream)
 static void VideoNextPacket(VideoStream * stream, int codec_id)
 {
     AVPacket *avpkt;
+    int used;
 
     avpkt = &stream->PacketRb[stream->PacketWrite];
     if (!avpkt->stream_index) {         // ignore empty packets
@@ -1505,7 +1826,8 @@ static void VideoNextPacket(VideoStream * stream, int codec_id)
         Debug(3, "video: possible stream change loss\n");
     }
 
-    if (atomic_read(&stream->PacketsFilled) >= VIDEO_PACKET_MAX - 1) {
+    if (atomic_read(&stream->PacketsFilled) >= VIDEO_PACKET_MAX - 1
+        || VideoArenaReserve(stream, VideoArenaNeed(avpkt->stream_index))) {
         // no free slot available drop last packet
         Error(_("video: no empty slot in packet ringbuffer\n"));
         avpkt->stream_index = 0;
@@ -1514,13 +1836,28 @@ static void VideoNextPacket(VideoStream * stream, int codec_id)
         }
         return;
     }
-    // clear area for decoder, always enough space allocated
+    // clear area for decoder, always enough space reserved
     memset(avpkt->data + avpkt->stream_index, 0, AV_INPUT_BUFFER_PADDING_SIZE);
 
+    if (codec_id != AV_CODEC_ID_NONE) {
+        stream->ArenaBudget = VideoArenaBudget(codec_id);
+        if (stream->ArenaBudget > stream->ArenaSize) {
+            stream->ArenaBudget = stream->ArenaSize;
+        }
+    }
+    if (avpkt->pts != (int64_t) AV_NOPTS_VALUE) {
+        stream->WritePts = avpkt->pts;
+    }
+    used = VideoArenaNeed(avpkt->stream_index);
+    stream->ReservedRb[stream->PacketWrite] = stream->ArenaWaste + used;
+    stream->ArenaWrite += used;
+    stream->ArenaWaste = 0;
+
     stream->CodecIDRb[stream->PacketWrite] = codec_id;
     // DumpH264(avpkt->data, avpkt->stream_index);
 
     // advance packet write
+    atomic_add(stream->ReservedRb[stream->PacketWrite], &stream->ArenaFilled);
     stream->PacketWrite = (stream->PacketWrite + 1) % VIDEO_PACKET_MAX;
     atomic_inc(&stream->PacketsFilled);
     VideoDisplayWakeup();
@@ -1796,6 +2133,9 @@ static void VideoStreamOpen(VideoStream * stream)
 static void VideoStreamClose(VideoStream * stream, int delhw)
 {
     stream->SkipStream = 1;
+    if (stream == MyVideoStream) {
+        VideoTrickWakeup();             // release the decoder lock
+    }
     if (stream->Decoder) {
         VideoDecoder *decoder;
 
@@ -1846,8 +2186,7 @@ int VideoPollInput(VideoStream * stream)
         return 1;
     }
     if (stream->ClearBuffers) {         // clear buffer request
-        atomic_set(&stream->PacketsFilled, 0);
-        stream->PacketRead = stream->PacketWrite;
+        VideoPacketClear(stream);
         // FIXME: ->Decoder already checked
         Debug(3, "Clear buffer request in Poll\n");
         if (stream->Decoder) {
@@ -1889,8 +2228,7 @@ int VideoDecodeInput(VideoStream * stream)
     }
 		
     if (stream->ClearBuffers) {         // clear buffer request
-        atomic_set(&stream->PacketsFilled, 0);
-        stream->PacketRead = stream->PacketWrite;
+        VideoPacketClear(stream);
         // FIXME: ->Decoder already checked
         if (stream->Decoder) {
             CodecVideoFlushBuffers(stream->Decoder);
@@ -1914,13 +2252,18 @@ int VideoDecodeInput(VideoStream * stream)
     //  handle queued commands
     //
     avpkt = &stream->PacketRb[stream->PacketRead];
+    // avcodec_decode_video2 needs size, the codec open looks into the packet
+    saved_size = avpkt->size;
+    avpkt->size = avpkt->stream_index;
+    avpkt->stream_index = 0;
+
     switch (stream->CodecIDRb[stream->PacketRead]) {
         case AV_CODEC_ID_NONE:
             stream->ClosingStream = 0;
             if (stream->LastCodecID != AV_CODEC_ID_NONE) {
                 Debug(3, "in VideoDecode make close\n");
                 stream->LastCodecID = AV_CODEC_ID_NONE;
-                CodecVideoClose(stream->HwDecoder);
+                CodecVideoPark(stream->HwDecoder);
                 // FIXME: CodecVideoClose calls/uses hw decoder
                 goto skip;
             }
@@ -1950,11 +2293,6 @@ int VideoDecodeInput(VideoStream * stream)
             break;
     }
 
-    // avcodec_decode_video2 needs size
-    saved_size = avpkt->size;
-    avpkt->size = avpkt->stream_index;
-    avpkt->stream_index = 0;
-
 #if 1
     // fprintf(stderr, "[");
     // DumpMpeg(avpkt->data, avpkt->size);
@@ -1979,10 +2317,13 @@ int VideoDecodeInput(VideoStream * stream)
     }
 #endif
 
-    avpkt->size = saved_size;
-
   skip:
+    avpkt->size = saved_size;
     // advance packet read
+    if (avpkt->pts != (int64_t) AV_NOPTS_VALUE) {
+        stream->ReadPts = avpkt->pts;
+    }
+    atomic_sub(stream->ReservedRb[stream->PacketRead], &stream->ArenaFilled);
     stream->PacketRead = (stream->PacketRead + 1) % VIDEO_PACKET_MAX;
     atomic_dec(&stream->PacketsFilled);
 
@@ -2185,7 +2526,7 @@ int PlayVideo3(VideoStream * stream, const uint8_t * data, int size)
         return size;
     }
     // hard limit buffer full: needed for replay
-    if (atomic_read(&stream->PacketsFilled) >= VIDEO_PACKET_MAX - 10) {
+    if (VideoPacketsFull(stream, size)) {
         // Debug(3, "video: video buffer full\n");
         usleep(20000);
         return 0;
@@ -2194,12 +2535,12 @@ int PlayVideo3(VideoStream * stream, const uint8_t * data, int size)
     // get pts/dts
     pts = AV_NOPTS_VALUE;
     dts = AV_NOPTS_VALUE;
-    if ((data[7] & 0xc0) == 0x80) {
+    if ((data[7] & 0xc0) == 0x80 && n >= 5) {
         pts =
             (int64_t) (data[9] & 0x0E) << 29 | data[10] << 22 | (data[11] & 0xFE) << 14 | data[12] << 7 | (data[13] &
             0xFE) >> 1;
     }
-    if ((data[7] & 0xC0) == 0xc0) {
+    if ((data[7] & 0xC0) == 0xc0 && n >= 10) {
         pts =
             (int64_t) (data[9] & 0x0E) << 29 | data[10] << 22 | (data[11] & 0xFE) << 14 | data[12] << 7 | (data[13] &
             0xFE) >> 1;
@@ -2224,7 +2565,8 @@ int PlayVideo3(VideoStream * stream, const uint8_t * data, int size)
 
     // H264 NAL AUD Access Unit Delimiter (0x00) 0x00 0x00 0x01 0x09
     // and next start code
-    if ((data[6] & 0xC0) == 0x80 && z >= 2 && check[0] == 0x01 && check[1] == 0x09 && !check[3] && !check[4]) {
+    if ((data[6] & 0xC0) == 0x80 && z >= 2 && l >= 5 && check[0] == 0x01 && check[1] == 0x09 && !check[3]
+        && !check[4]) {
         // old PES HDTV recording z == 2 -> stronger check!
         if (stream->CodecID == AV_CODEC_ID_H264) {
             VideoNextPacket(stream, AV_CODEC_ID_H264);
@@ -2237,7 +2579,7 @@ int PlayVideo3(VideoStream * stream, const uint8_t * data, int size)
         return size;
     }
     // HEVC Codec
-    if ((data[6] & 0xC0) == 0x80 && z >= 2 && check[0] == 0x01 && check[1] == 0x46) {
+    if ((data[6] & 0xC0) == 0x80 && z >= 2 && l >= 2 && check[0] == 0x01 && check[1] == 0x46) {
         // old PES HDTV recording z == 2 -> stronger check!
         if (stream->CodecID == AV_CODEC_ID_HEVC) {
             VideoNextPacket(stream, AV_CODEC_ID_HEVC);
@@ -2252,7 +2594,7 @@ int PlayVideo3(VideoStream * stream, const uint8_t * data, int size)
 
     // PES start code 0x00 0x00 0x01 0x00|0xb3
     //if (z > 1 && check[0] == 0x01 && (!check[1] || check[1] == 0xb3)) {
-    if (z > 1 && check[0] == 0x01 && (!check[1] || check[1] == 0xb3)) {
+    if (z > 1 && l >= 4 && check[0] == 0x01 && (!check[1] || check[1] == 0xb3)) {
         if (stream->CodecID == AV_CODEC_ID_MPEG2VIDEO) {
             VideoNextPacket(stream, AV_CODEC_ID_MPEG2VIDEO);
         } else {
@@ -2552,6 +2894,7 @@ void Clear(void)
     int i;
     VideoResetPacket(MyVideoStream);    // terminate work
     MyVideoStream->ClearBuffers = 1;
+    VideoTrickWakeup();                 // decoder may wait for an I-frame
     if (!SkipAudio) {
         AudioFlushBuffers();
     }
@@ -2598,20 +2941,88 @@ void Mute(void)
     //AudioSetVolume(0);
 }
 
+#define STILL_TIMEOUT 500                ///< max. ms to wait for the still frame
+#define STILL_POLL_US 2000              ///< packet queue poll interval in us
+#define STILL_FRAME_US 25000            ///< decode time without trick state
+
 /**
-**  Display the given I-frame as a still picture.
+**  Feed a still picture once, terminated by an end of sequence.
 **
-**  @param data pes frame data
-**  @param size number of bytes in frame
+**  @param data     pes frame data
+**  @param size     number of bytes in frame
 */
-void StillPicture(const uint8_t * data, int size)
+static void StillPictureFeed(const uint8_t * data, int size)
 {
     static uint8_t seq_end_mpeg[] = { 0x00, 0x00, 0x01, 0xB7 };
     // H264 NAL End of Sequence
     static uint8_t seq_end_h264[] = { 0x00, 0x00, 0x00, 0x01, 0x0A };
     // H265 NAL End of Sequence
     static uint8_t seq_end_h265[] = {  0x00, 0x00, 0x00, 0x01, 0x4a, 0x01 }; //0x48 = end of seq   0x4a = end of stream
-    int i;
+    const uint8_t *split;
+    int n;
+
+    // FIXME: vdr pes recordings sends mixed audio/video
+    if ((data[3] & 0xF0) == 0xE0) { // PES packet
+
+        split = data;
+        n = size;
+        // split the I-frame into single pes packets
+        do {
+            int len;
+
+#ifdef DEBUG
+            if (split[0] || split[1] || split[2] != 0x01) {
+                Error(_("[softhddev] invalid still video packet\n"));
+                break;
+            }
+#endif
+            len = (split[4] << 8) + split[5];
+            if (!len || len + 6 > n) {
+                if ((split[3] & 0xF0) == 0xE0) {
+                    // video only
+                    while (!PlayVideo3(MyVideoStream, split, n)) {  // feed remaining bytes
+                    }
+                }
+                break;
+            }
+            if ((split[3] & 0xF0) == 0xE0) {
+                // video only
+                while (!PlayVideo3(MyVideoStream, split, len + 6)) {    // feed it
+                }
+            }
+            split += 6 + len;
+            n -= 6 + len;
+        } while (n > 6);
+
+        VideoNextPacket(MyVideoStream, MyVideoStream->CodecID); // terminate last packet
+    } else {                        // ES packet
+        if (MyVideoStream->CodecID != AV_CODEC_ID_MPEG2VIDEO) {
+            VideoNextPacket(MyVideoStream, AV_CODEC_ID_NONE);   // close last stream
+            MyVideoStream->CodecID = AV_CODEC_ID_MPEG2VIDEO;
+        }
+        VideoEnqueue(MyVideoStream, AV_NOPTS_VALUE, AV_NOPTS_VALUE, data, size);
+    }
+    if (MyVideoStream->CodecID == AV_CODEC_ID_H264) {
+        VideoEnqueue(MyVideoStream, AV_NOPTS_VALUE, AV_NOPTS_VALUE, seq_end_h264, sizeof(seq_end_h264));
+    } else if (MyVideoStream->CodecID == AV_CODEC_ID_HEVC) {
+        VideoEnqueue(MyVideoStream, AV_NOPTS_VALUE, AV_NOPTS_VALUE, seq_end_h265, sizeof(seq_end_h265));
+    } else {
+        VideoEnqueue(MyVideoStream, AV_NOPTS_VALUE, AV_NOPTS_VALUE, seq_end_mpeg, sizeof(seq_end_mpeg));
+    }
+    VideoNextPacket(MyVideoStream, MyVideoStream->CodecID); // terminate last packet
+}
+
+/**
+**  Display the given I-frame as a still picture.
+**
+**  @param data pes frame data
+**  @param size number of bytes in frame
+*/
+void StillPicture(const uint8_t * data, int size)
+{
+    uint32_t start;
+    int intra;
+    int done;
 
     // might be called in Suspended Mode
     if (!MyVideoStream->Decoder || MyVideoStream->SkipStream) {
@@ -2638,88 +3049,39 @@ void StillPicture(const uint8_t * data, int size)
         Error(_("[softhddev] no codec known for still picture\n"));
     }
 
-    // FIXME: can check video backend, if a frame was produced.
-    // output for max reference frames
 #ifdef STILL_DEBUG
     fprintf(stderr, "still-picture\n");
 #endif
 
-    
-    i=5;
-    while (amlFreerun(1) && i--)
-        usleep(20000);
-    amlTrickMode(1);
+    amlFreerun(1);
+    intra = VideoSetTrickIntra(1);      // resets the frame done state
     //amlClearVBuf();
-    
-    for (i = 0; i < 2; ++i) {
-        const uint8_t *split;
-        int n;
-        // FIXME: vdr pes recordings sends mixed audio/video
-        if ((data[3] & 0xF0) == 0xE0) { // PES packet
 
-            split = data;
-            n = size;
-            // split the I-frame into single pes packets
-            do {
-                int len;
+    start = GetMsTicks();
+    StillPictureFeed(data, size);
 
-#ifdef DEBUG
-                if (split[0] || split[1] || split[2] != 0x01) {
-                    Error(_("[softhddev] invalid still video packet\n"));
-                    break;
-                }
-#endif
-                len = (split[4] << 8) + split[5];
-                if (!len || len + 6 > n) {
-                    if ((split[3] & 0xF0) == 0xE0) {
-                        // video only
-                        while (!PlayVideo3(MyVideoStream, split, n)) {  // feed remaining bytes
-                        }
-                    }
-                    break;
-                }
-                if ((split[3] & 0xF0) == 0xE0) {
-                    // video only
-                    while (!PlayVideo3(MyVideoStream, split, len + 6)) {    // feed it
-                    }
-                }
-                split += 6 + len;
-                n -= 6 + len;
-            } while (n > 6);
-
-            VideoNextPacket(MyVideoStream, MyVideoStream->CodecID); // terminate last packet
-        } else {                        // ES packet
-            if (MyVideoStream->CodecID != AV_CODEC_ID_MPEG2VIDEO) {
-                VideoNextPacket(MyVideoStream, AV_CODEC_ID_NONE);   // close last stream
-                MyVideoStream->CodecID = AV_CODEC_ID_MPEG2VIDEO;
-            }
-            VideoEnqueue(MyVideoStream, AV_NOPTS_VALUE, AV_NOPTS_VALUE, data, size);
+    // wait until the decoder has shown the frame
+    if ((done = amlTrickWait(STILL_TIMEOUT)) < 0) {
+        // Kernels without the trick state have no event for the shown
+        // frame and the packet queue has none for the fed packets, so
+        // wait for the queue to empty and give the decoder a frame time.
+        while (VideoGetBuffers(MyVideoStream) && GetMsTicks() - start < STILL_TIMEOUT) {
+            usleep(STILL_POLL_US);
         }
-        if (MyVideoStream->CodecID == AV_CODEC_ID_H264) {
-            VideoEnqueue(MyVideoStream, AV_NOPTS_VALUE, AV_NOPTS_VALUE, seq_end_h264, sizeof(seq_end_h264));
-        } else if (MyVideoStream->CodecID == AV_CODEC_ID_HEVC) {
-            VideoEnqueue(MyVideoStream, AV_NOPTS_VALUE, AV_NOPTS_VALUE, seq_end_h265, sizeof(seq_end_h265));
-        } else {
-            VideoEnqueue(MyVideoStream, AV_NOPTS_VALUE, AV_NOPTS_VALUE, seq_end_mpeg, sizeof(seq_end_mpeg));
-        }
-        VideoNextPacket(MyVideoStream, MyVideoStream->CodecID); // terminate last packet
-        usleep(25000);
+        usleep(STILL_FRAME_US);
     }
-
-    // wait for empty buffers
-    for (i = 0; VideoGetBuffers(MyVideoStream) && i < 50; ++i) {
-        usleep(10 * 1000);
-    }
-    Debug(3, "[softhddev]%s: buffers %d %dms\n", __FUNCTION__, VideoGetBuffers(MyVideoStream), i * 10);
+    Debug(3, "[softhddev]%s: %s after %dms, buffers %d\n", __FUNCTION__,
+        done > 0 ? "shown" : done ? "fed" : "timeout", GetMsTicks() - start, VideoGetBuffers(MyVideoStream));
 #ifdef STILL_DEBUG
     InStillPicture = 0;
 #endif
-    
+
   //  VideoNextPacket(MyVideoStream, AV_CODEC_ID_NONE);   // close last stream
-   
-   usleep(25000);
-   amlTrickMode(0);
-   amlFreerun(0);
+
+    VideoSetTrickIntra(intra);          // back to trick play or normal play
+    if (!intra) {
+        amlFreerun(0);
+    }
     //VideoSetTrickSpeed(MyVideoStream->HwDecoder, 0);
 }
 
@@ -2751,7 +3113,7 @@ int Poll(int timeout)
         filled = atomic_read(&MyVideoStream->PacketsFilled);
         // soft limit + hard limit
         full = (used > AUDIO_MIN_BUFFER_FREE && filled > 3)
-            || AudioFreeBytes() < AUDIO_MIN_BUFFER_FREE || filled >= VIDEO_PACKET_MAX - 10;
+            || AudioFreeBytes() < AUDIO_MIN_BUFFER_FREE || VideoPacketsFull(MyVideoStream, 0);
 
         if (!full || !timeout) {
             return !full;
@@ -2934,6 +3296,475 @@ int ProcessArgs(int argc, char *const argv[])
     return 1;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+//  Thread profiles
+//////////////////////////////////////////////////////////////////////////////
+
+/// thread scheduling profile
+typedef struct _thread_profile_
+{
+    const char *Name;                   ///< role name, setup key "Sched.<name>"
+    int Policy;                         ///< SCHED_FIFO/RR/OTHER, -1 unchanged
+    int Priority;                       ///< real-time priority or nice level
+    uint64_t Cpus;                      ///< core mask, 0 all cores
+    pid_t Tid;                          ///< kernel thread id, 0 not started
+} ThreadProfile;
+
+/// scheduling profiles indexed by thread role
+static ThreadProfile ThreadProfiles[THREAD_ROLE_MAX] = {
+    [THREAD_VIDEO] = {"Video", -1, 0, 0, 0},
+    [THREAD_AUDIO] = {"Audio", -1, 0, 0, 0},
+    [THREAD_OSD] = {"Osd", -1, 0, 0, 0},
+    [THREAD_CEC] = {"Cec", -1, 0, 0, 0},
+    [THREAD_DRM] = {"Drm", -1, 0, 0, 0},
+};
+
+/**
+**	Parse a core list like "4-5,7".
+**
+**	@param list	core list, "all" or "" for all cores
+**	@param[out] cpus	core mask
+**
+**	@returns true if the list is valid.
+*/
+static int ThreadParseCpus(const char *list, uint64_t * cpus)
+{
+    *cpus = 0;
+    if (!*list || !strcasecmp(list, "all")) {
+        return 1;
+    }
+    while (*list) {
+        char *e;
+        long first;
+        long last;
+
+        first = strtol(list, &e, 10);
+        last = first;
+        if (*e == '-') {
+            last = strtol(e + 1, &e, 10);
+        }
+        if (e == list || first < 0 || last < first || last >= 64 || (*e && *e != ',')) {
+            return 0;
+        }
+        while (first <= last) {
+            *cpus |= 1ULL << first++;
+        }
+        list = *e ? e + 1 : e;
+    }
+    return 1;
+}
+
+/**
+**	Format a core mask as core list.
+**
+**	@param cpus	core mask
+**	@param[out] buf	output buffer
+**	@param size	size of output buffer
+*/
+static void ThreadFormatCpus(uint64_t cpus, char *buf, size_t size)
+{
+    size_t len;
+    int i;
+
+    len = 0;
+    buf[0] = '\0';
+    for (i = 0; i < 64 && len < size; i++) {
+        int j;
+
+        if (!(cpus & (1ULL << i))) {
+            continue;
+        }
+        for (j = i; j < 63 && (cpus & (1ULL << (j + 1))); j++) ;
+        len += snprintf(buf + len, size - len, j > i ? "%s%d-%d" : "%s%d", len ? "," : "", i, j);
+        i = j;
+    }
+}
+
+/**
+**	Name of a scheduling policy.
+*/
+static const char *ThreadPolicyName(int policy)
+{
+    switch (policy) {
+        case SCHED_FIFO:
+            return "fifo";
+        case SCHED_RR:
+            return "rr";
+        case SCHED_OTHER:
+            return "other";
+    }
+    return "default";
+}
+
+/**
+**	Set the scheduling profile of a thread role.
+**
+**	The profile is "<policy> [<priority> [<cores>]]", with policy fifo,
+**	rr, other or default.  The priority is the real-time priority for
+**	fifo and rr and the nice level for other.  Cores are a list like
+**	"4-5,7" or all.  Example: "fifo 40 4-5".
+**
+**	@param role	role name (Video, Audio, Osd, Cec, Drm)
+**	@param profile	scheduling profile
+**
+**	@returns true if the role is known and the profile is valid.
+*/
+int ThreadSetProfile(const char *role, const char *profile)
+{
+    ThreadProfile *tp;
+    char policy[16];
+    char cpus[64];
+    uint64_t mask;
+    int policy_id;
+    int priority;
+    int i;
+
+    tp = NULL;
+    for (i = 0; i < THREAD_ROLE_MAX; ++i) {
+        if (!strcasecmp(ThreadProfiles[i].Name, role)) {
+            tp = &ThreadProfiles[i];
+        }
+    }
+    if (!tp) {
+        return 0;
+    }
+    policy[0] = '\0';
+    cpus[0] = '\0';
+    priority = 0;
+    sscanf(profile, "%15s %d %63s", policy, &priority, cpus);
+    if (!policy[0] || !strcasecmp(policy, "default")) {
+        policy_id = -1;
+    } else if (!strcasecmp(policy, "fifo")) {
+        policy_id = SCHED_FIFO;
+    } else if (!strcasecmp(policy, "rr")) {
+        policy_id = SCHED_RR;
+    } else if (!strcasecmp(policy, "other")) {
+        policy_id = SCHED_OTHER;
+    } else {
+        Error(_("softhddev: unknown scheduling policy '%s'\n"), policy);
+        return 0;
+    }
+    if (policy_id == SCHED_FIFO || policy_id == SCHED_RR) {
+        if (priority < sched_get_priority_min(policy_id) || priority > sched_get_priority_max(policy_id)) {
+            Error(_("softhddev: real-time priority %d out of range\n"), priority);
+            return 0;
+        }
+    } else if (priority < -20 || priority > 19) {
+        Error(_("softhddev: nice level %d out of range\n"), priority);
+        return 0;
+    }
+    if (!ThreadParseCpus(cpus, &mask)) {
+        Error(_("softhddev: invalid core list '%s'\n"), cpus);
+        return 0;
+    }
+    // an invalid profile keeps the old one
+    tp->Policy = policy_id;
+    tp->Priority = priority;
+    tp->Cpus = mask;
+    return 1;
+}
+
+/**
+**	Apply the scheduling profile of a role to the calling thread.
+**
+**	Called by each thread when it starts.  Failures (missing
+**	CAP_SYS_NICE, cores not present) are logged, the thread keeps
+**	running with the old settings.
+**
+**	@param role	thread role
+*/
+void ThreadApplyProfile(int role)
+{
+    ThreadProfile *tp;
+    struct sched_param param;
+
+    tp = &ThreadProfiles[role];
+    tp->Tid = syscall(SYS_gettid);
+
+    if (tp->Cpus) {
+        cpu_set_t set;
+        int i;
+
+        CPU_ZERO(&set);
+        for (i = 0; i < 64; i++) {
+            if (tp->Cpus & (1ULL << i)) {
+                CPU_SET(i, &set);
+            }
+        }
+        if (sched_setaffinity(0, sizeof(set), &set)) {
+            Warning(_("softhddev: can't set cores of %s thread: %m\n"), tp->Name);
+        }
+    }
+    switch (tp->Policy) {
+        case SCHED_FIFO:
+        case SCHED_RR:
+            param.sched_priority = tp->Priority;
+            if ((errno = pthread_setschedparam(pthread_self(), tp->Policy, &param))) {
+                Warning(_("softhddev: can't set %s scheduling of %s thread: %m\n"),
+                    ThreadPolicyName(tp->Policy), tp->Name);
+            }
+            break;
+        case SCHED_OTHER:
+            param.sched_priority = 0;
+            pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+            if (setpriority(PRIO_PROCESS, tp->Tid, tp->Priority)) {
+                Warning(_("softhddev: can't set nice level of %s thread: %m\n"), tp->Name);
+            }
+            break;
+    }
+    Debug(3, "softhddev: %s thread %d %s %d\n", tp->Name, tp->Tid, ThreadPolicyName(tp->Policy),
+        tp->Priority);
+}
+
+/**
+**	Report the effective scheduling of all thread roles.
+**
+**	The settings are read back from the kernel, threads which are no
+**	longer in /proc/self/task are reported as stopped.
+**
+**	@param[out] buf	output buffer
+**	@param size	size of output buffer
+*/
+void ThreadGetProfiles(char *buf, size_t size)
+{
+    size_t len;
+    int i;
+
+    len = 0;
+    buf[0] = '\0';
+    for (i = 0; i < THREAD_ROLE_MAX && len < size; ++i) {
+        const ThreadProfile *tp;
+        char path[64];
+        char wanted[192];
+        char cpus[128];
+        struct sched_param param;
+        cpu_set_t set;
+        uint64_t mask;
+        int policy;
+        int j;
+
+        tp = &ThreadProfiles[i];
+        ThreadFormatCpus(tp->Cpus, cpus, sizeof(cpus));
+        snprintf(wanted, sizeof(wanted), "%s %d %s", ThreadPolicyName(tp->Policy), tp->Priority,
+            tp->Cpus ? cpus : "all");
+
+        snprintf(path, sizeof(path), "/proc/self/task/%d", tp->Tid);
+        if (!tp->Tid || access(path, F_OK) || (policy = sched_getscheduler(tp->Tid)) < 0
+            || sched_getparam(tp->Tid, &param) || sched_getaffinity(tp->Tid, sizeof(set), &set)) {
+            len += snprintf(buf + len, size - len, "%-5s stopped (wanted %s)\n", tp->Name, wanted);
+            continue;
+        }
+        mask = 0;
+        for (j = 0; j < 64; j++) {
+            if (CPU_ISSET(j, &set)) {
+                mask |= 1ULL << j;
+            }
+        }
+        ThreadFormatCpus(mask, cpus, sizeof(cpus));
+        len += snprintf(buf + len, size - len, "%-5s tid %d %s %d nice %d cores %s (wanted %s)\n",
+            tp->Name, tp->Tid, ThreadPolicyName(policy & ~SCHED_RESET_ON_FORK), param.sched_priority,
+            getpriority(PRIO_PROCESS, tp->Tid), cpus, wanted);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//  Memory budgets
+//////////////////////////////////////////////////////////////////////////////
+
+/// large buffers of one subsystem
+typedef struct _mem_account_
+{
+    const char *Name;                   ///< tag name, setup key "Budget.<name>"
+    size_t Current;                     ///< bytes reserved now
+    size_t Peak;                        ///< max. bytes reserved
+    size_t Budget;                      ///< max. bytes, 0 unlimited
+    int Short;                          ///< reservations cut by the budget
+    size_t Over;                        ///< max. bytes granted past the budget
+} MemAccount;
+
+/// memory accounts indexed by tag
+static MemAccount MemAccounts[MEM_TAGS] = {
+    [MEM_VIDEO] = {"Video", 0, 0, 0, 0, 0},
+    [MEM_PIP] = {"Pip", 0, 0, 0, 0, 0},
+    [MEM_PES] = {"Pes", 0, 0, 0, 0, 0},
+    [MEM_AUDIO] = {"Audio", 0, 0, 0, 0, 0},
+    [MEM_OSD] = {"Osd", 0, 0, 0, 0, 0},
+    [MEM_IMAGE] = {"Image", 0, 0, 0, 0, 0},
+};
+
+static pthread_mutex_t MemMutex = PTHREAD_MUTEX_INITIALIZER;    ///< account lock
+static size_t MemCurrent;               ///< bytes reserved by all tags
+static size_t MemPeak;                  ///< max. bytes reserved by all tags
+
+/**
+**  Reserve bytes of a large buffer.
+**
+**  If the budget of the tag is exceeded, only the rest of the budget
+**  is granted, but at least @a min bytes.  Callers which can't work
+**  with less pass @a min = @a want, the buffer is only accounted.
+**
+**  @a min is granted even past the budget.  Such an overcommit is
+**  logged as error when it grows, MemGetStats() shows the current and
+**  the max. bytes over the budget.
+**
+**  @param tag  subsystem tag (MEM_VIDEO, ...)
+**  @param want wanted bytes
+**  @param min  bytes needed to work at all
+**
+**  @returns granted bytes, must be released with MemRelease().
+*/
+size_t MemReserve(int tag, size_t want, size_t min)
+{
+    MemAccount *account;
+    size_t granted;
+    size_t over;
+
+    account = &MemAccounts[tag];
+    pthread_mutex_lock(&MemMutex);
+    granted = want;
+    over = 0;
+    if (account->Budget && account->Current + want > account->Budget) {
+        granted = account->Budget > account->Current ? account->Budget - account->Current : 0;
+        if (granted < min) {
+            granted = min;
+        }
+        account->Short++;
+    }
+    account->Current += granted;
+    if (account->Current > account->Peak) {
+        account->Peak = account->Current;
+    }
+    if (account->Budget && account->Current > account->Budget
+        && account->Current - account->Budget > account->Over) {
+        over = account->Over = account->Current - account->Budget;
+    }
+    MemCurrent += granted;
+    if (MemCurrent > MemPeak) {
+        MemPeak = MemCurrent;
+    }
+    pthread_mutex_unlock(&MemMutex);
+
+    if (over) {
+        Error(_("softhddev: %s budget overcommitted by %zu KiB\n"), account->Name, over >> 10);
+    } else if (granted < want) {
+        Warning(_("softhddev: %s budget exceeded, %zu of %zu KiB granted\n"), account->Name, granted >> 10,
+            want >> 10);
+    }
+    return granted;
+}
+
+/**
+**  Release bytes reserved with MemReserve().
+**
+**  @param tag  subsystem tag
+**  @param size granted bytes
+*/
+void MemRelease(int tag, size_t size)
+{
+    MemAccount *account;
+
+    account = &MemAccounts[tag];
+    pthread_mutex_lock(&MemMutex);
+    if (size > account->Current) {
+        size = account->Current;
+    }
+    account->Current -= size;
+    MemCurrent -= size;
+    pthread_mutex_unlock(&MemMutex);
+}
+
+/**
+**  Get the budget of a tag.
+**
+**  @param tag  subsystem tag
+**
+**  @returns budget in bytes, 0 unlimited.
+*/
+size_t MemBudget(int tag)
+{
+    return MemAccounts[tag].Budget;
+}
+
+/**
+**  Set the budget of a tag.
+**
+**  @param name tag name (Video, Pip, Pes, Audio, Osd, Image)
+**  @param value    budget in MB, 0 unlimited
+**
+**  @returns true if the tag is known.
+*/
+int MemSetBudget(const char *name, const char *value)
+{
+    int i;
+
+    for (i = 0; i < MEM_TAGS; ++i) {
+        if (!strcasecmp(MemAccounts[i].Name, name)) {
+            MemAccounts[i].Budget = (size_t)strtoul(value, NULL, 0) * 1024 * 1024;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+**  Get total reserved bytes of all tags.
+*/
+size_t MemTotal(void)
+{
+    return MemCurrent;
+}
+
+/**
+**  Get current, peak, budget and overcommit of all tags and the
+**  process RSS.
+**
+**  @param[out] buf output buffer
+**  @param size size of output buffer
+*/
+void MemGetStats(char *buf, size_t size)
+{
+    MemAccount accounts[MEM_TAGS];
+    size_t current;
+    size_t peak;
+    size_t len;
+    char line[128];
+    long rss;
+    FILE *f;
+    int i;
+
+    pthread_mutex_lock(&MemMutex);
+    memcpy(accounts, MemAccounts, sizeof(accounts));
+    current = MemCurrent;
+    peak = MemPeak;
+    pthread_mutex_unlock(&MemMutex);
+
+    len = 0;
+    buf[0] = '\0';
+    for (i = 0; i < MEM_TAGS && len < size; ++i) {
+        size_t over;
+
+        over = accounts[i].Budget && accounts[i].Current > accounts[i].Budget
+            ? accounts[i].Current - accounts[i].Budget : 0;
+        len += snprintf(buf + len, size - len,
+            "%-5s %8zu KiB peak %8zu KiB budget %6zu MB short %d over %zu KiB peak %zu KiB\n", accounts[i].Name,
+            accounts[i].Current >> 10, accounts[i].Peak >> 10, accounts[i].Budget >> 20, accounts[i].Short,
+            over >> 10, accounts[i].Over >> 10);
+    }
+    rss = -1;
+    if ((f = fopen("/proc/self/status", "r"))) {
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "VmRSS: %ld", &rss) == 1) {
+                break;
+            }
+        }
+        fclose(f);
+    }
+    if (len < size) {
+        snprintf(buf + len, size - len, "total %8zu KiB peak %8zu KiB, process rss %ld KiB\n", current >> 10,
+            peak >> 10, rss);
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //  Init/Exit
 //////////////////////////////////////////////////////////////////////////////
@@ -2966,6 +3797,99 @@ void SoftHdDeviceExit(void)
     pthread_mutex_destroy(&PipVideoStream->DecoderLockMutex);
 
     pthread_mutex_destroy(&MyVideoStream->DecoderLockMutex);
+
+    LogExit();
+}
+
+/// startup phases
+enum
+{
+    START_CODEC,                        ///< codec module
+    START_AUDIO,                        ///< audio output, decoder and cec
+    START_VIDEO,                        ///< video output, drm and decoder
+    START_TOTAL,                        ///< wall time of a (re)start
+    START_PHASES                        ///< number of phases
+};
+
+/// names of the startup phases
+static const char *const StartPhaseName[START_PHASES] = {
+    "codec", "audio", "video", "total"
+};
+
+static uint64_t StartPhaseUs[START_PHASES]; ///< duration of the last phases
+
+/**
+**  Start the audio output and decoder.
+**
+**  @param dummy    unused thread argument
+*/
+static void *StartAudioWorker(void *dummy)
+{
+    uint64_t start;
+
+    start = GetusTicks();
+    AudioInit();
+    av_new_packet(AudioAvPkt, AUDIO_BUFFER_SIZE);
+    MyAudioDecoder = CodecAudioNewDecoder();
+    AudioCodecID = AV_CODEC_ID_NONE;
+    AudioChannelID = -1;
+    StartPhaseUs[START_AUDIO] = GetusTicks() - start;
+
+    return dummy;
+}
+
+/**
+**  Start audio and video output.
+**
+**  Audio (ALSA open and mixer setup) and video (DRM, VFM and decoder
+**  setup) don't depend on each other, the audio side runs in a helper
+**  thread while the video side runs in the caller.  CEC is opened by
+**  its own worker and grabbing needs no setup, both are only used on
+**  demand.
+**
+**  @param audio    start audio output
+**  @param video    start video output
+*/
+static void StartAudioVideo(int audio, int video)
+{
+    pthread_t thread;
+    uint64_t start;
+    int threaded;
+
+    threaded = 0;
+    if (audio) {
+        threaded = !pthread_create(&thread, NULL, StartAudioWorker, NULL);
+        if (!threaded) {
+            StartAudioWorker(NULL);
+        }
+    }
+    if (video) {
+        start = GetusTicks();
+        StartVideo();
+        StartPhaseUs[START_VIDEO] = GetusTicks() - start;
+    }
+    if (threaded) {
+        pthread_join(thread, NULL);
+    }
+}
+
+/**
+**  Get the timing of the last plugin (re)start.
+**
+**  @param[out] buf output buffer
+**  @param size size of output buffer
+*/
+void GetStartStats(char *buf, size_t size)
+{
+    size_t len;
+    int i;
+
+    len = 0;
+    buf[0] = '\0';
+    for (i = 0; i < START_PHASES && len < size; ++i) {
+        len += snprintf(buf + len, size - len, "%-5s %6" PRIu64 ".%03" PRIu64 "ms\n", StartPhaseName[i],
+            StartPhaseUs[i] / 1000, StartPhaseUs[i] % 1000);
+    }
 }
 
 /**
@@ -2977,8 +3901,12 @@ void SoftHdDeviceExit(void)
 */
 int Start(void)
 {
-   
+    uint64_t start;
+
+    memset(StartPhaseUs, 0, sizeof(StartPhaseUs));
+    start = GetusTicks();
     CodecInit();
+    StartPhaseUs[START_CODEC] = GetusTicks() - start;
 
     pthread_mutex_init(&MyVideoStream->DecoderLockMutex, NULL);
 
@@ -2988,16 +3916,7 @@ int Start(void)
 
     if (!ConfigStartSuspended) {
         // FIXME: AudioInit for HDMI after X11 startup
-        // StartAudio();
-        AudioInit();
-        av_new_packet(AudioAvPkt, AUDIO_BUFFER_SIZE);
-        MyAudioDecoder = CodecAudioNewDecoder();
-        AudioCodecID = AV_CODEC_ID_NONE;
-        AudioChannelID = -1;
-
-        if (!ConfigStartX11Server) {
-            StartVideo();
-        }
+        StartAudioVideo(1, !ConfigStartX11Server);
     } else {
         MyVideoStream->SkipStream = 1;
         SkipAudio = 1;
@@ -3006,8 +3925,10 @@ int Start(void)
 #ifndef NO_TS_AUDIO
     PesInit(PesDemuxAudio);
 #endif
-    Info(_("[softhddev] ready%s\n"),
-        ConfigStartSuspended ? ConfigStartSuspended == -1 ? " detached" : " suspended" : "");
+    StartPhaseUs[START_TOTAL] = GetusTicks() - start;
+    Info(_("[softhddev] ready%s in %" PRIu64 "ms (audio %" PRIu64 "ms, video %" PRIu64 "ms)\n"),
+        ConfigStartSuspended ? ConfigStartSuspended == -1 ? " detached" : " suspended" : "",
+        StartPhaseUs[START_TOTAL] / 1000, StartPhaseUs[START_AUDIO] / 1000, StartPhaseUs[START_VIDEO] / 1000);
 
     return ConfigStartSuspended;
 }
@@ -3092,6 +4013,8 @@ void Suspend(int video, int audio, int dox11)
 */
 void Resume(void)
 {
+    uint64_t start;
+
     if (!MyVideoStream->SkipStream && !SkipAudio) { // we are not suspended
         return;
     }
@@ -3101,17 +4024,12 @@ void Resume(void)
     pthread_mutex_lock(&SuspendLockMutex);
     // FIXME: start x11
 
-    if (!MyVideoStream->HwDecoder) {    // video not running
-        StartVideo();
-    }
-    if (!MyAudioDecoder) {              // audio not running
-        // StartAudio();
-        AudioInit();
-        av_new_packet(AudioAvPkt, AUDIO_BUFFER_SIZE);
-        MyAudioDecoder = CodecAudioNewDecoder();
-        AudioCodecID = AV_CODEC_ID_NONE;
-        AudioChannelID = -1;
-    }
+    memset(StartPhaseUs, 0, sizeof(StartPhaseUs));
+    start = GetusTicks();
+    // audio not running, video not running
+    StartAudioVideo(!MyAudioDecoder, !MyVideoStream->HwDecoder);
+    StartPhaseUs[START_TOTAL] = GetusTicks() - start;
+    Debug(3, "[softhddev] resumed in %" PRIu64 "ms\n", StartPhaseUs[START_TOTAL] / 1000);
 
     if (MyVideoStream->Decoder) {
         MyVideoStream->SkipStream = 0;
@@ -93,6 +93,8 @@ extern "C"
     /// Resume plugin
     extern void Resume(void);
 
+    /// Get timing of the last start/resume
+    extern void GetStartStats(char *, size_t);
     /// Get decoder statistics
     extern void GetStats(int *, int *, int *, int *, float *, int *, int *, int *, int *);
     /// C plugin scale video
@@ -108,6 +110,49 @@ extern "C"
     extern int PipPlayVideo(const uint8_t *, int);
     /// Check if Replay
     extern int IsReplay(void);
+
+    /// thread roles with a scheduling profile
+    enum ThreadRole
+    {
+        THREAD_VIDEO,                   ///< decoder display handler
+        THREAD_AUDIO,                   ///< audio play handler
+        THREAD_OSD,                     ///< OpenGL command thread
+        THREAD_CEC,                     ///< CEC worker
+        THREAD_DRM,                     ///< DRM mode refresh worker
+        THREAD_ROLE_MAX                 ///< number of roles
+    };
+
+    /// Set scheduling profile of a thread role
+    extern int ThreadSetProfile(const char *, const char *);
+    /// Apply scheduling profile to the calling thread
+    extern void ThreadApplyProfile(int);
+    /// Get effective scheduling of all thread roles
+    extern void ThreadGetProfiles(char *, size_t);
+
+    /// subsystems with large buffers
+    enum MemTag
+    {
+        MEM_VIDEO,                      ///< video packet arena
+        MEM_PIP,                        ///< pip video packet arena
+        MEM_PES,                        ///< PES demux buffers
+        MEM_AUDIO,                      ///< audio rings
+        MEM_OSD,                        ///< OSD readback buffer
+        MEM_IMAGE,                      ///< OSD image cache
+        MEM_TAGS                        ///< number of tags
+    };
+
+    /// Reserve bytes of a large buffer
+    extern size_t MemReserve(int, size_t, size_t);
+    /// Release bytes of a large buffer
+    extern void MemRelease(int, size_t);
+    /// Get budget of a subsystem
+    extern size_t MemBudget(int);
+    /// Set budget of a subsystem
+    extern int MemSetBudget(const char *, const char *);
+    /// Get bytes reserved by all subsystems
+    extern size_t MemTotal(void);
+    /// Get memory usage of all subsystems
+    extern void MemGetStats(char *, size_t);
     #ifdef __cplusplus
 }
 #endif
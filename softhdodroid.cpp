@@ -92,8 +92,14 @@ static char ConfigSuspendClose;         ///< suspend should close devices
 
 static int ConfigOsdWidth;              ///< config OSD width
 static int ConfigOsdHeight;             ///< config OSD height
+static int ConfigMaxSizeGPUImageCache = 128;    ///< config GPU image cache in MB
        int ConfigVideoBlackPicture = 1; ///< config enable black picture on channel switch
        int ConfigVideoFastSwitch = 1;   ///< config enable fast channel switch
+       int ConfigVideoWarmReuse = 1;    ///< config reuse open decoder on channel switch
+       int ConfigVideoAutoRefresh = 0;  ///< config switch display refresh to stream rate
+       int ConfigVideoBufferSD = 8;     ///< config SD video buffer budget in MB
+       int ConfigVideoBufferHD = 16;    ///< config HD video buffer budget in MB
+       int ConfigVideoBufferUHD = 40;   ///< config UHD video buffer budget in MB
 static char ConfigVideoStudioLevels;    ///< config use studio levels
 
        int ConfigVideoBrightness = 50;  ///< config video brightness
@@ -794,6 +800,7 @@ class cSoftOsdProvider:public cOsdProvider
     static void StopOpenGlThread(void);
     static const cImage *GetImageData(int ImageHandle);
     static void OsdSizeChanged(void);
+    static void GetImageStats(char *, size_t);
      cSoftOsdProvider(void);            ///< OSD provider constructor
      virtual ~ cSoftOsdProvider();      ///< OSD provider destructor
 };
@@ -879,7 +886,7 @@ bool cSoftOsdProvider::StartOpenGlThread(void)
     cCondWait wait;
 
     dsyslog("[softhddev]Trying to start OpenGL Worker Thread");
-    oglThread.reset(new cOglThread(&wait, 0));
+    oglThread.reset(new cOglThread(&wait, ConfigMaxSizeGPUImageCache));
     wait.Wait();
     if (oglThread->Active()) {
         dsyslog("[softhddev]OpenGL Worker Thread successfully started");
@@ -889,6 +896,18 @@ bool cSoftOsdProvider::StartOpenGlThread(void)
     return false;
 }
 
+/**
+**  Get the GPU image cache counters.
+*/
+void cSoftOsdProvider::GetImageStats(char *buf, size_t size)
+{
+    if (oglThread) {
+        oglThread->GetImageStats(buf, size);
+    } else {
+        snprintf(buf, size, "OpenGL Worker Thread not running");
+    }
+}
+
 void cSoftOsdProvider::StopOpenGlThread(void)
 {
     dsyslog("[softhddev]stopping OpenGL Worker Thread ");
@@ -950,6 +969,7 @@ class cMenuSetupSoft:public cMenuSetupPage
     int OsdSize;
     int OsdWidth;
     int OsdHeight;
+    int MaxSizeGPUImageCache;
     int SuspendClose;
 
     int Video;
@@ -959,6 +979,11 @@ class cMenuSetupSoft:public cMenuSetupPage
     int StudioLevels;
     int BlackPicture;
     int FastSwitch;
+    int WarmReuse;
+    int AutoRefresh;
+    int BufferSD;
+    int BufferHD;
+    int BufferUHD;
 
     int Brightness;
     int Contrast;
@@ -984,6 +1009,8 @@ class cMenuSetupSoft:public cMenuSetupPage
     int AudioPassthroughPCM;
     int AudioPassthroughAC3;
     int AudioPassthroughEAC3;
+    int AudioPassthroughDTS;
+    int AudioPassthroughDTSHD;
     int AudioDownmix;
     int AudioSoftvol;
     int AudioCECDevice;
@@ -1090,6 +1117,9 @@ void cMenuSetupSoft::Create(void)
     if (General) {
         Add(new cMenuEditBoolItem(tr("Make primary device"), &MakePrimary, trVDR("no"), trVDR("yes")));
         Add(new cMenuEditBoolItem(tr("Hide main menu entry"), &HideMainMenuEntry, trVDR("no"), trVDR("yes")));
+#ifdef USE_OPENGLOSD
+        Add(new cMenuEditIntItem(tr("GPU mem used for image caching (MB)"), &MaxSizeGPUImageCache, 0, 4000));
+#endif
     
         //
         //  suspend
@@ -1108,6 +1138,11 @@ void cMenuSetupSoft::Create(void)
         //Add(new cMenuEditStraItem(tr("Monitor Type"), &TargetColorSpace, 4, target_colorspace));
         Add(new cMenuEditBoolItem(tr("Black during channel switch"), &BlackPicture, trVDR("no"), trVDR("yes")));
         Add(new cMenuEditBoolItem(tr("Fast channel switch"), &FastSwitch, trVDR("no"), trVDR("yes")));
+        Add(new cMenuEditBoolItem(tr("Reuse decoder on channel switch"), &WarmReuse, trVDR("no"), trVDR("yes")));
+        Add(new cMenuEditBoolItem(tr("Match refresh rate to video"), &AutoRefresh, trVDR("no"), trVDR("yes")));
+        Add(new cMenuEditIntItem(tr("Video buffer SD (MB)"), &BufferSD, 4, 256));
+        Add(new cMenuEditIntItem(tr("Video buffer HD (MB)"), &BufferHD, 4, 256));
+        Add(new cMenuEditIntItem(tr("Video buffer UHD (MB)"), &BufferUHD, 4, 256));
         Add(new cMenuEditBoolItem(tr("Noise Reduction"), &Denoise, trVDR("no"), trVDR("yes")));
         Add(new cMenuEditBoolItem(tr("HDR to SDR Mode"), &HDR2SDR, trVDR("no"), trVDR("yes")));
         Add(new cMenuEditIntItem(*cString::sprintf(tr("Brightness (%d..[%d]..%d)"),
@@ -1142,6 +1177,8 @@ void cMenuSetupSoft::Create(void)
         	Add(new cMenuEditBoolItem(tr("\040\040PCM 5.1 pass-through"), &AudioPassthroughPCM, trVDR("no"), trVDR("yes")));
         	Add(new cMenuEditBoolItem(tr("\040\040AC-3 pass-through"), &AudioPassthroughAC3, trVDR("no"), trVDR("yes")));
         	Add(new cMenuEditBoolItem(tr("\040\040E-AC-3 pass-through"), &AudioPassthroughEAC3, trVDR("no"),trVDR("yes")));
+        	Add(new cMenuEditBoolItem(tr("\040\040DTS pass-through"), &AudioPassthroughDTS, trVDR("no"),trVDR("yes")));
+        	Add(new cMenuEditBoolItem(tr("\040\040DTS-HD pass-through"), &AudioPassthroughDTSHD, trVDR("no"),trVDR("yes")));
 		} else {
             Add(new cMenuEditBoolItem(tr("Enable 5.1 to Stereo downmix"), &AudioDownmix, trVDR("no"), trVDR("yes")));
         }
@@ -1269,6 +1306,7 @@ cMenuSetupSoft::cMenuSetupSoft(void)
     //  suspend
     //
     SuspendClose = ConfigSuspendClose;
+    MaxSizeGPUImageCache = ConfigMaxSizeGPUImageCache;
    
     //
     //  video
@@ -1279,6 +1317,11 @@ cMenuSetupSoft::cMenuSetupSoft(void)
     StudioLevels = ConfigVideoStudioLevels;
     BlackPicture = ConfigVideoBlackPicture;
     FastSwitch = ConfigVideoFastSwitch;
+    WarmReuse = ConfigVideoWarmReuse;
+    AutoRefresh = ConfigVideoAutoRefresh;
+    BufferSD = ConfigVideoBufferSD;
+    BufferHD = ConfigVideoBufferHD;
+    BufferUHD = ConfigVideoBufferUHD;
  
     Brightness = ConfigVideoBrightness;
     Contrast = ConfigVideoContrast;
@@ -1312,6 +1355,8 @@ cMenuSetupSoft::cMenuSetupSoft(void)
     AudioPassthroughPCM = ConfigAudioPassthrough & CodecPCM;
     AudioPassthroughAC3 = ConfigAudioPassthrough & CodecAC3;
     AudioPassthroughEAC3 = ConfigAudioPassthrough & CodecEAC3;
+    AudioPassthroughDTS = ConfigAudioPassthrough & CodecDTS;
+    AudioPassthroughDTSHD = ConfigAudioPassthrough & CodecDTSHD;
     AudioDownmix = ConfigAudioDownmix;
     AudioSoftvol = ConfigAudioSoftvol;
     AudioCECDevice = ConfigAudioCECDevice;
@@ -1360,11 +1405,17 @@ void cMenuSetupSoft::Store(void)
     SetupStore("DetachFromMainMenu", ConfigDetachFromMainMenu = DetachFromMainMenu);
     
     SetupStore("Suspend.Close", ConfigSuspendClose = SuspendClose);
+    SetupStore("MaxSizeGPUImageCache", ConfigMaxSizeGPUImageCache = MaxSizeGPUImageCache);
     
     SetupStore("StudioLevels", ConfigVideoStudioLevels = StudioLevels);
     VideoSetStudioLevels(ConfigVideoStudioLevels);
     SetupStore("BlackPicture", ConfigVideoBlackPicture = BlackPicture);
     SetupStore("FastSwitch", ConfigVideoFastSwitch = FastSwitch);
+    SetupStore("WarmReuse", ConfigVideoWarmReuse = WarmReuse);
+    SetupStore("AutoRefresh", ConfigVideoAutoRefresh = AutoRefresh);
+    SetupStore("VideoBufferSD", ConfigVideoBufferSD = BufferSD);
+    SetupStore("VideoBufferHD", ConfigVideoBufferHD = BufferHD);
+    SetupStore("VideoBufferUHD", ConfigVideoBufferUHD = BufferUHD);
     SetupStore("Brightness", ConfigVideoBrightness = Brightness);
     VideoSetBrightness(ConfigVideoBrightness);
     SetupStore("Contrast", ConfigVideoContrast = Contrast);
@@ -1414,7 +1465,9 @@ void cMenuSetupSoft::Store(void)
     }
     ConfigAudioPassthrough = (AudioPassthroughPCM ? CodecPCM : 0)
         | (AudioPassthroughAC3 ? CodecAC3 : 0)
-        | (AudioPassthroughEAC3 ? CodecEAC3 : 0);
+        | (AudioPassthroughEAC3 ? CodecEAC3 : 0)
+        | (AudioPassthroughDTS ? CodecDTS : 0)
+        | (AudioPassthroughDTSHD ? CodecDTSHD : 0);
     AudioPassthroughState = AudioPassthroughDefault;
     if (AudioPassthroughState) {
         SetupStore("AudioPassthrough", ConfigAudioPassthrough);
@@ -2999,6 +3052,10 @@ bool cPluginSoftHdDevice::SetupParse(const char *name, const char *value)
         ConfigSuspendClose = atoi(value);
         return true;
     }
+    if (!strcasecmp(name, "MaxSizeGPUImageCache")) {
+        ConfigMaxSizeGPUImageCache = atoi(value);
+        return true;
+    }
     if (!strcasecmp(name, "StudioLevels")) {
         VideoSetStudioLevels(ConfigVideoStudioLevels = atoi(value));
         return true;
@@ -3011,6 +3068,26 @@ bool cPluginSoftHdDevice::SetupParse(const char *name, const char *value)
         ConfigVideoFastSwitch = atoi(value);
         return true;
     }
+    if (!strcasecmp(name, "WarmReuse")) {
+        ConfigVideoWarmReuse = atoi(value);
+        return true;
+    }
+    if (!strcasecmp(name, "AutoRefresh")) {
+        ConfigVideoAutoRefresh = atoi(value);
+        return true;
+    }
+    if (!strcasecmp(name, "VideoBufferSD")) {
+        ConfigVideoBufferSD = atoi(value);
+        return true;
+    }
+    if (!strcasecmp(name, "VideoBufferHD")) {
+        ConfigVideoBufferHD = atoi(value);
+        return true;
+    }
+    if (!strcasecmp(name, "VideoBufferUHD")) {
+        ConfigVideoBufferUHD = atoi(value);
+        return true;
+    }
     if (!strcasecmp(name, "Brightness")) {
         int i;
 
@@ -3222,6 +3299,12 @@ bool cPluginSoftHdDevice::SetupParse(const char *name, const char *value)
         ConfigPipAltVideoHeight = atoi(value);
         return true;
     }
+    if (!strncasecmp(name, "Sched.", 6)) {
+        return ThreadSetProfile(name + 6, value);
+    }
+    if (!strncasecmp(name, "Budget.", 7)) {
+        return MemSetBudget(name + 7, value);
+    }
 
 
     return false;
@@ -3330,6 +3413,19 @@ static const char *SVDRPHelpText[] = {
     "STAT\n" "\040   Display SuspendMode of the plugin.\n\n" "    reply code is 910 + SuspendMode\n"
         "    SUSPEND_EXTERNAL == -1  (909)\n" "    NOT_SUSPENDED    ==  0  (910)\n"
         "    SUSPEND_NORMAL   ==  1  (911)\n" "    SUSPEND_DETACHED ==  2  (912)\n",
+    "ZAPS\n" "\040   Display channel switch time histograms and audio start.\n\n"
+        "    Time from switch to first I-frame, for decoder close/open (cold)\n"
+        "    and reuse of the open decoder (warm).\n",
+    "CECS\n" "\040   Display CEC adapter state and command latency.\n",
+    "IMGC\n" "\040   Display GPU image cache usage and hit/miss counters.\n",
+    "MEMS\n" "\040   Display the memory reserved by large buffers.\n\n"
+        "    Budgets in MB are set with the setup keys Budget.Video, Budget.Pip,\n"
+        "    Budget.Pes, Budget.Audio, Budget.Osd and Budget.Image.\n",
+    "STRT\n" "\040   Display the timing of the last plugin start or resume.\n\n"
+        "    Audio and video are started in parallel, total is the wall time.\n",
+    "SCHD\n" "\040   Display the effective scheduling of the plugin threads.\n\n"
+        "    Profiles are set with the setup keys Sched.Video, Sched.Audio,\n"
+        "    Sched.Osd, Sched.Cec and Sched.Drm, e.g. \"fifo 40 4-5\".\n",
     NULL
 };
 
@@ -3473,6 +3569,58 @@ cString cPluginSoftHdDevice::SVDRPCommand(const char *command, const char *optio
         SuspendMode = NOT_SUSPENDED;
         return "SoftHdDevice is attached";
     }
+    if (!strcasecmp(command, "ZAPS")) {
+        char buf[512];
+        size_t n;
+
+        VideoGetSwitchStats(buf, sizeof(buf));
+        n = strlen(buf);
+        if (n + 1 < sizeof(buf)) {
+            buf[n++] = '\n';
+            AudioGetStartStats(buf + n, sizeof(buf) - n);
+        }
+        return buf;
+    }
+    if (!strcasecmp(command, "IMGC")) {
+#ifdef USE_OPENGLOSD
+        char buf[256];
+
+        cSoftOsdProvider::GetImageStats(buf, sizeof(buf));
+        return buf;
+#else
+        reply_code = 550;
+        return "OpenGL OSD not compiled in";
+#endif
+    }
+    if (!strcasecmp(command, "MEMS")) {
+        char buf[1024];
+
+        MemGetStats(buf, sizeof(buf));
+        return buf;
+    }
+    if (!strcasecmp(command, "STRT")) {
+        char buf[256];
+
+        GetStartStats(buf, sizeof(buf));
+        return buf;
+    }
+    if (!strcasecmp(command, "SCHD")) {
+        char buf[1024];
+
+        ThreadGetProfiles(buf, sizeof(buf));
+        return buf;
+    }
+    if (!strcasecmp(command, "CECS")) {
+#ifdef USE_CEC
+        char buf[512];
+
+        cec_get_stats(buf, sizeof(buf));
+        return buf;
+#else
+        reply_code = 550;
+        return "CEC support not compiled in";
+#endif
+    }
     if (!strcasecmp(command, "HOTK")) {
         int hotk;
 
@@ -0,0 +1,219 @@
+///
+/// @file align_test.c	@brief Audio start alignment test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Replays the PES time stamps of recorded transport streams, in mux
+/// order, through AudioSetClock and AudioEnqueue like the audio codec
+/// does, until play-back starts.  The first video pts is taken from the
+/// first video PES, like the video decoder does.
+///
+/// Every buffered frame carries its number in the stream, so the start
+/// of the ring tells which sample is played first.  It must be the one
+/// at vpts - VideoAudioDelay, or silence up to it, and the clock set at
+/// the start must be vpts.
+///
+/// The recordings are 2 s of test pattern and tone, muxed by ffmpeg:
+/// audio 10 ms ahead (MP2, 5 frames per PES), audio 610 ms ahead (MP2)
+/// and audio 344 ms behind video over the 33 bit wrap (AC-3, 3 frames
+/// per PES).
+///
+
+#include "../audio.c"
+#include "test.h"
+
+#define CODEC_FRAMES_MAX 1536           ///< max. frames of a codec frame
+
+/// PES of a recording: video or audio with its pts
+typedef struct
+{
+    char Type;                          ///< 'V' video, 'A' audio
+    int64_t PTS;                        ///< presentation time stamp
+    int Frames;                         ///< audio frames of the PES
+} Event;
+
+static const Event Near[] = {
+    {'V', 0x00001FA40, 0}, {'V', 0x000020850, 0}, {'V', 0x000021660, 0}, {'V', 0x000022470, 0},
+    {'A', 0x00001F6BA, 5760}, {'V', 0x000023280, 0}, {'V', 0x000024090, 0}, {'V', 0x000024EA0, 0},
+    {'A', 0x0000220EA, 5760}, {'V', 0x000025CB0, 0}, {'V', 0x000026AC0, 0}, {'V', 0x0000278D0, 0},
+    {'A', 0x000024B1A, 5760}, {'V', 0x0000286E0, 0}, {'V', 0x0000294F0, 0}, {'V', 0x00002A300, 0},
+    {'A', 0x00002754A, 5760}, {'V', 0x00002B110, 0}, {'V', 0x00002BF20, 0}, {'V', 0x00002CD30, 0},
+    {'A', 0x000029F7A, 5760}, {'V', 0x00002DB40, 0}, {'V', 0x00002E950, 0}, {'V', 0x00002F760, 0},
+};
+
+static const Event Lead[] = {
+    {'A', 0x00001EC30, 5760}, {'A', 0x000021660, 5760}, {'A', 0x000024090, 5760}, {'A', 0x000026AC0, 5760},
+    {'V', 0x00002C2A6, 0}, {'A', 0x0000294F0, 5760}, {'V', 0x00002D0B6, 0}, {'V', 0x00002DEC6, 0},
+    {'V', 0x00002ECD6, 0}, {'A', 0x00002BF20, 5760}, {'V', 0x00002FAE6, 0}, {'V', 0x0000308F6, 0},
+    {'V', 0x000031706, 0}, {'A', 0x00002E950, 5760}, {'V', 0x000032516, 0}, {'V', 0x000033326, 0},
+    {'V', 0x000034136, 0}, {'A', 0x000031380, 5760}, {'V', 0x000034F46, 0}, {'V', 0x000035D56, 0},
+    {'V', 0x000036B66, 0}, {'A', 0x000033DB0, 5760}, {'V', 0x000037976, 0}, {'V', 0x000038786, 0},
+    {'V', 0x000039596, 0}, {'A', 0x0000367E0, 5760}, {'V', 0x00003A3A6, 0}, {'V', 0x00003B1B6, 0},
+    {'V', 0x00003BFC6, 0}, {'A', 0x000039210, 5760},
+};
+
+static const Event Wrap[] = {
+    {'V', 0x1FFFF4A00, 0}, {'V', 0x1FFFF5810, 0}, {'V', 0x1FFFF6620, 0}, {'V', 0x1FFFF7430, 0},
+    {'V', 0x1FFFF8240, 0}, {'V', 0x1FFFF9050, 0}, {'V', 0x1FFFF9E60, 0}, {'V', 0x1FFFFAC70, 0},
+    {'V', 0x1FFFFBA80, 0}, {'V', 0x1FFFFC890, 0}, {'V', 0x1FFFFD6A0, 0}, {'V', 0x1FFFFE4B0, 0},
+    {'V', 0x1FFFFF2C0, 0}, {'A', 0x1FFFFC32C, 4608}, {'V', 0x0000000D0, 0}, {'V', 0x000000EE0, 0},
+    {'A', 0x1FFFFE4EC, 4608}, {'V', 0x000001CF0, 0}, {'V', 0x000002B00, 0}, {'A', 0x0000006AC, 4608},
+    {'V', 0x000003910, 0}, {'V', 0x000004720, 0}, {'V', 0x000005530, 0}, {'A', 0x00000286C, 4608},
+    {'V', 0x000006340, 0}, {'V', 0x000007150, 0}, {'A', 0x000004A2C, 4608}, {'V', 0x000007F60, 0},
+    {'V', 0x000008D70, 0}, {'V', 0x000009B80, 0}, {'A', 0x000006BEC, 4608}, {'V', 0x00000A990, 0},
+    {'V', 0x00000B7A0, 0}, {'A', 0x000008DAC, 4608}, {'V', 0x00000C5B0, 0}, {'V', 0x00000D3C0, 0},
+    {'A', 0x00000AF6C, 4608}, {'V', 0x00000E1D0, 0}, {'V', 0x00000EFE0, 0}, {'V', 0x00000FDF0, 0},
+};
+
+static int64_t PCR = AV_NOPTS_VALUE;    ///< clock set at the start
+
+int SetCurrentPCR(int handle, uint64_t value)
+{
+    (void)handle;
+    PCR = value;
+    return 0;
+}
+
+///
+/// Replay a recording until play-back starts.
+///
+/// @param name	name of the recording
+/// @param events	PES of the recording
+/// @param count	number of PES
+/// @param codec_frames	frames of a codec frame
+/// @param delay	a/v delay in time stamps
+///
+static void Replay(const char *name, const Event * events, int count, int codec_frames, int delay)
+{
+    static int16_t samples[CODEC_FRAMES_MAX * 2];
+    static int16_t ring[2];
+    RingBuffer *rb;
+    int64_t first;
+    int64_t vpts;
+    int64_t target;
+    int64_t want;
+    int frame;
+    int freq;
+    int channels;
+    int silence;
+    int n;
+
+    AudioChannelMatrix[Audio48000][2] = 2;
+    atomic_set(&AudioRingFilled, 0);
+    freq = 48000;
+    channels = 2;
+    AudioSetup(&freq, &channels, 0);
+    rb = AudioRing[AudioRingWrite].RingBuffer;
+    AudioRunning = 0;
+    AudioPreRoll = 0;
+    FirstVPTS = AV_NOPTS_VALUE;
+    VideoAudioDelay = delay;
+    PCR = AV_NOPTS_VALUE;
+
+    first = AV_NOPTS_VALUE;
+    vpts = AV_NOPTS_VALUE;
+    frame = 0;
+    for (int i = 0; i < count && !AudioRunning; ++i) {
+        if (events[i].Type == 'V') {
+            if (vpts == (int64_t) AV_NOPTS_VALUE) {
+                vpts = FirstVPTS = events[i].PTS;
+            }
+            continue;
+        }
+        if (first == (int64_t) AV_NOPTS_VALUE) {
+            first = events[i].PTS;
+        }
+        AudioSetClock(events[i].PTS);
+        for (int f = 0; f < events[i].Frames; f += codec_frames) {
+            for (int s = 0; s < codec_frames; ++s) {
+                // frame number + 1, 0 is silence
+                samples[2 * s] = (frame + s + 1) & 0x7FFF;
+                samples[2 * s + 1] = (frame + s + 1) >> 15;
+            }
+            AudioEnqueue(samples, codec_frames * 4);
+            frame += codec_frames;
+        }
+    }
+    if (!AudioRunning) {
+        CHECK(0, "%s %+dms: play-back not started", name, delay / 90);
+        return;
+    }
+
+    // first played sample and the clock belong to the first video frame
+    target = vpts - delay;
+    want = PtsDiff(first, target) * 48000 / 90000 + 1;
+    silence = 0;
+    do {
+        n = RingBufferRead(rb, ring, sizeof(ring));
+    } while (n && !ring[0] && !ring[1] && ++silence);
+    if (want > 0) {
+        n = ring[0] + ring[1] * 0x8000;
+        CHECK(!silence && abs(n - (int)want) <= 1, "%s %+dms: frame %d after %d silent, expected frame %d", name,
+            delay / 90, n, silence, (int)want);
+    } else {
+        CHECK(abs(silence - (1 - (int)want)) <= 1 && ring[0] == 1 && !ring[1],
+            "%s %+dms: %d silent, expected %d", name, delay / 90, silence, 1 - (int)want);
+    }
+    CHECK(PCR != (int64_t) AV_NOPTS_VALUE && llabs(PtsDiff(vpts, PCR)) <= 2, "%s %+dms: clock %s, vpts %s",
+        name, delay / 90, Timestamp2String(PCR), Timestamp2String(vpts));
+}
+
+int main(void)
+{
+    static const int Delay[] = { 0, 20 * 90, -30 * 90 };
+
+    AudioRingInit();
+    AudioStartThreshold = 48000 * 4 / 5;    // 200 ms stereo
+    hasVideo = 1;
+
+    printf("audio 10ms ahead\n");
+    {
+        int failed = Failed;
+
+        for (int d = 0; d < 3; ++d) {
+            Replay("near", Near, sizeof(Near) / sizeof(*Near), 1152, Delay[d]);
+        }
+        printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+    }
+
+    printf("audio 610ms ahead\n");
+    {
+        int failed = Failed;
+
+        for (int d = 0; d < 3; ++d) {
+            Replay("lead", Lead, sizeof(Lead) / sizeof(*Lead), 1152, Delay[d]);
+        }
+        printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+    }
+
+    printf("audio 344ms behind over pts wrap\n");
+    {
+        int failed = Failed;
+
+        for (int d = 0; d < 3; ++d) {
+            Replay("wrap", Wrap, sizeof(Wrap) / sizeof(*Wrap), 1536, Delay[d]);
+        }
+        printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+    }
+
+    AudioRingExit();
+    return Failed ? 1 : 0;
+}
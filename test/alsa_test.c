@@ -0,0 +1,400 @@
+///
+/// @file alsa_test.c	@brief Alsa pcm handle reuse test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Runs AlsaSetup through sequences of rate, channel and pass-through
+/// changes against a fake alsa pcm.  The fake counts opens, closes,
+/// negotiations and applied hw params, so each step checks which of
+/// them the setup did.  A second thread reads the delay all the time,
+/// the fake fails if a handle is closed or reconfigured while it is
+/// published in AlsaPCMHandle.
+///
+
+#include "../audio.c"
+#include "test.h"
+
+/// fake pcm
+struct _snd_pcm
+{
+    const char *Device;                 ///< device name
+    int Open;                           ///< handle is open
+    unsigned Rate;                      ///< configured rate
+    unsigned Channels;                  ///< configured channels
+    unsigned Latency;                   ///< configured buffer time
+};
+
+/// fake hw params, the configuration of a pcm
+struct _snd_pcm_hw_params
+{
+    unsigned Rate;                      ///< rate
+    unsigned Channels;                  ///< channels
+    unsigned Latency;                   ///< buffer time
+};
+
+/// fake sw params
+struct _snd_pcm_sw_params
+{
+    int Dummy;
+};
+
+static struct _snd_pcm Pcms[16];        ///< opened handles
+static int Opens;                       ///< successful opens
+static int Closes;                      ///< closes
+static int Negotiations;                ///< snd_pcm_set_params calls
+static int Applied;                     ///< snd_pcm_hw_params calls
+static int Prepares;                    ///< snd_pcm_prepare calls
+static const char *Busy;                ///< device busy while another is open
+static int HwParamsFail;                ///< fail the next snd_pcm_hw_params
+static volatile int Unsafe;             ///< handle changed while published
+static volatile int DelayClosed;        ///< delay of a closed handle
+static volatile int StopDelay;          ///< stop the delay thread
+
+///
+/// Check a handle is not published while setup changes it.
+///
+static void Change(snd_pcm_t * pcm)
+{
+    pthread_mutex_lock(&AlsaMutex);
+    if (AlsaPCMHandle == pcm) {
+        Unsafe++;
+    }
+    pthread_mutex_unlock(&AlsaMutex);
+}
+
+int snd_pcm_open(snd_pcm_t ** pcm, const char *name, snd_pcm_stream_t stream, int mode)
+{
+    (void)stream;
+    (void)mode;
+    for (int i = 0; Busy && !strcmp(name, Busy) && i < 16; ++i) {
+        if (Pcms[i].Open && strcmp(Pcms[i].Device, name)) {
+            return -EBUSY;
+        }
+    }
+    for (int i = 0; i < 16; ++i) {
+        if (!Pcms[i].Open && !Pcms[i].Device) {
+            Pcms[i].Device = name;
+            Pcms[i].Open = 1;
+            *pcm = &Pcms[i];
+            Opens++;
+            return 0;
+        }
+    }
+    return -ENOMEM;
+}
+
+int snd_pcm_close(snd_pcm_t * pcm)
+{
+    Change(pcm);
+    pcm->Open = 0;
+    Closes++;
+    return 0;
+}
+
+int snd_pcm_nonblock(snd_pcm_t * pcm, int nonblock)
+{
+    (void)pcm;
+    (void)nonblock;
+    return 0;
+}
+
+int snd_pcm_drop(snd_pcm_t * pcm)
+{
+    Change(pcm);
+    return 0;
+}
+
+int snd_pcm_prepare(snd_pcm_t * pcm)
+{
+    (void)pcm;
+    Prepares++;
+    return 0;
+}
+
+int snd_pcm_set_params(snd_pcm_t * pcm, snd_pcm_format_t format, snd_pcm_access_t access, unsigned channels,
+    unsigned rate, int resample, unsigned latency)
+{
+    (void)format;
+    (void)access;
+    (void)resample;
+    Change(pcm);
+    Negotiations++;
+    if (latency > 72 * 1000) {          // the device needs a small buffer
+        return -EINVAL;
+    }
+    pcm->Rate = rate;
+    pcm->Channels = channels;
+    pcm->Latency = latency;
+    return 0;
+}
+
+int snd_pcm_hw_params_malloc(snd_pcm_hw_params_t ** params)
+{
+    *params = calloc(1, sizeof(**params));
+    return 0;
+}
+
+void snd_pcm_hw_params_free(snd_pcm_hw_params_t * params)
+{
+    free(params);
+}
+
+int snd_pcm_hw_params_current(snd_pcm_t * pcm, snd_pcm_hw_params_t * params)
+{
+    params->Rate = pcm->Rate;
+    params->Channels = pcm->Channels;
+    params->Latency = pcm->Latency;
+    return 0;
+}
+
+int snd_pcm_hw_params(snd_pcm_t * pcm, snd_pcm_hw_params_t * params)
+{
+    Change(pcm);
+    Applied++;
+    if (HwParamsFail) {
+        HwParamsFail = 0;
+        return -EINVAL;
+    }
+    pcm->Rate = params->Rate;
+    pcm->Channels = params->Channels;
+    pcm->Latency = params->Latency;
+    return 0;
+}
+
+int snd_pcm_sw_params_malloc(snd_pcm_sw_params_t ** params)
+{
+    *params = calloc(1, sizeof(**params));
+    return 0;
+}
+
+void snd_pcm_sw_params_free(snd_pcm_sw_params_t * params)
+{
+    free(params);
+}
+
+int snd_pcm_sw_params_current(snd_pcm_t * pcm, snd_pcm_sw_params_t * params)
+{
+    (void)pcm;
+    (void)params;
+    return 0;
+}
+
+int snd_pcm_sw_params(snd_pcm_t * pcm, snd_pcm_sw_params_t * params)
+{
+    (void)pcm;
+    (void)params;
+    return 0;
+}
+
+int snd_pcm_hw_params_any(snd_pcm_t * pcm, snd_pcm_hw_params_t * params)
+{
+    (void)pcm;
+    (void)params;
+    return 0;
+}
+
+int snd_pcm_hw_params_can_pause(const snd_pcm_hw_params_t * params)
+{
+    (void)params;
+    return 1;
+}
+
+int snd_pcm_get_params(snd_pcm_t * pcm, snd_pcm_uframes_t * buffer_size, snd_pcm_uframes_t * period_size)
+{
+    *buffer_size = (uint64_t) pcm->Rate * pcm->Latency / 1000000;
+    *period_size = *buffer_size / 4;
+    return 0;
+}
+
+ssize_t snd_pcm_frames_to_bytes(snd_pcm_t * pcm, snd_pcm_sframes_t frames)
+{
+    return frames * pcm->Channels * 2;
+}
+
+snd_pcm_state_t snd_pcm_state(snd_pcm_t * pcm)
+{
+    (void)pcm;
+    return SND_PCM_STATE_PREPARED;
+}
+
+const char *snd_pcm_state_name(snd_pcm_state_t state)
+{
+    (void)state;
+    return "PREPARED";
+}
+
+const char *snd_strerror(int err)
+{
+    return strerror(-err);
+}
+
+int snd_pcm_delay(snd_pcm_t * pcm, snd_pcm_sframes_t * delay)
+{
+    if (!pcm->Open) {
+        DelayClosed++;
+    }
+    usleep(10);
+    *delay = 0;
+    return 0;
+}
+
+///
+/// Read the delay like the video thread.
+///
+static void *DelayThread(void *dummy)
+{
+    while (!StopDelay) {
+        AlsaGetDelay();
+    }
+    return dummy;
+}
+
+///
+/// Setup a format and check what was done.
+///
+/// @param rate	sample rate
+/// @param channels	channels
+/// @param passthrough	pass-through
+/// @param opens	expected opens
+/// @param negotiations	expected snd_pcm_set_params calls
+/// @param applied	expected snd_pcm_hw_params calls
+///
+static void Setup(int rate, int channels, int passthrough, int opens, int negotiations, int applied)
+{
+    int o = Opens;
+    int n = Negotiations;
+    int a = Applied;
+    int freq = rate;
+    int chan = channels;
+
+    CHECK(!AlsaSetup(&freq, &chan, passthrough), "%d Hz %d channels%s: setup failed", rate, channels,
+        passthrough ? " pass-through" : "");
+    CHECK(Opens - o == opens && Negotiations - n == negotiations && Applied - a == applied,
+        "%d Hz %d channels%s: %d opens, %d negotiations, %d applied, expected %d, %d, %d", rate, channels,
+        passthrough ? " pass-through" : "", Opens - o, Negotiations - n, Applied - a, opens, negotiations, applied);
+    CHECK(AlsaPCMHandle && AlsaPCMHandle->Open && AlsaPCMHandle->Rate == (unsigned)rate
+        && AlsaPCMHandle->Channels == (unsigned)channels, "%d Hz %d channels%s: handle not configured", rate,
+        channels, passthrough ? " pass-through" : "");
+    CHECK(!strcmp(AlsaPCMHandle->Device, passthrough && AudioPassthroughDevice ? "spdif" : "hdmi"),
+        "%d Hz%s: device %s", rate, passthrough ? " pass-through" : "", AlsaPCMHandle->Device);
+}
+
+///
+/// Close all handles and forget the params.
+///
+static void Restart(void)
+{
+    AlsaExit();
+    memset(Pcms, 0, sizeof(Pcms));
+    AlsaInitPCM();
+    Closes = 0;
+}
+
+int main(void)
+{
+    pthread_t thread;
+    int failed;
+
+    AudioDoingInit = 1;
+    AudioPCMDevice = "hdmi";
+    AudioPassthroughDevice = NULL;
+    AudioRing[AudioRingRead].HwSampleRate = 48000;
+    AlsaInitPCM();
+    pthread_create(&thread, NULL, DelayThread, NULL);
+
+    // two negotiations for each new configuration, 96 ms fails
+    printf("close open\n");
+    failed = Failed;
+    Setup(48000, 2, 0, 1, 2, 0);
+    Setup(48000, 2, 0, 1, 0, 1);
+    Setup(44100, 2, 0, 1, 2, 0);
+    CHECK(Closes == 3, "%d closes, expected 3", Closes);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    printf("reuse\n");
+    failed = Failed;
+    AudioAlsaNoCloseOpen = 1;
+    Restart();
+    Setup(48000, 2, 0, 0, 2, 0);
+    Setup(48000, 2, 0, 0, 0, 0);
+    Setup(44100, 2, 0, 0, 2, 0);
+    Setup(48000, 6, 0, 0, 2, 0);
+    Setup(48000, 2, 0, 0, 0, 1);
+    Setup(44100, 2, 0, 0, 0, 1);
+    Setup(44100, 2, 0, 0, 0, 0);
+    CHECK(!Closes, "%d closes", Closes);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    // pass-through on the same device needs its own configuration
+    printf("pass-through same device\n");
+    failed = Failed;
+    Restart();
+    Setup(48000, 2, 0, 0, 2, 0);
+    Setup(48000, 2, 1, 0, 2, 0);
+    Setup(48000, 2, 0, 0, 0, 1);
+    Setup(48000, 2, 1, 0, 0, 1);
+    Setup(48000, 2, 1, 0, 0, 0);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    printf("pass-through device\n");
+    failed = Failed;
+    AudioPassthroughDevice = "spdif";
+    Restart();
+    Setup(48000, 2, 0, 0, 2, 0);
+    Setup(48000, 2, 1, 1, 2, 0);
+    Setup(48000, 2, 0, 0, 0, 0);
+    Setup(48000, 2, 1, 0, 0, 0);
+    Setup(44100, 2, 0, 0, 2, 0);
+    Setup(48000, 2, 1, 0, 0, 0);
+    CHECK(!Closes, "%d closes", Closes);
+    // busy while the other device is open
+    Restart();
+    Busy = "spdif";
+    Setup(48000, 2, 0, 0, 2, 0);
+    Setup(48000, 2, 1, 1, 2, 0);
+    CHECK(Closes == 1 && !AlsaPcms[0].Handle, "%d closes, pcm handle %p", Closes, (void *)AlsaPcms[0].Handle);
+    Busy = NULL;
+    Setup(48000, 2, 0, 1, 0, 1);
+    AudioPassthroughDevice = NULL;
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    printf("cached params fail\n");
+    failed = Failed;
+    Restart();
+    Setup(48000, 2, 0, 0, 2, 0);
+    Setup(44100, 2, 0, 0, 2, 0);
+    HwParamsFail = 1;
+    Setup(48000, 2, 0, 0, 2, 1);
+    Setup(44100, 2, 0, 0, 0, 1);
+    Setup(48000, 2, 0, 0, 0, 1);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    StopDelay = 1;
+    pthread_join(thread, NULL);
+    printf("handle hand over\n");
+    failed = Failed;
+    CHECK(!Unsafe && !DelayClosed, "%d changes of the published handle, %d delays of a closed handle", Unsafe,
+        DelayClosed);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    AlsaExit();
+    return Failed ? 1 : 0;
+}
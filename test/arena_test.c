@@ -0,0 +1,201 @@
+///
+/// @file arena_test.c	@brief Video packet arena test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Runs a pseudo random mix of I- and P-frames through the packet
+/// arena of the device module, with the back-pressure of PlayVideo and
+/// the reader VideoDecodeInput.  Every packet is filled with a pattern
+/// of its number, the decoder stub checks it, its padding and its place
+/// in the arena, so an overlap of two packets shows up as corruption.
+/// The resident size of the arena is checked with mincore after the
+/// stream changes from UHD to SD.
+///
+
+#include "../softhddev.c"
+#include "test.h"
+
+static unsigned Written;                ///< packets written
+static unsigned Decoded;                ///< packets decoded
+static int Sizes[VIDEO_PACKET_MAX];     ///< sizes of the queued packets
+
+///
+/// Check a decoded packet.
+///
+void CodecVideoDecode(VideoDecoder * decoder, const AVPacket * avpkt)
+{
+    const VideoStream *stream = MyVideoStream;
+    int size;
+
+    (void)decoder;
+    size = Sizes[Decoded % VIDEO_PACKET_MAX];
+    if (avpkt->size != size) {
+        CHECK(0, "packet %u has %d bytes, expected %d", Decoded, avpkt->size, size);
+    } else {
+        for (int i = 0; i < size; ++i) {
+            if (avpkt->data[i] != (uint8_t) (Decoded * 31 + i / 4096)) {
+                CHECK(0, "packet %u corrupt at %d", Decoded, i);
+                break;
+            }
+        }
+        for (int i = 0; i < AV_INPUT_BUFFER_PADDING_SIZE; ++i) {
+            if (avpkt->data[size + i]) {
+                CHECK(0, "padding of packet %u not cleared", Decoded);
+                break;
+            }
+        }
+        CHECK(!((avpkt->data - stream->Arena) % VIDEO_ARENA_ALIGN), "packet %u not aligned", Decoded);
+        CHECK(avpkt->data + VideoArenaNeed(size) <= stream->Arena + stream->ArenaSize,
+            "packet %u outside of the arena", Decoded);
+    }
+    Decoded++;
+}
+
+///
+/// Write a packet in PES sized chunks like PlayVideo3.
+///
+/// Each chunk waits for the reader while the ring is full, the chunks
+/// of one packet can't be dropped.
+///
+/// @param stream	video stream
+/// @param codec_id	codec of the packet
+/// @param pts	presentation timestamp
+/// @param size	packet size
+///
+static void Write(VideoStream * stream, int codec_id, int64_t pts, int size)
+{
+    static uint8_t chunk[65536];
+
+    Sizes[Written % VIDEO_PACKET_MAX] = size;
+    for (int i = 0; i < size;) {
+        int n = size - i < (int)sizeof(chunk) ? size - i : (int)sizeof(chunk);
+
+        while (VideoPacketsFull(stream, n)) {
+            if (VideoDecodeInput(stream)) {
+                CHECK(0, "full ring with nothing to decode");
+                break;
+            }
+        }
+        for (int j = 0; j < n; ++j) {
+            chunk[j] = Written * 31 + (i + j) / 4096;
+        }
+        VideoEnqueue(stream, i ? AV_NOPTS_VALUE : pts, AV_NOPTS_VALUE, chunk, n);
+        i += n;
+    }
+    VideoNextPacket(stream, codec_id);
+    Written++;
+}
+
+///
+/// Play a GOP structured stream.
+///
+/// The reader decodes half a packet per written packet on average, so
+/// the ring runs full and the writer blocks until the reader made room.
+///
+/// @param stream	video stream
+/// @param codec_id	codec of the stream
+/// @param frames	number of frames
+/// @param intra	max. size of an I-frame
+///
+static void PlayStream(VideoStream * stream, int codec_id, int frames, int intra)
+{
+    for (int f = 0; f < frames; ++f) {
+        int size;
+
+        size = f % 12 ? 2000 + Random() % (intra / 8) : intra / 4 + Random() % intra;
+        Write(stream, codec_id, Written * 3600LL, size);
+        for (unsigned n = Random() % 2; n--;) {
+            VideoDecodeInput(stream);
+        }
+        CHECK(atomic_read(&stream->ArenaFilled) + stream->ArenaWaste <= stream->ArenaSize,
+            "arena overfilled %d", atomic_read(&stream->ArenaFilled));
+    }
+    while (!VideoDecodeInput(stream)) {
+    }
+    CHECK(Written == Decoded, "%u packets written, %u decoded", Written, Decoded);
+    CHECK(!atomic_read(&stream->ArenaFilled), "%d bytes left in empty arena", atomic_read(&stream->ArenaFilled));
+}
+
+///
+/// Get resident size of the arena.
+///
+static int Resident(const VideoStream * stream)
+{
+    unsigned char vec[stream->ArenaSize / getpagesize()];
+    int n = 0;
+
+    mincore(stream->Arena, stream->ArenaSize, vec);
+    for (size_t i = 0; i < sizeof(vec); ++i) {
+        n += vec[i] & 1;
+    }
+    return n * getpagesize();
+}
+
+int main(void)
+{
+    static VideoDecoder decoder;
+    VideoStream *stream = MyVideoStream;
+    int n;
+    int m;
+
+    stream->Decoder = &decoder;
+    VideoPacketInit(stream);
+    VideoResetPacket(stream);
+    stream->LastCodecID = AV_CODEC_ID_NONE;
+
+    printf("h264\n");
+    PlayStream(stream, AV_CODEC_ID_H264, 3000, 400000);
+    printf("hevc\n");
+    PlayStream(stream, AV_CODEC_ID_HEVC, 3000, 1500000);
+    printf("mpeg2\n");
+    PlayStream(stream, AV_CODEC_ID_MPEG2VIDEO, 3000, 150000);
+    n = Resident(stream);
+    CHECK(n <= VideoArenaBudget(AV_CODEC_ID_MPEG2VIDEO), "%d KB resident after SD, budget %d KB", n / 1024,
+        VideoArenaBudget(AV_CODEC_ID_MPEG2VIDEO) / 1024);
+
+    // duration limit: 40 ms packets stop after 8 s
+    printf("duration\n");
+    Write(stream, AV_CODEC_ID_MPEG2VIDEO, Written * 3600LL, 1000);
+    VideoDecodeInput(stream);
+    for (n = 0; !VideoPacketsFull(stream, 1000); ++n) {
+        Write(stream, AV_CODEC_ID_MPEG2VIDEO, Written * 3600LL, 1000);
+    }
+    CHECK(n == VIDEO_MAX_DURATION / 40 + 1, "%d packets queued, expected %d", n, VIDEO_MAX_DURATION / 40 + 1);
+    while (!VideoDecodeInput(stream)) {
+    }
+
+    // byte limit: 7/8 of the budget, even without pts, a skipped tail
+    // at the wrap counts as used
+    printf("bytes\n");
+    for (n = 0; !VideoPacketsFull(stream, 100000); ++n) {
+        Write(stream, AV_CODEC_ID_MPEG2VIDEO, AV_NOPTS_VALUE, 100000);
+    }
+    m = (stream->ArenaBudget - stream->ArenaBudget / 8) / VideoArenaNeed(100000);
+    CHECK(n == m || n == m - 1, "%d packets queued, expected %d", n, m);
+    while (!VideoDecodeInput(stream)) {
+    }
+    CHECK(Written == Decoded, "%u packets written, %u decoded", Written, Decoded);
+
+    VideoPacketExit(stream);
+    printf("%s\n", Failed ? "FAILED" : "ok");
+
+    return Failed ? 1 : 0;
+}
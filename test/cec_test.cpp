@@ -0,0 +1,307 @@
+///
+/// @file cec_test.cpp	@brief CEC worker test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Checks the command queue of the CEC module and its worker with a
+/// fake adapter backend, which records the transmitted frames.  The
+/// backend is installed while the test holds CecMutex, before the
+/// worker makes its first call.  Needs the libcec headers, no adapter.
+///
+
+#include "../cec.cpp"
+#include "test.h"
+
+extern "C" void ThreadApplyProfile(int)
+{
+}
+
+#define FRAME_MAX 64                    ///< max. recorded frames
+
+/// frame sent by the fake adapter
+static struct {
+    uint64_t Tick;                      ///< us when the transmit started
+    int Dest;                           ///< destination
+    int Key;                            ///< user control code or -1 for raw
+} Frame[FRAME_MAX];
+static volatile int Frames;             ///< number of recorded frames
+
+static int OpenResult;                  ///< result of the adapter open
+static int OpenUs;                      ///< time of the adapter open
+static uint64_t OpenTick;               ///< us when the adapter was open
+static char LastRaw[CEC_RAW_MAX];       ///< last parsed raw command
+
+static int TestOpen(const char *)
+{
+    usleep(OpenUs);
+    OpenTick = CecTicks();
+    return OpenResult;
+}
+
+static int TestParse(const char *raw, cec_command *cmd)
+{
+    snprintf(LastRaw, sizeof(LastRaw), "%s", raw);
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->destination = (cec_logical_address)15;
+    return 1;
+}
+
+static int TestTransmit(const cec_command *cmd)
+{
+    if (Frames < FRAME_MAX) {
+        Frame[Frames].Tick = CecTicks();
+        Frame[Frames].Dest = cmd->destination;
+        Frame[Frames].Key = cmd->opcode_set ? cmd->parameters.data[0] : -1;
+        Frames = Frames + 1;
+    }
+    usleep(CEC_FAKE_TX_US);
+    return 1;
+}
+
+static void TestClose(void)
+{
+}
+
+static const CecBackend TestBackend = {
+    "test", TestOpen, TestParse, TestTransmit, TestClose
+};
+
+///
+/// Queue a volume step.
+///
+static int Volume(int dev, int steps)
+{
+    CecCmd cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.Type = CEC_CMD_VOLUME;
+    cmd.Dev = dev;
+    cmd.Steps = steps;
+    cmd.Queued = CecTicks();
+    return CecEnqueue(&cmd);
+}
+
+///
+/// Queue a raw command.
+///
+static int Raw(const char *raw, uint64_t queued)
+{
+    CecCmd cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.Type = CEC_CMD_RAW;
+    cmd.Queued = queued;
+    snprintf(cmd.Raw, sizeof(cmd.Raw), "%s", raw);
+    return CecEnqueue(&cmd);
+}
+
+///
+/// Take the next frame from the queue.
+///
+/// @returns user control code, -1 for a raw frame, 0 if empty
+///
+static int Next(int *dest)
+{
+    cec_command tx;
+    uint64_t queued;
+
+    if (!CecDequeue(&tx, &queued)) {
+        return 0;
+    }
+    *dest = tx.destination;
+    return tx.opcode_set ? tx.parameters.data[0] : -1;
+}
+
+///
+/// Check coalescing, order, bounds and staleness of the queue.
+///
+static void TestQueue(void)
+{
+    int failed = Failed;
+    int dest;
+
+    printf("queue\n");
+    CecUsed = &TestBackend;
+    CecState = CEC_STATE_READY;
+    CecHead = 7;                        // wrap inside the ring
+    CecCount = 0;
+
+    // a burst of steps becomes one entry, up and down cancel out
+    for (int i = 0; i < 5; ++i) {
+        Volume(5, 1);
+    }
+    Volume(5, -1);
+    Volume(5, -1);
+    CHECK(CecCount == 1 && CecQueue[CecHead].Steps == 3, "%d entries, %d steps", CecCount,
+        CecQueue[CecHead].Steps);
+    Volume(5, -1);
+    Volume(5, -1);
+    Volume(5, -1);
+    CHECK(!CecCount, "%d entries after cancel", CecCount);
+
+    // other commands keep the order, steps for another device aren't merged
+    Volume(5, 1);
+    Raw("1f:82:10:00", CecTicks());
+    Volume(5, 1);
+    Volume(0, -1);
+    CHECK(Next(&dest) == CEC_USER_CONTROL_CODE_VOLUME_UP && dest == 5, "first frame no volume up");
+    CHECK(Next(&dest) == -1 && !strcmp(LastRaw, "1f:82:10:00"), "second frame no raw %s", LastRaw);
+    CHECK(Next(&dest) == CEC_USER_CONTROL_CODE_VOLUME_UP && dest == 5, "third frame no volume up");
+    CHECK(Next(&dest) == CEC_USER_CONTROL_CODE_VOLUME_DOWN && !dest, "fourth frame no volume down");
+    CHECK(!Next(&dest), "queue not empty");
+
+    // a full queue drops, but still merges steps into its tail
+    for (int i = 0; i < CEC_QUEUE_MAX - 1; ++i) {
+        Raw("10:36", CecTicks());
+    }
+    Volume(5, 1);
+    CHECK(Raw("10:36", CecTicks()) < 0 && CecCount == CEC_QUEUE_MAX, "full queue accepted a command");
+    CHECK(!Volume(5, 1) && CecQueue[(CecHead + CEC_QUEUE_MAX - 1) % CEC_QUEUE_MAX].Steps == 2,
+        "step not merged into full queue");
+    while (Next(&dest)) {
+    }
+
+    // stale commands are dropped, not sent
+    Raw("10:04", CecTicks() - (CEC_STALE_MS + 100) * 1000ULL);
+    Raw("10:8f", CecTicks());
+    CHECK(Next(&dest) == -1 && !strcmp(LastRaw, "10:8f"), "stale command %s sent", LastRaw);
+
+    // nothing is queued without a usable adapter
+    CecState = CEC_STATE_FAILED;
+    CHECK(Volume(5, 1) < 0 && !CecCount, "command queued without adapter");
+    CecState = CEC_STATE_SEARCH;
+
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+}
+
+///
+/// Start the worker with the test backend.
+///
+static uint64_t Start(int result, int open_us)
+{
+    uint64_t t;
+
+    OpenResult = result;
+    OpenUs = open_us;
+    OpenTick = 0;
+    Frames = 0;
+
+    t = CecTicks();
+    pthread_mutex_lock(&CecMutex);
+    cec_init();
+    CecUsed = &TestBackend;
+    pthread_mutex_unlock(&CecMutex);
+    return CecTicks() - t;
+}
+
+///
+/// Wait until the queue is sent.
+///
+static void WaitIdle(void)
+{
+    int pending = 1;
+
+    for (int i = 0; i < 300 && pending; ++i) {
+        usleep(10000);
+        pthread_mutex_lock(&CecMutex);
+        pending = CecCount || CecState == CEC_STATE_SEARCH;
+        pthread_mutex_unlock(&CecMutex);
+    }
+    usleep(2 * CEC_FAKE_TX_US);         // last frame on the bus
+}
+
+///
+/// Check that callers don't wait for a slow adapter and bus.
+///
+static void TestWorker(void)
+{
+    int failed = Failed;
+    uint64_t t;
+    uint64_t max;
+    int net;
+    char buf[512];
+    char line[64];
+
+    printf("worker\n");
+    t = Start(1, 200000);
+    CHECK(t < 20000, "cec_init took %d us", (int)t);
+    CHECK(cec_active(), "not active during discovery");
+
+    // ten steps while the adapter opens and the bus is busy
+    max = 0;
+    for (int i = 0; i < 10; ++i) {
+        t = CecTicks();
+        cec_send_command(5, (char *)"up");
+        t = CecTicks() - t;
+        if (t > max) {
+            max = t;
+        }
+        usleep(5000);
+    }
+    CHECK(max < 5000, "cec_send_command took %d us", (int)max);
+    WaitIdle();
+    CHECK(Frames == 10, "%d frames sent, expected 10", Frames);
+    for (int i = 0; i < Frames; ++i) {
+        CHECK(Frame[i].Key == CEC_USER_CONTROL_CODE_VOLUME_UP && Frame[i].Dest == 5, "frame %d wrong", i);
+        CHECK(Frame[i].Tick >= OpenTick, "frame %d sent before the adapter was open", i);
+        CHECK(!i || Frame[i].Tick - Frame[i - 1].Tick >= CEC_FAKE_TX_US, "frame %d overlaps", i);
+    }
+
+    // up and down while one step is on the bus, the net change is sent
+    Frames = 0;
+    for (int i = 0; i < 5; ++i) {
+        cec_send_command(5, (char *)"up");
+    }
+    for (int i = 0; i < 5; ++i) {
+        cec_send_command(5, (char *)"down");
+    }
+    WaitIdle();
+    net = 0;
+    for (int i = 0; i < Frames; ++i) {
+        net += Frame[i].Key == CEC_USER_CONTROL_CODE_VOLUME_UP ? 1 : -1;
+    }
+    CHECK(!net && Frames <= 2, "%d frames with net %d", Frames, net);
+
+    cec_get_stats(buf, sizeof(buf));
+    snprintf(line, sizeof(line), "sent %d failed 0", 10 + Frames);
+    CHECK(strstr(buf, "adapter test (ready)") && strstr(buf, line), "stats:\n%s", buf);
+    cec_exit();
+    CHECK(!cec_active(), "active after exit");
+
+    // libcec missing: fall back to the mixer
+    Start(-1, 0);
+    for (int i = 0; i < 100 && cec_active(); ++i) {
+        usleep(1000);
+    }
+    CHECK(!cec_active(), "active without libcec");
+    CHECK(cec_send_command(5, (char *)"up") < 0, "command accepted without libcec");
+    cec_exit();
+
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+}
+
+int main(void)
+{
+    TestQueue();
+    TestWorker();
+
+    return Failed ? 1 : 0;
+}
@@ -0,0 +1,337 @@
+///
+/// @file drift_test.c	@brief Audio drift correction test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Plays a 1 kHz tone through AudioEnqueue with drift correction on.
+/// The stream delivers a packet every 24 ms of the virtual clock, a
+/// simulated output device consumes the ring in periods at a clock,
+/// which is off by a few hundred ppm.  clock_gettime of the audio
+/// module is replaced, so 20 minutes of playback run in seconds.
+///
+/// The correction must follow the skew, keep the delay at its target
+/// without underrun and play the tone without clicks.  The resampler
+/// must cost less than 1% of the real time of the packets it handles.
+///
+/// With -b the resampler is timed instead.
+///
+
+#include <time.h>
+
+#define clock_gettime DriftClock
+
+static int DriftClock(clockid_t, struct timespec *);
+
+#include "../audio.c"
+
+#undef clock_gettime
+
+#include "test.h"
+
+#define PACKET_FRAMES 1152              ///< frames of a stream packet, 24 ms
+#define PERIOD_FRAMES 256               ///< frames of an output period
+#define HW_DELAY (20 * 90)              ///< delay of the output device
+#define AMPLITUDE 16000                 ///< tone amplitude
+
+static uint64_t Clock;                  ///< virtual clock in us
+
+static int DriftClock(clockid_t id, struct timespec *tp)
+{
+    (void)id;
+    tp->tv_sec = Clock / 1000000;
+    tp->tv_nsec = Clock % 1000000 * 1000;
+    return 0;
+}
+
+static int64_t TestGetDelay(void)
+{
+    return HW_DELAY;
+}
+
+/// output device, which only reports its delay
+static const AudioModule TestModule = {
+    .Name = "test",
+    .FlushBuffers = NoopVoid,
+    .GetDelay = TestGetDelay,
+    .SetVolume = NoopSetVolume,
+    .Setup = NoopSetup,
+    .Play = NoopVoid,
+    .Pause = NoopVoid,
+    .Init = NoopVoid,
+    .Exit = NoopVoid,
+};
+
+///
+/// Get real time in us.
+///
+static uint64_t Ticks(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+///
+/// Fill a packet with the next frames of the tone.
+///
+/// @param[out] buf	stereo packet
+/// @param frame	stream position in frames
+///
+static void Tone(int16_t * buf, uint64_t frame)
+{
+    for (int i = 0; i < PACKET_FRAMES; ++i) {
+        buf[2 * i] = buf[2 * i + 1] = lrint(AMPLITUDE * sin(2 * M_PI * 1000 * (frame + i) / 48000));
+    }
+}
+
+///
+/// Set up a new stereo ring.
+///
+static void Setup(void)
+{
+    int freq;
+    int channels;
+
+    AudioChannelMatrix[Audio48000][2] = 2;
+    atomic_set(&AudioRingFilled, 0);
+    freq = 48000;
+    channels = 2;
+    if (AudioSetup(&freq, &channels, 0)) {
+        CHECK(0, "stereo not set up");
+    }
+    atomic_set(&AudioRingFilled, 0);
+    AudioRingRead = AudioRingWrite;
+    AudioRunning = 0;
+    memset(&AudioDrift, 0, sizeof(AudioDrift));
+}
+
+/// result of a played run
+typedef struct
+{
+    int Underruns;                      ///< periods not filled
+    int Clicks;                         ///< steps too large for the tone
+    int Ppm;                            ///< average ratio correction, settled
+    int Worst;                          ///< max. ppm off the skew, settled
+    int64_t Delay;                      ///< average hw + sw delay, settled
+} Result;
+
+///
+/// Play with a skewed output clock.
+///
+/// The last 5 minutes are taken as settled, the delay is sampled in
+/// front of each packet like the correction does.
+///
+/// @param[out] result	what was played
+/// @param skew	output clock error in ppm
+/// @param minutes	played minutes
+/// @param burst	minute, at which 300 ms more arrive, 0 none
+/// @param correct	drift correction on
+///
+static void PlaySkewed(Result * result, int skew, int minutes, int burst, int correct)
+{
+    static int16_t packet[PACKET_FRAMES * 2];
+    static int16_t period[PERIOD_FRAMES * 2];
+    RingBuffer *rb;
+    uint64_t frame;
+    uint64_t micro;
+    int64_t ppm;
+    int64_t sum;
+    int samples;
+    int last;
+
+    Setup();
+    AudioSetDriftCorrection(correct);
+    rb = AudioRing[AudioRingWrite].RingBuffer;
+    memset(result, 0, sizeof(*result));
+
+    // 96 ms pre-roll, then the output starts
+    frame = 0;
+    for (int i = 0; i < 4; ++i) {
+        Tone(packet, frame);
+        AudioEnqueue(packet, sizeof(packet));
+        frame += PACKET_FRAMES;
+    }
+    AudioRunning = 1;
+
+    micro = 0;
+    ppm = 0;
+    sum = 0;
+    samples = 0;
+    last = 0;
+    for (uint64_t ms = 1; ms <= (uint64_t) minutes * 60000; ++ms) {
+        Clock += 1000;
+        // output device: 48 frames per ms of its clock
+        micro += 48 * (1000000 + skew);
+        while (micro >= (uint64_t) PERIOD_FRAMES * 1000000) {
+            micro -= (uint64_t) PERIOD_FRAMES * 1000000;
+            if (RingBufferRead(rb, period, sizeof(period)) != sizeof(period)) {
+                result->Underruns++;
+                continue;
+            }
+            for (int i = 0; i < PERIOD_FRAMES; ++i) {
+                // a 1 kHz tone moves by 2093 per frame at most
+                if (abs(period[2 * i] - last) > 2400) {
+                    result->Clicks++;
+                }
+                last = period[2 * i];
+            }
+        }
+        if (burst && ms == (uint64_t) burst * 60000) {
+            for (int i = 0; i < 12; ++i) {
+                Tone(packet, frame);
+                AudioEnqueue(packet, sizeof(packet));
+                frame += PACKET_FRAMES;
+            }
+        }
+        if (ms > (uint64_t) (minutes - 5) * 60000) {
+            int diff = AudioDrift.Ppm - skew;
+
+            if (abs(diff) > abs(result->Worst)) {
+                result->Worst = diff;
+            }
+            ppm += AudioDrift.Ppm;
+            if (!(ms % 24)) {
+                sum += AudioGetDelay();
+                samples++;
+            }
+        }
+        if (!(ms % 24)) {
+            Tone(packet, frame);
+            AudioEnqueue(packet, sizeof(packet));
+            frame += PACKET_FRAMES;
+        }
+    }
+    result->Ppm = ppm / (5 * 60000);
+    result->Delay = sum / samples;
+}
+
+///
+/// Check a run with drift correction.
+///
+/// @param name	name of the run
+/// @param skew	output clock error in ppm
+/// @param burst	minute, at which 300 ms more arrive, 0 none
+///
+static void Run(const char *name, int skew, int burst)
+{
+    Result result;
+    int failed;
+
+    printf("%s\n", name);
+    failed = Failed;
+    PlaySkewed(&result, skew, 20, burst, 1);
+    CHECK(!result.Underruns, "%d underruns", result.Underruns);
+    CHECK(!result.Clicks, "%d clicks", result.Clicks);
+    // the proportional part follows the jitter of the periods
+    CHECK(abs(result.Ppm - skew) <= 3, "%dppm on average, skew %dppm", result.Ppm, skew);
+    CHECK(abs(result.Worst) <= 25, "%dppm off, skew %dppm", result.Worst, skew);
+    CHECK(llabs(result.Delay - AudioDrift.Target) <= 2 * 90, "average delay %" PRId64 "ms, target %" PRId64 "ms",
+        result.Delay / 90, AudioDrift.Target / 90);
+    // the burst restarts the loop at the new delay
+    CHECK(!burst || AudioDrift.Target > 300 * 90, "target %" PRId64 "ms after burst", AudioDrift.Target / 90);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+}
+
+///
+/// Time the resampler.
+///
+/// @param channels	number of channels
+///
+/// @returns us per packet of PACKET_FRAMES frames
+///
+static double Bench(int channels)
+{
+    enum { LOOPS = 2000 };
+    static int16_t in[PACKET_FRAMES * 8];
+    static int16_t out[(PACKET_FRAMES + PACKET_FRAMES / 512 + 2) * 8];
+    uint64_t best;
+
+    for (int i = 0; i < PACKET_FRAMES * channels; ++i) {
+        in[i] = lrint(AMPLITUDE * sin(i * 0.01));
+    }
+    AudioDrift.Channels = 0;
+    AudioDrift.Ppm = 317;
+    best = UINT64_MAX;
+    // best of some rounds, other load only slows down
+    for (int r = 0; r < 5; ++r) {
+        uint64_t t;
+
+        t = Ticks();
+        for (int i = 0; i < LOOPS; ++i) {
+            AudioDriftResample(in, PACKET_FRAMES, out, channels);
+        }
+        t = Ticks() - t;
+        if (t < best) {
+            best = t;
+        }
+    }
+    return (double)best / LOOPS;
+}
+
+int main(int argc, char *const argv[])
+{
+    double us;
+
+    AudioRingInit();
+    AudioDriftInit();
+    AudioUsedModule = &TestModule;
+    AudioStartThreshold = AudioRingBufferSize;  // the test starts playback
+    Clock = 1000000;
+
+    if (argc > 1 && !strcmp(argv[1], "-b")) {
+        static const int Channels[] = { 1, 2, 6, 8 };
+
+        for (int i = 0; i < 4; ++i) {
+            us = Bench(Channels[i]);
+            printf("%d channels: %.2f us per 24 ms packet, %.3f%% cpu\n", Channels[i], us, us * 100 / 24000);
+        }
+        AudioRingExit();
+        return 0;
+    }
+
+    Run("output 150ppm fast", 150, 0);
+    Run("output 300ppm slow", -300, 0);
+    Run("burst of 300 ms", 200, 10);
+
+    // without correction the ring runs empty
+    printf("uncorrected\n");
+    {
+        Result result;
+        int failed = Failed;
+
+        PlaySkewed(&result, 300, 10, 0, 0);
+        CHECK(result.Underruns, "300ppm fast played without underrun");
+        printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+    }
+
+    printf("cpu\n");
+    {
+        int failed = Failed;
+
+        us = Bench(2);
+        CHECK(us < 24000 / 100, "stereo packet takes %.1f us", us);
+        printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+    }
+
+    AudioRingExit();
+    return Failed ? 1 : 0;
+}
@@ -0,0 +1,351 @@
+///
+/// @file log_test.c	@brief Log module test and benchmark
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// syslog, vsyslog and usleep of the log module are replaced.  The
+/// lines of the writer thread are kept, its poll interval is shortened
+/// and it can be held in its sleep.
+///
+/// The test compares the deferred formatting with vsnprintf, checks
+/// %m and the formats, which are formatted by the caller, and the
+/// rate limit with its drop report.  The rate limit is flushed by the
+/// test itself while the writer is held.  A forked child, without the
+/// writer thread, must get its queued messages and a fatal error out
+/// through a pipe before it aborts.
+///
+/// With -b the cost of a call is timed instead: a queued message, a
+/// rate limited one, one below the log level and a direct syslog call.
+///
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define syslog LogTestSyslog
+#define vsyslog LogTestVsyslog
+#define usleep LogTestSleep
+
+static void LogTestSyslog(int, const char *, ...);
+static void LogTestVsyslog(int, const char *, va_list);
+static int LogTestSleep(useconds_t);
+
+#include "../log.c"
+
+#undef syslog
+#undef vsyslog
+#undef usleep
+
+#include "test.h"
+
+#define LINES_MAX 512                   ///< max. kept lines
+
+static char Lines[LINES_MAX][LOG_LINE_MAX]; ///< lines written
+static volatile int LineCount;          ///< number of lines written
+static atomic_t Hold;                   ///< flag: keep the writer sleeping
+static atomic_t Held;                   ///< flag: writer is kept sleeping
+static int Pipe = -1;                   ///< lines are also written here
+static const char *volatile Null;       ///< string argument NULL
+
+static void LogTestVsyslog(int priority, const char *format, va_list ap)
+{
+    (void)priority;
+    if (LineCount < LINES_MAX) {
+        vsnprintf(Lines[LineCount], LOG_LINE_MAX, format, ap);
+        if (Pipe >= 0 && write(Pipe, Lines[LineCount], strlen(Lines[LineCount])) < 0) {
+            _exit(2);
+        }
+    }
+    LineCount++;
+}
+
+static void LogTestSyslog(int priority, const char *format, ...)
+{
+    va_list ap;
+
+    va_start(ap, format);
+    LogTestVsyslog(priority, format, ap);
+    va_end(ap);
+}
+
+static int LogTestSleep(useconds_t us)
+{
+    while (atomic_read(&Hold)) {
+        atomic_set(&Held, 1);
+        usleep(50);
+    }
+    atomic_set(&Held, 0);
+    return usleep(us < 100 ? us : 100);
+}
+
+///
+/// Get time in ns.
+///
+static uint64_t Ticks(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+///
+/// Wait until the writer has written all queued records.
+///
+static void Drain(void)
+{
+    LogRing *ring = LogThreadRing;
+    uint64_t end;
+
+    end = Ticks() + 2000000000ULL;
+    // the drop report follows the records
+    while (ring && (atomic_read(&ring->Tail) != atomic_read(&ring->Head) || atomic_read(&ring->Dropped))) {
+        if (Ticks() > end) {
+            CHECK(0, "%d records and %d drops not written after 2s",
+                atomic_read(&ring->Head) - atomic_read(&ring->Tail), atomic_read(&ring->Dropped));
+            atomic_set(&ring->Tail, atomic_read(&ring->Head));
+            atomic_set(&ring->Dropped, 0);
+            break;
+        }
+        usleep(50);
+    }
+}
+
+///
+/// Wait until the writer sleeps after a flush and keep it there.
+///
+static void HoldWriter(void)
+{
+    atomic_set(&Hold, 1);
+    while (!atomic_read(&Held)) {
+        usleep(50);
+    }
+}
+
+///
+/// Let the writer go on and wait until it left its sleep.
+///
+static void ReleaseWriter(void)
+{
+    atomic_set(&Hold, 0);
+    while (atomic_read(&Held)) {
+        usleep(50);
+    }
+}
+
+///
+/// Log a message and wait until it is written.
+///
+/// @param want	expected line, NULL as vsnprintf formats it
+/// @param format	printf format
+///
+static void __attribute__((format(printf, 2, 3))) Expect(const char *want, const char *format, ...)
+{
+    char line[LOG_LINE_MAX];
+    va_list ap;
+    int n;
+
+    if (!want) {
+        va_start(ap, format);
+        vsnprintf(line, sizeof(line), format, ap);
+        va_end(ap);
+        want = line;
+    }
+    n = LineCount;
+    va_start(ap, format);
+    LogPrintf(format, ap);
+    va_end(ap);
+    Drain();
+    if (LineCount != n + 1) {
+        CHECK(0, "\"%s\": %d lines written", format, LineCount - n);
+        return;
+    }
+    CHECK(!strcmp(Lines[n], want), "\"%s\": \"%s\", expected \"%s\"", format, Lines[n], want);
+}
+
+///
+/// Time a message.
+///
+/// The timed calls are done in batches, which fit into the ring, the
+/// writer drains the ring between them.
+///
+/// @param name	name of the case
+/// @param tokens	tokens of the thread for each batch
+/// @param level	level of the message
+///
+static void Bench(const char *name, int tokens, int level)
+{
+    enum { BATCH = 200, BATCHES = 2000 };
+    uint64_t ns;
+
+    ns = 0;
+    for (int b = 0; b < BATCHES; ++b) {
+        uint64_t t;
+
+        Drain();
+        atomic_set(&LogThreadRing->Tokens, tokens);
+        t = Ticks();
+        for (int i = 0; i < BATCH; ++i) {
+            Syslog(level, "audio: %d of %zu bytes at %s, %.1fms\n", i, (size_t)4096, "ring", 12.5);
+        }
+        ns += Ticks() - t;
+    }
+    printf("%s: %.1f ns per call\n", name, (double)ns / BATCH / BATCHES);
+}
+
+int main(int argc, char *const argv[])
+{
+    int failed;
+
+    SysLogLevel = 4;                    // up to level 3
+    Syslog(3, "log: start\n");          // starts the writer
+    Drain();
+    LineCount = 0;
+
+    if (argc > 1 && !strcmp(argv[1], "-b")) {
+        uint64_t t;
+
+        Bench("queued", 1 << 30, 3);
+        Bench("rate limited", -(1 << 30), 3);
+        Bench("below level", 1 << 30, 7);
+        t = Ticks();
+        for (int i = 0; i < 20000; ++i) {
+            syslog(LOG_DEBUG, "audio: %d of %zu bytes at %s, %.1fms\n", i, (size_t)4096, "ring", 12.5);
+        }
+        printf("direct syslog: %.1f ns per call\n", (double)(Ticks() - t) / 20000);
+        LogExit();
+        return 0;
+    }
+
+    printf("format\n");
+    failed = Failed;
+    Expect(NULL, "plain text\n");
+    Expect(NULL, "%d %i %u %x %X %o %c|%%|\n", -12345, 42, 3000000000U, 0xBEEF, 0xBEEF, 8, 'z');
+    Expect(NULL, "%hhd %hd %ld %lld %zu %zd %jd %td\n", (signed char)-5, (short)-300, -123456789L, -1234567890123LL,
+        (size_t)0x10000000000ULL, (ssize_t) - 0x6300000000LL, (intmax_t) - 0x70000000000LL,
+        (ptrdiff_t) - 0xE00000000LL);
+    Expect(NULL, "%5d|%-5d|%05d|%+d|% d|%#x|%.3d\n", 42, 42, 42, 42, 42, 255, 7);
+    Expect(NULL, "%f %.2f %e %g %10.3f %a\n", 3.14159, 2.5, 12345.678, 0.0001, -1.5, 1.0);
+    Expect(NULL, "%s|%10s|%-10s|%.3s|\n", "abc", "right", "left", "truncate");
+    Expect("(null)\n", "%s\n", Null);
+    Expect(NULL, "%p %s %d\n", (void *)0x1234, "mixed", 7);
+    Expect(NULL, "%#012" PRIx64 " %" PRId64 "\n", (uint64_t) 0x1FFFFFFFFULL, (int64_t) - 5);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    // formatted by the caller
+    printf("immediate\n");
+    failed = Failed;
+    Expect(NULL, "%*d|%-*s|\n", 6, 42, 4, "ab");
+    Expect(NULL, "%.*f\n", 3, 2.0 / 3);
+    {
+        static char big[400];
+        static char cut[sizeof(((LogRecord *) 0)->Args)];
+
+        // a too long line is cut to the record
+        memset(big, 'x', sizeof(big) - 1);
+        memset(cut, 'x', sizeof(cut) - 1);
+        memcpy(cut, "long ", 5);
+        Expect(cut, "long %s\n", big);
+    }
+    errno = ENOENT;
+    Expect(NULL, "open: %m\n");
+    CHECK(errno == ENOENT, "errno changed to %d", errno);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    // a burst of LOG_BURST messages passes, the rest is counted
+    printf("rate limit\n");
+    failed = Failed;
+    HoldWriter();
+    atomic_set(&LogThreadRing->Tokens, LOG_BURST);
+    LineCount = 0;
+    for (int i = 0; i < LOG_BURST + 50; ++i) {
+        Syslog(3, "burst %d\n", i);
+    }
+    CHECK(atomic_read(&LogThreadRing->Head) - atomic_read(&LogThreadRing->Tail) == LOG_BURST, "%d queued",
+        atomic_read(&LogThreadRing->Head) - atomic_read(&LogThreadRing->Tail));
+    // the held writer can't refill the tokens or write the lines
+    LogFlush();
+    CHECK(LineCount == LOG_BURST + 1, "%d lines written", LineCount);
+    CHECK(!strcmp(Lines[LOG_BURST - 1], "burst 199\n"), "last line \"%s\"", Lines[LOG_BURST - 1]);
+    CHECK(!strcmp(Lines[LOG_BURST], "log: 50 messages dropped\n"), "report \"%s\"", Lines[LOG_BURST]);
+    CHECK(!atomic_read(&LogThreadRing->Dropped), "%d drops left", atomic_read(&LogThreadRing->Dropped));
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    // only the forking thread runs in the child, nothing but the fatal
+    // error itself can write the queued message.  The writer is still
+    // held, it isn't in a flush while forking.
+    printf("fatal\n");
+    failed = Failed;
+    {
+        static const char want[] = "queued 1\nfatal 2: No such file or directory\n";
+        char buf[256];
+        int fds[2];
+        pid_t pid;
+        int status;
+        ssize_t n;
+
+        atomic_set(&LogThreadRing->Tokens, LOG_BURST);
+        CHECK(pipe(fds) == 0, "pipe: %s", strerror(errno));
+        if (!(pid = fork())) {
+            struct rlimit core = { 0, 0 };
+
+            setrlimit(RLIMIT_CORE, &core);
+            close(fds[0]);
+            Pipe = fds[1];
+            Syslog(3, "queued %d\n", 1);
+            errno = ENOENT;
+            Fatal("fatal %d: %m\n", 2);
+        }
+        close(fds[1]);
+        n = 0;
+        while (n < (ssize_t) sizeof(buf) - 1) {
+            ssize_t r;
+
+            if ((r = read(fds[0], buf + n, sizeof(buf) - 1 - n)) <= 0) {
+                break;
+            }
+            n += r;
+        }
+        buf[n] = '\0';
+        close(fds[0]);
+        CHECK(waitpid(pid, &status, 0) == pid && WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT,
+            "child status %#x", status);
+        CHECK(!strcmp(buf, want), "child wrote \"%s\", expected \"%s\"", buf, want);
+        ReleaseWriter();
+    }
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    // after the exit the messages are written directly
+    printf("exit\n");
+    failed = Failed;
+    LogExit();
+    LineCount = 0;
+    Syslog(3, "direct %d\n", 1);
+    CHECK(LineCount == 1 && !strcmp(Lines[0], "direct 1\n"), "%d lines, \"%s\"", LineCount, Lines[0]);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    return Failed ? 1 : 0;
+}
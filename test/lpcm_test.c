@@ -0,0 +1,344 @@
+///
+/// @file lpcm_test.c	@brief DVD LPCM conversion test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Builds DVD LPCM PES packets of random samples for 16, 20 and 24 bit
+/// and 1 to 8 channels, passes their payload to AudioEnqueueLpcm like
+/// PlayAudio does and reads the audio ring back.  The ring must hold
+/// the upper 16 bits of every sample, in the channel order of decoded
+/// audio.  Each format is played once with the write position at the
+/// start of the ring and once just before its end.  AudioLpcmHeader
+/// must decode every format byte and reject each layout that can't be
+/// played, nothing of such a packet may reach the ring.
+///
+/// Blu-ray LPCM is not passed to PlayAudio, VDR only hands DVD LPCM to
+/// the device.
+///
+
+#include "../audio.c"
+#include "test.h"
+
+#define FRAMES_MAX 512                  ///< max. frames of a packet
+
+/// ring channel of each DVD channel: L R C LFE Ls Rs become
+/// L R Ls Rs C (5.0), L R LFE C Ls Rs (5.1, 7.1)
+static const int RingChannel[9][8] = {
+    [1] = {0},
+    [2] = {0, 1},
+    [3] = {0, 1, 2},
+    [4] = {0, 1, 2, 3},
+    [5] = {0, 1, 4, 2, 3},
+    [6] = {0, 1, 3, 2, 4, 5},
+    [7] = {0, 1, 2, 3, 4, 5, 6},
+    [8] = {0, 1, 3, 2, 4, 5, 6, 7},
+};
+
+///
+/// Build a DVD LPCM PES packet.
+///
+/// 20 and 24-bit samples are grouped by 2 frames.  A group is split
+/// into units of 4 samples (2 for mono), a unit stores the upper 16
+/// bits of its samples, then the 4 or 8 lower bits.
+///
+/// @param[out] pes	PES packet
+/// @param upper	upper 16 bits of the samples, DVD channel order
+/// @param lower	lower bits of the samples
+/// @param frames	number of frames
+/// @param bits	bits per sample
+/// @param channels	number of channels
+///
+/// @returns size of the PES packet
+///
+static int BuildPes(uint8_t * pes, const int16_t * upper, const uint8_t * lower, int frames, int bits,
+    int channels)
+{
+    uint8_t *p;
+    int size;
+
+    p = pes + 9 + 5;                    // PES header with PTS
+    *p++ = 0xA0;                        // sub stream: LPCM track 0
+    *p++ = 1;                           // number of frame headers
+    *p++ = 0;                           // first access unit
+    *p++ = 4;
+    *p++ = 0;                           // emphasis, mute, frame number
+    *p++ = ((bits - 16) / 4) << 6 | 0 << 4 | (channels - 1);    // 48 kHz
+    *p++ = 0x80;                        // dynamic range
+    if (bits == 16) {
+        for (int i = 0; i < frames * channels; ++i) {
+            *p++ = upper[i] >> 8;
+            *p++ = upper[i];
+        }
+    } else {
+        int unit = channels == 1 ? 2 : 4;
+
+        for (int i = 0; i < frames * channels; i += unit) {
+            for (int u = 0; u < unit; ++u) {
+                *p++ = upper[i + u] >> 8;
+                *p++ = upper[i + u];
+            }
+            for (int u = 0; u < unit; ++u) {
+                if (bits == 24) {
+                    *p++ = lower[i + u];
+                } else if (u & 1) {
+                    p[-1] |= lower[i + u] & 0x0F;
+                } else {
+                    *p++ = lower[i + u] << 4;
+                }
+            }
+        }
+    }
+    size = p - pes;
+    pes[0] = 0x00;
+    pes[1] = 0x00;
+    pes[2] = 0x01;
+    pes[3] = 0xBD;                      // private stream 1
+    pes[4] = (size - 6) >> 8;
+    pes[5] = size - 6;
+    pes[6] = 0x81;
+    pes[7] = 0x80;                      // PTS
+    pes[8] = 5;
+    pes[9] = 0x21;                      // PTS 0
+    pes[10] = 0x00;
+    pes[11] = 0x01;
+    pes[12] = 0x00;
+    pes[13] = 0x01;
+    return size;
+}
+
+///
+/// Play a DVD LPCM PES packet, the LPCM part of PlayAudio.
+///
+/// @returns 0 if played, -1 if the header was rejected
+///
+static int PlayPes(const uint8_t * pes, int size)
+{
+    const uint8_t *p;
+    int samplerate;
+    int bits;
+    int channels;
+    int n;
+
+    n = pes[8];
+    p = pes + 9 + n;
+    n = size - 9 - n;
+    if (AudioLpcmHeader(p, &samplerate, &bits, &channels)) {
+        return -1;
+    }
+    AudioEnqueueLpcm(p + LPCM_HEADER_SIZE, n - LPCM_HEADER_SIZE, bits, channels);
+    return 0;
+}
+
+///
+/// Set up a new ring.
+///
+/// @param channels	input channels
+/// @param hw_channels	hardware channels
+/// @param offset	ring write position
+///
+static RingBuffer *Setup(int channels, int hw_channels, size_t offset)
+{
+    RingBuffer *rb;
+    int freq;
+
+    AudioChannelMatrix[Audio48000][channels] = hw_channels;
+    atomic_set(&AudioRingFilled, 0);
+    freq = 48000;
+    if (AudioSetup(&freq, &channels, 0)) {
+        CHECK(0, "%d channels not set up", channels);
+    }
+    rb = AudioRing[AudioRingWrite].RingBuffer;
+    while (offset) {
+        static uint8_t fill[4096];
+        size_t n = offset < sizeof(fill) ? offset : sizeof(fill);
+
+        RingBufferWrite(rb, fill, n);
+        RingBufferReadAdvance(rb, n);
+        offset -= n;
+    }
+    return rb;
+}
+
+///
+/// Play random packets and check the ring.
+///
+/// @param bits	bits per sample
+/// @param channels	DVD channels
+/// @param hw_channels	hardware channels
+/// @param offset	ring write position
+///
+static void PlayFormat(int bits, int channels, int hw_channels, size_t offset)
+{
+    static uint8_t pes[9 + 5 + 7 + FRAMES_MAX * 8 * 3];
+    static int16_t upper[FRAMES_MAX * 8];
+    static uint8_t lower[FRAMES_MAX * 8];
+    static int16_t ring[FRAMES_MAX * 8];
+    RingBuffer *rb;
+    int frames;
+    int size;
+    int n;
+
+    rb = Setup(channels, hw_channels, offset);
+    frames = 2 * (1 + Random() % (FRAMES_MAX / 2));
+    for (int i = 0; i < frames * channels; ++i) {
+        upper[i] = Random();
+        lower[i] = Random();
+        if (!(Random() % 8)) {
+            upper[i] = Random() & 1 ? INT16_MIN : INT16_MAX;
+        }
+    }
+    size = BuildPes(pes, upper, lower, frames, bits, channels);
+    if (PlayPes(pes, size)) {
+        CHECK(0, "%d bit %d channels rejected", bits, channels);
+        return;
+    }
+
+    n = RingBufferRead(rb, ring, sizeof(ring));
+    if (n != frames * hw_channels * 2) {
+        CHECK(0, "%d bit %d -> %d channels at %zu: %d bytes in ring, expected %d", bits, channels, hw_channels,
+            offset, n, frames * hw_channels * 2);
+        return;
+    }
+    for (int f = 0; f < frames; ++f) {
+        for (int c = 0; c < hw_channels; ++c) {
+            int16_t want;
+
+            want = 0;                   // missing channels are silent
+            for (int d = 0; d < channels; ++d) {
+                if (RingChannel[channels][d] == c) {
+                    want = upper[f * channels + d];
+                }
+            }
+            if (channels == 1 && hw_channels == 2) {
+                want = upper[f];        // mono to both sides
+            }
+            if (ring[f * hw_channels + c] != want) {
+                CHECK(0, "%d bit %d -> %d channels at %zu: frame %d channel %d is %d, expected %d", bits, channels,
+                    hw_channels, offset, f, c, ring[f * hw_channels + c], want);
+                return;
+            }
+        }
+    }
+}
+
+int main(void)
+{
+    static const int Bits[] = { 16, 20, 24 };
+    int failed;
+
+    AudioRingInit();
+    AudioStartThreshold = AudioRingBufferSize;  // don't start playback
+
+    // same channels in and out, converted straight into the ring
+    printf("direct\n");
+    failed = Failed;
+    for (int b = 0; b < 3; ++b) {
+        for (int c = 1; c <= 8; ++c) {
+            if (Bits[b] != 16 && c > 1 && c & 1) {
+                continue;               // no whole units
+            }
+            for (int i = 0; i < 20; ++i) {
+                // at the start and 2 frames and one sample before the end
+                PlayFormat(Bits[b], c, c, 0);
+                PlayFormat(Bits[b], c, c, AudioRingBufferSize - 2 * c * 2 - 2);
+            }
+        }
+    }
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    // hardware channels differ, through the mixer of AudioEnqueue
+    printf("mixed\n");
+    failed = Failed;
+    for (int b = 0; b < 3; ++b) {
+        for (int i = 0; i < 20; ++i) {
+            PlayFormat(Bits[b], 1, 2, 0);
+            if (Bits[b] == 16) {
+                PlayFormat(Bits[b], 3, 8, 0);
+                PlayFormat(Bits[b], 5, 6, 0);
+            }
+            PlayFormat(Bits[b], 6, 8, AudioRingBufferSize - 3 * 16 - 2);
+        }
+    }
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    // every field of the format byte
+    printf("header\n");
+    failed = Failed;
+    for (int format = 0; format < 256; ++format) {
+        static const int rates[] = { 48000, 96000, 44100, 32000 };
+        uint8_t header[LPCM_HEADER_SIZE] = { 0xA0, 1, 0, 4, 0, format, 0x80 };
+        int samplerate;
+        int bits;
+        int channels;
+        int ret;
+
+        ret = AudioLpcmHeader(header, &samplerate, &bits, &channels);
+        CHECK(bits == 16 + (format >> 6) * 4 && samplerate == rates[(format >> 4) & 3]
+            && channels == (format & 7) + 1, "format %#04x: %d bit %d Hz %d channels", format, bits, samplerate,
+            channels);
+        if ((format >> 6) == 3 || ((format >> 6) && (format & 7) && !(format & 1))) {
+            CHECK(ret == -1, "format %#04x: %d bit %d channels accepted", format, bits, channels);
+        } else {
+            CHECK(ret == 0, "format %#04x: %d bit %d channels rejected", format, bits, channels);
+        }
+    }
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    // formats which can't be split into units and the reserved
+    // quantization are rejected and dropped
+    printf("unsupported\n");
+    failed = Failed;
+    {
+        static const struct
+        {
+            int bits;
+            int channels;
+        } layouts[] = {
+            {20, 3}, {20, 5}, {20, 7},
+            {24, 3}, {24, 5}, {24, 7},
+            {28, 1}, {28, 2}, {28, 6}, {28, 8},
+        };
+        static uint8_t pes[9 + 5 + 7 + 64 * 8 * 4];
+        static int16_t upper[64 * 8];
+        static uint8_t lower[64 * 8];
+        RingBuffer *rb;
+        int size;
+
+        for (size_t i = 0; i < sizeof(layouts) / sizeof(*layouts); ++i) {
+            int bits = layouts[i].bits;
+            int channels = layouts[i].channels;
+
+            rb = Setup(channels, channels, 0);
+            // the reserved quantization is built as 24 bit and patched
+            size = BuildPes(pes, upper, lower, 64, bits == 28 ? 24 : bits, channels);
+            pes[9 + 5 + LPCM_FORMAT] |= bits == 28 ? 0xC0 : 0;
+            CHECK(PlayPes(pes, size) == -1, "%d bit %d channels accepted", bits, channels);
+            CHECK(!RingBufferUsedBytes(rb), "%d bit %d channels queued", bits, channels);
+            // AudioEnqueueLpcm drops them too
+            AudioEnqueueLpcm(pes + 9 + 5 + LPCM_HEADER_SIZE, size - 9 - 5 - LPCM_HEADER_SIZE, bits, channels);
+            CHECK(!RingBufferUsedBytes(rb), "%d bit %d channels enqueued", bits, channels);
+        }
+    }
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    AudioRingExit();
+    return Failed ? 1 : 0;
+}
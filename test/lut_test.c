@@ -0,0 +1,300 @@
+///
+/// @file lut_test.c	@brief 3D LUT parser, resampling and cache test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Writes .cube files of a reference transform, parses them and
+/// resamples them to the 17x17x17 amvecm grid.  Each grid point must be
+/// within 1 LSB of a double precision trilinear interpolation of the
+/// parsed cube and within LUT_TOLERANCE of the transform itself.  The
+/// binary cache must return the table only for the hash it was written
+/// with.
+///
+/// With -b the load of a 65^3 cube is timed, parsed and from the cache,
+/// and the error to the transform is printed for some cube sizes.
+///
+
+#include <math.h>
+
+#include "../video.c"
+#include "test.h"
+
+#define LUT_TOLERANCE 3                 ///< max. error to the transform in LSB
+
+///
+/// Reference transform, a display gamma with a little cross talk.
+///
+/// @param rgb	input, 0 - 1
+/// @param c	output channel
+///
+static double Transform(const double rgb[3], int c)
+{
+    double v;
+
+    v = pow(rgb[c], 1.0 / 1.1) * 0.9 + 0.05 * (rgb[(c + 1) % 3] + rgb[(c + 2) % 3]);
+    return v < 0.0 ? 0.0 : v > 1.0 ? 1.0 : v;
+}
+
+///
+/// Write a .cube file of the transform.
+///
+/// @param size	grid size
+/// @param[out] len	length of the file
+///
+/// @returns malloc'ed file contents
+///
+static char *MakeCube(int size, size_t *len)
+{
+    char *data;
+    size_t n;
+
+    data = malloc((size_t)size * size * size * 32 + 256);
+    n = sprintf(data, "# reference\nTITLE \"test\"\nLUT_3D_SIZE %d\n\nDOMAIN_MIN 0 0 0\nDOMAIN_MAX 1 1 1\n", size);
+    for (int b = 0; b < size; ++b) {
+        for (int g = 0; g < size; ++g) {
+            for (int r = 0; r < size; ++r) {
+                double rgb[3] = { (double)r / (size - 1), (double)g / (size - 1), (double)b / (size - 1) };
+
+                n += sprintf(data + n, "%.6f %.6f %.6f\n", Transform(rgb, 0), Transform(rgb, 1), Transform(rgb, 2));
+            }
+        }
+    }
+    *len = n;
+    return data;
+}
+
+///
+/// Trilinear interpolation of a cube in double precision.
+///
+static double Interpolate(const float *lut, int size, const double rgb[3], int c)
+{
+    int i[3];
+    double f[3];
+    double v;
+
+    for (int k = 0; k < 3; ++k) {
+        double pos = rgb[k] * (size - 1);
+
+        i[k] = pos >= size - 1 ? size - 2 : (int)pos;
+        f[k] = pos - i[k];
+    }
+    v = 0.0;
+    for (int k = 0; k < 8; ++k) {
+        int r = i[0] + (k & 1);
+        int g = i[1] + ((k >> 1) & 1);
+        int b = i[2] + (k >> 2);
+
+        v += (k & 1 ? f[0] : 1.0 - f[0]) * (k & 2 ? f[1] : 1.0 - f[1]) * (k & 4 ? f[2] : 1.0 - f[2])
+            * lut[((b * size + g) * size + r) * 3 + c];
+    }
+    return v;
+}
+
+///
+/// Compare a resampled table with the cube and the transform.
+///
+/// @param lut	parsed cube
+/// @param size	grid size of the cube
+/// @param lut17	resampled table
+/// @param[out] error	max. error to the transform in LSB
+///
+/// @returns max. error to the interpolated cube in LSB
+///
+static int Compare(const float *lut, int size, const unsigned *lut17, int *error)
+{
+    int max = 0;
+
+    *error = 0;
+    for (int b = 0; b < LUT_GRID; ++b) {
+        for (int g = 0; g < LUT_GRID; ++g) {
+            for (int r = 0; r < LUT_GRID; ++r) {
+                double rgb[3] =
+                    { (double)r / (LUT_GRID - 1), (double)g / (LUT_GRID - 1), (double)b / (LUT_GRID - 1) };
+                const unsigned *v = &lut17[((b * LUT_GRID + g) * LUT_GRID + r) * 3];
+
+                for (int c = 0; c < 3; ++c) {
+                    int d = abs((int)v[c] - (int)lround(Interpolate(lut, size, rgb, c) * 4095.0));
+                    int e = abs((int)v[c] - (int)lround(Transform(rgb, c) * 4095.0));
+
+                    max = d > max ? d : max;
+                    *error = e > *error ? e : *error;
+                }
+            }
+        }
+    }
+    return max;
+}
+
+///
+/// Get a time in us.
+///
+static uint64_t Ticks(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+///
+/// Time the load of a cube, parsed and from the cache.
+///
+static void Bench(const char *dir)
+{
+    static const int sizes[] = { 17, 24, 33, 48, 65 };
+    char cache[PATH_MAX];
+    unsigned *lut17;
+    uint64_t parse;
+    uint64_t resample;
+    uint64_t read;
+    uint64_t hash;
+    size_t len;
+    float *lut;
+    char *data;
+    int size;
+    int error;
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+        data = MakeCube(sizes[i], &len);
+        lut = lut_parse_cube(data, len, &size);
+        lut17 = convert_to_17(lut, size);
+        Compare(lut, size, lut17, &error);
+        printf("%d^3: max. error %d LSB\n", sizes[i], error);
+        free(lut17);
+        free(lut);
+        free(data);
+    }
+
+    data = MakeCube(65, &len);
+    snprintf(cache, sizeof(cache), "%s/lut.cube.bin", dir);
+    parse = Ticks();
+    hash = LutHash(data, len);
+    lut = lut_parse_cube(data, len, &size);
+    parse = Ticks() - parse;
+    resample = Ticks();
+    lut17 = convert_to_17(lut, size);
+    resample = Ticks() - resample;
+    LutCacheWrite(cache, hash, lut17);
+    free(lut17);
+    read = Ticks();
+    hash = LutHash(data, len);
+    lut17 = LutCacheRead(cache, hash);
+    read = Ticks() - read;
+    printf("65^3, %zu bytes: parse %.1f ms, resample %.1f ms, hash and cache %.1f ms\n", len, parse / 1000.0,
+        resample / 1000.0, read / 1000.0);
+    unlink(cache);
+    free(lut17);
+    free(lut);
+    free(data);
+}
+
+int main(int argc, char *const argv[])
+{
+    char dir[] = "/tmp/lut_testXXXXXX";
+    char cache[PATH_MAX];
+    unsigned *lut17;
+    unsigned *cached;
+    size_t len;
+    float *lut;
+    char *data;
+    int failed;
+    int size;
+
+    if (!mkdtemp(dir)) {
+        perror(dir);
+        return 1;
+    }
+    if (argc > 1 && !strcmp(argv[1], "-b")) {
+        Bench(dir);
+        rmdir(dir);
+        return 0;
+    }
+
+    printf("parser\n");
+    failed = Failed;
+    {
+        static const char cube[] =
+            "TITLE \"x\"\r\n# comment\nDOMAIN_MIN 0 0 -1\nDOMAIN_MAX 2 2 1\nLUT_3D_SIZE 2\n"
+            "0 0 -1\n2e0 0 -1 # red\n0 2 -1\n+2 2 -1\n0,0 0 1\n2 0 1\n0 2 1\n2 2 1.0E+0";
+
+        lut = lut_parse_cube(cube, sizeof(cube) - 1, &size);
+        CHECK(lut && size == 2, "cube not parsed");
+        for (int i = 0; lut && i < 8; ++i) {
+            CHECK(lut[i * 3] == (i & 1) && lut[i * 3 + 1] == ((i >> 1) & 1) && lut[i * 3 + 2] == (i >> 2),
+                "entry %d: %f %f %f", i, lut[i * 3], lut[i * 3 + 1], lut[i * 3 + 2]);
+        }
+        free(lut);
+        // short, 1D and a grid of one
+        CHECK(!lut_parse_cube(cube, sizeof(cube) - 8, &size), "short cube parsed");
+        CHECK(!lut_parse_cube("LUT_1D_SIZE 2\n0 0 0\n1 1 1\n", 26, &size), "1D lut parsed");
+        CHECK(!lut_parse_cube("LUT_3D_SIZE 1\n0 0 0\n", 20, &size), "grid of one parsed");
+        CHECK(!lut_parse_cube("LUT_3D_SIZE 99\n0 0 0\n", 21, &size), "grid of 99 parsed");
+    }
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    printf("resampling\n");
+    failed = Failed;
+    for (int s = 2; s <= LUT_MAX_SIZE; s += s < 17 ? 7 : 16) {
+        int max;
+        int error;
+
+        data = MakeCube(s, &len);
+        lut = lut_parse_cube(data, len, &size);
+        CHECK(lut && size == s, "%d^3 not parsed", s);
+        if (lut && (lut17 = convert_to_17(lut, size))) {
+            max = Compare(lut, size, lut17, &error);
+            CHECK(max <= 1, "%d^3: %d LSB from the interpolated cube", s, max);
+            // two points only follow the gamma curve roughly
+            CHECK(s < 16 || error <= LUT_TOLERANCE, "%d^3: %d LSB from the transform", s, error);
+            free(lut17);
+        }
+        free(lut);
+        free(data);
+    }
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    printf("cache\n");
+    failed = Failed;
+    data = MakeCube(33, &len);
+    lut = lut_parse_cube(data, len, &size);
+    lut17 = convert_to_17(lut, size);
+    snprintf(cache, sizeof(cache), "%s/lut.cube.bin", dir);
+    LutCacheWrite(cache, LutHash(data, len), lut17);
+    cached = LutCacheRead(cache, LutHash(data, len));
+    CHECK(cached && !memcmp(cached, lut17, sizeof(int) * LUT_GRID * LUT_GRID * LUT_GRID * 3),
+        "cache doesn't match");
+    free(cached);
+    data[len / 2] ^= 1;                 // edited cube
+    CHECK(!(cached = LutCacheRead(cache, LutHash(data, len))), "cache of another cube read");
+    free(cached);
+    CHECK(truncate(cache, 1000) == 0, "can't truncate %s", cache);
+    data[len / 2] ^= 1;
+    CHECK(!(cached = LutCacheRead(cache, LutHash(data, len))), "short cache read");
+    free(cached);
+    unlink(cache);
+    free(lut17);
+    free(lut);
+    free(data);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    rmdir(dir);
+    return Failed ? 1 : 0;
+}
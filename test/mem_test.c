@@ -0,0 +1,275 @@
+///
+/// @file mem_test.c	@brief Memory budget registry test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Checks the totals of the memory registry against the sum of its tags
+/// and against the MEMS report, the budget cut of a reservation, the
+/// report of a reservation granted past the budget, and threads which
+/// reserve and release at the same time.
+///
+/// The PES buffer and the video arena are set up and torn down by the
+/// device module.  av_malloc and mmap of the module are replaced, they
+/// can fail, then nothing may stay reserved when the module gives up.
+///
+
+#include <libavutil/mem.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+#define av_malloc MemTestMalloc
+#define mmap MemTestMmap
+
+static void *MemTestMalloc(size_t);
+static void *MemTestMmap(void *, size_t, int, int, int, off_t);
+
+#include "../softhddev.c"
+
+#undef av_malloc
+#undef mmap
+
+#include "test.h"
+
+#define THREADS 4                       ///< concurrent reserving threads
+#define ROUNDS 100000                   ///< reservations per thread
+
+static int FailAlloc;                   ///< flag: allocations fail
+static sigjmp_buf Aborted;              ///< return from Fatal
+
+static void *MemTestMalloc(size_t size)
+{
+    return FailAlloc ? NULL : av_malloc(size);
+}
+
+static void *MemTestMmap(void *addr, size_t size, int prot, int flags, int fd, off_t offset)
+{
+    return FailAlloc ? MAP_FAILED : mmap(addr, size, prot, flags, fd, offset);
+}
+
+static void OnAbort(int sig)
+{
+    (void)sig;
+    siglongjmp(Aborted, 1);
+}
+
+///
+/// Check the totals against the tags and the report.
+///
+/// @param name	name of the state
+///
+static void CheckTotals(const char *name)
+{
+    char buf[1024];
+    char tag[8];
+    const char *s;
+    size_t current;
+    size_t peak;
+    size_t kib;
+    size_t total;
+    size_t total_peak;
+    int lines;
+
+    current = 0;
+    peak = 0;
+    for (int i = 0; i < MEM_TAGS; ++i) {
+        current += MemAccounts[i].Current;
+        if (MemAccounts[i].Peak > peak) {
+            peak = MemAccounts[i].Peak;
+        }
+        CHECK(MemAccounts[i].Current <= MemAccounts[i].Peak, "%s: %s above its peak", name, MemAccounts[i].Name);
+    }
+    CHECK(MemTotal() == current, "%s: total %zu, tags %zu", name, MemTotal(), current);
+    CHECK(MemPeak >= current && MemPeak >= peak, "%s: total peak %zu below %zu", name, MemPeak, current);
+
+    // the report in KiB
+    MemGetStats(buf, sizeof(buf));
+    lines = 0;
+    for (s = buf; *s; s = strchr(s, '\n') + 1, ++lines) {
+        if (lines < MEM_TAGS) {
+            CHECK(sscanf(s, "%7s %zu KiB", tag, &kib) == 2 && !strcmp(tag, MemAccounts[lines].Name)
+                && kib == MemAccounts[lines].Current >> 10, "%s: report \"%.*s\"", name,
+                (int)strcspn(s, "\n"), s);
+        } else {
+            CHECK(sscanf(s, "total %zu KiB peak %zu KiB", &total, &total_peak) == 2 && total == current >> 10
+                && total_peak == MemPeak >> 10, "%s: report \"%.*s\"", name, (int)strcspn(s, "\n"), s);
+        }
+    }
+    CHECK(lines == MEM_TAGS + 1, "%s: %d report lines", name, lines);
+}
+
+///
+/// Reserve and release random buffers.
+///
+/// @param arg	seed of the thread
+///
+static void *Worker(void *arg)
+{
+    unsigned seed = (unsigned)(intptr_t) arg;
+    size_t held[MEM_TAGS] = { 0 };
+
+    for (int i = 0; i < ROUNDS; ++i) {
+        int tag;
+
+        seed = seed * 1103515245 + 12345;
+        tag = (seed >> 8) % MEM_TAGS;
+        if (held[tag] && (seed >> 20) & 1) {
+            MemRelease(tag, held[tag]);
+            held[tag] = 0;
+        } else {
+            held[tag] += MemReserve(tag, (seed >> 12) % 65536 + 1, 1);
+        }
+    }
+    for (int tag = 0; tag < MEM_TAGS; ++tag) {
+        MemRelease(tag, held[tag]);
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    static const size_t MB = 1024 * 1024;
+    VideoStream *stream = MyVideoStream;
+    size_t granted;
+    int failed;
+
+    signal(SIGABRT, OnAbort);
+
+    printf("totals\n");
+    failed = Failed;
+    CheckTotals("empty");
+    MemReserve(MEM_AUDIO, 3 * MB, 3 * MB);
+    MemReserve(MEM_OSD, 5000, 5000);
+    MemReserve(MEM_IMAGE, 2 * MB + 17, 2 * MB + 17);
+    CheckTotals("reserved");
+    MemRelease(MEM_IMAGE, 2 * MB + 17);
+    CheckTotals("released");
+    // more than reserved is cut to the tag
+    MemRelease(MEM_OSD, 10000);
+    CHECK(!MemAccounts[MEM_OSD].Current, "%zu osd bytes after release", MemAccounts[MEM_OSD].Current);
+    CheckTotals("over released");
+    MemRelease(MEM_AUDIO, 3 * MB);
+    CHECK(!MemTotal() && MemPeak == 5 * MB + 5017, "total %zu, peak %zu", MemTotal(), MemPeak);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    printf("budget\n");
+    failed = Failed;
+    CHECK(MemSetBudget("pip", "3") && MemBudget(MEM_PIP) == 3 * MB, "pip budget %zu", MemBudget(MEM_PIP));
+    CHECK(!MemSetBudget("Heap", "3"), "unknown tag accepted");
+    granted = MemReserve(MEM_PIP, 2 * MB, MB);
+    CHECK(granted == 2 * MB, "%zu of 2 MB granted", granted);
+    granted = MemReserve(MEM_PIP, 2 * MB, MB / 2);
+    CHECK(granted == MB, "%zu granted, 1 MB left", granted);
+    granted = MemReserve(MEM_PIP, 2 * MB, MB / 2);
+    CHECK(granted == MB / 2, "%zu granted over budget, min 0.5 MB", granted);
+    CHECK(MemAccounts[MEM_PIP].Short == 2, "%d cut reservations", MemAccounts[MEM_PIP].Short);
+    CheckTotals("budget");
+    MemRelease(MEM_PIP, 3 * MB + MB / 2);
+    MemSetBudget("Pip", "0");
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    // min is granted past the budget, the report shows by how much
+    printf("overcommit\n");
+    failed = Failed;
+    {
+        char buf[1024];
+        const char *s;
+        size_t over;
+        size_t over_peak;
+
+        MemSetBudget("Osd", "1");
+        granted = MemReserve(MEM_OSD, MB, MB);
+        CHECK(granted == MB && !MemAccounts[MEM_OSD].Over, "%zu granted, %zu over budget", granted,
+            MemAccounts[MEM_OSD].Over);
+        granted = MemReserve(MEM_OSD, 3 * MB, 3 * MB);
+        CHECK(granted == 3 * MB && MemAccounts[MEM_OSD].Over == 3 * MB, "%zu granted, %zu over budget", granted,
+            MemAccounts[MEM_OSD].Over);
+        MemRelease(MEM_OSD, 2 * MB);
+        MemGetStats(buf, sizeof(buf));
+        s = strstr(buf, "Osd ");
+        CHECK(s && (s = strstr(s, " over ")) && sscanf(s, " over %zu KiB peak %zu KiB", &over, &over_peak) == 2
+            && over == 1024 && over_peak == 3072, "report \"%.*s\"", s ? (int)strcspn(s, "\n") : 0, s ? s : "");
+        CheckTotals("overcommit");
+        MemRelease(MEM_OSD, 2 * MB);
+        MemSetBudget("Osd", "0");
+    }
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    printf("threads\n");
+    failed = Failed;
+    {
+        pthread_t threads[THREADS];
+
+        for (intptr_t i = 0; i < THREADS; ++i) {
+            pthread_create(&threads[i], NULL, Worker, (void *)(i + 1));
+        }
+        for (int i = 0; i < THREADS; ++i) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    for (int i = 0; i < MEM_TAGS; ++i) {
+        CHECK(!MemAccounts[i].Current, "%zu %s bytes left", MemAccounts[i].Current, MemAccounts[i].Name);
+    }
+    CheckTotals("threads");
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    // the buffers of the device module
+    printf("device buffers\n");
+    failed = Failed;
+    PesInit(PesDemuxAudio);
+    CHECK(MemAccounts[MEM_PES].Current == PES_MAX_PAYLOAD + AV_INPUT_BUFFER_PADDING_SIZE, "%zu pes bytes",
+        MemAccounts[MEM_PES].Current);
+    MemSetBudget("Video", "6");
+    VideoPacketInit(stream);
+    CHECK((size_t)stream->ArenaSize == 6 * MB && MemAccounts[MEM_VIDEO].Current == 6 * MB,
+        "arena %d bytes, %zu video bytes", stream->ArenaSize, MemAccounts[MEM_VIDEO].Current);
+    CheckTotals("device");
+    VideoPacketExit(stream);
+    CHECK(!MemAccounts[MEM_VIDEO].Current, "%zu video bytes after exit", MemAccounts[MEM_VIDEO].Current);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    // Fatal aborts, nothing may be accounted for the missing buffer
+    printf("failed allocations\n");
+    failed = Failed;
+    {
+        static PesDemux pesdx[1];
+        size_t before = MemAccounts[MEM_PES].Current;
+
+        FailAlloc = 1;
+        if (!sigsetjmp(Aborted, 1)) {
+            PesInit(pesdx);
+            CHECK(0, "pes buffer failure not fatal");
+        }
+        CHECK(MemAccounts[MEM_PES].Current == before, "%zu pes bytes accounted without buffer",
+            MemAccounts[MEM_PES].Current - before);
+        if (!sigsetjmp(Aborted, 1)) {
+            VideoPacketInit(stream);
+            CHECK(0, "arena failure not fatal");
+        }
+        CHECK(!MemAccounts[MEM_VIDEO].Current, "%zu video bytes accounted without arena",
+            MemAccounts[MEM_VIDEO].Current);
+        FailAlloc = 0;
+    }
+    CheckTotals("failed");
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    return Failed ? 1 : 0;
+}
@@ -0,0 +1,228 @@
+///
+/// @file mix_test.c	@brief Audio channel mix test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Runs every channel combination through AudioMixSetup and compares
+/// the NEON or SSE2 kernel with the scalar kernel bit by bit, for all
+/// frame counts up to a few vectors and with samples at the limits.
+/// The buffers end in front of a protected page, so a kernel touching
+/// memory behind the frames crashes the test.
+///
+/// With -b the kernels are timed instead.
+///
+
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../audio.c"
+#include "test.h"
+
+///
+/// Get buffer in front of a protected page.
+///
+/// @param size	buffer size in bytes
+///
+static int16_t *GuardedAlloc(size_t size)
+{
+    size_t page;
+    size_t pages;
+    uint8_t *p;
+
+    page = getpagesize();
+    pages = (size + page - 1) / page;
+    p = mmap(NULL, (pages + 1) * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    mprotect(p + pages * page, page, PROT_NONE);
+    return (int16_t *) (p + pages * page - size);
+}
+
+///
+/// Get time in us.
+///
+static uint64_t Ticks(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+///
+/// Check AudioMixSetup for all channel counts.
+///
+static void TestSetup(void)
+{
+    int failed = Failed;
+
+    printf("setup\n");
+    for (int in = 0; in <= 9; ++in) {
+        for (int out = 0; out <= 9; ++out) {
+            AudioMix mix;
+            int supported;
+
+            supported = in >= 1 && in <= 8 && out >= 1 && out <= 8 && (in == out || (in == 2 && out == 1)
+                || (in == 1 && out == 2) || (in >= 3 && out == 2) || (in == 5 && out == 6) || (out == 8
+                    && (in == 3 || in == 5 || in == 6)));
+            memset(&mix, 0x55, sizeof(mix));
+            if (AudioMixSetup(&mix, in, out)) {
+                CHECK(!supported, "%d -> %d refused", in, out);
+                // AudioResample plays silence for a cleared mix
+                CHECK(!mix.InChannels && !mix.OutChannels && !mix.Mix, "%d -> %d refused with %d -> %d", in, out,
+                    mix.InChannels, mix.OutChannels);
+            } else {
+                CHECK(supported, "%d -> %d accepted", in, out);
+                CHECK(mix.InChannels == in && mix.OutChannels == out, "%d -> %d set up as %d -> %d", in, out,
+                    mix.InChannels, mix.OutChannels);
+                CHECK(!mix.Mix == (in == out), "%d -> %d %s kernel", in, out, mix.Mix ? "has a" : "without");
+            }
+        }
+    }
+
+    // the caller keeps the hardware channels of an unsupported mix
+    {
+        AudioMix mix;
+        int16_t in[7 * 16];
+        int16_t out[3 * 16];
+
+        AudioMixSetup(&mix, 7, 3);
+        mix.OutChannels = 3;
+        memset(out, 0x55, sizeof(out));
+        for (size_t i = 0; i < sizeof(in) / sizeof(*in); ++i) {
+            in[i] = Random();
+        }
+        AudioResample(&mix, in, 16, out);
+        for (size_t i = 0; i < sizeof(out) / sizeof(*out); ++i) {
+            if (out[i]) {
+                CHECK(0, "sample %d of unsupported mix not silent", (int)i);
+                break;
+            }
+        }
+    }
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+}
+
+///
+/// Compare the kernel of a mix with the scalar kernel.
+///
+static void TestKernel(int in_chan, int out_chan)
+{
+    enum { MAX_FRAMES = 67 };
+    AudioMix mix;
+    int16_t *in;
+    int16_t *out;
+    int16_t ref[MAX_FRAMES * 8];
+
+    if (AudioMixSetup(&mix, in_chan, out_chan) || !mix.Mix) {
+        return;
+    }
+    for (int frames = 0; frames <= MAX_FRAMES; ++frames) {
+        in = GuardedAlloc(frames * in_chan * sizeof(*in));
+        out = GuardedAlloc(frames * out_chan * sizeof(*out));
+        for (int i = 0; i < frames * in_chan; ++i) {
+            switch (Random() % 4) {
+                case 0:
+                    in[i] = INT16_MAX;
+                    break;
+                case 1:
+                    in[i] = INT16_MIN;
+                    break;
+                default:
+                    in[i] = Random();
+                    break;
+            }
+        }
+        AudioMixScalar(&mix, in, frames, ref);
+        mix.Mix(&mix, in, frames, out);
+        for (int i = 0; i < frames * out_chan; ++i) {
+            if (out[i] != ref[i]) {
+                CHECK(0, "%d -> %d, %d frames: sample %d is %d, expected %d", in_chan, out_chan, frames, i, out[i],
+                    ref[i]);
+                break;
+            }
+        }
+        munmap((void *)((uintptr_t) in & ~(uintptr_t) (getpagesize() - 1)),
+            (frames * in_chan * sizeof(*in) + getpagesize() - 1) / getpagesize() * getpagesize() + getpagesize());
+        munmap((void *)((uintptr_t) out & ~(uintptr_t) (getpagesize() - 1)),
+            (frames * out_chan * sizeof(*out) + getpagesize() - 1) / getpagesize() * getpagesize() + getpagesize());
+    }
+}
+
+///
+/// Time the kernels of a mix.
+///
+static void Bench(int in_chan, int out_chan)
+{
+    enum { FRAMES = 1536, LOOPS = 20000 };
+    static int16_t in[FRAMES * 8];
+    static int16_t out[FRAMES * 8];
+    AudioMix mix;
+    uint64_t scalar;
+    uint64_t kernel;
+
+    AudioMixSetup(&mix, in_chan, out_chan);
+    for (int i = 0; i < FRAMES * in_chan; ++i) {
+        in[i] = Random();
+    }
+    scalar = Ticks();
+    for (int i = 0; i < LOOPS; ++i) {
+        AudioMixScalar(&mix, in, FRAMES, out);
+    }
+    scalar = Ticks() - scalar;
+    kernel = Ticks();
+    for (int i = 0; i < LOOPS; ++i) {
+        mix.Mix(&mix, in, FRAMES, out);
+    }
+    kernel = Ticks() - kernel;
+    printf("%d -> %d: scalar %.2f ns/frame, kernel %.2f ns/frame, %.1fx\n", in_chan, out_chan,
+        scalar * 1000.0 / FRAMES / LOOPS, kernel * 1000.0 / FRAMES / LOOPS, (double)scalar / (kernel ? kernel : 1));
+}
+
+int main(int argc, char *const argv[])
+{
+    int failed;
+
+    if (argc > 1 && !strcmp(argv[1], "-b")) {
+        Bench(2, 1);
+        Bench(1, 2);
+        Bench(6, 2);
+        Bench(8, 2);
+        Bench(5, 8);
+        return 0;
+    }
+
+    TestSetup();
+
+    printf("kernel\n");
+    failed = Failed;
+    for (int in = 1; in <= 8; ++in) {
+        for (int out = 1; out <= 8; ++out) {
+            TestKernel(in, out);
+        }
+    }
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    return Failed ? 1 : 0;
+}
@@ -0,0 +1,291 @@
+///
+/// @file park_test.c	@brief Warm decoder reuse test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Parks the main decoder on a channel switch and opens the next
+/// stream from the parameter sets in test/data.  open, read, close,
+/// ioctl and clock_gettime of the video module are replaced, the fake
+/// amstream device counts opened handles, decoder resets and the clock
+/// calls, the fake vdec status tells the height of the playing stream.
+///
+/// A stream of the same codec and resolution class must reuse the
+/// parked handle, another one must reopen it.  While parked no clock
+/// may reach the handle, and a parked decoder no stream claims is
+/// closed after SWITCH_PARK_MAX.
+///
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#define open ParkOpen
+#define read ParkRead
+#define close ParkClose
+#define ioctl ParkIoctl
+#define clock_gettime ParkClock
+
+static int ParkOpen(const char *, int, ...);
+static ssize_t ParkRead(int, void *, size_t);
+static int ParkClose(int);
+static int ParkIoctl(int, unsigned long, ...);
+static int ParkClock(clockid_t, struct timespec *);
+
+#include "../video.c"
+
+#undef open
+#undef read
+#undef close
+#undef ioctl
+#undef clock_gettime
+
+#include "test.h"
+
+static const char *DataDir = "test/data";   ///< directory of the test data
+
+#define DEVICE_FD 100                   ///< first fake amstream handle
+#define CNTL_FD 99                      ///< fake amvideo handle
+#define STATUS_FD 98                    ///< fake vdec status
+
+static int NextFd = DEVICE_FD;          ///< next amstream handle
+static int Handles;                     ///< open amstream handles
+static int Opens;                       ///< amstream opens
+static int Resets;                      ///< decoder resets
+static int ClockCalls;                  ///< pcr, time stamp and vpts calls
+static uint64_t Clock = 1000000;        ///< virtual clock in us
+static int Height;                      ///< height of the decoded stream
+
+static int ParkOpen(const char *path, int flags, ...)
+{
+    (void)flags;
+    if (!strcmp(path, "/sys/class/vdec/vdec_status")) {
+        return STATUS_FD;
+    }
+    if (strncmp(path, "/dev/amstream_", 14)) {
+        errno = ENOENT;                 // no other sysfs
+        return -1;
+    }
+    Opens++;
+    Handles++;
+    return NextFd++;
+}
+
+static ssize_t ParkRead(int fd, void *buf, size_t count)
+{
+    if (fd != STATUS_FD) {
+        errno = EBADF;
+        return -1;
+    }
+    return snprintf(buf, count, "vdec channel 0 statistics:\n  width : %d\n  height : %d\n", Height * 16 / 9,
+        Height) + 1;
+}
+
+static int ParkClose(int fd)
+{
+    if (fd >= DEVICE_FD) {
+        Handles--;
+    }
+    return 0;
+}
+
+static int ParkIoctl(int fd, unsigned long request, ...)
+{
+    struct am_ioctl_parm *parm;
+    va_list ap;
+
+    va_start(ap, request);
+    parm = va_arg(ap, struct am_ioctl_parm *);
+    va_end(ap);
+
+    if (fd < DEVICE_FD) {
+        return 0;
+    }
+    if (request == AMSTREAM_IOC_SET) {
+        switch (parm->cmd) {
+            case AMSTREAM_DEC_RESET:
+                Resets++;
+                break;
+            case AMSTREAM_SET_PCRSCR:
+            case AMSTREAM_SET_TSTAMP:
+                ClockCalls++;
+                break;
+        }
+    } else if (request == AMSTREAM_IOC_GET && parm->cmd == AMSTREAM_GET_VPTS) {
+        ClockCalls++;
+        parm->data_64 = 90000;
+    }
+    return 0;
+}
+
+static int ParkClock(clockid_t id, struct timespec *tp)
+{
+    (void)id;
+    tp->tv_sec = Clock / 1000000;
+    tp->tv_nsec = Clock % 1000000 * 1000;
+    return 0;
+}
+
+uint64_t AudioGetClock(void)
+{
+    return 10 * 90000;                  // far from the vpts, the pcr is set
+}
+
+///
+/// Read a test data file as packet.
+///
+/// @param name	file name in the data directory
+/// @param[out] avpkt	packet
+///
+static void ReadPacket(const char *name, AVPacket * avpkt)
+{
+    char path[256];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/%s", DataDir, name);
+    if (!(f = fopen(path, "rb"))) {
+        perror(path);
+        exit(1);
+    }
+    memset(avpkt, 0, sizeof(*avpkt));
+    fseek(f, 0, SEEK_END);
+    avpkt->size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    avpkt->data = calloc(1, avpkt->size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (fread(avpkt->data, 1, avpkt->size, f) != (size_t)avpkt->size) {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+    avpkt->pts = 90000;
+}
+
+///
+/// Switch to a stream.
+///
+/// @param decoder	video decoder
+/// @param codec_id	codec of the stream
+/// @param name	parameter sets of the stream
+/// @param height	height of the stream
+/// @param warm	expect the parked decoder to be reused
+///
+static void Switch(VideoDecoder * decoder, int codec_id, const char *name, int height, int warm)
+{
+    AVPacket avpkt;
+    int opens = Opens;
+    int resets = Resets;
+    int handle = decoder->HwDecoder->handle;
+    int clock;
+
+    ReadPacket(name, &avpkt);
+    CodecVideoPark(decoder->HwDecoder);
+    CHECK(WarmParked && isOpen && decoder->HwDecoder->handle == handle, "%s: decoder not parked", name);
+
+    // no clock while parked
+    clock = ClockCalls;
+    CHECK(SetCurrentPCR(handle, 90000) == 2, "%s: pcr accepted while parked", name);
+    ProcessClockBuffer(handle);
+    CheckinPts(handle, 90000);
+    CHECK(ClockCalls == clock, "%s: %d clock calls while parked", name, ClockCalls - clock);
+
+    Clock += 200000;
+    CodecVideoOpen(decoder, codec_id, &avpkt);
+    Height = height;
+    CHECK(!WarmParked && isOpen && Handles == 1, "%s: parked %d, open %d, %d handles", name, WarmParked, isOpen,
+        Handles);
+    if (warm) {
+        CHECK(SwitchMode == SWITCH_WARM && Opens == opens && Resets == resets + 1
+            && decoder->HwDecoder->handle == handle, "%s: not reused, %d opens, %d resets", name, Opens - opens,
+            Resets - resets);
+    } else {
+        CHECK(SwitchMode == SWITCH_COLD && Opens == opens + 1 && Resets == resets
+            && decoder->HwDecoder->handle != handle, "%s: reused, %d opens, %d resets", name, Opens - opens,
+            Resets - resets);
+    }
+
+    // the new stream owns the clock
+    clock = ClockCalls;
+    ProcessClockBuffer(decoder->HwDecoder->handle);
+    CHECK(ClockCalls > clock, "%s: no clock after the switch", name);
+    free(avpkt.data);
+}
+
+int main(int argc, char *argv[])
+{
+    static VideoHwDecoder hw;
+    static VideoDecoder decoder;
+    AVPacket avpkt;
+    int failed;
+
+    if (argc > 1) {
+        DataDir = argv[1];
+    }
+    apiLevel = S905;
+    cntl_handle = CNTL_FD;
+    hw.handle = -1;
+    OdroidDecoders[0] = &hw;
+    decoder.HwDecoder = &hw;
+    ConfigVideoWarmReuse = 1;
+
+    printf("reuse\n");
+    failed = Failed;
+    ReadPacket("avc1080.h264", &avpkt);
+    CodecVideoOpen(&decoder, AV_CODEC_ID_H264, &avpkt);
+    free(avpkt.data);
+    Height = 1080;
+    CHECK(isOpen && Handles == 1 && hw.Format == Avc, "first open: open %d, %d handles", isOpen, Handles);
+    Switch(&decoder, AV_CODEC_ID_H264, "avc1080i.h264", 1080, 1);
+    Switch(&decoder, AV_CODEC_ID_H264, "avc720.h264", 720, 1);
+    Switch(&decoder, AV_CODEC_ID_H264, "avc576.h264", 576, 0);
+    Switch(&decoder, AV_CODEC_ID_MPEG2VIDEO, "m2v576.m2v", 576, 0);
+    Switch(&decoder, AV_CODEC_ID_MPEG2VIDEO, "m2v576.m2v", 576, 1);
+    Switch(&decoder, AV_CODEC_ID_HEVC, "hevc576.hevc", 576, 0);
+    Switch(&decoder, AV_CODEC_ID_HEVC, "hevc2160.hevc", 2160, 0);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    // the flag is checked by the caller, without it the decoder closes
+    printf("disabled\n");
+    failed = Failed;
+    ConfigVideoWarmReuse = 0;
+    CodecVideoPark(&hw);
+    CHECK(!WarmParked && !isOpen && !Handles, "parked %d, open %d, %d handles", WarmParked, isOpen, Handles);
+    ConfigVideoWarmReuse = 1;
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    printf("timeout\n");
+    failed = Failed;
+    ReadPacket("avc1080.h264", &avpkt);
+    CodecVideoOpen(&decoder, AV_CODEC_ID_H264, &avpkt);
+    free(avpkt.data);
+    CodecVideoPark(&hw);
+    Clock += SWITCH_PARK_MAX * 1000;
+    VideoParkTimeout(&hw);
+    CHECK(WarmParked && isOpen && Handles == 1, "closed after %d ms", SWITCH_PARK_MAX);
+    Clock += 1000;
+    VideoParkTimeout(&hw);
+    CHECK(!WarmParked && !isOpen && !Handles, "parked %d, open %d, %d handles after %d ms", WarmParked, isOpen,
+        Handles, SWITCH_PARK_MAX + 1);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    return Failed ? 1 : 0;
+}
@@ -0,0 +1,431 @@
+///
+/// @file parse_test.c	@brief PES and TS parser fuzz target and benchmark
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Feeds untrusted input through the parsers of the device module.  The
+/// first byte of an input selects the entry point:
+///
+///	- 0 transport stream audio, PlayTsAudio with TsDemuxer and PesParse
+///	- 1 PES audio, PlayAudio
+///	- 2 PES video, PlayVideo3 and the packet ring to the decoder
+///	- 3 elementary stream, the Fast*Check and *Check sync detectors
+///
+/// The rest are TS packets, PES packets as their length field tells, or
+/// the elementary stream.  Each packet is copied into a heap buffer of
+/// its exact size, so a sanitizer catches a read past it.  The decoder
+/// and audio sinks read every byte they get.
+///
+/// Built with -DLIBFUZZER it is a libFuzzer target.  Otherwise it plays
+/// the given files or the seed corpus test/data/parse, an AFL target is
+/// "parse_test @@".  For the seeds, named <mode>_<codec>, the codec must
+/// be detected.  With -b the throughput of each entry point on the
+/// corpus is measured instead.
+///
+
+#include "../softhddev.c"
+#include "test.h"
+
+#include <dirent.h>
+
+#define CORPUS "test/data/parse"        ///< default seed corpus
+
+static VideoDecoder Decoder;            ///< stub video decoder
+static char AudioCodec[1];              ///< stub audio decoder, its type is opaque
+static int Exact = 1;                   ///< flag: copy packets to exact buffers
+static int Frames;                      ///< packets reaching the sinks
+static int SinkCodec;                   ///< codec detected by the sync scan
+static unsigned Sum;                    ///< sum of all bytes the sinks read
+
+///
+/// Read a sink buffer.
+///
+static void Sink(const void *data, int size)
+{
+    const uint8_t *p = data;
+
+    for (int i = 0; i < size; ++i) {
+        Sum += p[i];
+    }
+    Frames++;
+}
+
+void CodecAudioDecode(AudioDecoder * decoder, const AVPacket * avpkt)
+{
+    (void)decoder;
+    Sink(avpkt->data, avpkt->size);
+}
+
+void CodecVideoDecode(VideoDecoder * decoder, const AVPacket * avpkt)
+{
+    (void)decoder;
+    Sink(avpkt->data, avpkt->size);
+}
+
+void AudioEnqueue(const void *samples, int count)
+{
+    Sink(samples, count);
+}
+
+void AudioEnqueueLpcm(const uint8_t * data, int count, int bits, int channels)
+{
+    (void)bits;
+    (void)channels;
+    Sink(data, count);
+}
+
+///
+/// Call a parser with a packet.
+///
+/// @param play	parser entry point
+/// @param data	packet
+/// @param size	packet size
+///
+/// @returns bytes consumed by the parser.
+///
+static int Feed(int (*play)(const uint8_t *, int), const uint8_t * data, int size)
+{
+    uint8_t *copy;
+    int n;
+
+    if (!Exact) {
+        return play(data, size);
+    }
+    copy = malloc(size);
+    memcpy(copy, data, size);
+    n = play(copy, size);
+    free(copy);
+    return n;
+}
+
+static int PlayPesAudio(const uint8_t * data, int size)
+{
+    uint8_t id;
+
+    // like VDR: sub stream id of private stream 1 DVD audio
+    id = size > 3 ? data[3] : 0;
+    if (id == PES_PRIVATE_STREAM1 && size > 9 && size > 9 + data[8] && (data[9 + data[8]] & 0xC0) == 0x80) {
+        id = data[9 + data[8]];
+    }
+    return PlayAudio(data, size, id);
+}
+
+static int PlayPesVideo(const uint8_t * data, int size)
+{
+    int n;
+
+    n = PlayVideo3(MyVideoStream, data, size);
+    while (!VideoDecodeInput(MyVideoStream)) {
+    }
+    return n;
+}
+
+///
+/// Scan an elementary stream like PesParse.
+///
+static int ScanSync(const uint8_t * data, int size)
+{
+    const uint8_t *p = data;
+    int n = size;
+
+    while (n >= 5) {
+        int r = 0;
+        int codec_id = AV_CODEC_ID_NONE;
+
+        if (FastMpegCheck(p)) {
+            r = MpegCheck(p, n);
+            codec_id = AV_CODEC_ID_MP2;
+        }
+        if (!r && FastAc3Check(p)) {
+            r = Ac3Check(p, n);
+            codec_id = r > 0 && p[5] > (10 << 3) ? AV_CODEC_ID_EAC3 : AV_CODEC_ID_AC3;
+        }
+        if (!r && FastLatmCheck(p)) {
+            r = LatmCheck(p, n);
+            codec_id = AV_CODEC_ID_AAC_LATM;
+        }
+        if (!r && FastAdtsCheck(p)) {
+            r = AdtsCheck(p, n);
+            codec_id = AV_CODEC_ID_AAC;
+        }
+        if (!r && FastDtsCheck(p)) {
+            r = DtsCheck(p, n);
+            codec_id = AV_CODEC_ID_DTS;
+        }
+        if (r < 0) {                    // need more bytes
+            break;
+        }
+        if (r > 0) {
+            SinkCodec = codec_id;
+            Sink(p, r);
+            p += r;
+            n -= r;
+            continue;
+        }
+        ++p;
+        --n;
+    }
+    return size;
+}
+
+///
+/// Set up the device module once.
+///
+static void Init(void)
+{
+    CodecInit();
+    MyAudioDecoder = (AudioDecoder *) AudioCodec;
+    av_new_packet(AudioAvPkt, AUDIO_BUFFER_SIZE);
+    PesInit(PesDemuxAudio);
+    MyVideoStream->Decoder = &Decoder;
+    VideoPacketInit(MyVideoStream);
+    VideoResetPacket(MyVideoStream);
+    MyVideoStream->LastCodecID = AV_CODEC_ID_NONE;
+}
+
+///
+/// Reset the parsers like a channel switch.
+///
+static void Reset(void)
+{
+    NewAudioStream = 1;
+    AudioAvPkt->stream_index = 0;
+    AudioAvPkt->pts = AV_NOPTS_VALUE;
+    AudioAvPkt->dts = AV_NOPTS_VALUE;
+    MyVideoStream->NewStream = 1;
+    SinkCodec = AV_CODEC_ID_NONE;
+    Frames = 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size)
+{
+    static int init;
+    int (*play)(const uint8_t *, int);
+    int mode;
+
+    if (!init) {
+        Init();
+        init = 1;
+    }
+    if (!size || size > 16 * 1024 * 1024) {
+        return 0;
+    }
+    Reset();
+    mode = data[0] & 3;
+    ++data;
+    --size;
+
+    switch (mode) {
+        case 0:
+            // VDR passes single TS packets
+            for (; size >= TS_PACKET_SIZE; data += TS_PACKET_SIZE, size -= TS_PACKET_SIZE) {
+                if (!Feed(PlayTsAudio, data, TS_PACKET_SIZE)) {
+                    break;
+                }
+            }
+            break;
+        case 1:
+        case 2:
+            play = mode == 1 ? PlayPesAudio : PlayPesVideo;
+            while (size) {
+                size_t n;
+
+                // length 0 (unbounded video) or cut: the rest
+                n = size >= 6 ? 6 + (size_t)(data[4] << 8 | data[5]) : size;
+                if (n == 6 || n > size) {
+                    n = size;
+                }
+                if (!Feed(play, data, n)) {
+                    break;
+                }
+                data += n;
+                size -= n;
+            }
+            break;
+        case 3:
+            Feed(ScanSync, data, size);
+            break;
+    }
+    return 0;
+}
+
+#ifndef LIBFUZZER
+
+///
+/// Read a file.
+///
+/// @param name	file name
+/// @param[out] size	file size
+///
+/// @returns malloced file data, NULL on error.
+///
+static uint8_t *ReadFile(const char *name, size_t *size)
+{
+    uint8_t *data;
+    FILE *f;
+    long n;
+
+    if (!(f = fopen(name, "rb"))) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    n = ftell(f);
+    rewind(f);
+    data = malloc(n > 0 ? n : 1);
+    *size = fread(data, 1, n > 0 ? n : 0, f);
+    fclose(f);
+    return data;
+}
+
+///
+/// Check the codec found in a seed.
+///
+/// @param name	seed name <mode>_<codec>
+///
+static void CheckSeed(const char *name)
+{
+    static const struct
+    {
+        const char *Name;
+        int CodecID;
+    } Codecs[] = {
+        {"mp2", AV_CODEC_ID_MP2}, {"ac3", AV_CODEC_ID_AC3}, {"dvdac3", AV_CODEC_ID_AC3},
+        {"eac3", AV_CODEC_ID_EAC3}, {"aac", AV_CODEC_ID_AAC}, {"latm", AV_CODEC_ID_AAC_LATM},
+        {"dts", AV_CODEC_ID_DTS}, {"lpcm", AV_CODEC_ID_PCM_DVD}, {"h264", AV_CODEC_ID_H264},
+        {"hevc", AV_CODEC_ID_HEVC}, {"mpeg2", AV_CODEC_ID_MPEG2VIDEO},
+    };
+    const char *codec;
+    int found;
+
+    if (!(codec = strchr(name, '_'))) {
+        return;
+    }
+    if (!strncmp(name, "sync", 4)) {
+        found = SinkCodec;
+    } else if (!strncmp(name, "video", 5)) {
+        found = MyVideoStream->CodecID;
+    } else {
+        found = AudioCodecID;
+    }
+    for (size_t i = 0; i < sizeof(Codecs) / sizeof(*Codecs); ++i) {
+        if (!strcmp(codec + 1, Codecs[i].Name)) {
+            CHECK(found == Codecs[i].CodecID && Frames > 1, "%s: found %s, %d frames", name,
+                avcodec_get_name(found), Frames);
+        }
+    }
+}
+
+///
+/// Measure the throughput of an entry point on a seed.
+///
+/// @param name	seed name
+/// @param data	seed
+/// @param size	seed size
+///
+static void Bench(const char *name, const uint8_t * data, size_t size)
+{
+    uint64_t start;
+    uint64_t bytes;
+    uint64_t us;
+
+    start = GetusTicks();
+    bytes = 0;
+    do {
+        LLVMFuzzerTestOneInput(data, size);
+        bytes += size;
+        us = GetusTicks() - start;
+    } while (us < 200000);
+    printf("%-12s %8.1f MB/s\n", name, bytes / (double)us);
+}
+
+int main(int argc, char *const argv[])
+{
+    const char *dir;
+    int bench;
+    int files;
+
+    bench = argc > 1 && !strcmp(argv[1], "-b");
+    if (bench) {
+        Exact = 0;
+        --argc;
+        ++argv;
+    }
+
+    files = 0;
+    dir = argc > 1 ? NULL : CORPUS;
+    for (int i = 1; i < argc || dir; ++i) {
+        struct dirent **list;
+        int n;
+
+        // plain files, AFL passes one
+        if (!dir) {
+            uint8_t *data;
+            size_t size;
+
+            if (!(data = ReadFile(argv[i], &size))) {
+                fprintf(stderr, "can't read %s\n", argv[i]);
+                return 1;
+            }
+            LLVMFuzzerTestOneInput(data, size);
+            free(data);
+            ++files;
+            continue;
+        }
+        if ((n = scandir(dir, &list, NULL, alphasort)) < 0) {
+            fprintf(stderr, "can't read %s\n", dir);
+            return 1;
+        }
+        if (!bench) {
+            printf("seeds\n");
+        }
+        for (int j = 0; j < n; ++j) {
+            char path[512];
+            uint8_t *data;
+            size_t size;
+
+            snprintf(path, sizeof(path), "%s/%s", dir, list[j]->d_name);
+            if (list[j]->d_name[0] != '.' && (data = ReadFile(path, &size))) {
+                if (bench) {
+                    Bench(list[j]->d_name, data, size);
+                } else {
+                    LLVMFuzzerTestOneInput(data, size);
+                    CheckSeed(list[j]->d_name);
+                }
+                free(data);
+                ++files;
+            }
+            free(list[j]);
+        }
+        free(list);
+        if (!bench) {
+            CHECK(files, "no seeds in %s", dir);
+            printf("  %s\n", Failed ? "FAILED" : "ok");
+        }
+        break;
+    }
+    if (bench) {
+        printf("sinks read %u\n", Sum);
+    }
+
+    return Failed ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,211 @@
+///
+/// @file preroll_test.c	@brief Audio pts index and pre-roll trim test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Fills an audio ring through AudioSetClock and AudioEnqueue with
+/// 3 s of packets and trims it to time stamps every 7 ms, from 250 ms
+/// before to 250 ms behind the buffered samples.  The skipped bytes
+/// must end at the frame of the time stamp, for pass-through at the
+/// start of the burst playing it.  Also over the 33 bit wrap, after a
+/// flush with stale index entries and at a start with fast channel
+/// switch.
+///
+
+#include "../audio.c"
+#include "test.h"
+
+#define PACKETS 125                     ///< packets buffered per ring
+
+static int64_t PCR = AV_NOPTS_VALUE;    ///< clock set at the start
+
+int SetCurrentPCR(int handle, uint64_t value)
+{
+    (void)handle;
+    PCR = value;
+    return 0;
+}
+
+///
+/// Prepare an empty 48 kHz stereo ring.
+///
+/// @param passthrough	ring is pass-through
+///
+static void Prepare(int passthrough)
+{
+    int freq;
+    int channels;
+
+    atomic_set(&AudioRingFilled, 0);
+    freq = 48000;
+    channels = 2;
+    AudioSetup(&freq, &channels, 0);
+    AudioRing[AudioRingWrite].Passthrough = passthrough;
+    AudioRunning = 0;
+    AudioPreRoll = 0;
+}
+
+///
+/// Fill the ring with packets.
+///
+/// @param pts	pts of the first packet
+/// @param count	number of packets
+/// @param frames	frames of a packet
+///
+static void Fill(int64_t pts, int count, int frames)
+{
+    static int16_t samples[9600 * 2];
+    int i;
+
+    for (i = 0; i < count; ++i) {
+        AudioSetClock(PtsAdd(pts, (int64_t) i * frames * 90000 / 48000));
+        AudioEnqueue(samples, frames * 4);
+    }
+}
+
+///
+/// Trim to time stamps around the buffered samples.
+///
+/// @param name	name of the check
+/// @param first	pts of the first buffered sample
+/// @param count	number of buffered packets
+/// @param frames	frames of a packet
+///
+static void Trim(const char *name, int64_t first, int count, int frames)
+{
+    AudioRingRing *ring;
+    size_t used;
+    int64_t pts;
+    int64_t want;
+    int64_t skip;
+    int d;
+
+    ring = &AudioRing[AudioRingWrite];
+    used = RingBufferUsedBytes(ring->RingBuffer);
+    for (d = -250 * 90; d < (int64_t) count * frames * 90000 / 48000 + 250 * 90; d += 7 * 90) {
+        pts = PtsAdd(first, d);
+        skip = AudioPtsIndexSkip(ring, pts);
+        if (ring->Passthrough) {
+            // start of the burst playing pts
+            want = d < 0 ? 0 : d / (frames * 90000 / 48000) * frames * 4;
+        } else {
+            want = d < 0 ? 0 : (int64_t) d * 48000 / 90000 * 4;
+        }
+        if (want > (int64_t) used) {
+            want = used;
+        }
+        CHECK(llabs(skip - want) <= 4, "%s %+dms: skip %" PRId64 " bytes, expected %" PRId64, name, d / 90, skip,
+            want);
+    }
+}
+
+int main(void)
+{
+    int64_t pts;
+    int failed;
+
+    AudioRingInit();
+    AudioChannelMatrix[Audio48000][2] = 2;
+    AudioStartThreshold = 1000000;      // no start while filling
+
+    printf("index add and skip\n");
+    failed = Failed;
+    Prepare(0);
+    Fill(0x12345678, PACKETS, 1152);
+    Trim("pcm", 0x12345678, PACKETS, 1152);
+    Prepare(0);
+    Fill(0x12345678, PACKETS / 8, 9600);    // lpcm, packets longer than a slot
+    Trim("lpcm", 0x12345678, PACKETS / 8, 9600);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    printf("index over the pts wrap\n");
+    failed = Failed;
+    pts = PTS_WRAP - 1500 * 90 + 17;
+    Prepare(0);
+    Fill(pts, PACKETS, 1152);
+    Trim("wrap", pts, PACKETS, 1152);
+    // packet over the wrap, then 100 ms lost, slot 0 has no entry
+    Prepare(0);
+    pts = PTS_WRAP - 12 * 90;
+    Fill(pts, 1, 1152);
+    Fill(PtsAdd(pts, 124 * 90), PACKETS - 1, 1152);
+    CHECK(AudioPtsIndexSkip(&AudioRing[AudioRingWrite], 5 * 90) == 17 * 48 * 4, "last slot: skip %zu bytes",
+        AudioPtsIndexSkip(&AudioRing[AudioRingWrite], 5 * 90));
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    printf("index reset\n");
+    failed = Failed;
+    Prepare(0);
+    Fill(0x40000000, PACKETS, 1152);
+    // flush like a replay from 1s before, the slots behind it are stale
+    RingBufferReadAdvance(AudioRing[AudioRingWrite].RingBuffer,
+        RingBufferUsedBytes(AudioRing[AudioRingWrite].RingBuffer));
+    AudioPtsIndexReset(&AudioRing[AudioRingWrite]);
+    Fill(0x40000000 - 1000 * 90, PACKETS / 2, 1152);
+    Trim("stale", 0x40000000 - 1000 * 90, PACKETS / 2, 1152);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    printf("pass-through bursts\n");
+    failed = Failed;
+    Prepare(1);
+    Fill(0x23456789, PACKETS / 2, 1536);
+    Trim("ac-3", 0x23456789, PACKETS / 2, 1536);
+    Prepare(1);
+    pts = PTS_WRAP - 1000 * 90;
+    Fill(pts, PACKETS / 2, 1536);
+    Trim("ac-3 wrap", pts, PACKETS / 2, 1536);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    // audio 600 ms ahead, the video doesn't wait for it
+    printf("fast switch start\n");
+    failed = Failed;
+    {
+        size_t start;
+        int64_t frame;
+        unsigned starts;
+
+        ConfigVideoFastSwitch = 1;
+        hasVideo = 1;
+        AudioStartThreshold = 48000 * 4 / 5;    // 200 ms stereo
+        starts = AudioStartStats.Starts;
+        AudioStartStats.Dropped = 0;    // flushed on a switch
+        Prepare(0);
+        PCR = AV_NOPTS_VALUE;
+        pts = PTS_WRAP - 300 * 90;
+        FirstVPTS = PtsAdd(pts, 600 * 90);
+        start = AudioRing[AudioRingWrite].Written;
+        for (int i = 0; i < PACKETS && !AudioRunning; ++i) {
+            Fill(PtsAdd(pts, (int64_t) i * 1152 * 90000 / 48000), 1, 1152);
+        }
+        frame = (int64_t) (AudioRing[AudioRingWrite].Written - RingBufferUsedBytes(AudioRing[AudioRingWrite].RingBuffer)
+            - start) / 4;
+        CHECK(AudioRunning, "play-back not started");
+        CHECK(llabs(frame - 600 * 48) <= 1, "first frame %" PRId64 ", expected %d", frame, 600 * 48);
+        CHECK(PCR == (int64_t) AV_NOPTS_VALUE, "clock set with fast switch");
+        CHECK(AudioStartStats.Starts == starts + 1 && AudioStartStats.Dropped >= 599
+            && AudioStartStats.Dropped <= 600, "%u starts, dropped %d ms", AudioStartStats.Starts - starts,
+            AudioStartStats.Dropped);
+    }
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    AudioRingExit();
+    return Failed ? 1 : 0;
+}
@@ -0,0 +1,201 @@
+///
+/// @file pts_test.c	@brief 33 bit time stamp arithmetic test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Checks properties of PtsDiff, PtsBefore and PtsAdd for random time
+/// stamps, half of them within 2^16 of the 33 bit wrap, and random
+/// distances, a quarter of them at the ends of the range.
+///
+/// The audio ring clock is a 33 bit time stamp too.  Audio is fed over
+/// the wrap around until play-back starts aligned to a video frame after
+/// it, the ring clock and the clock set for the decoder must stay 33 bit
+/// and the first played sample must belong to the video frame.
+///
+
+#include "../audio.c"
+#include "test.h"
+
+#define CASES 2000000                   ///< random cases per property
+
+///
+/// Get random 33 bit time stamp, half of them at the wrap.
+///
+static int64_t RandomPts(void)
+{
+    int64_t pts;
+
+    pts = ((int64_t) Random() << 24 | Random()) & PTS_MASK;
+    if (Random() & 1) {
+        pts = (PTS_WRAP - 0x10000 + (Random() & 0x1FFFF)) & PTS_MASK;
+    }
+    return pts;
+}
+
+///
+/// Get random distance in -2^32 .. 2^32 - 1, a quarter at the ends.
+///
+static int64_t RandomDistance(void)
+{
+    int64_t d;
+
+    d = (((int64_t) Random() << 24 | Random()) & PTS_MASK) - PTS_WRAP / 2;
+    switch (Random() % 8) {
+        case 0:
+            d = -PTS_WRAP / 2 + (Random() & 0xFF);
+            break;
+        case 1:
+            d = PTS_WRAP / 2 - 1 - (Random() & 0xFF);
+            break;
+    }
+    return d;
+}
+
+#define PACKET_FRAMES 1152              ///< frames of an audio packet, 24 ms
+
+static int64_t PCR = AV_NOPTS_VALUE;    ///< clock set at the start
+
+int SetCurrentPCR(int handle, uint64_t value)
+{
+    (void)handle;
+    PCR = value;
+    return 0;
+}
+
+///
+/// Start audio over the wrap, aligned to the first video frame after it.
+///
+/// Audio starts 200 ms before the wrap, the first video frame is 100 ms
+/// after it.  Every sample carries its number, so the start of the ring
+/// tells which one is played first.
+///
+/// @param delay	a/v delay in time stamps
+///
+static void AudioStart(int delay)
+{
+    static int16_t samples[PACKET_FRAMES * 2];
+    static int16_t ring[2];
+    int64_t first;
+    int64_t vpts;
+    int64_t target;
+    int64_t pts;
+    int frame;
+    int want;
+    int freq;
+    int channels;
+    int n;
+
+    AudioChannelMatrix[Audio48000][2] = 2;
+    atomic_set(&AudioRingFilled, 0);
+    freq = 48000;
+    channels = 2;
+    AudioSetup(&freq, &channels, 0);
+    AudioRunning = 0;
+    AudioPreRoll = 0;
+    VideoAudioDelay = delay;
+    PCR = AV_NOPTS_VALUE;
+
+    first = PTS_WRAP - 200 * 90;
+    vpts = FirstVPTS = 100 * 90;
+    pts = first;
+    for (frame = 0; frame < 48000 && !AudioRunning; frame += PACKET_FRAMES) {
+        AudioSetClock(pts);
+        for (int s = 0; s < PACKET_FRAMES; ++s) {
+            // frame number + 1, 0 is silence
+            samples[2 * s] = (frame + s + 1) & 0x7FFF;
+            samples[2 * s + 1] = (frame + s + 1) >> 15;
+        }
+        AudioEnqueue(samples, sizeof(samples));
+        pts = PtsAdd(pts, PACKET_FRAMES * 90000 / 48000);
+        CHECK(AudioRing[AudioRingWrite].PTS >= 0 && AudioRing[AudioRingWrite].PTS <= PTS_MASK,
+            "%+dms: ring clock %#" PRIx64 " not 33 bit", delay / 90, AudioRing[AudioRingWrite].PTS);
+    }
+    if (!AudioRunning) {
+        CHECK(0, "%+dms: play-back not started", delay / 90);
+        return;
+    }
+
+    target = PtsAdd(vpts, -delay);
+    want = PtsDiff(first, target) * 48000 / 90000 + 1;
+    RingBufferRead(AudioRing[AudioRingWrite].RingBuffer, ring, sizeof(ring));
+    n = ring[0] + ring[1] * 0x8000;
+    CHECK(abs(n - want) <= 1, "%+dms: frame %d played first, expected frame %d", delay / 90, n, want);
+    CHECK(PCR >= 0 && PCR <= PTS_MASK && llabs(PtsDiff(vpts, PCR)) <= 2, "%+dms: clock %#" PRIx64
+        ", vpts %#" PRIx64, delay / 90, PCR, vpts);
+}
+
+int main(void)
+{
+    static const int Delay[] = { 0, 20 * 90, -30 * 90 };
+    int failed;
+
+    AudioRingInit();
+    AudioStartThreshold = 48000 * 4 / 5;    // 200 ms stereo
+    hasVideo = 1;
+
+    // a + d - a is d for the whole range
+    printf("distance\n");
+    failed = Failed;
+    for (int i = 0; i < CASES && Failed - failed < 10; ++i) {
+        int64_t a = RandomPts();
+        int64_t d = RandomDistance();
+        int64_t b = PtsAdd(a, d);
+
+        CHECK(b >= 0 && b <= PTS_MASK, "%#" PRIx64 " + %" PRId64 " is %#" PRIx64 ", not 33 bit", a, d, b);
+        CHECK(PtsDiff(a, b) == d, "%#" PRIx64 " -> %#" PRIx64 " is %" PRId64 ", expected %" PRId64, a, b,
+            PtsDiff(a, b), d);
+        // -2^32 has no positive counterpart
+        CHECK(d == -PTS_WRAP / 2 || PtsDiff(b, a) == -d, "%#" PRIx64 " -> %#" PRIx64 " is %" PRId64 ", back %"
+            PRId64, a, b, d, PtsDiff(b, a));
+        CHECK(PtsBefore(a, b) == (d > 0), "%#" PRIx64 " before %#" PRIx64 " is %d, distance %" PRId64, a, b,
+            PtsBefore(a, b), d);
+    }
+    CHECK(!PtsBefore(PTS_MASK, PTS_MASK) && !PtsBefore(0, 0), "equal stamps are before");
+    CHECK(PtsDiff(PTS_MASK, 0) == 1, "max -> 0 is %" PRId64, PtsDiff(PTS_MASK, 0));
+    CHECK(PtsDiff(0, PTS_MASK) == -1, "0 -> max is %" PRId64, PtsDiff(0, PTS_MASK));
+    CHECK(PtsDiff(0, PTS_WRAP / 2) == -PTS_WRAP / 2, "half wrap is %" PRId64, PtsDiff(0, PTS_WRAP / 2));
+    CHECK(PtsDiff(0, PTS_WRAP / 2 - 1) == PTS_WRAP / 2 - 1, "half wrap - 1 is %" PRId64,
+        PtsDiff(0, PTS_WRAP / 2 - 1));
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    // whole wraps don't change the distance
+    printf("wrapped operands\n");
+    failed = Failed;
+    for (int i = 0; i < CASES && Failed - failed < 10; ++i) {
+        int64_t a = RandomPts();
+        int64_t b = RandomPts();
+        int64_t n = Random() % 1000;
+
+        CHECK(PtsDiff(a + n * PTS_WRAP, b) == PtsDiff(a, b) && PtsDiff(a, b + n * PTS_WRAP) == PtsDiff(a, b),
+            "%#" PRIx64 " -> %#" PRIx64 " changes with %" PRId64 " wraps", a, b, n);
+    }
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    printf("audio start over the wrap\n");
+    failed = Failed;
+    for (int d = 0; d < 3; ++d) {
+        AudioStart(Delay[d]);
+    }
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    AudioRingExit();
+    return Failed ? 1 : 0;
+}
@@ -0,0 +1,403 @@
+///
+/// @file refresh_test.c	@brief Display refresh switching test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Reads the frame rate and height from the parameter sets in
+/// test/data and checks the display mode picked from a mocked
+/// connector mode list.  The streams were made by ffmpeg 7.0 from
+/// testsrc with libx264, libx265 and mpeg2video, cut before the first
+/// slice and without SEI.  No DRM device is opened, the queued mode is
+/// checked directly.
+///
+/// At last the refresh worker runs against fake atomic commits while
+/// the main thread changes the content rate.  Build with
+/// -fsanitize=thread -fno-builtin-memcpy -fno-builtin-memcmp to check
+/// the mode hand over, gcc doesn't instrument inlined copies.
+///
+
+#include "../video.c"
+#include "test.h"
+
+static const char *DataDir = "test/data";   ///< directory of the test data
+
+///
+/// Make a CEA-861 mode.
+///
+#define MODE(w, h, khz, ht, vt, fl) \
+    { .hdisplay = w, .vdisplay = h, .clock = khz, .htotal = ht, .vtotal = vt, \
+      .vrefresh = (khz) * 1000 / ((ht) * (vt)), .flags = fl }
+
+/// modes of a typical UHD TV, not sorted
+static const drmModeModeInfo TvModes[] = {
+    MODE(1920, 1080, 148500, 2200, 1125, 0),    // 60
+    MODE(1920, 1080, 148352, 2200, 1125, 0),    // 59.94
+    MODE(1920, 1080, 148500, 2640, 1125, 0),    // 50
+    MODE(1920, 1080, 74250, 2200, 1125, 0),     // 30
+    MODE(1920, 1080, 74176, 2200, 1125, 0),     // 29.97
+    MODE(1920, 1080, 74250, 2640, 1125, 0),     // 25
+    MODE(1920, 1080, 74250, 2750, 1125, 0),     // 24
+    MODE(1920, 1080, 74176, 2750, 1125, 0),     // 23.976
+    MODE(1920, 1080, 74250, 2640, 1125, DRM_MODE_FLAG_INTERLACE),   // 50i
+    MODE(1920, 1080, 74250, 2200, 1125, DRM_MODE_FLAG_INTERLACE),   // 60i
+    MODE(3840, 2160, 594000, 4400, 2250, 0),    // 60
+    MODE(3840, 2160, 593407, 4400, 2250, 0),    // 59.94
+    MODE(3840, 2160, 594000, 5280, 2250, 0),    // 50
+    MODE(3840, 2160, 297000, 5500, 2250, 0),    // 24
+    MODE(3840, 2160, 296703, 5500, 2250, 0),    // 23.976
+    MODE(1280, 720, 74250, 1650, 750, 0),       // 60
+    MODE(1280, 720, 74250, 1980, 750, 0),       // 50
+    MODE(720, 576, 27000, 864, 625, 0),         // 50
+};
+
+#define TV_MODES (int)(sizeof(TvModes) / sizeof(*TvModes))
+
+/// modes of a 60 Hz only monitor
+static const drmModeModeInfo MonitorModes[] = {
+    MODE(1920, 1080, 148500, 2200, 1125, 0),    // 60
+    MODE(1920, 1080, 74250, 2200, 1125, 0),     // 30
+};
+
+///
+/// Read a test data file.
+///
+/// @param name	file name in the data directory
+/// @param[out] size	file size
+///
+static uint8_t *ReadData(const char *name, int *size)
+{
+    char path[256];
+    uint8_t *data;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/%s", DataDir, name);
+    if (!(f = fopen(path, "rb"))) {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = calloc(1, *size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (fread(data, 1, *size, f) != (size_t)*size) {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+    return data;
+}
+
+///
+/// Check the mode picked for a frame rate.
+///
+/// @param modes	mode table
+/// @param count	number of modes
+/// @param width	display width
+/// @param height	display height
+/// @param rate	frame rate in mHz
+/// @param refresh	expected refresh in mHz, 0 for no mode
+///
+static void CheckMode(const drmModeModeInfo * modes, int count, int width, int height, int rate, int refresh)
+{
+    int i;
+
+    i = DrmFindRefreshMode(modes, count, width, height, rate);
+    if (!refresh) {
+        CHECK(i < 0, "%dx%d %.3f fps: got %.3f Hz, expected none", width, height, rate / 1000.0,
+            DrmModeRefresh(&modes[i]) / 1000.0);
+        return;
+    }
+    if (i < 0) {
+        CHECK(0, "%dx%d %.3f fps: no mode, expected %.3f Hz", width, height, rate / 1000.0, refresh / 1000.0);
+        return;
+    }
+    CHECK(modes[i].hdisplay == width && modes[i].vdisplay == height
+        && !(modes[i].flags & DRM_MODE_FLAG_INTERLACE)
+        && abs(DrmModeRefresh(&modes[i]) - refresh) <= 1, "%dx%d %.3f fps: got %dx%d%s %.3f Hz, expected %.3f Hz",
+        width, height, rate / 1000.0, modes[i].hdisplay, modes[i].vdisplay,
+        modes[i].flags & DRM_MODE_FLAG_INTERLACE ? "i" : "", DrmModeRefresh(&modes[i]) / 1000.0,
+        refresh / 1000.0);
+}
+
+/// canned streams with their rate, height, resolution class and the
+/// refresh expected on a 1080 and a 2160 display
+static const struct
+{
+    const char *Name;                   ///< file in the data directory
+    int Format;                         ///< video format
+    int Rate;                           ///< frame rate in mHz
+    int Height;                         ///< cropped picture height
+    int Class;                          ///< resolution class
+    int Refresh1080;                    ///< refresh on a 1080 display
+    int Refresh2160;                    ///< refresh on a 2160 display
+} Streams[] = {
+    {"m2v576.m2v", Mpeg2, 25000, 576, 0, 50000, 50000},
+    {"m2v1080.m2v", Mpeg2, 29970, 1080, 1, 59940, 59940},
+    {"avc576.h264", Avc, 25000, 576, 0, 50000, 50000},
+    {"avc720.h264", Avc, 59940, 720, 1, 59940, 59940},
+    {"avc1080.h264", Avc, 50000, 1080, 1, 50000, 50000},
+    {"avc1080i.h264", Avc, 25000, 1080, 1, 50000, 50000},
+    {"avc1080f.h264", Avc, 23976, 1080, 1, 23976, 23976},
+    {"hevc576.hevc", Hevc, 25000, 576, 0, 50000, 50000},
+    {"hevc2160.hevc", Hevc, 50000, 2160, 2, 50000, 50000},
+};
+
+static int Commits;                     ///< atomic commits of the worker
+static int BadCommits;                  ///< commits of another mode
+static drmModeModeInfo CommitMode;      ///< mode of the last property blob
+
+// fake libdrm, every property exists and every commit succeeds
+
+static drmModePropertyRes Props[] = {
+    {.prop_id = 1, .name = "MODE_ID"},
+    {.prop_id = 2, .name = "CRTC_ID"},
+    {.prop_id = 3, .name = "ACTIVE"},
+};
+
+static uint32_t PropIds[] = { 1, 2, 3 };
+
+static drmModeObjectProperties ObjectProps = {.count_props = 3, .props = PropIds };
+
+int drmSetMaster(int fd)
+{
+    (void)fd;
+    return 0;
+}
+
+int drmDropMaster(int fd)
+{
+    (void)fd;
+    return 0;
+}
+
+int drmModeCreatePropertyBlob(int fd, const void *data, size_t size, uint32_t * id)
+{
+    (void)fd;
+    memcpy(&CommitMode, data, size);
+    *id = 42;
+    return 0;
+}
+
+int drmModeDestroyPropertyBlob(int fd, uint32_t id)
+{
+    (void)fd;
+    (void)id;
+    return 0;
+}
+
+drmModeObjectPropertiesPtr drmModeObjectGetProperties(int fd, uint32_t id, uint32_t type)
+{
+    (void)fd;
+    (void)id;
+    (void)type;
+    return &ObjectProps;
+}
+
+void drmModeFreeObjectProperties(drmModeObjectPropertiesPtr props)
+{
+    (void)props;
+}
+
+drmModePropertyPtr drmModeGetProperty(int fd, uint32_t id)
+{
+    (void)fd;
+    return &Props[id - 1];
+}
+
+void drmModeFreeProperty(drmModePropertyPtr prop)
+{
+    (void)prop;
+}
+
+drmModeAtomicReqPtr drmModeAtomicAlloc(void)
+{
+    return (drmModeAtomicReqPtr) & ObjectProps;
+}
+
+void drmModeAtomicFree(drmModeAtomicReqPtr req)
+{
+    (void)req;
+}
+
+int drmModeAtomicAddProperty(drmModeAtomicReqPtr req, uint32_t id, uint32_t prop, uint64_t value)
+{
+    (void)req;
+    (void)id;
+    (void)prop;
+    (void)value;
+    return 0;
+}
+
+int drmModeAtomicCommit(int fd, drmModeAtomicReqPtr req, uint32_t flags, void *data)
+{
+    (void)fd;
+    (void)req;
+    (void)flags;
+    (void)data;
+    usleep(200);                        // the display takes a while
+    Commits++;
+    // 50, 23.976 or 59.94 Hz for the rates of the test
+    if (memcmp(&CommitMode, &TvModes[2], sizeof(CommitMode)) && memcmp(&CommitMode, &TvModes[7], sizeof(CommitMode))
+        && memcmp(&CommitMode, &TvModes[1], sizeof(CommitMode))) {
+        BadCommits++;
+    }
+    return 0;
+}
+
+int main(int argc, char *const argv[])
+{
+    static VideoRender display;
+
+    if (argc > 1) {
+        DataDir = argv[1];
+    }
+
+    printf("mode table\n");
+    // film at its own rate, video at the lowest multiple >= 48 Hz
+    CheckMode(TvModes, TV_MODES, 1920, 1080, 23976, 23976);
+    CheckMode(TvModes, TV_MODES, 1920, 1080, 24000, 24000);
+    CheckMode(TvModes, TV_MODES, 1920, 1080, 25000, 50000);
+    CheckMode(TvModes, TV_MODES, 1920, 1080, 29970, 59940);
+    CheckMode(TvModes, TV_MODES, 1920, 1080, 30000, 60000);
+    CheckMode(TvModes, TV_MODES, 1920, 1080, 50000, 50000);
+    CheckMode(TvModes, TV_MODES, 1920, 1080, 59940, 59940);
+    CheckMode(TvModes, TV_MODES, 1920, 1080, 60000, 60000);
+    CheckMode(TvModes, TV_MODES, 3840, 2160, 25000, 50000);
+    CheckMode(TvModes, TV_MODES, 3840, 2160, 23976, 23976);
+    CheckMode(TvModes, TV_MODES, 1280, 720, 50000, 50000);
+    // no mode of the size or no matching refresh
+    CheckMode(TvModes, TV_MODES, 720, 576, 29970, 0);
+    CheckMode(TvModes, TV_MODES, 2560, 1440, 50000, 0);
+    CheckMode(MonitorModes, 2, 1920, 1080, 50000, 0);
+    CheckMode(MonitorModes, 2, 1920, 1080, 30000, 60000);
+    CheckMode(TvModes, TV_MODES, 1920, 1080, 0, 0);
+    printf("  %s\n", Failed ? "FAILED" : "ok");
+
+    // the stream rate queues the mode on the first I-frame
+    memcpy(DrmModes, TvModes, sizeof(TvModes));
+    DrmModeCount = TV_MODES;
+    DrmRefreshRunning = 1;
+    ConfigVideoAutoRefresh = 1;
+    render = &display;
+
+    for (size_t i = 0; i < sizeof(Streams) / sizeof(*Streams); ++i) {
+        AVPacket avpkt;
+        int failed;
+        int height;
+        int rate;
+
+        failed = Failed;
+        printf("%s\n", Streams[i].Name);
+        memset(&avpkt, 0, sizeof(avpkt));
+        avpkt.data = ReadData(Streams[i].Name, &avpkt.size);
+
+        rate = VideoPacketFrameRate(Streams[i].Format, &avpkt, &height);
+        CHECK(rate == Streams[i].Rate, "rate %d, expected %d", rate, Streams[i].Rate);
+        CHECK(height == Streams[i].Height, "height %d, expected %d", height, Streams[i].Height);
+        CHECK(VideoPacketResolutionClass(Streams[i].Format, &avpkt) == Streams[i].Class,
+            "resolution class %d, expected %d", VideoPacketResolutionClass(Streams[i].Format, &avpkt),
+            Streams[i].Class);
+
+        for (int uhd = 0; uhd < 2; ++uhd) {
+            int refresh = uhd ? Streams[i].Refresh2160 : Streams[i].Refresh1080;
+
+            display.mode = TvModes[uhd ? 10 : 0];   // running at 60 Hz
+            DrmModeRequest = -1;
+            VideoStreamFrameRate(Streams[i].Format, &avpkt);
+            CHECK((int)(FrameRate * 1000 + 0.5) == Streams[i].Rate, "FrameRate %.3f", FrameRate);
+            if (DrmModeRequest < 0) {
+                CHECK(0, "no mode queued, expected %.3f Hz", refresh / 1000.0);
+                continue;
+            }
+            CHECK(DrmModes[DrmModeRequest].vdisplay == display.mode.vdisplay
+                && abs(DrmModeRefresh(&DrmModes[DrmModeRequest]) - refresh) <= 1,
+                "queued %dx%d %.3f Hz, expected %.3f Hz", DrmModes[DrmModeRequest].hdisplay,
+                DrmModes[DrmModeRequest].vdisplay, DrmModeRefresh(&DrmModes[DrmModeRequest]) / 1000.0,
+                refresh / 1000.0);
+
+            // already running in the mode
+            display.mode = DrmModes[DrmModeRequest];
+            DrmModeRequest = -1;
+            VideoStreamFrameRate(Streams[i].Format, &avpkt);
+            CHECK(DrmModeRequest < 0, "mode %d queued for the running mode", DrmModeRequest);
+        }
+
+        // trick play doesn't switch
+        myTrickSpeed = 1;
+        DrmModeRequest = -1;
+        VideoStreamFrameRate(Streams[i].Format, &avpkt);
+        CHECK(DrmModeRequest < 0, "mode queued in trick play");
+        myTrickSpeed = 0;
+
+        free(avpkt.data);
+        printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+    }
+
+    // without the setup option nothing is switched
+    ConfigVideoAutoRefresh = 0;
+    DrmModeRequest = -1;
+    VideoSetContentRate(25000);
+    CHECK(DrmModeRequest < 0, "mode queued with AutoRefresh off");
+
+    // rate changes while the worker commits, the last one wins
+    printf("refresh worker\n");
+    {
+        static const int rates[] = { 25000, 23976, 29970 };
+        int failed;
+        int i;
+
+        failed = Failed;
+        ConfigVideoAutoRefresh = 1;
+        display.mode = TvModes[0];
+        DrmModeRequest = -1;
+        DrmRefreshStop = 0;
+        CHECK(!pthread_create(&DrmRefreshThread, NULL, DrmRefreshWorker, NULL), "worker not started");
+        for (i = 0; i < 2000; ++i) {
+            VideoSetContentRate(rates[i % 3]);
+            if (!(i % 64)) {
+                usleep(100);
+            }
+        }
+        VideoSetContentRate(23976);
+        for (i = 0; i < 1000; ++i) {
+            pthread_mutex_lock(&DrmRefreshMutex);
+            if (DrmModeRequest < 0 && !memcmp(&display.mode, &TvModes[7], sizeof(display.mode))) {
+                pthread_mutex_unlock(&DrmRefreshMutex);
+                break;
+            }
+            pthread_mutex_unlock(&DrmRefreshMutex);
+            usleep(1000);
+        }
+        pthread_mutex_lock(&DrmRefreshMutex);
+        DrmRefreshStop = 1;
+        pthread_cond_signal(&DrmRefreshCond);
+        pthread_mutex_unlock(&DrmRefreshMutex);
+        pthread_join(DrmRefreshThread, NULL);
+
+        CHECK(!memcmp(&display.mode, &TvModes[7], sizeof(display.mode)), "running %dx%d %.3f Hz, expected 23.976 Hz",
+            display.mode.hdisplay, display.mode.vdisplay, DrmModeRefresh(&display.mode) / 1000.0);
+        printf("commits %d\n", Commits); CHECK(Commits > 0 && !BadCommits, "%d commits, %d of other modes", Commits, BadCommits);
+        printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+    }
+
+    render = NULL;
+    return Failed ? 1 : 0;
+}
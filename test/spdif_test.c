@@ -0,0 +1,219 @@
+///
+/// @file spdif_test.c	@brief IEC 61937 packer test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Compares the pass-through bursts of the codec module byte by byte
+/// with the ffmpeg spdif muxer.  The golden files in test/data were
+/// made by ffmpeg 7.0 from the elementary streams next to them:
+///
+///	ffmpeg -i ac3.ac3 -c copy -f spdif ac3.spdif
+///	ffmpeg -i eac3.eac3 -c copy -f spdif eac3.spdif
+///	ffmpeg -f dts -i dts.dts -c copy -f spdif dts.spdif
+///	ffmpeg -f dts -i dtsraw.dts -c copy -f spdif dtsraw.spdif
+///	ffmpeg -f dts -i dts.dts -c copy -frames:a 1 -dtshd_rate 768000
+///		-f spdif dtshd.spdif
+///
+/// All streams go through one decoder, like a channel switch does, so
+/// a burst left over from the previous codec shows up as a mismatch.
+///
+
+#include "../codec.c"
+#include "test.h"
+
+static const char *DataDir = "test/data";   ///< directory of the test data
+
+static const uint8_t *Expect;           ///< expected bursts
+static int ExpectSize;                  ///< size of expected bursts
+static int ExpectOffset;                ///< bytes of expected bursts seen
+
+/**
+**	Compare an enqueued burst with the golden file.
+**
+**	@param samples	burst
+**	@param count	size of burst in bytes
+*/
+void AudioEnqueue(const void *samples, int count)
+{
+    const uint8_t *p;
+    int i;
+
+    p = samples;
+    if (ExpectOffset + count > ExpectSize) {
+        printf("  burst of %d bytes at %d past the end of %d\n", count, ExpectOffset, ExpectSize);
+        Failed++;
+        return;
+    }
+    for (i = 0; i < count; ++i) {
+        if (p[i] != Expect[ExpectOffset + i]) {
+            printf("  byte %d of burst at %d: got %02x expected %02x\n", i, ExpectOffset, p[i],
+                Expect[ExpectOffset + i]);
+            Failed++;
+            break;
+        }
+    }
+    ExpectOffset += count;
+}
+
+/**
+**	Read a test data file.
+**
+**	@param name	file name in the data directory
+**	@param[out] size	file size
+*/
+static uint8_t *ReadData(const char *name, int *size)
+{
+    char path[256];
+    uint8_t *data;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/%s", DataDir, name);
+    if (!(f = fopen(path, "rb"))) {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(*size);
+    if (fread(data, 1, *size, f) != (size_t)*size) {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+    return data;
+}
+
+/**
+**	Get size of the AC-3, E-AC-3 or DTS frame at p.
+**
+**	@returns frame size or -1.
+*/
+static int FrameSize(const uint8_t * p, int size)
+{
+    static const int ac3_rate[19] = {
+        32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512, 576, 640
+    };
+
+    if (size >= 10 && p[0] == 0x7F && p[1] == 0xFE && p[2] == 0x80 && p[3] == 0x01) {
+        return (((p[5] & 0x03) << 12) | (p[6] << 4) | (p[7] >> 4)) + 1;
+    }
+    if (size >= 6 && p[0] == 0x0B && p[1] == 0x77) {
+        if ((p[5] >> 3) > 10) {         // E-AC-3
+            return ((((p[2] & 0x07) << 8) | p[3]) + 1) * 2;
+        }
+        if (!(p[4] & 0xC0) && (p[4] & 0x3F) < 38) {    // 48 kHz AC-3
+            return ac3_rate[(p[4] & 0x3F) >> 1] * 4;
+        }
+    }
+    return -1;
+}
+
+/**
+**	Pack a stream and compare it with its golden file.
+**
+**	@param decoder	audio decoder, kept over all streams
+**	@param codec_id	codec of the stream
+**	@param dtshd	DTS-HD pass-through
+**	@param frames	number of frames to pack, 0 for all
+**	@param stream	elementary stream file
+**	@param golden	spdif muxer output file
+*/
+static void PackStream(AudioDecoder * decoder, int codec_id, int dtshd, int frames, const char *stream,
+    const char *golden)
+{
+    uint8_t *data;
+    int size;
+    int offset;
+    int failed;
+
+    printf("%s -> %s\n", stream, golden);
+    failed = Failed;
+    data = ReadData(stream, &size);
+    Expect = ReadData(golden, &ExpectSize);
+    ExpectOffset = 0;
+
+    decoder->AudioCtx->codec_id = codec_id;
+    decoder->DtsHd = dtshd;
+    decoder->SpdifIndex = 0;
+    decoder->SpdifCount = 0;
+
+    for (offset = 0; offset < size;) {
+        AVPacket avpkt;
+        int n;
+
+        if ((n = FrameSize(data + offset, size - offset)) <= 0 || offset + n > size) {
+            printf("  bad frame at %d\n", offset);
+            Failed++;
+            break;
+        }
+        memset(&avpkt, 0, sizeof(avpkt));
+        avpkt.data = data + offset;
+        avpkt.size = n;
+        if (CodecAudioPassthroughHelper(decoder, &avpkt) != 1) {
+            printf("  frame at %d not packed\n", offset);
+            Failed++;
+        }
+        offset += n;
+        if (!--frames) {
+            break;
+        }
+    }
+    if (ExpectOffset != ExpectSize) {
+        printf("  %d bytes packed, %d expected\n", ExpectOffset, ExpectSize);
+        Failed++;
+    }
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    free(data);
+    free((void *)Expect);
+}
+
+int main(int argc, char *const argv[])
+{
+    AudioDecoder *decoder;
+    AVCodecContext *audio_ctx;
+
+    if (argc > 1) {
+        DataDir = argv[1];
+    }
+
+    decoder = calloc(1, sizeof(*decoder));
+    audio_ctx = calloc(1, sizeof(*audio_ctx));
+    decoder->AudioCtx = audio_ctx;
+    decoder->HwSampleRate = 192000;     // E-AC-3 with HBR
+    CodecPassthrough = CodecAC3 | CodecEAC3 | CodecDTS | CodecDTSHD;
+
+    PackStream(decoder, AV_CODEC_ID_AC3, 0, 0, "ac3.ac3", "ac3.spdif");
+    PackStream(decoder, AV_CODEC_ID_EAC3, 0, 0, "eac3.eac3", "eac3.spdif");
+    PackStream(decoder, AV_CODEC_ID_DTS, 0, 0, "dtsraw.dts", "dtsraw.spdif");
+    PackStream(decoder, AV_CODEC_ID_AC3, 0, 0, "ac3.ac3", "ac3.spdif");
+    PackStream(decoder, AV_CODEC_ID_DTS, 1, 1, "dts.dts", "dtshd.spdif");
+    PackStream(decoder, AV_CODEC_ID_DTS, 0, 0, "dts.dts", "dts.spdif");
+    PackStream(decoder, AV_CODEC_ID_EAC3, 0, 0, "eac3.eac3", "eac3.spdif");
+    PackStream(decoder, AV_CODEC_ID_DTS, 0, 0, "dtsraw.dts", "dtsraw.spdif");
+    PackStream(decoder, AV_CODEC_ID_AC3, 0, 0, "ac3.ac3", "ac3.spdif");
+
+    free(audio_ctx);
+    free(decoder);
+
+    return Failed ? 1 : 0;
+}
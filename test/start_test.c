@@ -0,0 +1,226 @@
+///
+/// @file start_test.c	@brief Plugin start timing test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// The audio and video backends are replaced by stubs, which sleep like
+/// ALSA open with mixer setup and like the DRM and decoder setup.  The
+/// time to the first frame is taken from the call of Start or Resume
+/// until the first packet reaches the video decoder.
+///
+/// Audio and video start in parallel, the first frame must come after
+/// the slower backend, not after both.  pthread_create of the device
+/// module is replaced, it can fail, then audio starts inline and the
+/// start takes the sum, which is the serial start the parallel one is
+/// compared with.
+///
+
+#include <pthread.h>
+
+#define pthread_create StartTestCreate
+
+static int StartTestCreate(pthread_t *, const pthread_attr_t *, void *(*)(void *), void *);
+
+#include "../softhddev.c"
+
+#undef pthread_create
+
+#include "test.h"
+
+#define AUDIO_MS 300                    ///< ALSA open and mixer setup
+#define VIDEO_MS 500                    ///< DRM and decoder setup
+#define SLACK_MS 80                     ///< allowed scheduling delay
+
+static VideoHwDecoder HwDecoder;        ///< stub hardware decoder
+static VideoDecoder Decoder;            ///< stub video decoder
+static char AudioCodec[1];              ///< stub audio decoder, its type is opaque
+static volatile uint64_t FirstFrame;    ///< us of the first decoded packet
+static int Serial;                      ///< flag: thread creation fails
+
+static int StartTestCreate(pthread_t * thread, const pthread_attr_t * attr, void *(*start)(void *), void *arg)
+{
+    if (Serial) {
+        return EAGAIN;
+    }
+    return pthread_create(thread, attr, start, arg);
+}
+
+void AudioInit(void)
+{
+    usleep(AUDIO_MS * 1000);
+}
+
+AudioDecoder *CodecAudioNewDecoder(void)
+{
+    return (AudioDecoder *) AudioCodec;
+}
+
+void VideoInit(const char *display)
+{
+    (void)display;
+    usleep(VIDEO_MS * 1000);
+}
+
+VideoHwDecoder *VideoNewHwDecoder(VideoStream * stream)
+{
+    (void)stream;
+    return &HwDecoder;
+}
+
+VideoDecoder *CodecVideoNewDecoder(VideoHwDecoder * hw_decoder)
+{
+    (void)hw_decoder;
+    return &Decoder;
+}
+
+void CodecVideoDecode(VideoDecoder * decoder, const AVPacket * avpkt)
+{
+    (void)decoder;
+    (void)avpkt;
+    if (!FirstFrame) {
+        FirstFrame = GetusTicks();
+    }
+}
+
+///
+/// Play the first frame after a start.
+///
+/// @param start	us of the start call
+///
+/// @returns time to the first frame in ms.
+///
+static int PlayFirstFrame(uint64_t start)
+{
+    static uint8_t frame[4096];
+    VideoStream *stream = MyVideoStream;
+
+    FirstFrame = 0;
+    if (!stream->Decoder || stream->SkipStream) {
+        CHECK(0, "video not started");
+        return -1;
+    }
+    VideoEnqueue(stream, 0, AV_NOPTS_VALUE, frame, sizeof(frame));
+    VideoNextPacket(stream, AV_CODEC_ID_H264);
+    for (int i = 0; i < 10 && !FirstFrame; ++i) {
+        VideoDecodeInput(stream);
+    }
+    if (!FirstFrame) {
+        CHECK(0, "first frame not decoded");
+        return -1;
+    }
+    return (FirstFrame - start) / 1000;
+}
+
+///
+/// Get a phase of the timing report.
+///
+/// @param name	phase name
+///
+/// @returns duration of the phase in ms, -1 not reported.
+///
+static int GetPhase(const char *name)
+{
+    char buf[256];
+    char phase[8];
+    const char *s;
+    int ms;
+
+    GetStartStats(buf, sizeof(buf));
+    for (s = buf; *s; s = strchr(s, '\n') + 1) {
+        if (sscanf(s, "%7s %d.", phase, &ms) == 2 && !strcmp(phase, name)) {
+            return ms;
+        }
+    }
+    return -1;
+}
+
+///
+/// Check the timing report of a start.
+///
+/// @param name	name of the start
+/// @param ttff	time to the first frame in ms
+/// @param want	expected total in ms
+///
+static void CheckPhases(const char *name, int ttff, int want)
+{
+    int audio = GetPhase("audio");
+    int video = GetPhase("video");
+    int total = GetPhase("total");
+
+    printf("  %s: first frame after %dms (audio %dms, video %dms, total %dms)\n", name, ttff, audio, video, total);
+    CHECK(audio >= AUDIO_MS && audio < AUDIO_MS + SLACK_MS, "%s: audio phase %dms", name, audio);
+    CHECK(video >= VIDEO_MS && video < VIDEO_MS + SLACK_MS, "%s: video phase %dms", name, video);
+    CHECK(total >= want && total < want + SLACK_MS, "%s: total %dms, expected %dms", name, total, want);
+    CHECK(ttff >= total && ttff < total + SLACK_MS, "%s: first frame after %dms, total %dms", name, ttff, total);
+}
+
+///
+/// Resume after a suspend.
+///
+/// @param serial	start audio inline
+///
+/// @returns time to the first frame in ms.
+///
+static int SuspendResume(int serial)
+{
+    uint64_t start;
+    int ttff;
+
+    Suspend(1, 1, 0);
+    CHECK(!MyAudioDecoder && !MyVideoStream->HwDecoder, "audio or video kept after suspend");
+    Serial = serial;
+    start = GetusTicks();
+    Resume();
+    ttff = PlayFirstFrame(start);
+    Serial = 0;
+    CHECK(MyAudioDecoder == (AudioDecoder *) AudioCodec && !SkipAudio, "audio not resumed");
+    return ttff;
+}
+
+int main(void)
+{
+    uint64_t start;
+    int serial;
+    int parallel;
+    int failed;
+
+    printf("start\n");
+    failed = Failed;
+    start = GetusTicks();
+    Start();
+    parallel = PlayFirstFrame(start);
+    CHECK(MyAudioDecoder == (AudioDecoder *) AudioCodec, "audio not started");
+    CheckPhases("parallel", parallel, VIDEO_MS);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    printf("resume\n");
+    failed = Failed;
+    serial = SuspendResume(1);
+    CheckPhases("serial", serial, AUDIO_MS + VIDEO_MS);
+    parallel = SuspendResume(0);
+    CheckPhases("parallel", parallel, VIDEO_MS);
+    // the audio start is hidden behind the video start
+    CHECK(parallel <= serial - AUDIO_MS + SLACK_MS, "first frame after %dms parallel, %dms serial", parallel,
+        serial);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    return Failed ? 1 : 0;
+}
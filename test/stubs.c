@@ -0,0 +1,548 @@
+///
+/// @file stubs.c	@brief Test stubs
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// @defgroup Test The test programs.
+///
+/// Each test includes the unit it checks.  The other plugin units and
+/// the C++ part of the plugin are replaced by the weak stubs below, a
+/// test overrides a stub by defining the function itself or by linking
+/// the real unit.
+///
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libavcodec/avcodec.h>
+
+#include "../iatomic.h"
+#include "../misc.h"
+#include "../video.h"
+#include "../audio.h"
+#include "../codec.h"
+#include "../softhddev.h"
+
+#define WEAK __attribute__((weak))      ///< stub, replaced by a real unit
+
+//----------------------------------------------------------------------------
+//  C++ part
+//----------------------------------------------------------------------------
+
+WEAK int SysLogLevel;                   ///< show additional debug informations
+
+WEAK int ConfigVideoAutoRefresh;        ///< config auto refresh rate
+WEAK int ConfigVideoBlackPicture;       ///< config black picture on switch
+WEAK int ConfigVideoBrightness;         ///< config video brightness
+WEAK int ConfigVideoContrast;           ///< config video contrast
+WEAK int ConfigVideoFastSwitch;         ///< config fast channel switch
+WEAK int ConfigVideoWarmReuse;          ///< config warm decoder reuse
+WEAK int ConfigVideoBufferSD = 8;       ///< config SD video buffer budget in MB
+WEAK int ConfigVideoBufferHD = 16;      ///< config HD video buffer budget in MB
+WEAK int ConfigVideoBufferUHD = 40;     ///< config UHD video buffer budget in MB
+
+WEAK void DelPip(void)
+{
+}
+
+//----------------------------------------------------------------------------
+//  Device
+//----------------------------------------------------------------------------
+
+WEAK int m_PlayMode;                    ///< current play mode
+WEAK int hasVideo;                      ///< stream has video
+
+WEAK int IsReplay(void)
+{
+    return 0;
+}
+
+WEAK void ThreadApplyProfile(int role)
+{
+    (void)role;
+}
+
+WEAK size_t MemReserve(int tag, size_t want, size_t min)
+{
+    (void)tag;
+    (void)min;
+    return want;
+}
+
+WEAK void MemRelease(int tag, size_t size)
+{
+    (void)tag;
+    (void)size;
+}
+
+WEAK size_t MemBudget(int tag)
+{
+    (void)tag;
+    return 0;
+}
+
+WEAK int VideoPollInput(VideoStream * stream)
+{
+    (void)stream;
+    return -1;
+}
+
+WEAK int VideoDecodeInput(VideoStream * stream)
+{
+    (void)stream;
+    return -1;
+}
+
+//----------------------------------------------------------------------------
+//  Audio
+//----------------------------------------------------------------------------
+
+WEAK char AudioVideoIsReady;            ///< video ready start early
+
+WEAK void AudioEnqueue(const void *samples, int count)
+{
+    (void)samples;
+    (void)count;
+}
+
+WEAK int64_t AudioGetDelay(void)
+{
+    return 0;
+}
+
+WEAK uint64_t AudioGetClock(void)
+{
+    return AV_NOPTS_VALUE;
+}
+
+WEAK void AudioVideoReady(uint64_t pts)
+{
+    (void)pts;
+}
+
+WEAK void AudioSetClock(int64_t pts)
+{
+    (void)pts;
+}
+
+WEAK int AudioSetup(int *freq, int *channels, int passthrough)
+{
+    (void)freq;
+    (void)channels;
+    (void)passthrough;
+    return 0;
+}
+
+WEAK void AudioSetDriftCorrection(int mask)
+{
+    (void)mask;
+}
+
+WEAK char AudioAlsaNoCloseOpen;         ///< disable alsa close/open fix
+WEAK int UseAudioSpdif;                 ///< use pass-through device
+WEAK int ConfigAudioBufferTime;         ///< config size ms of audio buffer
+
+WEAK void AudioInit(void)
+{
+}
+
+WEAK void AudioExit(void)
+{
+}
+
+WEAK void AudioEnqueueLpcm(const uint8_t * data, int count, int bits, int channels)
+{
+    (void)data;
+    (void)count;
+    (void)bits;
+    (void)channels;
+}
+
+WEAK int AudioLpcmHeader(const uint8_t * header, int *samplerate, int *bits, int *channels)
+{
+    (void)header;
+    *samplerate = 48000;
+    *bits = 16;
+    *channels = 2;
+    return 0;
+}
+
+WEAK void AudioFlushBuffers(void)
+{
+}
+
+WEAK int AudioFreeBytes(void)
+{
+    return 1024 * 1024;
+}
+
+WEAK int AudioUsedBytes(void)
+{
+    return 0;
+}
+
+WEAK int AudioGetBufferUsedbytes(void)
+{
+    return 0;
+}
+
+WEAK void AudioPlay(void)
+{
+}
+
+WEAK void AudioPause(void)
+{
+}
+
+WEAK void AudioSetBufferTime(int ms)
+{
+    (void)ms;
+}
+
+WEAK void AudioSetVolume(int volume)
+{
+    (void)volume;
+}
+
+WEAK void AudioSetDevice(const char *device)
+{
+    (void)device;
+}
+
+WEAK void AudioSetPassthroughDevice(const char *device)
+{
+    (void)device;
+}
+
+WEAK void AudioSetChannel(const char *channel)
+{
+    (void)channel;
+}
+
+//----------------------------------------------------------------------------
+//  CEC
+//----------------------------------------------------------------------------
+
+WEAK int cec_init(void)
+{
+    return 0;
+}
+
+WEAK int cec_exit(void)
+{
+    return 0;
+}
+
+WEAK int cec_send_command(int dev, char *cmd)
+{
+    (void)dev;
+    (void)cmd;
+    return -1;
+}
+
+WEAK int cec_active(void)
+{
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+//  Codec
+//----------------------------------------------------------------------------
+
+WEAK void CodecInit(void)
+{
+}
+
+WEAK void CodecExit(void)
+{
+}
+
+WEAK AudioDecoder *CodecAudioNewDecoder(void)
+{
+    return NULL;
+}
+
+WEAK void CodecAudioDelDecoder(AudioDecoder * decoder)
+{
+    (void)decoder;
+}
+
+WEAK void CodecAudioOpen(AudioDecoder * decoder, int codec_id)
+{
+    (void)decoder;
+    (void)codec_id;
+}
+
+WEAK void CodecAudioClose(AudioDecoder * decoder)
+{
+    (void)decoder;
+}
+
+WEAK void CodecAudioDecode(AudioDecoder * decoder, const AVPacket * avpkt)
+{
+    (void)decoder;
+    (void)avpkt;
+}
+
+WEAK VideoDecoder *CodecVideoNewDecoder(VideoHwDecoder * hw_decoder)
+{
+    (void)hw_decoder;
+    return NULL;
+}
+
+WEAK void CodecVideoDelDecoder(VideoDecoder * decoder)
+{
+    (void)decoder;
+}
+
+WEAK void CodecVideoOpen(VideoDecoder * decoder, int codec_id, AVPacket * avpkt)
+{
+    (void)decoder;
+    (void)codec_id;
+    (void)avpkt;
+}
+
+WEAK void CodecVideoClose(VideoHwDecoder * hw_decoder)
+{
+    (void)hw_decoder;
+}
+
+WEAK void CodecVideoPark(VideoHwDecoder * hw_decoder)
+{
+    (void)hw_decoder;
+}
+
+WEAK void CodecVideoDecode(VideoDecoder * decoder, const AVPacket * avpkt)
+{
+    (void)decoder;
+    (void)avpkt;
+}
+
+WEAK void CodecVideoFlushBuffers(VideoDecoder * decoder)
+{
+    (void)decoder;
+}
+
+//----------------------------------------------------------------------------
+//  Video
+//----------------------------------------------------------------------------
+
+WEAK int myKernel;                      ///< kernel version
+
+WEAK int VideoWindowWidth;              ///< video output window width
+WEAK int VideoWindowHeight;             ///< video output window height
+WEAK int VideoAudioDelay;               ///< audio/video delay
+WEAK uint64_t FirstVPTS;                ///< pts of the first video frame
+WEAK bool isFirstVideoPacket;           ///< decoder was reset
+
+WEAK int SetCurrentPCR(int handle, uint64_t value)
+{
+    (void)handle;
+    (void)value;
+    return 0;
+}
+
+WEAK void VideoInit(const char *display)
+{
+    (void)display;
+}
+
+WEAK void VideoExit(void)
+{
+}
+
+WEAK VideoHwDecoder *VideoNewHwDecoder(VideoStream * stream)
+{
+    (void)stream;
+    return NULL;
+}
+
+WEAK void VideoDelHwDecoder(VideoHwDecoder * hw_decoder)
+{
+    (void)hw_decoder;
+}
+
+WEAK void VideoDisplayWakeup(void)
+{
+}
+
+WEAK void VideoResetStart(VideoHwDecoder * hw_decoder)
+{
+    (void)hw_decoder;
+}
+
+WEAK void VideoSetTrickSpeed(VideoHwDecoder * hw_decoder, int speed, int forward)
+{
+    (void)hw_decoder;
+    (void)speed;
+    (void)forward;
+}
+
+WEAK int VideoSetTrickIntra(int intra)
+{
+    (void)intra;
+    return 0;
+}
+
+WEAK void VideoTrickWakeup(void)
+{
+}
+
+WEAK uint64_t VideoGetClock(const VideoHwDecoder * hw_decoder)
+{
+    (void)hw_decoder;
+    return AV_NOPTS_VALUE;
+}
+
+WEAK void VideoGetStats(VideoHwDecoder * hw_decoder, int *missed, int *duped, int *dropped, int *count,
+    float *frametime, int *width, int *height, int *color, int *eotf)
+{
+    (void)hw_decoder;
+    *missed = *duped = *dropped = *count = 0;
+    *frametime = 0;
+    *width = *height = *color = *eotf = 0;
+}
+
+WEAK void VideoGetVideoSize(VideoHwDecoder * hw_decoder, int *width, int *height, int *aspect_num,
+    int *aspect_den)
+{
+    (void)hw_decoder;
+    *width = *height = 0;
+    *aspect_num = *aspect_den = 1;
+}
+
+WEAK void VideoGetOsdSize(int *width, int *height)
+{
+    *width = 1920;
+    *height = 1080;
+}
+
+WEAK int VideoSetGeometry(const char *geometry)
+{
+    (void)geometry;
+    return 0;
+}
+
+WEAK void VideoSetOutputPosition(VideoHwDecoder * hw_decoder, int x, int y, int width, int height)
+{
+    (void)hw_decoder;
+    (void)x;
+    (void)y;
+    (void)width;
+    (void)height;
+}
+
+WEAK void VideoSetRefresh(char *refresh)
+{
+    (void)refresh;
+}
+
+WEAK void VideoOsdInit(void)
+{
+}
+
+WEAK void VideoOsdExit(void)
+{
+}
+
+WEAK void VideoOsdClear(void)
+{
+}
+
+WEAK void VideoOsdDrawARGB(int xi, int yi, int width, int height, int pitch, const uint8_t * argb, int x,
+    int y)
+{
+    (void)xi;
+    (void)yi;
+    (void)width;
+    (void)height;
+    (void)pitch;
+    (void)argb;
+    (void)x;
+    (void)y;
+}
+
+WEAK uint8_t *VideoGrab(int *size, int *width, int *height, int write_header)
+{
+    (void)size;
+    (void)width;
+    (void)height;
+    (void)write_header;
+    return NULL;
+}
+
+WEAK uint8_t *CreateJpeg(uint8_t * image, int *size, int quality, int width, int height)
+{
+    (void)image;
+    (void)size;
+    (void)quality;
+    (void)width;
+    (void)height;
+    return NULL;
+}
+
+WEAK int amlFreerun(int val)
+{
+    (void)val;
+    return 0;
+}
+
+WEAK void amlPause(void)
+{
+}
+
+WEAK void amlResume(void)
+{
+}
+
+WEAK void amlTrickMode(int val)
+{
+    (void)val;
+}
+
+WEAK int amlTrickDone(void)
+{
+    return -1;
+}
+
+WEAK int amlTrickWait(int timeout)
+{
+    (void)timeout;
+    return -1;
+}
+
+WEAK void amlSetVideoAxis(int pip, int x, int y, int width, int height)
+{
+    (void)pip;
+    (void)x;
+    (void)y;
+    (void)width;
+    (void)height;
+}
+
+WEAK int amlSetInt(char *path, int val)
+{
+    (void)path;
+    (void)val;
+    return 0;
+}
@@ -0,0 +1,47 @@
+///
+/// @file test.h	@brief Shared helpers of the unit tests
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Each test includes the unit it checks and then this header.  A
+/// failed check prints its message indented below the section name,
+/// main returns non-zero if any check failed.
+///
+
+#include <stdio.h>
+
+static int Failed;                      ///< number of failed checks
+static unsigned Seed = 1;               ///< random generator state
+
+///
+/// Check a condition.
+///
+#define CHECK(cond, ...) \
+    do { if (!(cond)) { printf("  "); printf(__VA_ARGS__); printf("\n"); Failed++; } } while (0)
+
+///
+/// Get a pseudo random number, the sequence is the same in each run.
+///
+static inline unsigned Random(void)
+{
+    Seed = Seed * 1103515245 + 12345;
+    return Seed >> 8;
+}
@@ -0,0 +1,260 @@
+///
+/// @file thread_test.c	@brief Thread scheduling profile test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Parses valid and invalid profiles, an invalid one must keep the old
+/// profile of the role.  Threads apply their profile with
+/// ThreadApplyProfile, the report of ThreadGetProfiles must match
+/// /proc/self/task/<tid> of the threads while they run and tell stopped
+/// after they are joined.
+///
+/// The real-time policies need CAP_SYS_NICE, without it the report must
+/// still match the kernel, which kept the thread at other.
+///
+
+#include "../softhddev.c"
+#include "test.h"
+
+static volatile int Quit;               ///< flag: test threads exit
+
+/// a line of the report
+typedef struct
+{
+    char Name[8];                       ///< role name
+    int Tid;                            ///< thread id, 0 stopped
+    char Policy[16];                    ///< policy name
+    int Priority;                       ///< real-time priority
+    int Nice;                           ///< nice level
+    char Cpus[128];                     ///< core list
+    char Wanted[192];                   ///< profile of the role
+} Report;
+
+///
+/// Get the report line of a role.
+///
+/// @param name	role name
+/// @param[out] report	parsed line
+///
+/// @returns true if the line is found and has the format.
+///
+static int GetReport(const char *name, Report * report)
+{
+    char buf[1024];
+    const char *s;
+
+    ThreadGetProfiles(buf, sizeof(buf));
+    memset(report, 0, sizeof(*report));
+    for (s = buf; *s; s = strchr(s, '\n') + 1) {
+        if (strncmp(s, name, strlen(name)) || s[strlen(name)] != ' ') {
+            continue;
+        }
+        if (sscanf(s, "%7s stopped (wanted %191[^)])", report->Name, report->Wanted) == 2) {
+            return 1;
+        }
+        return sscanf(s, "%7s tid %d %15s %d nice %d cores %127s (wanted %191[^)])", report->Name,
+            &report->Tid, report->Policy, &report->Priority, &report->Nice, report->Cpus, report->Wanted) == 7;
+    }
+    return 0;
+}
+
+///
+/// Read the scheduling of a thread from /proc/self/task.
+///
+/// @param tid	thread id
+/// @param[out] policy	scheduling policy
+/// @param[out] priority	real-time priority
+/// @param[out] nice	nice level
+/// @param[out] cpus	allowed cores as core list
+///
+/// @returns true if the thread is found.
+///
+static int GetTask(int tid, int *policy, int *priority, int *nice, char *cpus)
+{
+    char path[64];
+    char line[1024];
+    const char *s;
+    FILE *f;
+    int n;
+
+    // fields after the command: 19 nice, 40 rt_priority, 41 policy
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+    if (!(f = fopen(path, "r"))) {
+        return 0;
+    }
+    n = fgets(line, sizeof(line), f) != NULL;
+    fclose(f);
+    if (!n || !(s = strrchr(line, ')'))) {
+        return 0;
+    }
+    for (n = 2; n < 19 && (s = strchr(s + 1, ' ')); ++n) ;
+    if (!s || sscanf(s, " %d", nice) != 1) {
+        return 0;
+    }
+    for (; n < 40 && (s = strchr(s + 1, ' ')); ++n) ;
+    if (!s || sscanf(s, " %d %d", priority, policy) != 2) {
+        return 0;
+    }
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/status", tid);
+    if (!(f = fopen(path, "r"))) {
+        return 0;
+    }
+    n = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "Cpus_allowed_list: %127s", cpus) == 1) {
+            n = 1;
+        }
+    }
+    fclose(f);
+    return n;
+}
+
+///
+/// Test thread, applies the profile of its role.
+///
+static void *Worker(void *arg)
+{
+    ThreadApplyProfile((int)(intptr_t) arg);
+    while (!Quit) {
+        usleep(1000);
+    }
+    return NULL;
+}
+
+///
+/// Check that a profile is refused and keeps the old one.
+///
+/// @param profile	invalid profile
+///
+static void Refuse(const char *profile)
+{
+    Report report;
+
+    CHECK(!ThreadSetProfile("Video", profile), "\"%s\" accepted", profile);
+    CHECK(GetReport("Video", &report) && !strcmp(report.Wanted, "rr 20 0-1"),
+        "\"%s\" changed the profile to \"%s\"", profile, report.Wanted);
+}
+
+///
+/// Check the report of a running thread against the kernel.
+///
+/// @param name	role name
+/// @param wanted	expected profile in the report
+///
+/// @returns the thread id.
+///
+static int Compare(const char *name, const char *wanted)
+{
+    Report report;
+    char cpus[128];
+    int policy;
+    int priority;
+    int nice;
+
+    if (!GetReport(name, &report) || !report.Tid) {
+        CHECK(0, "%s not reported as running", name);
+        return 0;
+    }
+    CHECK(!strcmp(report.Wanted, wanted), "%s wanted \"%s\", expected \"%s\"", name, report.Wanted, wanted);
+    if (!GetTask(report.Tid, &policy, &priority, &nice, cpus)) {
+        CHECK(0, "%s tid %d not in /proc/self/task", name, report.Tid);
+        return report.Tid;
+    }
+    CHECK(!strcmp(report.Policy, ThreadPolicyName(policy)), "%s policy %s, kernel %s", name, report.Policy,
+        ThreadPolicyName(policy));
+    CHECK(report.Priority == priority, "%s priority %d, kernel %d", name, report.Priority, priority);
+    CHECK(report.Nice == nice, "%s nice %d, kernel %d", name, report.Nice, nice);
+    CHECK(!strcmp(report.Cpus, cpus), "%s cores %s, kernel %s", name, report.Cpus, cpus);
+    return report.Tid;
+}
+
+int main(void)
+{
+    char profile[64];
+    char core[8];
+    pthread_t video;
+    pthread_t audio;
+    cpu_set_t set;
+    Report report;
+    int failed;
+    int tid;
+    int i;
+
+    // highest core the test may run on
+    sched_getaffinity(0, sizeof(set), &set);
+    for (i = 63; i > 0 && !CPU_ISSET(i, &set); --i) ;
+    snprintf(core, sizeof(core), "%d", i);
+
+    printf("parse\n");
+    failed = Failed;
+    CHECK(ThreadSetProfile("video", "rr 20 0-1"), "\"rr 20 0-1\" refused");
+    Refuse("bogus 10");
+    Refuse("fifo 0");
+    Refuse("rr 100 2");
+    Refuse("other 20");
+    Refuse("other -21 1");
+    Refuse("other 5 3-2");
+    Refuse("fifo 30 64");
+    Refuse("fifo 30 1;2");
+    CHECK(!ThreadSetProfile("Blitter", "fifo 30"), "unknown role accepted");
+    CHECK(ThreadSetProfile("Audio", "FIFO 99 4-5,7") && GetReport("Audio", &report)
+        && !strcmp(report.Wanted, "fifo 99 4-5,7"), "audio wanted \"%s\"", report.Wanted);
+    CHECK(ThreadSetProfile("Audio", "") && GetReport("Audio", &report)
+        && !strcmp(report.Wanted, "default 0 all"), "audio wanted \"%s\"", report.Wanted);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    // nice and cores need no privilege
+    printf("running\n");
+    failed = Failed;
+    snprintf(profile, sizeof(profile), "other 5 %s", core);
+    ThreadSetProfile("Video", profile);
+    ThreadSetProfile("Audio", "fifo 10");
+    Quit = 0;
+    pthread_create(&video, NULL, Worker, (void *)(intptr_t) THREAD_VIDEO);
+    pthread_create(&audio, NULL, Worker, (void *)(intptr_t) THREAD_AUDIO);
+    while (!ThreadProfiles[THREAD_VIDEO].Tid || !ThreadProfiles[THREAD_AUDIO].Tid) {
+        usleep(1000);
+    }
+    usleep(10000);
+    tid = Compare("Video", profile);
+    if (GetReport("Video", &report) && report.Tid) {
+        CHECK(!strcmp(report.Policy, "other") && report.Nice == 5 && !strcmp(report.Cpus, core),
+            "video %s nice %d cores %s, expected other nice 5 cores %s", report.Policy, report.Nice,
+            report.Cpus, core);
+    }
+    Compare("Audio", "fifo 10 all");
+    CHECK(GetReport("Osd", &report) && !report.Tid && !strcmp(report.Wanted, "default 0 all"),
+        "osd not reported as stopped");
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    printf("stopped\n");
+    failed = Failed;
+    Quit = 1;
+    pthread_join(video, NULL);
+    pthread_join(audio, NULL);
+    CHECK(GetReport("Video", &report) && !report.Tid && !strcmp(report.Wanted, profile),
+        "video tid %d reported after exit", tid);
+    CHECK(GetReport("Audio", &report) && !report.Tid, "audio reported after exit");
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    return Failed ? 1 : 0;
+}
@@ -0,0 +1,458 @@
+///
+/// @file trick_test.c	@brief I-frame trick play test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Feeds GOPs through CodecVideoDecode in trick mode and records what
+/// reaches the amstream device.  write, ioctl, usleep, clock_gettime
+/// and the timed wait of the video module are replaced, the device
+/// keeps the written access units with the time of the virtual clock,
+/// so pacing is checked exactly and without waiting.  Only the clear
+/// during a wait waits in real time, for a second thread.  poll of the
+/// fake amvideo device shows the still frame at a virtual time.
+///
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#define write TrickWrite
+#define ioctl TrickIoctl
+#define usleep TrickSleep
+#define clock_gettime TrickClock
+#define pthread_cond_timedwait TrickTimedWait
+#define poll TrickPoll
+
+static ssize_t TrickWrite(int, const void *, size_t);
+static int TrickIoctl(int, unsigned long, ...);
+static int TrickSleep(useconds_t);
+static int TrickClock(clockid_t, struct timespec *);
+static int TrickTimedWait(pthread_cond_t *, pthread_mutex_t *, const struct timespec *);
+static int TrickPoll(struct pollfd *, nfds_t, int);
+
+#include "../video.c"
+
+#undef write
+#undef ioctl
+#undef usleep
+#undef clock_gettime
+#undef pthread_cond_timedwait
+#undef poll
+
+#include "test.h"
+
+#define DEVICE_FD 100                   ///< fake amstream handle
+#define CNTL_FD 101                     ///< fake amvideo handle
+#define UNIT_MAX 256                    ///< max. recorded access units
+
+/// access unit written to the device
+static struct
+{
+    uint64_t Tick;                      ///< us of the virtual clock
+    uint32_t PCR;                       ///< pcr when written
+    int Type;                           ///< first nal/picture type
+    int Size;                           ///< bytes written
+} Unit[UNIT_MAX];
+static int Units;                       ///< number of recorded units
+
+static uint64_t Clock;                  ///< virtual clock in us
+static int RealWait;                    ///< flag timed wait in real time
+static uint32_t PCR;                    ///< last pcr set
+static int Trick = -1;                  ///< last trick mode set
+static int TrickStat = 1;               ///< kernel has the trick state
+static uint64_t FrameAt = UINT64_MAX;   ///< virtual time the still is shown
+
+static ssize_t TrickWrite(int fd, const void *buf, size_t count)
+{
+    const uint8_t *p;
+
+    if (fd != DEVICE_FD) {
+        errno = EBADF;
+        return -1;
+    }
+    p = buf;
+    if (Units < UNIT_MAX) {
+        Unit[Units].Tick = Clock;
+        Unit[Units].PCR = PCR;
+        Unit[Units].Type = count > 3 ? p[3] : -1;
+        Unit[Units].Size = count;
+        Units++;
+    }
+    return count;
+}
+
+static int TrickIoctl(int fd, unsigned long request, ...)
+{
+    va_list ap;
+    unsigned long arg;
+
+    va_start(ap, request);
+    arg = va_arg(ap, unsigned long);
+    va_end(ap);
+
+    if (fd == CNTL_FD && request == AMSTREAM_IOC_TRICKMODE) {
+        Trick = arg;
+    } else if (fd == CNTL_FD && request == AMSTREAM_IOC_TRICK_STAT) {
+        if (!TrickStat) {
+            errno = ENOTTY;
+            return -1;
+        }
+        *(uint32_t *) arg = Clock >= FrameAt ? TRICK_STAT_DONE : TRICK_STAT_WAIT;
+    } else if (fd == DEVICE_FD && request == AMSTREAM_IOC_SET) {
+        struct am_ioctl_parm *parm = (struct am_ioctl_parm *)arg;
+
+        if (parm->cmd == AMSTREAM_SET_PCRSCR) {
+            PCR = parm->data_32;
+        }
+    }
+    return 0;
+}
+
+static int TrickSleep(useconds_t us)
+{
+    Clock += us;
+    return 0;
+}
+
+static int TrickClock(clockid_t id, struct timespec *tp)
+{
+    (void)id;
+    tp->tv_sec = Clock / 1000000;
+    tp->tv_nsec = Clock % 1000000 * 1000;
+    return 0;
+}
+
+static int TrickPoll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    (void)nfds;
+    if (fds->fd != CNTL_FD) {
+        errno = EBADF;
+        return -1;
+    }
+    if (FrameAt > Clock + timeout * 1000ULL) {
+        Clock += timeout * 1000ULL;
+        return 0;
+    }
+    if (FrameAt > Clock) {
+        Clock = FrameAt;
+    }
+    FrameAt = UINT64_MAX;               // the poll clears the done state
+    fds->revents = POLLOUT;
+    return 1;
+}
+
+static int TrickTimedWait(pthread_cond_t * cond, pthread_mutex_t * mutex, const struct timespec *abstime)
+{
+    uint64_t due;
+    uint64_t real;
+    struct timespec ts;
+    int ret;
+
+    due = abstime->tv_sec * 1000000ULL + abstime->tv_nsec / 1000;
+    if (!RealWait) {
+        Clock = due;
+        return ETIMEDOUT;
+    }
+    // the same wait on the monotonic clock
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    real = ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000 + (due - Clock);
+    ts.tv_sec = real / 1000000;
+    ts.tv_nsec = real % 1000000 * 1000;
+    ret = pthread_cond_timedwait(cond, mutex, &ts);
+    if (ret == ETIMEDOUT) {
+        Clock = due;
+    }
+    return ret;
+}
+
+///
+/// Clear the stream from another thread, like vdr does.
+///
+static void *ClearThread(void *arg)
+{
+    (void)arg;
+    usleep(50 * 1000);
+    VideoTrickWakeup();
+    return NULL;
+}
+
+/// H.264 and H.265 access units: I (IDR), P, continuation
+static const uint8_t AvcI[] = { 0, 0, 1, 0x65, 0x88, 0x80, 0x40, 0x00 };
+static const uint8_t AvcP[] = { 0, 0, 1, 0x41, 0x9A, 0x20, 0x40, 0x00 };
+static const uint8_t HevcI[] = { 0, 0, 1, 0x26, 0x01, 0xAF, 0x00, 0x00 };
+static const uint8_t HevcP[] = { 0, 0, 1, 0x02, 0x01, 0xD0, 0x00, 0x00 };
+static const uint8_t Cont[] = { 0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF0 };
+
+/// H.264 I- and P-slice with a long first_mb_in_slice (2^21 - 1 and
+/// 2^22 - 1), read with the emulation prevention byte slice_type is
+/// 11 (P) and 257 (I)
+static const uint8_t AvcEscI[] = { 0, 0, 1, 0x41, 0x00, 0x00, 0x04, 0x00, 0x00, 0x03, 0x02, 0x00, 0x20 };
+static const uint8_t AvcEscP[] = { 0, 0, 1, 0x41, 0x00, 0x00, 0x03, 0x02, 0x00, 0x00, 0x04, 0x0A };
+
+///
+/// Decode one access unit.
+///
+static void Feed(VideoDecoder * decoder, const uint8_t * data, int size, int64_t pts)
+{
+    AVPacket avpkt;
+    uint8_t buf[16];
+
+    memcpy(buf, data, size);            // ProcessBuffer may rewrite it
+    memset(&avpkt, 0, sizeof(avpkt));
+    avpkt.data = buf;
+    avpkt.size = size;
+    avpkt.pts = pts;
+    CodecVideoDecode(decoder, &avpkt);
+}
+
+///
+/// Feed GOPs like vdr does in trick mode.
+///
+/// Each I-frame is followed by a continuation packet without pts, the
+/// P-frames are only fed in forward direction.  Reverse trick play of
+/// vdr sends the I-frames only, in decreasing order.
+///
+/// @param decoder	video decoder
+/// @param gops	number of GOPs
+/// @param gop	frames per GOP
+/// @param forward	forward direction
+///
+static void FeedGops(VideoDecoder * decoder, int gops, int gop, int forward)
+{
+    const uint8_t *intra;
+    const uint8_t *inter;
+    int64_t pts;
+
+    intra = decoder->HwDecoder->Format == Hevc ? HevcI : AvcI;
+    inter = decoder->HwDecoder->Format == Hevc ? HevcP : AvcP;
+    for (int g = 0; g < gops; ++g) {
+        int n = forward ? g : gops - 1 - g;
+
+        pts = (0x1FFFF0000LL + (int64_t)n * gop * 3600) & 0x1FFFFFFFFLL;	// cross the 33 bit wrap
+        Feed(decoder, intra, sizeof(AvcI), pts);
+        Feed(decoder, Cont, sizeof(Cont), AV_NOPTS_VALUE);
+        for (int f = 1; forward && f < gop; ++f) {
+            Feed(decoder, inter, sizeof(AvcP), (pts + f * 3600) & 0x1FFFFFFFFLL);
+        }
+    }
+}
+
+///
+/// Check the recorded access units of a run.
+///
+/// @param name	name of the run
+/// @param gops	I-frames expected
+/// @param interval	expected wall time between I-frames in us
+/// @param forward	forward direction
+/// @param intra	nal type of the I-frames
+///
+static void CheckRun(const char *name, int gops, int interval, int forward, int intra)
+{
+    int pushed = 0;
+    int failed = Failed;
+
+    printf("%s\n", name);
+    for (int i = 0; i < Units; ++i) {
+        if (Unit[i].Type == intra) {
+            if (pushed) {
+                int32_t step = Unit[i].PCR - Unit[i - 2].PCR;
+
+                CHECK(Unit[i].Tick - Unit[i - 2].Tick == (uint64_t)interval,
+                    "I-frame %d after %d us, expected %d", pushed, (int)(Unit[i].Tick - Unit[i - 2].Tick),
+                    interval);
+                CHECK(forward ? step > 0 : step < 0, "I-frame %d moves in the wrong direction", pushed);
+            }
+            CHECK(i + 1 < Units && Unit[i + 1].Type == Cont[3], "continuation of I-frame %d missing", pushed);
+            pushed++;
+            i++;
+        } else {
+            CHECK(0, "unit %d of type %02x is no I-frame", i, Unit[i].Type);
+        }
+    }
+    CHECK(pushed == gops, "%d I-frames pushed, expected %d", pushed, gops);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+    Units = 0;
+}
+
+int main(void)
+{
+    static VideoHwDecoder hw;
+    static VideoDecoder decoder;
+    int intra;
+    int n;
+
+    isOpen = true;
+    isRunning = true;
+    isFirstVideoPacket = false;
+    isAnnexB = true;                    // vdr sends annex B streams
+    isShortStartCode = true;
+    apiLevel = S905;
+    cntl_handle = CNTL_FD;
+    timeBase = (AVRational) { 1, 90000 };
+    hw.handle = DEVICE_FD;
+    hw.Format = Avc;
+    videoFormat = Avc;
+    OdroidDecoders[0] = &hw;
+    decoder.HwDecoder = &hw;
+    decoder.PTS = AV_NOPTS_VALUE;
+    Clock = 1000000;
+    VideoTrickInit();
+
+    // speed 6 is 2x: a GOP of 12 frames (480 ms) every 240 ms
+    VideoSetTrickSpeed(&hw, 6, 1);
+    CHECK(Trick == TRICKMODE_I, "trick mode %d, expected TRICKMODE_I", Trick);
+    FeedGops(&decoder, 8, 12, 1);
+    CheckRun("forward 2x", 8, 240000, 1, AvcI[3]);
+
+    // speed 1 is 12x: a GOP every 40 ms
+    VideoSetTrickSpeed(&hw, 1, 1);
+    FeedGops(&decoder, 8, 12, 1);
+    CheckRun("forward 12x", 8, 40000, 1, AvcI[3]);
+
+    // reverse 2x, paced from the absolute pts distance
+    VideoSetTrickSpeed(&hw, 6, 0);
+    FeedGops(&decoder, 8, 12, 0);
+    CheckRun("reverse 2x", 8, 240000, 0, AvcI[3]);
+
+    // I-frame only stream at 12x: 3.3 ms per frame is below
+    // TRICK_MIN_US, every 6th frame is shown for 20 ms
+    VideoSetTrickSpeed(&hw, 1, 1);
+    FeedGops(&decoder, 48, 1, 1);
+    CheckRun("all intra 12x", 8, 20000, 1, AvcI[3]);
+
+    // decoder reset restores the trick mode
+    Trick = -1;
+    isFirstVideoPacket = true;
+    FeedGops(&decoder, 1, 12, 1);
+    CHECK(Trick == TRICKMODE_I, "trick mode %d after reset, expected TRICKMODE_I", Trick);
+    CheckRun("reset", 1, 0, 1, AvcI[3]);
+
+    // slow motion feeds all frames through
+    VideoSetTrickSpeed(&hw, 2, 1);
+    CHECK(Trick == TRICKMODE_NONE, "trick mode %d, expected TRICKMODE_NONE", Trick);
+
+    VideoSetTrickSpeed(&hw, 0, 1);
+    hw.Format = Hevc;
+    videoFormat = Hevc;
+    VideoSetTrickSpeed(&hw, 3, 1);
+    CHECK(Trick == TRICKMODE_I_HEVC, "trick mode %d, expected TRICKMODE_I_HEVC", Trick);
+    FeedGops(&decoder, 4, 24, 1);
+    CheckRun("hevc forward 4x", 4, 240000, 1, HevcI[3]);
+
+    // a still picture during trick play restores the I-frame mode
+    printf("still picture\n");
+    n = Failed;
+    Trick = -1;
+    intra = VideoSetTrickIntra(1);
+    CHECK(intra && Trick == TRICKMODE_I_HEVC, "still in trick play: mode %d, previous %d", Trick, intra);
+    VideoSetTrickIntra(intra);
+    CHECK(TrickIntra && Trick == TRICKMODE_I_HEVC, "mode %d after still, expected TRICKMODE_I_HEVC", Trick);
+    VideoSetTrickSpeed(&hw, 0, 1);
+    CHECK(Trick == TRICKMODE_NONE, "trick mode %d after play, expected TRICKMODE_NONE", Trick);
+    Trick = -1;
+    intra = VideoSetTrickIntra(1);
+    CHECK(!intra && TrickIntra && Trick == TRICKMODE_I_HEVC, "still in play: mode %d, previous %d", Trick,
+        intra);
+    VideoSetTrickIntra(intra);
+    CHECK(!TrickIntra && Trick == TRICKMODE_NONE, "mode %d after still, expected TRICKMODE_NONE", Trick);
+    printf("  %s\n", Failed == n ? "ok" : "FAILED");
+
+    // the wait ends with the shown frame, not at a poll interval
+    printf("still frame wait\n");
+    n = Failed;
+    {
+        uint64_t start;
+        int done;
+
+        start = Clock;
+        FrameAt = Clock + 37000;
+        done = amlTrickWait(500);
+        CHECK(done == 1 && Clock - start == 37000, "shown %d after %" PRIu64 " us, expected after 37000 us", done,
+            Clock - start);
+        start = Clock;
+        done = amlTrickWait(500);
+        CHECK(done == 0 && Clock - start == 500000, "no frame: %d after %" PRIu64 " us", done, Clock - start);
+        FrameAt = Clock;
+        CHECK(amlTrickWait(500) == 1 && FrameAt == Clock, "frame shown before the wait");
+        FrameAt = UINT64_MAX;
+        TrickStat = 0;
+        start = Clock;
+        CHECK(amlTrickWait(500) < 0 && Clock == start, "kernel without trick state");
+        TrickStat = 1;
+    }
+    printf("  %s\n", Failed == n ? "ok" : "FAILED");
+
+    printf("escaped slice header\n");
+    n = Failed;
+    {
+        AVPacket avpkt;
+
+        memset(&avpkt, 0, sizeof(avpkt));
+        avpkt.data = (uint8_t *) AvcEscI;
+        avpkt.size = sizeof(AvcEscI);
+        CHECK(VideoIsIntraPacket(Avc, &avpkt), "escaped I-slice is no I-frame");
+        avpkt.data = (uint8_t *) AvcEscP;
+        avpkt.size = sizeof(AvcEscP);
+        CHECK(!VideoIsIntraPacket(Avc, &avpkt), "escaped P-slice is an I-frame");
+    }
+    printf("  %s\n", Failed == n ? "ok" : "FAILED");
+
+    // 2x: the next I-frame 3.6 s of pts later is due after 1.8 s
+    printf("clear during wait\n");
+    n = Failed;
+    {
+        pthread_t thread;
+        struct timespec start;
+        struct timespec end;
+        long ms;
+
+        hw.Format = Avc;
+        videoFormat = Avc;
+        VideoSetTrickSpeed(&hw, 6, 1);
+        Feed(&decoder, AvcI, sizeof(AvcI), 0x10000);
+        RealWait = 1;
+        pthread_create(&thread, NULL, ClearThread, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        Feed(&decoder, AvcI, sizeof(AvcI), 0x10000 + 3600 * 90);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        pthread_join(thread, NULL);
+        RealWait = 0;
+        ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+        CHECK(ms < 1000, "wait interrupted after %ld ms", ms);
+        CHECK(Units == 1, "%d units written, the I-frame after the clear must be dropped", Units);
+
+        // the decoder thread flushes like CodecVideoFlushBuffers, then the
+        // I-frames are paced again
+        VideoTrickRearm();
+        isFirstVideoPacket = true;
+        Units = 0;
+        FeedGops(&decoder, 2, 12, 1);
+        CHECK(Units == 4 && Unit[2].Tick - Unit[0].Tick == 240000, "%d units after the flush", Units);
+        Units = 0;
+    }
+    printf("  %s\n", Failed == n ? "ok" : "FAILED");
+
+    return Failed ? 1 : 0;
+}
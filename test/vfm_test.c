@@ -0,0 +1,310 @@
+///
+/// @file vfm_test.c	@brief VFM map topology test
+///
+/// Copyright (c) 2026 by the softhdodroid contributors.
+///
+/// Contributor(s):
+///
+/// License: AGPLv3
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// $Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Points VFM_MAP_PATH to a map table in a temporary directory and
+/// commits the topologies of VideoInit, InternalOpen, InternalClose and
+/// VideoExit.  Writes to the table are recorded and applied like the
+/// kernel does, then the table is written back in the layout of the
+/// running kernel, so each commit reads the result of the last one.
+///
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define write VfmTestWrite
+#define usleep VfmTestSleep
+
+static ssize_t VfmTestWrite(int, const void *, size_t);
+static int VfmTestSleep(useconds_t);
+
+static char VfmPath[256];               ///< map table of the fixture
+
+#define VFM_MAP_PATH VfmPath
+
+#include "../video.c"
+
+#undef write
+#undef usleep
+
+#include "test.h"
+
+static VfmTopology Kernel;              ///< maps known to the fake kernel
+static int OldLayout;                   ///< write the "map[ 0]" layout
+static char Ops[1024];                  ///< commands written, "; " separated
+static const char *BusyId;              ///< map refusing a rm
+static int Busy;                        ///< number of refused rm
+static int Sleeps;                      ///< number of sleeps
+
+///
+/// Write the kernel maps to the table.
+///
+static void Store(void)
+{
+    FILE *f;
+
+    if (!(f = fopen(VfmPath, "w"))) {
+        perror(VfmPath);
+        exit(1);
+    }
+    for (int i = 0; i < Kernel.Count; ++i) {
+        const char *s = Kernel.Map[i].Chain;
+
+        fprintf(f, OldLayout ? "map[%2d] %s {" : "[%02d]  %s {", i, Kernel.Map[i].Id);
+        while (*s) {
+            int n = strcspn(s, " ");
+
+            if (OldLayout) {
+                fprintf(f, " %.*s", n, s);
+            } else {
+                fprintf(f, "%s%.*s%s", s == Kernel.Map[i].Chain ? " " : "", n, s, s[n] ? "(0) -> " : "");
+            }
+            s += n + !!s[n];
+        }
+        fprintf(f, "}\n");
+    }
+    fclose(f);
+}
+
+///
+/// Set the maps of the fake kernel.
+///
+/// @param maps	id and chain pairs, NULL terminated
+///
+static void Load(const char *const *maps)
+{
+    VfmBegin(&Kernel);
+    for (; *maps; maps += 2) {
+        VfmWant(&Kernel, maps[0], maps[1]);
+    }
+    Store();
+    Ops[0] = '\0';
+}
+
+///
+/// Record and apply a command written to the table.
+///
+static ssize_t VfmTestWrite(int fd, const void *buf, size_t count)
+{
+    struct stat a;
+    struct stat b;
+    char cmd[256];
+    int i;
+
+    if (fstat(fd, &a) || stat(VfmPath, &b) || a.st_ino != b.st_ino) {
+        return write(fd, buf, count);
+    }
+    snprintf(cmd, sizeof(cmd), "%.*s", (int)count, (const char *)buf);
+    if (!strncmp(cmd, "rm ", 3)) {
+        if (BusyId && !strcmp(cmd + 3, BusyId) && Busy) {
+            Busy--;
+            errno = EBUSY;
+            return -1;
+        }
+        for (i = 0; i < Kernel.Count && strcmp(Kernel.Map[i].Id, cmd + 3); ++i) {
+        }
+        if (i == Kernel.Count) {
+            errno = EINVAL;
+            return -1;
+        }
+        Kernel.Map[i] = Kernel.Map[--Kernel.Count];
+    } else if (!strncmp(cmd, "add ", 4)) {
+        char *id = cmd + 4;
+        char *chain = strchr(id, ' ');
+
+        if (!chain) {
+            errno = EINVAL;
+            return -1;
+        }
+        *chain++ = '\0';
+        if (VfmFind(&Kernel, id)) {
+            errno = EEXIST;             // the kernel refuses a second map
+            return -1;
+        }
+        VfmWant(&Kernel, id, chain);
+        chain[-1] = ' ';
+    }
+    snprintf(Ops + strlen(Ops), sizeof(Ops) - strlen(Ops), "%s%s", Ops[0] ? "; " : "", cmd);
+    Store();
+    return count;
+}
+
+static int VfmTestSleep(useconds_t us)
+{
+    (void)us;
+    Sleeps++;
+    return 0;
+}
+
+///
+/// Commit a topology and check the written commands.
+///
+/// @param name	name of the step
+/// @param maps	wanted id and chain pairs, chain NULL for absent
+/// @param exclusive	remove maps not listed
+/// @param ops	expected commands
+///
+static void Step(const char *name, const char *const *maps, int exclusive, const char *ops)
+{
+    VfmTopology topo;
+    int failed = Failed;
+    int n;
+
+    printf("%s\n", name);
+    VfmBegin(&topo);
+    for (; *maps; maps += 2) {
+        VfmWant(&topo, maps[0], maps[1]);
+    }
+    Ops[0] = '\0';
+    n = VfmCommit(&topo, exclusive);
+    CHECK(!n, "%d commands failed", n);
+    CHECK(!strcmp(Ops, ops), "wrote '%s'\n  expected '%s'", Ops, ops);
+
+    // the result is stable, a second commit writes nothing
+    Ops[0] = '\0';
+    VfmCommit(&topo, exclusive);
+    CHECK(!Ops[0], "second commit wrote '%s'", Ops);
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+}
+
+/// maps after boot of an odroid kernel
+static const char *const Boot[] = {
+    "default", "decoder(0) -> ppmgr(0) -> deinterlace(0) -> amvideo",
+    "default_amlvideo2", "vdin1 amlvideo2.1",
+    "dvblpath", "dvbldec amvideo",
+    "dvelpath", "dveldec dvel",
+    "dvhdmiin", "dv_vdin(active) -> amvideo",
+    "vdec-map-0", "vdec.h264.00 amvideo",
+    NULL
+};
+
+/// VideoInit
+static const char *const Init[] = {
+    "default", "decoder ppmgr deinterlace amvideo",
+    "default_amlvideo2", "vdin1 amlvideo2.1",
+    "dvblpath", "dvbldec amvideo",
+    "dvelpath", "dveldec dvel",
+    "dvhdmiin", "dv_vdin amvideo",
+    NULL
+};
+
+/// InternalOpen of the main decoder
+static const char *const OpenAvc[] = {
+    "vdec-map-0", NULL,
+    "pip0", "vdec.h264.00 ppmgr deinterlace amvideo",
+    NULL
+};
+static const char *const OpenHevc[] = {
+    "vdec-map-0", NULL,
+    "pip0", "vdec.h265.00 ppmgr deinterlace amvideo",
+    NULL
+};
+
+/// InternalOpen and InternalClose of the pip decoder
+static const char *const OpenPip[] = { "pip1", "vdec.h264.01 videopip", NULL };
+static const char *const ClosePip[] = { "pip1", NULL, "vdec-map-1", NULL, NULL };
+
+/// InternalClose of the main decoder
+static const char *const Close[] = { "pip0", NULL, NULL };
+
+/// VideoExit on kernel 4
+static const char *const Exit[] = {
+    "default", "decoder amvideo",
+    "default_amlvideo2", "vdin1 amlvideo2.1",
+    NULL
+};
+
+int main(void)
+{
+    char dir[] = "/tmp/vfm_testXXXXXX";
+    VfmTopology topo;
+    int failed;
+    int n;
+
+    if (!mkdtemp(dir)) {
+        perror(dir);
+        return 1;
+    }
+    snprintf(VfmPath, sizeof(VfmPath), "%s/map", dir);
+
+    printf("parse\n");
+    Load(Boot);
+    VfmRead(&topo);
+    CHECK(topo.Count == 6, "%d maps read, expected 6", topo.Count);
+    CHECK(VfmFind(&topo, "default") && !strcmp(VfmFind(&topo, "default")->Chain,
+            "decoder ppmgr deinterlace amvideo"), "default not parsed");
+    CHECK(VfmFind(&topo, "dvhdmiin") && !strcmp(VfmFind(&topo, "dvhdmiin")->Chain, "dv_vdin amvideo"),
+        "active suffix not dropped");
+    OldLayout = 1;
+    Store();
+    VfmRead(&topo);
+    CHECK(topo.Count == 6 && VfmFind(&topo, "vdec-map-0")
+        && !strcmp(VfmFind(&topo, "vdec-map-0")->Chain, "vdec.h264.00 amvideo"), "old layout not parsed");
+    OldLayout = 0;
+    printf("  %s\n", Failed ? "FAILED" : "ok");
+
+    // only the difference to the boot state is written
+    Load(Boot);
+    Step("init", Init, 1, "rm vdec-map-0");
+    Step("open h264", OpenAvc, 0, "add pip0 vdec.h264.00 ppmgr deinterlace amvideo");
+    Step("open pip", OpenPip, 0, "add pip1 vdec.h264.01 videopip");
+    Step("close pip", ClosePip, 0, "rm pip1");
+    Step("open hevc", OpenHevc, 0, "rm pip0; add pip0 vdec.h265.00 ppmgr deinterlace amvideo");
+    Step("close", Close, 0, "rm pip0");
+    Step("exit", Exit, 1, "rm default; rm dvblpath; rm dvelpath; rm dvhdmiin; add default decoder amvideo");
+
+    // a restart on a kernel with the old layout
+    OldLayout = 1;
+    Load(Boot);
+    Step("old layout init", Init, 1, "rm vdec-map-0");
+    OldLayout = 0;
+
+    // a busy map is polled until it is released
+    Load(Init);
+    Step("open", OpenAvc, 0, "add pip0 vdec.h264.00 ppmgr deinterlace amvideo");
+    BusyId = "pip0";
+    Busy = 3;
+    Sleeps = 0;
+    Step("busy close", Close, 0, "rm pip0");
+    CHECK(Sleeps == 3, "%d sleeps, expected 3", Sleeps);
+
+    // a map that stays busy gives up after VFM_BUSY_RETRY
+    Load(Init);
+    Step("open", OpenAvc, 0, "add pip0 vdec.h264.00 ppmgr deinterlace amvideo");
+    printf("stays busy\n");
+    failed = Failed;
+    Busy = 1000;
+    Sleeps = 0;
+    VfmBegin(&topo);
+    VfmWant(&topo, "pip0", NULL);
+    n = VfmCommit(&topo, 0);
+    CHECK(n == 1 && Sleeps == VFM_BUSY_RETRY, "%d failed after %d sleeps", n, Sleeps);
+    CHECK(VfmFind(&Kernel, "pip0"), "busy map removed");
+    BusyId = NULL;
+    printf("  %s\n", Failed == failed ? "ok" : "FAILED");
+
+    unlink(VfmPath);
+    rmdir(dir);
+    return Failed ? 1 : 0;
+}
@@ -0,0 +1,259 @@
+//----------------------------------------------------------------------------
+//  VFM pipeline topology
+//----------------------------------------------------------------------------
+
+///
+/// The video frame manager graph in /sys/class/vfm/map is described as
+/// a list of wanted maps.  VfmCommit reads the current graph once, and
+/// writes only the rm/add commands needed to reach the wanted state
+/// through a single file descriptor.
+///
+
+#ifndef VFM_MAP_PATH
+#define VFM_MAP_PATH "/sys/class/vfm/map"
+#endif
+
+#define VFM_MAPS_MAX 32				///< max. maps in a topology
+#define VFM_ID_MAX 32				///< max. length of a map id
+#define VFM_CHAIN_MAX 160			///< max. length of a receiver chain
+#define VFM_READ_MAX 4096			///< max. size of the sysfs map table
+#define VFM_BUSY_RETRY 100			///< retries of a busy rm, 10ms each
+
+typedef struct _vfm_map_ {
+    char Id[VFM_ID_MAX];			///< map name, "default", "pip0", ...
+    char Chain[VFM_CHAIN_MAX];		///< space separated chain, "" = absent
+} VfmMap;
+
+typedef struct _vfm_topology_ {
+    int Count;						///< number of maps
+    VfmMap Map[VFM_MAPS_MAX];		///< maps
+} VfmTopology;
+
+///
+/// Copy a chain with single spaces between the names.
+///
+/// Names from the sysfs table may carry an "(active)" suffix and are
+/// joined with "->", both are dropped.
+///
+static void VfmNormalize(char *dst, const char *src, const char *end)
+{
+    char *d = dst;
+    char *e = dst + VFM_CHAIN_MAX - 1;
+
+    while (src < end && *src) {
+        const char *s;
+        const char *n;
+
+        while (src < end && (*src == ' ' || *src == '\t')) {
+            src++;
+        }
+        s = src;
+        while (src < end && *src && *src != ' ' && *src != '\t') {
+            src++;
+        }
+        if (src == s || (src - s == 2 && s[0] == '-' && s[1] == '>')) {
+            continue;
+        }
+        for (n = s; n < src && *n != '('; n++) ;
+        if (d != dst && d < e) {
+            *d++ = ' ';
+        }
+        while (s < n && d < e) {
+            *d++ = *s++;
+        }
+    }
+    *d = '\0';
+}
+
+///
+/// Find a map in a topology.
+///
+static VfmMap *VfmFind(VfmTopology * topo, const char *id)
+{
+    int i;
+
+    for (i = 0; i < topo->Count; i++) {
+        if (!strcmp(topo->Map[i].Id, id)) {
+            return &topo->Map[i];
+        }
+    }
+    return NULL;
+}
+
+///
+/// Start an empty topology.
+///
+static void VfmBegin(VfmTopology * topo)
+{
+    topo->Count = 0;
+}
+
+///
+/// Want a map with the given receiver chain, or absent for NULL.
+///
+static void VfmWant(VfmTopology * topo, const char *id, const char *chain)
+{
+    VfmMap *map;
+
+    if (!(map = VfmFind(topo, id))) {
+        if (topo->Count >= VFM_MAPS_MAX) {
+            Debug(3, "vfm: too many maps, %s ignored\n", id);
+            return;
+        }
+        map = &topo->Map[topo->Count++];
+        snprintf(map->Id, sizeof(map->Id), "%s", id);
+    }
+    if (chain) {
+        VfmNormalize(map->Chain, chain, chain + strlen(chain));
+    } else {
+        map->Chain[0] = '\0';
+    }
+}
+
+///
+/// Parse the sysfs map table.
+///
+/// Accepts "[00]  default { decoder(1) -> ppmgr(0) -> amvideo}" and the
+/// older "map[ 0] default { decoder ppmgr amvideo}".
+///
+static void VfmParse(VfmTopology * topo, const char *buf)
+{
+    const char *line;
+
+    VfmBegin(topo);
+    for (line = buf; *line; ) {
+        const char *eol;
+        const char *open;
+        const char *close;
+        const char *id;
+        const char *e;
+        VfmMap *map;
+
+        if (!(eol = strchr(line, '\n'))) {
+            eol = line + strlen(line);
+        }
+        open = memchr(line, '{', eol - line);
+        close = open ? memchr(open, '}', eol - open) : NULL;
+        if (open && close && topo->Count < VFM_MAPS_MAX) {
+            for (e = open; e > line && e[-1] == ' '; e--) ;
+            for (id = e; id > line && id[-1] != ' ' && id[-1] != ']'; id--) ;
+            if (e > id && e - id < VFM_ID_MAX) {
+                map = &topo->Map[topo->Count++];
+                memcpy(map->Id, id, e - id);
+                map->Id[e - id] = '\0';
+                VfmNormalize(map->Chain, open + 1, close);
+            }
+        }
+        line = *eol ? eol + 1 : eol;
+    }
+}
+
+///
+/// Read the current topology from sysfs.
+///
+static int VfmRead(VfmTopology * topo)
+{
+    char buf[VFM_READ_MAX];
+    int fd;
+    int n;
+    int len;
+
+    VfmBegin(topo);
+    if ((fd = open(VFM_MAP_PATH, O_RDONLY)) < 0) {
+        return -1;
+    }
+    len = 0;
+    while (len < (int)sizeof(buf) - 1 && (n = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0) {
+        len += n;
+    }
+    close(fd);
+    buf[len] = '\0';
+    VfmParse(topo, buf);
+    return 0;
+}
+
+///
+/// Write one map command, retrying a rm while the map is busy.
+///
+static int VfmWrite(int fd, const char *cmd)
+{
+    int retry;
+
+    for (retry = 0;; retry++) {
+        lseek(fd, 0, SEEK_SET);
+        if (write(fd, cmd, strlen(cmd)) >= 0) {
+            Debug(4, "vfm: %s\n", cmd);
+            return 0;
+        }
+        if (errno != EBUSY || strncmp(cmd, "rm ", 3) || retry >= VFM_BUSY_RETRY) {
+            break;
+        }
+        usleep(10 * 1000);
+    }
+    Debug(3, "vfm: '%s' failed: %s\n", cmd, strerror(errno));
+    return -1;
+}
+
+///
+/// Bring /sys/class/vfm/map to the wanted topology.
+///
+/// @param want			wanted maps, an empty chain removes the map
+/// @param exclusive	remove all maps not listed in want
+///
+/// @returns number of failed commands
+///
+static int VfmCommit(const VfmTopology * want, int exclusive)
+{
+    VfmTopology cur;
+    char cmd[VFM_ID_MAX + VFM_CHAIN_MAX + 8];
+    int failed;
+    int fd;
+    int i;
+
+    VfmRead(&cur);
+
+    fd = -1;
+    failed = 0;
+    // removals first, a changed map is re-added below
+    for (i = 0; i < cur.Count; i++) {
+        const VfmMap *w;
+        int j;
+
+        w = NULL;
+        for (j = 0; j < want->Count; j++) {
+            if (!strcmp(want->Map[j].Id, cur.Map[i].Id)) {
+                w = &want->Map[j];
+                break;
+            }
+        }
+        if (w ? !strcmp(w->Chain, cur.Map[i].Chain) : !exclusive) {
+            continue;
+        }
+        if (fd < 0 && (fd = open(VFM_MAP_PATH, O_WRONLY)) < 0) {
+            return want->Count + cur.Count;
+        }
+        snprintf(cmd, sizeof(cmd), "rm %s", cur.Map[i].Id);
+        failed += VfmWrite(fd, cmd) < 0;
+        cur.Map[i].Chain[0] = '\0';
+    }
+    for (i = 0; i < want->Count; i++) {
+        const VfmMap *c;
+
+        if (!want->Map[i].Chain[0]) {
+            continue;
+        }
+        c = VfmFind(&cur, want->Map[i].Id);
+        if (c && !strcmp(c->Chain, want->Map[i].Chain)) {
+            continue;
+        }
+        if (fd < 0 && (fd = open(VFM_MAP_PATH, O_WRONLY)) < 0) {
+            return want->Count;
+        }
+        snprintf(cmd, sizeof(cmd), "add %s %s", want->Map[i].Id, want->Map[i].Chain);
+        failed += VfmWrite(fd, cmd) < 0;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return failed;
+}
@@ -39,6 +39,8 @@
 #include <signal.h>
 #include <linux/kd.h>
 #include <ctype.h>
+#include <limits.h>
+#include <poll.h>
 
 #include "codec_type.h"
 #include "amports/amstream.h"
@@ -68,6 +70,7 @@ enum {
 #include "codec.h"
 #include "audio.h"
 #include "misc.h"
+#include "softhddev.h"
 
 extern uint64_t AudioGetClock(void);
 extern uint64_t GetCurrentVPts(int);
@@ -112,7 +115,6 @@ static int VideoCutLeftRight[VideoResolutionMax];
 
 
 char MyConfigDir[200];
-int locale_dot=0;
 
 int myKernel,myMajor,myMinor;			/// Kernel Version
 int dovi;								/// Supports Dolby Vision
@@ -141,6 +143,8 @@ extern int ConfigVideoFastSwitch;
 extern int ConfigVideoBrightness;
 extern int ConfigVideoContrast;
 extern int ConfigVideoBlackPicture;
+extern int ConfigVideoWarmReuse;
+extern int ConfigVideoAutoRefresh;
 
 enum ApiLevel
 {
@@ -212,6 +216,37 @@ int pip_ratio;
 int ratio_checked = 0;
 int CurrentSyncThresh;
 
+/// Warm decoder reuse on channel switch
+#define SWITCH_COLD 0					///< switch with close/open of the decoder
+#define SWITCH_WARM 1					///< switch with reset of the open decoder
+#define SWITCH_HIST_MAX 8				///< number of switch time buckets
+#define SWITCH_PARK_MAX 1000			///< ms a parked decoder waits for a stream
+
+/// upper bounds in ms of the switch time buckets, last bucket is open
+static const int SwitchHistLimit[SWITCH_HIST_MAX - 1] = { 50, 100, 200, 400, 800, 1600, 3200 };
+static int SwitchHist[2][SWITCH_HIST_MAX];	///< switch time histogram cold/warm
+static uint32_t SwitchStart;			///< ms tick of the pending switch
+static int SwitchMode;					///< mode of the pending switch
+static int WarmParked;					///< flag decoder parked for reuse
+static int WarmResolution;				///< resolution class of parked decoder
+
+/// I-frame only trick play
+#define TRICK_SPEED_MULT 12				///< vdr speed multiplier, speed 1 = 12x
+#define TRICK_RATE_MAX 64				///< max. supported trick rate
+#define TRICK_MIN_US 20000				///< min. time an I-frame is shown
+#define TRICK_MAX_US 2000000			///< max. wait, larger gaps re-anchor
+
+static int TrickIntra;					///< flag I-frame only trick mode
+static int TrickPassing;				///< flag forward continuation packets
+static int64_t TrickAnchorPTS;			///< pts of the pacing anchor
+static uint64_t TrickAnchorTick;		///< us tick of the pacing anchor
+static uint64_t TrickShownTick;			///< us tick of the last pushed I-frame
+static unsigned TrickPushed;			///< I-frames pushed in trick mode
+static unsigned TrickDropped;			///< packets dropped in trick mode
+static pthread_mutex_t TrickMutex = PTHREAD_MUTEX_INITIALIZER;	///< trick wait lock
+static pthread_cond_t TrickCond;		///< trick wait wakeup, monotonic clock
+static int TrickCancel;					///< flag clear or close pending, don't wait
+
 AVRational timeBase;
 
 int handle,cntl_handle,fd,DmaBufferHandle;
@@ -411,12 +446,107 @@ void VideoSetClosing(VideoHwDecoder *decoder) {
 	 decoder->Closing = 1;
 };
 
+/// Switch the I-frame only trick mode of the decoder.
+///
+/// The mode is always written, this also resets the frame done state.
+///
+/// @param intra	feed I-frames only
+///
+/// @returns the previous mode, for the caller to restore it
+///
+int VideoSetTrickIntra(int intra)
+{
+	int prev;
+
+	prev = TrickIntra;
+	amlTrickMode(intra ? (videoFormat == Hevc ? TRICKMODE_I_HEVC : TRICKMODE_I) : TRICKMODE_NONE);
+	TrickIntra = intra;
+	return prev;
+}
+
+///
+/// Setup the trick play wait.
+///
+static void VideoTrickInit(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&TrickCond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+///
+/// Interrupt the trick play wait of the decoder thread.
+///
+/// Called before a clear or close of the stream, the decoder thread
+/// waits again after it has flushed or reopened the decoder.
+///
+void VideoTrickWakeup(void)
+{
+	pthread_mutex_lock(&TrickMutex);
+	TrickCancel = 1;
+	pthread_cond_broadcast(&TrickCond);
+	pthread_mutex_unlock(&TrickMutex);
+}
+
+///
+/// Allow the trick play wait again, the pending clear or close is done.
+///
+static void VideoTrickRearm(void)
+{
+	pthread_mutex_lock(&TrickMutex);
+	TrickCancel = 0;
+	pthread_mutex_unlock(&TrickMutex);
+}
+
+///
+/// Wait until an I-frame is due.
+///
+/// @param due	us tick (CLOCK_MONOTONIC) the I-frame is due
+///
+/// @returns 0 if due, -1 if interrupted by VideoTrickWakeup.
+///
+static int VideoTrickWait(uint64_t due)
+{
+	struct timespec abstime;
+	int ret;
+
+	abstime.tv_sec = due / 1000000;
+	abstime.tv_nsec = due % 1000000 * 1000;
+	ret = 0;
+	pthread_mutex_lock(&TrickMutex);
+	while (!TrickCancel && !ret) {
+		ret = pthread_cond_timedwait(&TrickCond, &TrickMutex, &abstime);
+	}
+	ret = TrickCancel ? -1 : 0;
+	pthread_mutex_unlock(&TrickMutex);
+	return ret;
+}
+
 /// Set trick play speed.
 void VideoSetTrickSpeed(VideoHwDecoder *decoder, int speed, int forward) {
 
+	int intra;
+
 	Debug(3,"set trickspeed to %d\n",speed);
 	decoder->TrickSpeed = speed;
 	decoder->Forward = forward;
+
+	// fast forward and all reverse speeds are fed with I-frames only
+	intra = !decoder->pip && speed && (!forward || speed == 1 || speed == 3 || speed == 6);
+	if (intra != TrickIntra) {
+		if (TrickIntra) {
+			Debug(3,"trick: leave I-frame mode, %u pushed %u dropped\n",TrickPushed,TrickDropped);
+		}
+		VideoSetTrickIntra(intra);
+		TrickPushed = 0;
+		TrickDropped = 0;
+	}
+	TrickAnchorPTS = AV_NOPTS_VALUE;
+	TrickPassing = 0;
+
 	if (speed) {
 		amlFreerun(1);
 		myTrickSpeed=1;
@@ -427,175 +557,405 @@ void VideoSetTrickSpeed(VideoHwDecoder *decoder, int speed, int forward) {
 	}
 };
 
-void dot_to_comma(char *input) {
-   char *ptr = NULL;
-	if (locale_dot)
-		return;
-   while ((ptr = strpbrk(input, "."))) { //find the first dot in input
-        *ptr = ','; //replace the dot with a comma
-    }
-}
+//----------------------------------------------------------------------------
+//	3D LUT
+//----------------------------------------------------------------------------
+
+#define LUT_GRID 17						///< grid size of the amvecm 3D LUT
+#define LUT_MAX_SIZE 65					///< max. grid size of .cube files
+#define LUT_MAX_EXP 40					///< max. decimal exponent of .cube values
+#define LUT_CACHE_MAGIC 0x4C445348		///< "SHDL" magic of the cache file
+#define LUT_CACHE_VERSION 1				///< version of the cache file
 
-static inline bool isnumeric(char c)
+///
+///	Binary LUT cache header.
+///
+struct lut_cache_header
 {
-    return (c >= '0' && c <= '9') || c == '-';
+	uint32_t Magic;						///< LUT_CACHE_MAGIC
+	uint32_t Version;					///< LUT_CACHE_VERSION
+	uint64_t Hash;						///< FNV-1a hash of the .cube file
+	uint32_t Grid;						///< grid size of the data
+	uint32_t Reserved;
+};
+
+///
+///	FNV-1a 64 bit hash.
+///
+static uint64_t LutHash(const char *data, size_t len)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	while (len--) {
+		hash ^= (unsigned char)*data++;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
 }
 
-void check_locale() {
-	float test = 5.0;
-	char t[20];
-	sprintf(t,"%f",test);
-	if (strpbrk(t, ".")) {
-	   locale_dot = 1;
+///
+///	Skip white space and comments of a .cube file.
+///
+static const char *LutSkip(const char *p, const char *end)
+{
+	while (p < end) {
+		if (*p == '#') {
+			while (p < end && *p != '\n') {
+				p++;
+			}
+		} else if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+			p++;
+		} else {
+			break;
+		}
 	}
-	//printf("Test >%s< %d\n",t,locale_dot);
+	return p;
 }
 
-float *lut_parse_cube(FILE *fp, int *size) {
+///
+///	Parse a float independent of the locale.
+///
+///	@param[in,out] pp	parse position
+///	@param end		end of data
+///	@param[out] value	parsed value
+///
+///	@returns 0 on success, -1 if no number
+///
+static int LutParseFloat(const char **pp, const char *end, float *value)
+{
+	const char *p = *pp;
+	double v = 0.0;
+	double scale = 1.0;
+	int neg = 0;
+	int digits = 0;
+
+	if (p < end && (*p == '-' || *p == '+')) {
+		neg = *p++ == '-';
+	}
+	while (p < end && *p >= '0' && *p <= '9') {
+		v = v * 10.0 + (*p++ - '0');
+		digits++;
+	}
+	if (p < end && (*p == '.' || *p == ',')) {
+		p++;
+		while (p < end && *p >= '0' && *p <= '9') {
+			scale *= 0.1;
+			v += (*p++ - '0') * scale;
+			digits++;
+		}
+	}
+	if (!digits) {
+		return -1;
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		int e = 0;
+		int eneg = 0;
 
-	char * line = NULL;
-    size_t len = 0;
-    ssize_t read;
-	int cube_size,lines;
-	float minr,ming,minb,maxr,maxg,maxb,r,g,b,*data,*ptr;
+		p++;
+		if (p < end && (*p == '-' || *p == '+')) {
+			eneg = *p++ == '-';
+		}
+		while (p < end && *p >= '0' && *p <= '9') {
+			e = e * 10 + (*p++ - '0');
+			if (e > LUT_MAX_EXP) {			// float is 0 or inf beyond
+				e = LUT_MAX_EXP;
+			}
+		}
+		while (e--) {
+			v = eneg ? v * 0.1 : v * 10.0;
+		}
+	}
+	*value = neg ? -v : v;
+	*pp = p;
+	return 0;
+}
 
-    while ((read = getline(&line, &len, fp)) != -1) {
+///
+///	Parse a .cube file.
+///
+///	Values are normalized with DOMAIN_MIN/MAX, red runs fastest.
+///
+///	@param data	file contents
+///	@param len	length of file contents
+///	@param[out] size	grid size of the cube
+///
+///	@returns malloc'ed rgb float table or NULL on error
+///
+static float *lut_parse_cube(const char *data, size_t len, int *size)
+{
+	const char *p = data;
+	const char *end = data + len;
+	float min[3] = { 0.0, 0.0, 0.0 };
+	float max[3] = { 1.0, 1.0, 1.0 };
+	int cube_size = 0;
+	float *lut;
+	int n;
 
-		if (line[0] == '#' || len == 0) {
-			continue;
+	// header keywords
+	for (;;) {
+		p = LutSkip(p, end);
+		if (p >= end) {
+			return NULL;
 		}
-		if (strstr(line,"LUT_3D_SIZE")) {
-			sscanf(line,"LUT_3D_SIZE %d",&cube_size);
-			printf("Cubesize %d\n",cube_size);
-			if (cube_size > 64)
+		if ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.') {
+			break;
+		}
+		if (end - p > 11 && !strncmp(p, "LUT_3D_SIZE", 11)) {
+			p = LutSkip(p + 11, end);
+			cube_size = 0;
+			while (p < end && *p >= '0' && *p <= '9') {
+				if (cube_size <= LUT_MAX_SIZE) {
+					cube_size = cube_size * 10 + (*p - '0');
+				}
+				p++;
+			}
+		} else if (end - p > 10 && (!strncmp(p, "DOMAIN_MIN", 10) || !strncmp(p, "DOMAIN_MAX", 10))) {
+			float *v = p[8] == 'I' ? min : max;
+
+			p += 10;
+			for (int i = 0; i < 3; i++) {
+				p = LutSkip(p, end);
+				if (LutParseFloat(&p, end, &v[i])) {
+					return NULL;
+				}
+			}
+		} else {						// TITLE, LUT_1D_SIZE, ...
+			if (end - p > 11 && !strncmp(p, "LUT_1D_SIZE", 11)) {
 				return NULL;
+			}
+			while (p < end && *p != '\n') {
+				p++;
+			}
 		}
-
-		if (strstr(line,"DOMAIN_MIN")) {
-			dot_to_comma(line);
-			sscanf(line,"DOMAIN_MIN %f %f %f",&minr,&ming,&minb);
-			printf("DOMAIN_MIN %f %f %f\n",minr,ming,minb);
+	}
+	Debug(3, "LUT: cube size %d domain %f-%f\n", cube_size, min[0], max[0]);
+	if (cube_size < 2 || cube_size > LUT_MAX_SIZE) {
+		return NULL;
+	}
+	for (int i = 0; i < 3; i++) {
+		if (max[i] <= min[i]) {
+			return NULL;
 		}
+	}
 
-		if (strstr(line,"DOMAIN_MAX")) {
-			dot_to_comma(line);
-			sscanf(line,"DOMAIN_MAX %f %f %f",&maxr,&maxg,&maxb);
-			printf("DOMAIN_MAX %f %f %f\n",maxr,maxg,maxb);
+	n = cube_size * cube_size * cube_size * 3;
+	if (!(lut = malloc(sizeof(float) * n))) {
+		return NULL;
+	}
+	for (int i = 0; i < n; i++) {
+		p = LutSkip(p, end);
+		if (LutParseFloat(&p, end, &lut[i])) {
+			Debug(3, "LUT: only %d of %d values\n", i, n);
+			free(lut);
+			return NULL;
 		}
+		lut[i] = (lut[i] - min[i % 3]) / (max[i % 3] - min[i % 3]);
+	}
+	*size = cube_size;
+	return lut;
+}
 
-		if (strstr(line,"TITLE")) {
-			continue;
+///
+///	Resample a cube to the 17x17x17 amvecm grid.
+///
+///	Uses trilinear interpolation, output is 12 bit, red runs fastest.
+///
+///	@param lut	rgb float table
+///	@param size	grid size of lut
+///
+///	@returns malloc'ed table with LUT_GRID^3 rgb entries
+///
+static unsigned int *convert_to_17(const float *lut, int size)
+{
+	unsigned int *lut17;
+	int idx[LUT_GRID][2];				// lower/upper source index per grid point
+	float frac[LUT_GRID];				// weight of the upper index
+
+	if (!(lut17 = malloc(sizeof(int) * LUT_GRID * LUT_GRID * LUT_GRID * 3))) {
+		return NULL;
+	}
+	for (int i = 0; i < LUT_GRID; i++) {
+		float pos = (float)i * (size - 1) / (LUT_GRID - 1);
+
+		idx[i][0] = (int)pos;
+		if (idx[i][0] >= size - 1) {
+			idx[i][0] = size - 2;
 		}
+		idx[i][1] = idx[i][0] + 1;
+		frac[i] = pos - idx[i][0];
+	}
 
-		if (isnumeric(line[0])) {
-			break;
+	for (int b = 0; b < LUT_GRID; b++) {
+		for (int g = 0; g < LUT_GRID; g++) {
+			for (int r = 0; r < LUT_GRID; r++) {
+				unsigned int *dst = &lut17[((b * LUT_GRID + g) * LUT_GRID + r) * 3];
+				float fr = frac[r];
+				float fg = frac[g];
+				float fb = frac[b];
+
+				for (int c = 0; c < 3; c++) {
+					float v = 0.0;
+
+					for (int k = 0; k < 8; k++) {
+						int ir = idx[r][k & 1];
+						int ig = idx[g][(k >> 1) & 1];
+						int ib = idx[b][k >> 2];
+						float w = (k & 1 ? fr : 1.0 - fr) * (k & 2 ? fg : 1.0 - fg) * (k & 4 ? fb : 1.0 - fb);
+
+						v += w * lut[((ib * size + ig) * size + ir) * 3 + c];
+					}
+					v = v * 4095.0 + 0.5;
+					dst[c] = v < 0.0 ? 0 : v > 4095.0 ? 4095 : (unsigned int)v;
+				}
+			}
 		}
 	}
+	return lut17;
+}
 
-	lines = cube_size * cube_size * cube_size;
-	*size = cube_size;
+///
+///	Read the resampled LUT from the cache.
+///
+///	@returns malloc'ed table or NULL if the cache doesn't match
+///
+static unsigned int *LutCacheRead(const char *name, uint64_t hash)
+{
+	struct lut_cache_header header;
+	unsigned int *lut17;
+	size_t n = LUT_GRID * LUT_GRID * LUT_GRID * 3;
+	FILE *f;
 
-	ptr = data = malloc(sizeof(float) * lines * 3);
-
-	do {
-		dot_to_comma(line);
-		sscanf(line,"%f %f %f",&r,&g,&b);
-		*data++ = r;
-		*data++ = g;
-		*data++ = b;
-		//printf("Got %s %d\n",line,lines);
-	}  while ((read = getline(&line, &len, fp)) != -1 && --lines);
-
-   if (line)
-      free(line);
-	return ptr;
-}
-
-unsigned int  *convert_to_17(float *lut, int size ) {
-	unsigned int *lut17 = malloc(sizeof(int) * 17 * 17 * 17 * 3);
-	float faktor = (float)size / 17.0;
-	float maxw = 4095.0;
-	for (int b = 0; b < 17; b++) {
-        for (int g = 0; g < 17; g++) {
-            for (int r = 0; r < 17; r++) {
-                size_t offset = b * 289 + g * 17 + r;
-				size_t offset1 = (b * 17.0 * faktor +  g * faktor) * 17.0 + r * faktor;
-
-                const float *src = &lut[offset1 * 3];
-                unsigned int *dst = &lut17[offset * 3];
-                dst[0] = (uint)(src[0] * maxw);
-                dst[1] = (uint)(src[1] * maxw);
-                dst[2] = (uint)(src[2] * maxw);
-				if( b == 0 && g == 0)
-				  printf("Offset %zu Offset1 %zu - %d %d %d\n",offset,offset1,dst[0],dst[1],dst[2]);
-            }
-        }
-    }
+	if (!(f = fopen(name, "rb"))) {
+		return NULL;
+	}
+	lut17 = NULL;
+	if (fread(&header, sizeof(header), 1, f) == 1 && header.Magic == LUT_CACHE_MAGIC
+		&& header.Version == LUT_CACHE_VERSION && header.Hash == hash && header.Grid == LUT_GRID
+		&& (lut17 = malloc(sizeof(int) * n)) && fread(lut17, sizeof(int), n, f) != n) {
+		free(lut17);
+		lut17 = NULL;
+	}
+	fclose(f);
 	return lut17;
 }
 
+///
+///	Write the resampled LUT to the cache.
+///
+static void LutCacheWrite(const char *name, uint64_t hash, const unsigned int *lut17)
+{
+	struct lut_cache_header header = { LUT_CACHE_MAGIC, LUT_CACHE_VERSION, hash, LUT_GRID, 0 };
+	size_t n = LUT_GRID * LUT_GRID * LUT_GRID * 3;
+	char tmp[PATH_MAX];
+	FILE *f;
+
+	// write a temporary file, an aborted write never leaves a bad cache
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", name) >= (int)sizeof(tmp)) {
+		return;
+	}
+	if (!(f = fopen(tmp, "wb"))) {
+		Debug(3, "LUT: can't write cache %s\n", tmp);
+		return;
+	}
+	if (fwrite(&header, sizeof(header), 1, f) != 1 || fwrite(lut17, sizeof(int), n, f) != n) {
+		fclose(f);
+		unlink(tmp);
+		return;
+	}
+	fclose(f);
+	rename(tmp, name);
+}
+
 #define _VE_CM  'C'
 #define AMVECM_IOC_SET_3D_LUT  _IO(_VE_CM, 0x6d)
 #define AMVECM_IOC_LOAD_3D_LUT  _IO(_VE_CM, 0x6e)
 #define AMVECM_IOC_SET_3D_LUT_ORDER  _IO(_VE_CM, 0x6f)
 
+///
+///	Load the 3D LUT from the config directory.
+///
+///	The .cube file is only hashed, the resampled table comes from the
+///	cache next to it if the hash matches.
+///
 void Load_Lut() {
 
 	FILE *lutf;
-    char tmp[200];
-	float *lut=NULL;
-	unsigned int *lut17=NULL;
+	char tmp[sizeof(MyConfigDir) + 16];
+	char cache[sizeof(tmp) + 4];
+	char *data;
+	long len;
+	float *lut;
+	unsigned int *lut17;
+	uint64_t hash;
 	int size;
+	int cached;
+	uint32_t tick;
 	char *lut_file = "lut/lut.cube";
 
+	snprintf(tmp, sizeof(tmp), "%s/%s", MyConfigDir, lut_file);
+	if (!(lutf = fopen(tmp, "rb"))) {
+		Debug(3, "No LUT File used\n");
+		return;
+	}
+	tick = GetMsTicks();
+	fseek(lutf, 0, SEEK_END);
+	len = ftell(lutf);
+	fseek(lutf, 0, SEEK_SET);
+	if (len <= 0 || !(data = malloc(len + 1))) {
+		fclose(lutf);
+		return;
+	}
+	if (fread(data, 1, len, lutf) != (size_t)len) {
+		fclose(lutf);
+		free(data);
+		return;
+	}
+	fclose(lutf);
+	data[len] = '\0';
 
-	check_locale();
-   return;
-
-   sprintf(tmp, "%s/%s", MyConfigDir, lut_file);
-
-	printf("Opening %s LUT File\n",tmp);
-
-   if ((lutf = fopen(tmp, "r"))) {
-        if (!(lut = lut_parse_cube(lutf,&size)))
-            printf("Failed parsing LUT.. continuing anyway\n");
-		printf("LUT Size %d\n",size);
-        fclose(lutf);
-		if (lut) {
-			lut17 = convert_to_17(lut,size);
-			int _amlogicDev = open("/dev/amvecm", O_RDWR, 0);
-
-			// If the device is still not open, there is something wrong
-			if (_amlogicDev == -1)
-			{
-				Debug(3,"No amvecm device found");
-				free(lut);
-				free(lut17);
-				return;
-			}
-			amlSetString("/sys/class/amvecm/debug","3dlut enable");
-			//amlSetString("/sys/class/amvecm/debug","3dlut debug 1");
-			//amlSetString("/sys/class/amvecm/debug","3dlut open");
-			if (ioctl(_amlogicDev, AMVECM_IOC_SET_3D_LUT,  (void *)lut17)  == -1 )
-			{
-				// Failed to configure Lut
-				Debug(3,"Failed to set LUT Data\n");
-				perror("Failed to set LUT Data: ");
-			} else {
-				amlSetString("/sys/class/amvecm/debug","3dlut open");
-				printf("LUT initialized\n");
-				//amlSetString("/sys/class/amvecm/debug","3dlut close");
-			}
-			close(_amlogicDev);
-			free(lut);
-			free(lut17);
+	hash = LutHash(data, len);
+	snprintf(cache, sizeof(cache), "%s.bin", tmp);
+	cached = 1;
+	if (!(lut17 = LutCacheRead(cache, hash))) {
+		cached = 0;
+		if (!(lut = lut_parse_cube(data, len, &size))) {
+			printf("Failed parsing LUT.. continuing anyway\n");
+			free(data);
+			return;
 		}
+		lut17 = convert_to_17(lut, size);
+		free(lut);
+		if (lut17) {
+			LutCacheWrite(cache, hash, lut17);
+		}
+	}
+	free(data);
+	if (!lut17) {
+		return;
+	}
+	Debug(3, "LUT %s loaded in %dms%s\n", tmp, GetMsTicks() - tick, cached ? " from cache" : "");
 
-    } else {
-        Debug(3, "No LUT File used\n");
-    }
-
+	int _amlogicDev = open("/dev/amvecm", O_RDWR, 0);
 
+	// If the device is still not open, there is something wrong
+	if (_amlogicDev == -1)
+	{
+		Debug(3,"No amvecm device found");
+		free(lut17);
+		return;
+	}
+	amlSetString("/sys/class/amvecm/debug","3dlut enable");
+	if (ioctl(_amlogicDev, AMVECM_IOC_SET_3D_LUT,  (void *)lut17)  == -1 )
+	{
+		// Failed to configure Lut
+		Debug(3,"Failed to set LUT Data\n");
+		perror("Failed to set LUT Data: ");
+	} else {
+		amlSetString("/sys/class/amvecm/debug","3dlut open");
+		printf("LUT initialized\n");
+	}
+	close(_amlogicDev);
+	free(lut17);
 }
 
 // check dolby vision support
@@ -1031,6 +1391,7 @@ void VideoGetVideoSize(VideoHwDecoder *i, int *width, int *height, int *aspect_n
  void VideoOsdExit(void) {};         ///< Cleanup osd.
 
 #include "drm.c"
+#include "vfm.c"
 
 extern char SuspendMode;
 
@@ -1038,6 +1399,7 @@ extern char SuspendMode;
 
 	int fd_m;
 	struct fb_var_screeninfo info;
+	VfmTopology topo;
 
 	Debug(3,"VideoExit");
 
@@ -1045,6 +1407,7 @@ extern char SuspendMode;
 		VideoThreadExit();
 		//sleep(1);
 	//}
+	VideoExitDrm();
 #if 0
 	for (int i = 0; i < OdroidDecoderN; ++i) {
         if (OdroidDecoders[i]) {
@@ -1113,32 +1476,27 @@ extern char SuspendMode;
 	close(fd_m);
 #endif
 	
-	// restore vfm mapping
+	// restore vfm mapping, pip0 and all other maps are removed
+	VfmBegin(&topo);
+	VfmWant(&topo, "default", "decoder amvideo");
+	VfmWant(&topo, "default_amlvideo2", "vdin1 amlvideo2.1");
 	if (myKernel == 4) {
 		amlSetInt("/sys/class/graphics/fb0/free_scale", 0);
-		amlSetString("/sys/class/vfm/map","rm pip0");   // make it save
-		amlSetString("/sys/class/vfm/map","rm all");
-		//sleep(1);
-		amlSetString("/sys/class/vfm/map","add default decoder amvideo");
-		amlSetString("/sys/class/vfm/map","add default_amlvideo2 vdin1 amlvideo2.1");
-		amlSetString("/sys/class/vfm/map","add dvblpath dvbldec amvideo");
-		amlSetString("/sys/class/vfm/map","add dvelpath dveldec dvel");
-		amlSetString("/sys/class/vfm/map","add dvhdmiin dv_vdin amvideo");
+		VfmWant(&topo, "dvblpath", "dvbldec amvideo");
+		VfmWant(&topo, "dvelpath", "dveldec dvel");
+		VfmWant(&topo, "dvhdmiin", "dv_vdin amvideo");
+		VfmCommit(&topo, 1);
 		amlSetString("/sys/class/amvecm/debug","3dlut close");
 		amlSetString("/sys/class/amvecm/debug","3dlut disable");
 	} else {
-		amlSetString("/sys/class/vfm/map","rm pip0");   // make it save
-		amlSetString("/sys/class/vfm/map","rm all");
-		//sleep(1);
-		amlSetString("/sys/class/vfm/map","add default decoder amvideo");
-		amlSetString("/sys/class/vfm/map","add default_amlvideo2 vdin1 amlvideo2.1");
-		amlSetString("/sys/class/vfm/map","add dvblpath dvbldec amlvideo ppmgr deinterlace amvideo");
-		amlSetString("/sys/class/vfm/map","add dvelpath dveldec dvel");
-		amlSetString("/sys/class/vfm/map","add dvblpath2 dvbldec2 videopip");
-		amlSetString("/sys/class/vfm/map","add dvelpath2 dveldec2 dvel");
-		amlSetString("/sys/class/vfm/map","add dvhdmiin dv_vdin amvideo");
-		amlSetString("/sys/class/vfm/map","add video-map-0 video1_block amvideo");
-		amlSetString("/sys/class/vfm/map","add video-map-1 video2_block videopip");
+		VfmWant(&topo, "dvblpath", "dvbldec amlvideo ppmgr deinterlace amvideo");
+		VfmWant(&topo, "dvelpath", "dveldec dvel");
+		VfmWant(&topo, "dvblpath2", "dvbldec2 videopip");
+		VfmWant(&topo, "dvelpath2", "dveldec2 dvel");
+		VfmWant(&topo, "dvhdmiin", "dv_vdin amvideo");
+		VfmWant(&topo, "video-map-0", "video1_block amvideo");
+		VfmWant(&topo, "video-map-1", "video2_block videopip");
+		VfmCommit(&topo, 1);
 	}
 
 	// reset audio codec to 2 chan
@@ -1176,8 +1534,143 @@ void CodecVideoDelDecoder(VideoDecoder *decoder){
 	InternalClose(HwDecoder->pip);
  };
 
+///
+///	Get resolution class of a height.
+///
+static int VideoResolutionClass(int height)
+{
+	if (height <= 0) {
+		return -1;
+	}
+	if (height <= 576) {
+		return VideoResolution576;
+	}
+	if (height <= 1088) {
+		return VideoResolution1080;
+	}
+	return VideoResolutionUHD;
+}
+
+///
+///	Park video codec on channel switch.
+///
+///	With warm reuse the main decoder stays open, CodecVideoOpen
+///	decides if it can be reset or must be reopened.
+///
+void CodecVideoPark(VideoHwDecoder *HwDecoder)
+{
+	int w, h, an, ad;
+
+	if (!HwDecoder->pip) {
+		SwitchStart = GetMsTicks();
+	}
+	if (HwDecoder->pip || !ConfigVideoWarmReuse || !isOpen || apiLevel < S905 || myTrickSpeed) {
+		CodecVideoClose(HwDecoder);
+		return;
+	}
+	VideoGetVideoSize(HwDecoder, &w, &h, &an, &ad);
+	WarmResolution = VideoResolutionClass(h);
+	WarmParked = 1;
+	Debug(3,"CodecVideoPark Handle %d format %d res %d\n",HwDecoder->handle,HwDecoder->Format,WarmResolution);
+}
+
+///
+///	Close a parked decoder no new stream has claimed.
+///
+///	Without a following stream (radio, end of replay) the parked
+///	decoder would keep showing the last frame.
+///
+static void VideoParkTimeout(VideoHwDecoder *HwDecoder)
+{
+	if (WarmParked && !HwDecoder->pip && GetMsTicks() - SwitchStart > SWITCH_PARK_MAX) {
+		Debug(3,"CodecVideoPark no new stream, closing handle %d\n",HwDecoder->handle);
+		WarmParked = 0;
+		CodecVideoClose(HwDecoder);
+	}
+}
+
+///
+///	Reset the parked decoder for a new stream.
+///
+///	Flushes the decoder state and the video buffer, the vfm map,
+///	sysinfo and port setup of the open instance are kept.
+///
+///	@returns 0 on success, -1 if a close/open cycle is needed.
+///
+static int VideoWarmReset(VideoHwDecoder *hwdecoder)
+{
+	struct am_ioctl_parm_ex parm = { 0 };
+	int handle = hwdecoder->handle;
+
+	if (m_PlayMode == 0 && ConfigVideoBlackPicture) {
+		amlSetInt("/sys/class/video/blackout_policy", 1);
+	} else {
+		amlSetInt("/sys/class/video/blackout_policy", 0);
+	}
+	VideoSetSyncThresh(IsReplay() ? 0 : ConfigVideoFastSwitch ? 0 : 1);
+
+	if (codec_h_ioctl_set(handle, AMSTREAM_DEC_RESET, 0) < 0) {
+		Debug(3,"AMSTREAM_DEC_RESET failed, errno=%d\n",errno);
+		return -1;
+	}
+	parm.cmd = AMSTREAM_CLEAR_VBUF;
+	if (ioctl(handle, AMSTREAM_IOC_SET_EX, (unsigned long)&parm) < 0) {
+		Debug(3,"AMSTREAM_CLEAR_VBUF failed, errno=%d\n",errno);
+		return -1;
+	}
+	codec_h_ioctl_set(handle,AMSTREAM_SET_VIDEO_DELAY_LIMIT_MS,1000);
+	return 0;
+}
+
+///
+///	Account time of a finished channel switch.
+///
+static void VideoSwitchDone(void)
+{
+	int ms;
+	int i;
+
+	if (!SwitchStart) {
+		return;
+	}
+	ms = GetMsTicks() - SwitchStart;
+	SwitchStart = 0;
+	for (i = 0; i < SWITCH_HIST_MAX - 1; ++i) {
+		if (ms < SwitchHistLimit[i]) {
+			break;
+		}
+	}
+	SwitchHist[SwitchMode][i]++;
+	Debug(3,"video: %s channel switch to first I-frame %d ms\n",SwitchMode == SWITCH_WARM ? "warm" : "cold",ms);
+}
+
+///
+///	Get channel switch time histograms.
+///
+///	@param buf	output buffer
+///	@param size	size of output buffer
+///
+void VideoGetSwitchStats(char *buf, size_t size)
+{
+	int n;
+	int m;
+	int i;
+
+	n = snprintf(buf, size, "%-6s", "ms");
+	for (i = 0; i < SWITCH_HIST_MAX - 1 && n < (int)size; ++i) {
+		n += snprintf(buf + n, size - n, " <%5d", SwitchHistLimit[i]);
+	}
+	for (m = SWITCH_COLD; m <= SWITCH_WARM && n < (int)size; ++m) {
+		n += snprintf(buf + n, size - n, "\n%-6s", m == SWITCH_WARM ? "warm" : "cold");
+		for (i = 0; i < SWITCH_HIST_MAX && n < (int)size; ++i) {
+			n += snprintf(buf + n, size - n, " %6d", SwitchHist[m][i]);
+		}
+	}
+}
+
  void CodecVideoFlushBuffers(VideoDecoder *decoder) {
         amlReset();
+        VideoTrickRearm();
 };
 
 
@@ -1197,104 +1690,752 @@ void CodecVideoDelDecoder(VideoDecoder *decoder){
 /// C plugin play TS video packet
 void PlayTsVideo(const uint8_t *i, int j) {};
 
-void VideoSetHdr2Sdr(int i)
+void VideoSetHdr2Sdr(int i)
+{
+
+	Hdr2Sdr = i;
+
+	Debug(3,Hdr2Sdr ? "Enable HDR2SDR\n" : "Disable HDR2SDR\n");
+	if (myKernel == 5)
+		amlSetInt("/sys/module/aml_media/parameters/hdr_mode", Hdr2Sdr ? 1 :0);
+	else
+		amlSetInt("/sys/module/am_vecm/parameters/hdr_mode", Hdr2Sdr ? 1 : 0);
+};
+
+void VideoSetDenoise(int i)
+{
+
+	NoiseReduction = i;
+	
+	Debug(3,i ? "Enable Noice Reduction" : "Disable Noise reduction\n");
+	if (myKernel == 5)
+		amlSetString("/sys/module/aml_media/parameters/nr2_en", i ? "1" : "0");
+	else
+		amlSetString("/sys/module/di/parameters/nr2_en", i ?  "1" : "0");
+};
+
+void VideoDelHwDecoder(VideoHwDecoder * decoder)
+{
+	Debug(3,"DelHWDecoder PIP %d ",decoder->pip);
+	if (decoder->pip && OdroidDecoders[1]->handle != -1) {
+		printf("delhwdecoder\n");
+		InternalClose(1);
+	}
+
+	for (int i = 0; i < OdroidDecoderN; ++i) {
+        if (OdroidDecoders[i] == decoder) {
+            OdroidDecoders[i] = NULL;
+
+            // copy last slot into empty slot
+
+            if (i < --OdroidDecoderN) {
+                OdroidDecoders[i] = OdroidDecoders[OdroidDecoderN];
+            }
+
+            free(decoder);
+            return;
+        }
+    }
+
+}
+
+
+
+extern int SetCurrentPCR(int, uint64_t );
+extern int AHandle;
+void ProcessClockBuffer(int handle)
+{
+		if (WarmParked) {		// no clock until a stream claims the decoder
+			return;
+		}
+
+		uint64_t pts = (uint64_t)AudioGetClock(); //(uint64_t) GetCurrentAPts(AHandle) ;
+		uint64_t apts;
+
+		apts = pts;
+		pts &= 0xffffffff;
+
+		uint64_t vpts = (uint64_t)GetCurrentVPts(handle) ;
+		vpts &= 0xffffffff;
+
+		if (!pts || !vpts) {
+			return;
+		}
+
+		if (inwrap && vpts < 0x10000) {
+			amlFreerun(0);
+			inwrap=0;
+			Debug(3,"ende inwrap \n");
+		}
+#ifdef PERFTEST
+		if (last_time) {
+			printf("Channelswitch in %ld ms \n",(GetusTicks() - last_time) / 1000);
+			printf("firstvpts  %#012" PRIx64 "  apts %#012" PRIx64 " diff %dms \n", firstvpts,firstapts,(int)(firstapts-firstvpts)/90);
+			last_time = firstvpts = firstapts = 0;
+		}
+#endif
+		pts = (pts + VideoAudioDelay) & 0xffffffff;
+		//printf("pts   %#012" PRIx64 "  %#012" PRIx64 "  %#012" PRIx64 "  \n",pts, apts,vpts);
+		// hardware clock is 32 bit, wrap-aware distance
+		double drift = (double)(int32_t)(uint32_t)(vpts - pts) / (double)PTS_FREQ;
+		//double driftTime = drift / (double)PTS_FREQ;
+
+		double driftFrames = drift * 25.0; // frameRate;
+		const int maxDelta = 2;
+
+		// To minimize clock jitter, only adjust the clock if it
+		// deviates more than +/- 2 frames
+		if ((driftFrames >= maxDelta || driftFrames <= -maxDelta) && abs(driftFrames) < 1000)
+		{
+			{
+				SetCurrentPCR(handle,apts);
+				//printf("AmlVideoSink: Adjust PTS - apts= %#012" PRIx64 " vpts %#012" PRIx64 "   (%f frames)\n", pts , vpts , driftFrames);
+			}
+		}
+}
+
+///
+/// Read an unsigned exp-golomb code.
+///
+/// @param data	bitstream
+/// @param size	size of bitstream in bytes
+/// @param bit	[in,out] current bit position
+///
+/// @returns decoded value or -1 on end of data
+///
+static int VideoReadUe(const unsigned char *data, int size, int *bit)
+{
+	int zeros;
+	int value;
+
+	zeros = 0;
+	while (*bit < size * 8 && !((data[*bit >> 3] >> (7 - (*bit & 7))) & 1)) {
+		++zeros;
+		++*bit;
+	}
+	if (zeros > 30 || *bit + 1 + zeros > size * 8) {
+		return -1;
+	}
+	++*bit;
+	value = 0;
+	for (int i = 0; i < zeros; ++i) {
+		value = (value << 1) | ((data[*bit >> 3] >> (7 - (*bit & 7))) & 1);
+		++*bit;
+	}
+	return (1 << zeros) - 1 + value;
+}
+
+///
+/// Read bits from a bitstream.
+///
+/// @param data	bitstream
+/// @param size	size of bitstream in bytes
+/// @param bit	[in,out] current bit position
+/// @param n	number of bits (0 .. 32)
+///
+/// @returns bits read, 0 behind the end of data
+///
+static uint32_t VideoReadBits(const unsigned char *data, int size, int *bit, int n)
+{
+	uint32_t value = 0;
+
+	while (n--) {
+		value <<= 1;
+		if (*bit < size * 8) {
+			value |= (data[*bit >> 3] >> (7 - (*bit & 7))) & 1;
+		}
+		++*bit;
+	}
+	return value;
+}
+
+///
+/// Read a signed exp-golomb code.
+///
+static int VideoReadSe(const unsigned char *data, int size, int *bit)
+{
+	int value = VideoReadUe(data, size, bit);
+
+	return value & 1 ? (value + 1) / 2 : -(value / 2);
+}
+
+///
+/// Copy a NAL unit payload without emulation prevention bytes.
+///
+/// @param dst	buffer for the payload
+/// @param max	size of the buffer
+/// @param src	NAL unit payload
+/// @param size	bytes available at src
+///
+/// @returns size of the unescaped payload
+///
+static int VideoUnescapeNal(unsigned char *dst, int max, const unsigned char *src, int size)
+{
+	int n = 0;
+	int zeros = 0;
+
+	for (int i = 0; i < size && n < max; ++i) {
+		if (zeros >= 2 && src[i] == 3) {
+			zeros = 0;
+			continue;
+		}
+		if (zeros >= 2 && src[i] <= 1) {	// next start code
+			n -= zeros;
+			break;
+		}
+		zeros = src[i] ? 0 : zeros + 1;
+		dst[n++] = src[i];
+	}
+	return n;
+}
+
+///
+/// Get the frame rate from a H.264 sequence parameter set.
+///
+/// @param p	unescaped SPS payload after the NAL header
+/// @param size	size of payload
+/// @param[out] height	cropped picture height
+///
+/// @returns frame rate in mHz or 0 without VUI timing
+///
+static int VideoAvcSpsRate(const unsigned char *p, int size, int *height)
+{
+	int bit = 0;
+	int profile_idc;
+	int chroma_format_idc = 1;
+	int frame_mbs_only;
+	int map_units;
+	int crop_unit;
+	uint32_t num_units;
+	uint32_t time_scale;
+
+	profile_idc = VideoReadBits(p, size, &bit, 8);
+	VideoReadBits(p, size, &bit, 16);	// constraint flags, level
+	VideoReadUe(p, size, &bit);			// seq_parameter_set_id
+	if (profile_idc == 100 || profile_idc == 110 || profile_idc == 122 || profile_idc == 244
+		|| profile_idc == 44 || profile_idc == 83 || profile_idc == 86 || profile_idc == 118
+		|| profile_idc == 128 || profile_idc == 138 || profile_idc == 139 || profile_idc == 134
+		|| profile_idc == 135) {
+		chroma_format_idc = VideoReadUe(p, size, &bit);
+		if (chroma_format_idc == 3) {
+			VideoReadBits(p, size, &bit, 1);
+		}
+		VideoReadUe(p, size, &bit);		// bit_depth_luma_minus8
+		VideoReadUe(p, size, &bit);		// bit_depth_chroma_minus8
+		VideoReadBits(p, size, &bit, 1);
+		if (VideoReadBits(p, size, &bit, 1)) {	// seq_scaling_matrix_present
+			for (int i = 0; i < (chroma_format_idc != 3 ? 8 : 12); ++i) {
+				if (VideoReadBits(p, size, &bit, 1)) {
+					int last = 8;
+					int next = 8;
+
+					for (int j = 0; j < (i < 6 ? 16 : 64) && next; ++j) {
+						next = (last + VideoReadSe(p, size, &bit) + 256) % 256;
+						last = next ? next : last;
+					}
+				}
+			}
+		}
+	}
+	VideoReadUe(p, size, &bit);			// log2_max_frame_num_minus4
+	switch (VideoReadUe(p, size, &bit)) {	// pic_order_cnt_type
+		case 0:
+			VideoReadUe(p, size, &bit);
+			break;
+		case 1:
+			{
+				int n;
+
+				VideoReadBits(p, size, &bit, 1);
+				VideoReadSe(p, size, &bit);
+				VideoReadSe(p, size, &bit);
+				n = VideoReadUe(p, size, &bit);
+				while (n-- > 0) {
+					VideoReadSe(p, size, &bit);
+				}
+			}
+			break;
+	}
+	VideoReadUe(p, size, &bit);			// max_num_ref_frames
+	VideoReadBits(p, size, &bit, 1);
+	VideoReadUe(p, size, &bit);			// pic_width_in_mbs_minus1
+	map_units = VideoReadUe(p, size, &bit) + 1;
+	frame_mbs_only = VideoReadBits(p, size, &bit, 1);
+	if (!frame_mbs_only) {
+		VideoReadBits(p, size, &bit, 1);
+	}
+	*height = (2 - frame_mbs_only) * map_units * 16;
+	crop_unit = (chroma_format_idc == 1 ? 2 : 1) * (2 - frame_mbs_only);
+	VideoReadBits(p, size, &bit, 1);	// direct_8x8_inference
+	if (VideoReadBits(p, size, &bit, 1)) {	// frame_cropping
+		VideoReadUe(p, size, &bit);
+		VideoReadUe(p, size, &bit);
+		*height -= crop_unit * VideoReadUe(p, size, &bit);
+		*height -= crop_unit * VideoReadUe(p, size, &bit);
+	}
+	if (bit > size * 8) {
+		*height = 0;
+		return 0;
+	}
+	if (!VideoReadBits(p, size, &bit, 1)) {	// vui_parameters_present
+		return 0;
+	}
+	if (VideoReadBits(p, size, &bit, 1)) {	// aspect_ratio_info_present
+		if (VideoReadBits(p, size, &bit, 8) == 255) {
+			VideoReadBits(p, size, &bit, 32);
+		}
+	}
+	if (VideoReadBits(p, size, &bit, 1)) {	// overscan_info_present
+		VideoReadBits(p, size, &bit, 1);
+	}
+	if (VideoReadBits(p, size, &bit, 1)) {	// video_signal_type_present
+		VideoReadBits(p, size, &bit, 4);
+		if (VideoReadBits(p, size, &bit, 1)) {
+			VideoReadBits(p, size, &bit, 24);
+		}
+	}
+	if (VideoReadBits(p, size, &bit, 1)) {	// chroma_loc_info_present
+		VideoReadUe(p, size, &bit);
+		VideoReadUe(p, size, &bit);
+	}
+	if (!VideoReadBits(p, size, &bit, 1)) {	// timing_info_present
+		return 0;
+	}
+	num_units = VideoReadBits(p, size, &bit, 32);
+	time_scale = VideoReadBits(p, size, &bit, 32);
+	if (bit > size * 8 || !num_units) {
+		return 0;
+	}
+	// one tick is a field
+	return (uint64_t)time_scale * 1000 / (2 * (uint64_t)num_units);
+}
+
+///
+/// Get the frame rate from a H.265 sequence parameter set.
+///
+/// @param p	unescaped SPS payload after the NAL header
+/// @param size	size of payload
+/// @param[out] height	cropped picture height
+///
+/// @returns frame rate in mHz or 0 without VUI timing
+///
+static int VideoHevcSpsRate(const unsigned char *p, int size, int *height)
 {
+	int bit = 0;
+	int max_sub_layers;
+	int sub_height;
+	int sub_profile[8];
+	int sub_level[8];
+	int log2_max_poc_lsb;
+	int num_st_rps;
+	int num_delta_pocs[65];
+	int field_seq;
+	uint32_t num_units;
+	uint32_t time_scale;
+
+	VideoReadBits(p, size, &bit, 4);	// sps_video_parameter_set_id
+	max_sub_layers = VideoReadBits(p, size, &bit, 3);
+	VideoReadBits(p, size, &bit, 1);
+	// profile_tier_level
+	VideoReadBits(p, size, &bit, 88);	// general profile, 32 + 56 bits
+	VideoReadBits(p, size, &bit, 8);	// general_level_idc
+	for (int i = 0; i < max_sub_layers; ++i) {
+		sub_profile[i] = VideoReadBits(p, size, &bit, 1);
+		sub_level[i] = VideoReadBits(p, size, &bit, 1);
+	}
+	if (max_sub_layers > 0) {
+		VideoReadBits(p, size, &bit, 2 * (8 - max_sub_layers));
+	}
+	for (int i = 0; i < max_sub_layers; ++i) {
+		if (sub_profile[i]) {
+			VideoReadBits(p, size, &bit, 88);
+		}
+		if (sub_level[i]) {
+			VideoReadBits(p, size, &bit, 8);
+		}
+	}
+	VideoReadUe(p, size, &bit);			// sps_seq_parameter_set_id
+	switch (VideoReadUe(p, size, &bit)) {	// chroma_format_idc
+		case 1:
+			sub_height = 2;
+			break;
+		case 3:
+			VideoReadBits(p, size, &bit, 1);
+			// fall through
+		default:
+			sub_height = 1;
+			break;
+	}
+	VideoReadUe(p, size, &bit);			// pic_width_in_luma_samples
+	*height = VideoReadUe(p, size, &bit);
+	if (VideoReadBits(p, size, &bit, 1)) {	// conformance_window
+		VideoReadUe(p, size, &bit);
+		VideoReadUe(p, size, &bit);
+		*height -= sub_height * VideoReadUe(p, size, &bit);
+		*height -= sub_height * VideoReadUe(p, size, &bit);
+	}
+	if (bit > size * 8) {
+		*height = 0;
+		return 0;
+	}
+	VideoReadUe(p, size, &bit);			// bit_depth_luma_minus8
+	VideoReadUe(p, size, &bit);			// bit_depth_chroma_minus8
+	log2_max_poc_lsb = VideoReadUe(p, size, &bit) + 4;
+	for (int i = VideoReadBits(p, size, &bit, 1) ? 0 : max_sub_layers; i <= max_sub_layers; ++i) {
+		VideoReadUe(p, size, &bit);
+		VideoReadUe(p, size, &bit);
+		VideoReadUe(p, size, &bit);
+	}
+	for (int i = 0; i < 6; ++i) {		// coding/transform block sizes
+		VideoReadUe(p, size, &bit);
+	}
+	if (VideoReadBits(p, size, &bit, 1) && VideoReadBits(p, size, &bit, 1)) {	// scaling lists
+		for (int size_id = 0; size_id < 4; ++size_id) {
+			for (int matrix_id = 0; matrix_id < 6; matrix_id += size_id == 3 ? 3 : 1) {
+				if (!VideoReadBits(p, size, &bit, 1)) {
+					VideoReadUe(p, size, &bit);
+				} else {
+					int coefs = 1 << (4 + (size_id << 1));
 
-	Hdr2Sdr = i;
+					if (coefs > 64) {
+						coefs = 64;
+					}
+					if (size_id > 1) {
+						VideoReadSe(p, size, &bit);
+					}
+					while (coefs--) {
+						VideoReadSe(p, size, &bit);
+					}
+				}
+			}
+		}
+	}
+	VideoReadBits(p, size, &bit, 2);	// amp, sample_adaptive_offset
+	if (VideoReadBits(p, size, &bit, 1)) {	// pcm
+		VideoReadBits(p, size, &bit, 8);
+		VideoReadUe(p, size, &bit);
+		VideoReadUe(p, size, &bit);
+		VideoReadBits(p, size, &bit, 1);
+	}
+	num_st_rps = VideoReadUe(p, size, &bit);
+	if (num_st_rps < 0 || num_st_rps > 64) {
+		return 0;
+	}
+	for (int i = 0; i < num_st_rps; ++i) {
+		if (i && VideoReadBits(p, size, &bit, 1)) {	// inter_ref_pic_set_prediction
+			num_delta_pocs[i] = 0;
+			VideoReadBits(p, size, &bit, 1);
+			VideoReadUe(p, size, &bit);
+			for (int j = 0; j <= num_delta_pocs[i - 1]; ++j) {
+				if (VideoReadBits(p, size, &bit, 1) || VideoReadBits(p, size, &bit, 1)) {
+					num_delta_pocs[i]++;
+				}
+			}
+		} else {
+			int neg = VideoReadUe(p, size, &bit);
+			int pos = VideoReadUe(p, size, &bit);
 
-	Debug(3,Hdr2Sdr ? "Enable HDR2SDR\n" : "Disable HDR2SDR\n");
-	if (myKernel == 5)
-		amlSetInt("/sys/module/aml_media/parameters/hdr_mode", Hdr2Sdr ? 1 :0);
-	else
-		amlSetInt("/sys/module/am_vecm/parameters/hdr_mode", Hdr2Sdr ? 1 : 0);
-};
+			if (neg < 0 || pos < 0 || neg + pos > 32) {
+				return 0;
+			}
+			num_delta_pocs[i] = neg + pos;
+			for (int j = 0; j < neg + pos; ++j) {
+				VideoReadUe(p, size, &bit);
+				VideoReadBits(p, size, &bit, 1);
+			}
+		}
+	}
+	if (VideoReadBits(p, size, &bit, 1)) {	// long_term_ref_pics_present
+		int n = VideoReadUe(p, size, &bit);
 
-void VideoSetDenoise(int i)
+		while (n-- > 0) {
+			VideoReadBits(p, size, &bit, log2_max_poc_lsb + 1);
+		}
+	}
+	VideoReadBits(p, size, &bit, 2);	// temporal_mvp, strong_intra_smoothing
+	if (!VideoReadBits(p, size, &bit, 1)) {	// vui_parameters_present
+		return 0;
+	}
+	if (VideoReadBits(p, size, &bit, 1)) {	// aspect_ratio_info_present
+		if (VideoReadBits(p, size, &bit, 8) == 255) {
+			VideoReadBits(p, size, &bit, 32);
+		}
+	}
+	if (VideoReadBits(p, size, &bit, 1)) {	// overscan_info_present
+		VideoReadBits(p, size, &bit, 1);
+	}
+	if (VideoReadBits(p, size, &bit, 1)) {	// video_signal_type_present
+		VideoReadBits(p, size, &bit, 4);
+		if (VideoReadBits(p, size, &bit, 1)) {
+			VideoReadBits(p, size, &bit, 24);
+		}
+	}
+	if (VideoReadBits(p, size, &bit, 1)) {	// chroma_loc_info_present
+		VideoReadUe(p, size, &bit);
+		VideoReadUe(p, size, &bit);
+	}
+	VideoReadBits(p, size, &bit, 1);	// neutral_chroma_indication
+	field_seq = VideoReadBits(p, size, &bit, 1);
+	VideoReadBits(p, size, &bit, 1);	// frame_field_info_present
+	if (VideoReadBits(p, size, &bit, 1)) {	// default_display_window
+		for (int i = 0; i < 4; ++i) {
+			VideoReadUe(p, size, &bit);
+		}
+	}
+	if (!VideoReadBits(p, size, &bit, 1)) {	// vui_timing_info_present
+		return 0;
+	}
+	num_units = VideoReadBits(p, size, &bit, 32);
+	time_scale = VideoReadBits(p, size, &bit, 32);
+	if (bit > size * 8 || !num_units) {
+		return 0;
+	}
+	// with field_seq a picture is a field
+	return (uint64_t)time_scale * 1000 / ((field_seq ? 2 : 1) * (uint64_t)num_units);
+}
+
+///
+/// Get the frame rate of a stream from its packet.
+///
+/// Uses the MPEG-2 sequence header and the VUI timing of the H.264 and
+/// H.265 sequence parameter set.
+///
+/// @param format	video format
+/// @param avpkt	video packet
+/// @param[out] height	picture height, 0 if the packet carries none
+///
+/// @returns frame rate in mHz or 0 if the packet carries none
+///
+static int VideoPacketFrameRate(int format, const AVPacket * avpkt, int *height)
 {
+	static const int mpeg2_rate[16] = {
+		0, 23976, 24000, 25000, 29970, 30000, 50000, 59940, 60000
+	};
+	const unsigned char *data;
+	int size;
+	unsigned char sps[512];
 
-	NoiseReduction = i;
-	
-	Debug(3,i ? "Enable Noice Reduction" : "Disable Noise reduction\n");
-	if (myKernel == 5)
-		amlSetString("/sys/module/aml_media/parameters/nr2_en", i ? "1" : "0");
-	else
-		amlSetString("/sys/module/di/parameters/nr2_en", i ?  "1" : "0");
-};
+	*height = 0;
+	if (!avpkt || !avpkt->data) {
+		return 0;
+	}
+	data = avpkt->data;
+	size = avpkt->size;
+	for (int i = 0; i + 8 < size; ++i) {
+		if (data[i] || data[i + 1] || data[i + 2] != 1) {
+			continue;
+		}
+		switch (format) {
+			case Mpeg2:
+				if (data[i + 3] == 0xb3) {
+					*height = ((data[i + 5] & 0x0f) << 8) | data[i + 6];
+					return mpeg2_rate[data[i + 7] & 0x0f];
+				}
+				break;
+			case Avc:
+				if ((data[i + 3] & 0x1f) == 7) {
+					return VideoAvcSpsRate(sps, VideoUnescapeNal(sps, sizeof(sps), data + i + 4, size - i - 4), height);
+				}
+				break;
+			case Hevc:
+				if (((data[i + 3] >> 1) & 0x3f) == 33) {
+					return VideoHevcSpsRate(sps, VideoUnescapeNal(sps, sizeof(sps), data + i + 5, size - i - 5), height);
+				}
+				break;
+		}
+		i += 2;
+	}
+	return 0;
+}
 
-void VideoDelHwDecoder(VideoHwDecoder * decoder)
+///
+/// Follow the frame rate of the main stream.
+///
+/// Updates the rate given to the decoder on open and asks the display
+/// for a matching refresh.
+///
+static void VideoStreamFrameRate(int format, const AVPacket * avpkt)
 {
-	Debug(3,"DelHWDecoder PIP %d ",decoder->pip);
-	if (decoder->pip && OdroidDecoders[1]->handle != -1) {
-		printf("delhwdecoder\n");
-		InternalClose(1);
+	int height;
+	int rate = VideoPacketFrameRate(format, avpkt, &height);
+
+	if (rate < 10000 || rate > 120000) {
+		return;
+	}
+	if ((int)(FrameRate * 1000 + 0.5) != rate) {
+		Debug(3,"video: stream frame rate %.3f\n",rate / 1000.0);
+		FrameRate = rate / 1000.0;
 	}
+	if (!myTrickSpeed) {
+		VideoSetContentRate(rate);
+	}
+}
 
-	for (int i = 0; i < OdroidDecoderN; ++i) {
-        if (OdroidDecoders[i] == decoder) {
-            OdroidDecoders[i] = NULL;
+///
+///	Get resolution class of a new stream from its first packet.
+///
+///	Uses the height of the MPEG-2 sequence header or of the H.264/HEVC
+///	SPS, -1 is returned if the packet carries none.
+///
+static int VideoPacketResolutionClass(int format, const AVPacket *avpkt)
+{
+	int height;
 
-            // copy last slot into empty slot
+	VideoPacketFrameRate(format, avpkt, &height);
+	return VideoResolutionClass(height);
+}
 
-            if (i < --OdroidDecoderN) {
-                OdroidDecoders[i] = OdroidDecoders[OdroidDecoderN];
-            }
+///
+/// Check if the packet starts an intra coded access unit.
+///
+/// Accepts IDR and I-slices for H.264, IRAP pictures for H.265 and
+/// I-pictures for MPEG-2. Parameter sets count as intra, they only
+/// precede an intra picture in the I-frame streams of vdr.
+///
+/// @param format	video format
+/// @param avpkt	video packet
+///
+static int VideoIsIntraPacket(int format, const AVPacket * avpkt)
+{
+	const unsigned char *data = avpkt->data;
+	int size = avpkt->size;
 
-            free(decoder);
-            return;
-        }
-    }
+	for (int i = 0; i + 5 < size; ++i) {
+		if (data[i] || data[i + 1] || data[i + 2] != 1) {
+			continue;
+		}
+		switch (format) {
+			case Mpeg2:
+				if (data[i + 3] == 0x00) {		// picture start code
+					return ((data[i + 5] >> 3) & 0x07) == 1;
+				}
+				break;
+			case Avc:
+				switch (data[i + 3] & 0x1f) {
+					case 5:						// IDR slice
+					case 7:						// SPS
+						return 1;
+					case 1:						// non-IDR slice
+						{
+							unsigned char header[16];	// first_mb_in_slice and slice_type
+							int bit = 0;
+							int n;
+							int slice_type;
+
+							n = VideoUnescapeNal(header, sizeof(header), data + i + 4, size - i - 4);
+							VideoReadUe(header, n, &bit);	// first_mb_in_slice
+							slice_type = VideoReadUe(header, n, &bit);
+							return slice_type >= 0 && (slice_type % 5 == 2 || slice_type % 5 == 4);
+						}
+				}
+				break;
+			case Hevc:
+				{
+					int nal_unit_type = (data[i + 3] >> 1) & 0x3f;
 
+					if ((nal_unit_type >= 16 && nal_unit_type <= 21)
+						|| (nal_unit_type >= 32 && nal_unit_type <= 34)) {
+						return 1;
+					}
+					if (nal_unit_type < 16) {	// non-IRAP picture
+						return 0;
+					}
+				}
+				break;
+			default:
+				return 1;
+		}
+		i += 2;
+	}
+	return 0;
 }
 
-
-
-extern int SetCurrentPCR(int, uint64_t );
-extern int AHandle;
-void ProcessClockBuffer(int handle)
+///
+/// Distance of two 33 bit pts in 90kHz ticks, independent of direction.
+///
+static int64_t VideoTrickPtsDistance(int64_t a, int64_t b)
 {
-		
-		uint64_t pts = (uint64_t)AudioGetClock(); //(uint64_t) GetCurrentAPts(AHandle) ;
-		uint64_t apts;
-
-		apts = pts;
-		pts &= 0xffffffff;
+	int64_t d = PtsDiff(a, b);
 
-		uint64_t vpts = (uint64_t)GetCurrentVPts(handle) ;
-		vpts &= 0xffffffff;
+	return d < 0 ? -d : d;
+}
 
-		if (!pts || !vpts) {
-			return;
+///
+/// Push an access unit in I-frame only trick mode.
+///
+/// Non intra access units are dropped, packets without pts continue
+/// the last accepted unit. The I-frames are paced from their pts
+/// distance scaled by the trick rate, so the shown position moves at
+/// the same speed regardless of the GOP length. I-frames which would be
+/// visible shorter than TRICK_MIN_US are skipped, which keeps the pace
+/// up to TRICK_RATE_MAX.
+///
+/// @param decoder	video decoder
+/// @param avpkt	video packet
+///
+static void VideoTrickPush(VideoDecoder * decoder, const AVPacket * avpkt)
+{
+	VideoHwDecoder *hw = decoder->HwDecoder;
+	uint64_t now;
+	uint64_t due;
+	int64_t dist;
+
+	if (isFirstVideoPacket) {			// decoder was reset, restore mode
+		amlTrickMode(videoFormat == Hevc ? TRICKMODE_I_HEVC : TRICKMODE_I);
+		TrickAnchorPTS = AV_NOPTS_VALUE;
+	}
+	if (avpkt->pts == AV_NOPTS_VALUE) {
+		if (TrickPassing) {
+			ProcessBuffer(hw,avpkt);
+		} else {
+			TrickDropped++;
 		}
+		return;
+	}
+	TrickPassing = 0;
+	if (!VideoIsIntraPacket(videoFormat, avpkt)) {
+		TrickDropped++;
+		return;
+	}
 
-		if (inwrap && vpts < 0x10000) {
-			amlFreerun(0);
-			inwrap=0;
-			Debug(3,"ende inwrap \n");
-		}
-#ifdef PERFTEST
-		if (last_time) {
-			printf("Channelswitch in %ld ms \n",(GetusTicks() - last_time) / 1000);
-			printf("firstvpts  %#012" PRIx64 "  apts %#012" PRIx64 " diff %dms \n", firstvpts,firstapts,(int)(firstapts-firstvpts)/90);
-			last_time = firstvpts = firstapts = 0;
+	now = GetusTicks();
+	if (TrickAnchorPTS != AV_NOPTS_VALUE) {
+		dist = VideoTrickPtsDistance(TrickAnchorPTS, avpkt->pts);
+		// wall time = pts time * speed / 12, at least pts time / 64
+		due = (uint64_t)dist * 1000 / 90 * hw->TrickSpeed / TRICK_SPEED_MULT;
+		if (due < (uint64_t)dist * 1000 / 90 / TRICK_RATE_MAX) {
+			due = (uint64_t)dist * 1000 / 90 / TRICK_RATE_MAX;
 		}
-#endif
-		pts = (pts + VideoAudioDelay) & 0xffffffff;
-		//printf("pts   %#012" PRIx64 "  %#012" PRIx64 "  %#012" PRIx64 "  \n",pts, apts,vpts);
-		double drift = ((double)vpts - (double)pts) / (double)PTS_FREQ;
-		//double driftTime = drift / (double)PTS_FREQ;
-
-		double driftFrames = drift * 25.0; // frameRate;
-		const int maxDelta = 2;
-
-		// To minimize clock jitter, only adjust the clock if it
-		// deviates more than +/- 2 frames
-		if ((driftFrames >= maxDelta || driftFrames <= -maxDelta) && abs(driftFrames) < 1000)
-		{
-			{
-				SetCurrentPCR(handle,apts);
-				//printf("AmlVideoSink: Adjust PTS - apts= %#012" PRIx64 " vpts %#012" PRIx64 "   (%f frames)\n", pts , vpts , driftFrames);
+		due += TrickAnchorTick;
+		if (due > now + TRICK_MAX_US || now > due + TRICK_MAX_US) {
+			// jump in the recording or stalled, restart pacing
+			Debug(4,"trick: re-anchor at %s\n",Timestamp2String(avpkt->pts));
+			TrickAnchorPTS = AV_NOPTS_VALUE;
+		} else if (due < TrickShownTick + TRICK_MIN_US) {
+			TrickDropped++;
+			return;
+		} else if (due > now) {
+			if (VideoTrickWait(due)) {
+				Debug(4,"trick: wait interrupted at %s\n",Timestamp2String(avpkt->pts));
+				TrickDropped++;
+				return;
 			}
+			now = due;
 		}
+	}
+	if (TrickAnchorPTS == AV_NOPTS_VALUE) {
+		TrickAnchorPTS = avpkt->pts;
+		TrickAnchorTick = now;
+	}
+	Debug(4,"trick: push %s %d bytes after %d ms\n",Timestamp2String(avpkt->pts),
+		avpkt->size,(int)((now - TrickShownTick) / 1000));
+	TrickShownTick = now;
+	TrickPushed++;
+	TrickPassing = 1;
+
+	SetCurrentPCR(hw->handle,avpkt->pts);
+	ProcessBuffer(hw,avpkt);
+	decoder->PTS = avpkt->pts;
 }
 
 extern char AudioVideoIsReady;
@@ -1307,6 +2448,10 @@ void CodecVideoDecode(VideoDecoder * decoder, const AVPacket * avpkt)
 		ProcessBuffer(decoder->HwDecoder,avpkt);
 		return;
 	}
+	if (TrickIntra && decoder->HwDecoder->TrickSpeed) {
+		VideoTrickPush(decoder,avpkt);
+		return;
+	}
 	if (!decoder->HwDecoder->TrickSpeed) {
 		if (!AudioVideoIsReady) {
 			AudioVideoReady(avpkt->pts);
@@ -1315,14 +2460,6 @@ void CodecVideoDecode(VideoDecoder * decoder, const AVPacket * avpkt)
 	}
 	else {
 		if (avpkt->pts != AV_NOPTS_VALUE) {
-			if ((!decoder->HwDecoder->Forward
-			   || decoder->HwDecoder->TrickSpeed == 1
-			   || decoder->HwDecoder->TrickSpeed == 3
-			   || decoder->HwDecoder->TrickSpeed == 6)
-			   && videoFormat == Avc)  {
-				amlReset();
-				waiter = decoder->HwDecoder->TrickSpeed == 1 ? 40000:30000;
-			}
 			//amlFreerun(1); //already done in VideoSetTrickspeed
 			SetCurrentPCR(handle,avpkt->pts);
 			//printf("push buffer ohne sync PTS %ld\n",avpkt->pts);
@@ -1478,6 +2615,9 @@ void OdroidDisplayHandlerThread(void)
 					decoder->Closing = -1;
 				}
 			}
+			if (err == -1) {
+				VideoParkTimeout(decoder);
+			}
 			usleep(1000);
 
 		}
@@ -1491,6 +2631,7 @@ void *VideoDisplayHandlerThread(void *dummy)
 {
 
   //  prctl(PR_SET_NAME, "video decoder", 0, 0, 0);
+    ThreadApplyProfile(THREAD_VIDEO);
 
     pthread_cleanup_push(delete_decode, NULL);
     for (;;) {
@@ -1719,12 +2860,14 @@ bool getResolution(char *mode) {
 {
 
 	struct fb_var_screeninfo info = {0};
+	VfmTopology topo;
 	uint32_t h[3];
 	char mode[256];
 
 	timeBase.num = 1;
 	timeBase.den = 90000;
 	ratio = -1;
+	VideoTrickInit();
 	pip_ratio = -1;
 	hasVideo = 0;
 	CurrentSyncThresh = -1;
@@ -1779,9 +2922,9 @@ bool getResolution(char *mode) {
 			return;
 	}
 
-	if (NeedDRM && myKernel == 5) {
+	if ((NeedDRM || ConfigVideoAutoRefresh) && myKernel == 5 && !render) {
+		VideoInitDrm(NeedDRM);
 		NeedDRM = 0;
-		VideoInitDrm();
 	}
 
 	amlGetString("/sys/class/display/mode",mode,sizeof(mode));
@@ -1887,13 +3030,14 @@ bool getResolution(char *mode) {
 	sprintf(fsaxis_str, "0 0 %d %d", OsdWidth-1, OsdHeight-1);
 	sprintf(waxis_str, "0 0 %d %d", VideoWindowWidth-1, VideoWindowHeight-1);
 	
-	amlSetString("/sys/class/vfm/map","rm all");
-	sleep(1);
-	amlSetString("/sys/class/vfm/map","add default decoder ppmgr deinterlace amvideo");
-	amlSetString("/sys/class/vfm/map","add default_amlvideo2 vdin1 amlvideo2.1");
-	amlSetString("/sys/class/vfm/map","add dvblpath dvbldec amvideo");
-	amlSetString("/sys/class/vfm/map","add dvelpath dveldec dvel");
-	amlSetString("/sys/class/vfm/map","add dvhdmiin dv_vdin amvideo");
+	// only maps that differ are rewritten, a busy rm is polled
+	VfmBegin(&topo);
+	VfmWant(&topo, "default", "decoder ppmgr deinterlace amvideo");
+	VfmWant(&topo, "default_amlvideo2", "vdin1 amlvideo2.1");
+	VfmWant(&topo, "dvblpath", "dvbldec amvideo");
+	VfmWant(&topo, "dvelpath", "dveldec dvel");
+	VfmWant(&topo, "dvhdmiin", "dv_vdin amvideo");
+	VfmCommit(&topo, 1);
 	if (myKernel == 4) {
 		amlSetInt("/sys/class/graphics/fb0/free_scale", 0);
 		amlSetString("/sys/class/graphics/fb0/free_scale_axis", fsaxis_str);
@@ -1911,7 +3055,7 @@ bool getResolution(char *mode) {
 	Debug(3,"aml ApiLevel = %d  Screen %d-%d using OSD dma: %s H264-PIP: %d MPEG2 PIP %d\n",apiLevel,VideoWindowWidth,VideoWindowHeight,(DmaBufferHandle >= 0) ? "yes": "no",use_pip,use_pip_mpeg2);
 	ClearDisplay();
 	
-	// Load_Lut();
+	Load_Lut();
 };
 
 
@@ -1922,6 +3066,9 @@ extern void DelPip(void);
  {
 	int pip = decoder->HwDecoder->pip;
 	ratio_checked = 0;
+	if (!pip) {
+		VideoTrickRearm();
+	}
 	switch (codec_id)
 	{
 	case AV_CODEC_ID_MPEG2VIDEO:
@@ -1955,6 +3102,27 @@ extern void DelPip(void);
 		isFirstVideoPacket = true;
 	}
 
+	if (!pip) {
+		VideoStreamFrameRate(videoFormat, avpkt);
+	}
+
+	if (!pip) {
+		SwitchMode = SWITCH_COLD;
+	}
+	if (WarmParked && !pip) {
+		int res = VideoPacketResolutionClass(videoFormat, avpkt);
+
+		WarmParked = 0;
+		if (isOpen && decoder->HwDecoder->Format == videoFormat
+			&& res >= 0 && res == WarmResolution
+			&& !VideoWarmReset(decoder->HwDecoder)) {
+			Debug(3,"CodecVideoOpen warm reuse of handle %d\n",decoder->HwDecoder->handle);
+			SwitchMode = SWITCH_WARM;
+			amlResume();
+			return;
+		}
+	}
+
 	if (isOpen && !pip) {
 		InternalClose(pip);
 	}
@@ -2180,34 +3348,36 @@ void InternalOpen(VideoHwDecoder *hwdecoder, int format, double frameRate)
 	if (apiLevel >= S905) // S905
 	{
 		if (!pip) {
+			VfmTopology topo;
+
 			//codec_h_ioctl_set(handle,AMSTREAM_SET_FRAME_BASE_PATH,FRAME_BASE_PATH_TUNNEL_MODE);
+			VfmBegin(&topo);
 			if (myKernel == 5 && myMajor == 4 && format == Hevc) {
-				amlSetString("/sys/class/vfm/map","add pip0 vdec.h265.00   amvideo");
-
+				VfmWant(&topo, "pip0", "vdec.h265.00 amvideo");
 			} 
 			else if (format == Hevc) {
-				amlSetString("/sys/class/vfm/map","rm vdec-map-0");
-				amlSetString("/sys/class/vfm/map","add pip0 vdec.h265.00  ppmgr deinterlace amvideo");
+				VfmWant(&topo, "vdec-map-0", NULL);
+				VfmWant(&topo, "pip0", "vdec.h265.00 ppmgr deinterlace amvideo");
 			}
 			else if (format == Avc) {
-				amlSetString("/sys/class/vfm/map","rm vdec-map-0");
-				amlSetString("/sys/class/vfm/map","add pip0 vdec.h264.00  ppmgr deinterlace amvideo");
+				VfmWant(&topo, "vdec-map-0", NULL);
+				VfmWant(&topo, "pip0", "vdec.h264.00 ppmgr deinterlace amvideo");
 			}
 			else if (format == Mpeg2) {
-				amlSetString("/sys/class/vfm/map","rm vdec-map-0");
-				amlSetString("/sys/class/vfm/map","add pip0 vdec.mpeg12.00 ppmgr deinterlace  amvideo");
+				VfmWant(&topo, "vdec-map-0", NULL);
+				VfmWant(&topo, "pip0", "vdec.mpeg12.00 ppmgr deinterlace amvideo");
 			}
+			VfmCommit(&topo, 0);
 		}
 		//amlSetInt("/sys/class/video/blackout_policy", 0);
 
 		if (use_pip && PIP_allowed && pip) {
+			VfmTopology topo;
+
 			isPIP = true;
-		    if (format == Avc) {
-		       	amlSetString("/sys/class/vfm/map","add pip1 vdec.h264.01 videopip");
-			}
-			else {
-			   amlSetString("/sys/class/vfm/map","add pip1 vdec.mpeg12.01 videopip");
-			}
+			VfmBegin(&topo);
+			VfmWant(&topo, "pip1", format == Avc ? "vdec.h264.01 videopip" : "vdec.mpeg12.01 videopip");
+			VfmCommit(&topo, 0);
 			amlSetInt("/sys/class/video/pip_global_output",1);
 		}
 	}
@@ -2334,6 +3504,9 @@ int SetCurrentPCR(int handle, uint64_t value)
 		printf(" SetCurrentPCR The codec is not open.\n");
 		return 2;
 	}
+	if (WarmParked) {			// the parked decoder belongs to no stream
+		return 2;
+	}
 
 	handle = OdroidDecoders[0]->handle;
 	if (handle == -1) {
@@ -2758,10 +3931,12 @@ void ProcessBuffer(VideoHwDecoder *hwdecoder, const AVPacket* pkt)
 		}
 
 		if (!pip) {
+			VideoStreamFrameRate(hwdecoder->Format, pkt);
 			FirstVPTS = pkt->pts;
 			lpts=0;
 			inwrap=0;
 			Debug(3,"first vpts: %#012" PRIx64 "\n",FirstVPTS);
+			VideoSwitchDone();
 		}
 
 		//amlCodec.SetSyncThreshold(pts);
@@ -2949,6 +4124,9 @@ void CheckinPts(int handle, uint64_t pts)
 		printf("The codec is not open. %s\n",__FUNCTION__);
 		return;
 	}
+	if (WarmParked) {
+		return;
+	}
 
 	if (apiLevel >= S905)	// S905
 	{
@@ -3010,7 +4188,8 @@ Bool SendCodecData(int pip, uint64_t pts, unsigned char* data, int length)
 	{
 		atomic_set(&LastPTS, pts);
 		//printf("pts PTS  %#012" PRIx64 "  %#012" PRIx64 "\n",pts ,lpts);
-		if(lpts  && !inwrap && ((pts & 0xffffffff)  < 0x1000) && (lpts > 0xffff0000)) {
+		// forward step over the 32 bit hardware wrap around
+		if (lpts && !inwrap && (pts & 0xffffffff) < lpts && (int32_t)(uint32_t)((pts & 0xffffffff) - lpts) > 0) {
 			Debug(3,"PTS wrap \n");
 			inwrap=1;
 			amlFreerun(1);
@@ -3134,6 +4313,7 @@ void amlReset()
 
 void InternalClose(int pip)
 {
+	VfmTopology topo;
 	int r;
 	
 	pthread_mutex_lock(&VideoLockMutex);
@@ -3160,11 +4340,16 @@ void InternalClose(int pip)
 			uint32_t nMode = 1;
 			ioctl(cntl_handle, AMSTREAM_IOC_SET_VIDEOPIP_DISABLE, &nMode);
 		}
-		amlSetString("/sys/class/vfm/map","rm pip1");
-		amlSetString("/sys/class/vfm/map","rm vdec-map-1");
+		VfmBegin(&topo);
+		VfmWant(&topo, "pip1", NULL);
+		VfmWant(&topo, "vdec-map-1", NULL);
+		VfmCommit(&topo, 0);
 		amlSetInt("/sys/class/video/pip_global_output",0);
 	} else {
-		amlSetString("/sys/class/vfm/map","rm pip0");
+		VfmBegin(&topo);
+		VfmWant(&topo, "pip0", NULL);
+		VfmCommit(&topo, 0);
+		WarmParked = 0;
 	}
 
 
@@ -3244,6 +4429,62 @@ void amlTrickMode(int val)  // used in StillPicture
 	}
 }
 
+/// Get the trick mode frame state, used in StillPicture
+///
+/// @returns 1 if the frame is shown, 0 if still waiting, -1 unsupported
+///
+int amlTrickDone(void)
+{
+	uint32_t stat = TRICK_STAT_WAIT;
+
+	if (!isOpen) {
+		return -1;
+	}
+	if (ioctl(cntl_handle, AMSTREAM_IOC_TRICK_STAT, (unsigned long)&stat) < 0) {
+		return -1;
+	}
+	return stat == TRICK_STAT_DONE;
+}
+
+/// Wait until the trick mode frame is shown, used in StillPicture
+///
+/// amvideo wakes poll() with POLLOUT when the trick frame is done and
+/// clears the done state with it.  Kernels with the trick state ioctl
+/// have this poll, without it there is nothing to wait for.
+///
+/// @param timeout	max. ms to wait
+///
+/// @returns 1 if the frame is shown, 0 on timeout, -1 unsupported
+///
+int amlTrickWait(int timeout)
+{
+	struct pollfd fds;
+	uint32_t start;
+	int done;
+	int n;
+
+	if ((done = amlTrickDone())) {		// shown already or unsupported
+		return done;
+	}
+	start = GetMsTicks();
+	for (;;) {
+		int left = timeout - (int)(GetMsTicks() - start);
+
+		if (left <= 0) {
+			return 0;
+		}
+		fds.fd = cntl_handle;
+		fds.events = POLLOUT;
+		fds.revents = 0;
+		if ((n = poll(&fds, 1, left)) > 0 && (fds.revents & POLLOUT)) {
+			return 1;
+		}
+		if (n < 0 && errno != EINTR) {
+			return amlTrickDone();
+		}
+	}
+}
+
 int amlGetBufferFree(int pip)
 {
 
@@ -153,7 +153,9 @@ typedef struct _video_decoder_ VideoDecoder;
 typedef struct _audio_decoder_ AudioDecoder;
 
 
-#define VIDEO_PACKET_MAX 256            ///< max number of video packets  192
+/// The queue is limited by the arena budget and VIDEO_MAX_DURATION (8 s),
+/// not by the slots: 1080i60 with one PES per field needs 480 of them.
+#define VIDEO_PACKET_MAX 512            ///< max number of video packet slots
 struct __video_stream__
 {
     VideoHwDecoder *HwDecoder;          ///< video hardware decoder
@@ -177,11 +179,24 @@ struct __video_stream__
 
     enum AVCodecID CodecIDRb[VIDEO_PACKET_MAX]; ///< codec ids in ring buffer
     AVPacket PacketRb[VIDEO_PACKET_MAX];    ///< PES packet ring buffer
+    int ReservedRb[VIDEO_PACKET_MAX];   ///< arena bytes held by packets
     int StartCodeState;                 ///< last three bytes start code state
 
     int PacketWrite;                    ///< ring buffer write pointer
     int PacketRead;                     ///< ring buffer read pointer
     atomic_t PacketsFilled;             ///< how many of the ring buffer is used
+
+    uint8_t *Arena;                     ///< packet data arena
+    int ArenaSize;                      ///< mapped size of the arena
+    int ArenaBudget;                    ///< byte budget of the current stream
+    int ArenaWrite;                     ///< arena offset of packet in progress
+    int ArenaWaste;                     ///< arena tail skipped by packet in progress
+    int ArenaEnd;                       ///< wrap offset of the current lap
+    int ArenaPrevEnd;                   ///< wrap offset of the previous lap
+    int ArenaHigh;                      ///< end of the resident arena pages
+    atomic_t ArenaFilled;               ///< arena bytes held by queued packets
+    int64_t WritePts;                   ///< pts of the newest queued packet
+    volatile int64_t ReadPts;           ///< pts of the last decoded packet
 };
 //----------------------------------------------------------------------------
 //  Typedefs
@@ -340,6 +355,12 @@ extern void VideoResetStart(VideoHwDecoder *);
 /// Set trick play speed.
 extern void VideoSetTrickSpeed(VideoHwDecoder *, int, int);
 
+/// Switch I-frame only trick mode.
+extern int VideoSetTrickIntra(int);
+
+/// Interrupt the trick play wait for a clear or close.
+extern void VideoTrickWakeup(void);
+
 /// Grab screen.
 extern uint8_t *VideoGrab(int *, int *, int *, int);
 
@@ -349,6 +370,9 @@ extern uint8_t *VideoGrabService(int *, int *, int *);
 /// Get decoder statistics.
 extern void VideoGetStats(VideoHwDecoder *, int *, int *, int *, int *, float *, int *, int *, int *, int *);
 
+/// Get channel switch time histograms.
+extern void VideoGetSwitchStats(char *, size_t);
+
 /// Get video stream size
 extern void VideoGetVideoSize(VideoHwDecoder *, int *, int *, int *, int *);
 
@@ -382,6 +406,8 @@ extern void amlResume();
 extern void amlPause();
 extern int amlFreerun(int);
 extern void amlTrickMode(int);
+extern int amlTrickDone(void);
+extern int amlTrickWait(int);
 extern void amlReset();
 extern void ClearDisplay(void);
 extern int amlSetString(char *, char *);